@@ -0,0 +1,217 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_BACKGROUND_PROCESSING_THREAD_LOCAL_CACHE_
+#define MOVEIT_BACKGROUND_PROCESSING_THREAD_LOCAL_CACHE_
+
+#include <map>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace moveit
+{
+namespace tools
+{
+
+/** \brief Objects of type T that each thread keeps for one owner, such as solver workspaces or scratch copies of a
+    state, so that the owner can be used from several threads without locking.
+
+    The owner holds a ThreadLocalCache and asks it for the object of the calling thread; finding it does not lock.
+    The objects of all threads become stale when the owner calls clear() or destroys the cache. A stale object
+    stays valid until its thread adds an object to a cache of the same type, or exits; the object of the thread
+    that destroys the cache is released right away. T may be incomplete where the cache is only held.
+
+    A cache can bound the number of objects of type T a thread keeps: when the calling thread adds an object beyond
+    that bound, the objects it used least recently, stale or not, are released first. */
+template <typename T>
+class ThreadLocalCache : private boost::noncopyable
+{
+public:
+
+  /** \brief Keep at most \e max_objects_per_thread objects of type T in a thread when it calls set() on this cache;
+      0 means no bound */
+  explicit ThreadLocalCache(std::size_t max_objects_per_thread = 0) :
+    id_(allocId()), alive_(new bool(true)), max_objects_per_thread_(max_objects_per_thread)
+  {
+  }
+
+  ~ThreadLocalCache()
+  {
+    alive_.reset();
+    if (ThreadObjects *to = objects_.get())
+      to->entries_.erase(id_);
+  }
+
+  /** \brief Get the object of the calling thread, or NULL if the thread has none since the last clear() */
+  T* get() const
+  {
+    Entry *e = find();
+    return e ? e->object_.get() : NULL;
+  }
+
+  /** \brief Get the object of the calling thread like get(). The object stays valid while the returned pointer is
+      held, even if the thread releases it in the meantime. */
+  boost::shared_ptr<T> getShared() const
+  {
+    Entry *e = find();
+    return e ? e->object_ : boost::shared_ptr<T>();
+  }
+
+  /** \brief Make \e object (allocated with new) the object of the calling thread and return it. Stale objects
+      of the calling thread are released, and so are the least recently used ones beyond the bound of this cache. */
+  T* set(T *object) const
+  {
+    ThreadObjects *to = objects_.get();
+    if (!to)
+    {
+      to = new ThreadObjects();
+      objects_.reset(to);
+    }
+    else
+    {
+      for (typename EntryMap::iterator it = to->entries_.begin() ; it != to->entries_.end() ; )
+        if (it->second.owner_alive_.expired())
+          to->entries_.erase(it++);
+        else
+          ++it;
+      if (max_objects_per_thread_ > 0)
+      {
+        to->entries_.erase(id_);
+        while (to->entries_.size() >= max_objects_per_thread_)
+        {
+          typename EntryMap::iterator lru = to->entries_.begin();
+          for (typename EntryMap::iterator it = lru ; it != to->entries_.end() ; ++it)
+            if (it->second.last_use_ < lru->second.last_use_)
+              lru = it;
+          to->entries_.erase(lru);
+        }
+      }
+    }
+
+    Entry &e = to->entries_[id_];
+    e.owner_alive_ = alive_;
+    e.object_.reset(object);
+    e.last_use_ = ++to->clock_;
+    return object;
+  }
+
+  /** \brief Make the objects of all threads stale, e.g. because the configuration they were built for changed */
+  void clear()
+  {
+    id_ = allocId();
+    alive_.reset(new bool(true));
+  }
+
+  /** \brief A flag that expires when the current objects become stale. Objects that call back into their
+      owner keep it, since they may outlive the owner. */
+  boost::weak_ptr<bool> getAliveFlag() const
+  {
+    return alive_;
+  }
+
+private:
+
+  struct Entry
+  {
+    boost::weak_ptr<bool> owner_alive_;
+    boost::shared_ptr<T>  object_;
+
+    /// the value of the clock of the thread when the object was last used
+    std::size_t           last_use_;
+  };
+  typedef std::map<std::size_t, Entry> EntryMap;
+
+  struct ThreadObjects
+  {
+    ThreadObjects() : clock_(0)
+    {
+    }
+
+    EntryMap    entries_;
+
+    /// counts the uses of the objects of the thread
+    std::size_t clock_;
+  };
+
+  /// find the entry of the calling thread for the current objects of this cache and mark it as used
+  Entry* find() const
+  {
+    ThreadObjects *to = objects_.get();
+    if (!to)
+      return NULL;
+    typename EntryMap::iterator it = to->entries_.find(id_);
+    if (it == to->entries_.end())
+      return NULL;
+    it->second.last_use_ = ++to->clock_;
+    return &it->second;
+  }
+
+  static std::size_t allocId()
+  {
+    boost::mutex::scoped_lock slock(id_lock_);
+    return next_id_++;
+  }
+
+  /// identifies the current objects of this cache in the maps of the threads
+  std::size_t             id_;
+
+  /// expires when the current objects become stale
+  boost::shared_ptr<bool> alive_;
+
+  /// the bound on the objects of type T a thread keeps when it calls set() on this cache; 0 for none
+  std::size_t             max_objects_per_thread_;
+
+  /// the objects of each thread, for all caches of type T; deleted when the thread exits
+  static boost::thread_specific_ptr<ThreadObjects> objects_;
+
+  static boost::mutex id_lock_;
+  static std::size_t  next_id_;
+};
+
+template <typename T>
+boost::thread_specific_ptr<typename ThreadLocalCache<T>::ThreadObjects> ThreadLocalCache<T>::objects_;
+
+template <typename T>
+boost::mutex ThreadLocalCache<T>::id_lock_;
+
+template <typename T>
+std::size_t ThreadLocalCache<T>::next_id_ = 0;
+
+}
+}
+
+#endif
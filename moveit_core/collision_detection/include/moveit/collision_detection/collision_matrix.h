@@ -71,6 +71,8 @@ namespace collision_detection
   /** \brief Signature of predicate that decides whether a contact is allowed or not (when AllowedCollision::Type is CONDITIONAL) */
   typedef boost::function<bool(collision_detection::Contact&)> DecideContactFn;
 
+  class CompiledAllowedCollisionMatrix;
+
   /** @class AllowedCollisionMatrix
    *  @brief Definition of a structure for the allowed collision matrix. All elements in the collision world are referred to by their names.
    *   This class represents which collisions are allowed to happen and which are not. */
@@ -92,6 +94,20 @@ namespace collision_detection
     /** @brief Copy constructor */
     AllowedCollisionMatrix(const AllowedCollisionMatrix& acm);
 
+    virtual ~AllowedCollisionMatrix();
+
+    /** @brief If this matrix is a CompiledAllowedCollisionMatrix whose lookup table is up to date with the entries of the matrix,
+     *  return it. Return NULL otherwise. Collision checkers use this to replace name based lookups with index based ones. */
+    virtual const CompiledAllowedCollisionMatrix* getCompiled() const;
+
+    /** @brief Get a number that identifies the entries of this matrix. Every modification gives the matrix a new revision and
+     *  copies keep the revision of their source, so two matrices with the same revision have the same entries. Matrices that were
+     *  never modified have revision 0. */
+    std::size_t getRevision() const
+    {
+      return revision_;
+    }
+
     /** @brief Get the type of the allowed collision between two elements. Return true if the entry is included in the collision matrix.
      * Return false if the entry is not found.
      *  @param name1 name of first element
@@ -233,6 +249,14 @@ namespace collision_detection
     /** @brief Print the allowed collision matrix */
     void print(std::ostream& out) const;
 
+  protected:
+
+    /** \brief Give the matrix a new, globally unique, revision; called by every modification of the matrix */
+    void updateRevision();
+
+    /** \brief Identifies the entries of this matrix; see getRevision() */
+    std::size_t                                                           revision_;
+
   private:
 
     std::map<std::string, std::map<std::string, AllowedCollision::Type> > entries_;
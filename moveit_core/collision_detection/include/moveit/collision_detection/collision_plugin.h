@@ -38,6 +38,7 @@
 #include <moveit/collision_detection/collision_robot.h>
 #include <moveit/collision_detection/collision_world.h>
 #include <moveit/planning_scene/planning_scene.h>
+#include <map>
 
 namespace collision_detection
 {
@@ -86,6 +87,13 @@ public:
   virtual bool initialize(
     const planning_scene::PlanningScenePtr& scene,
     bool exclusive) const = 0;
+
+  /**
+   * @brief Configure the collision detector before initialize() is called.
+   * The plugin loader passes the entries of the "collision_detector_parameters" parameter.
+   * The default implementation ignores them.
+   */
+  virtual void setParameters(const std::map<std::string, double>& /*parameters*/) {}
 };
 
 }  // namespace collision_detection
@@ -0,0 +1,136 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_COMPILED_COLLISION_MATRIX_
+#define MOVEIT_COLLISION_DETECTION_COMPILED_COLLISION_MATRIX_
+
+#include <moveit/collision_detection/collision_matrix.h>
+#include <moveit/robot_model/robot_model.h>
+#include <boost/unordered_map.hpp>
+
+namespace collision_detection
+{
+
+  /** @class CompiledAllowedCollisionMatrix
+   *  @brief An allowed collision matrix that additionally keeps its entries in a dense lookup table indexed by integers.
+   *  Links of the robot model are indexed by their link index; other elements (world objects, attached bodies) follow them.
+   *  Queries by index take constant time; for conditional entries, the predicate is still obtained by name.
+   *  Since this is an AllowedCollisionMatrix, it can be used anywhere one is expected. Collision checkers that know about
+   *  the lookup table get to it using getCompiled(). If the matrix is modified, the table is no longer used until compile()
+   *  is called again. */
+  class CompiledAllowedCollisionMatrix : public AllowedCollisionMatrix
+  {
+  public:
+
+    /** \brief Value returned by getIndex() for elements that are not in the lookup table */
+    static const std::size_t NO_INDEX = static_cast<std::size_t>(-1);
+
+    /** @brief Compile \e acm for the links of \e robot_model and the elements named in \e names (typically the world objects).
+     *  If \e names is empty, all the names known to \e acm (including names with default entries) that are not links of the robot are used. */
+    CompiledAllowedCollisionMatrix(const AllowedCollisionMatrix &acm, const robot_model::RobotModelConstPtr &robot_model,
+                                   const std::vector<std::string> &names = std::vector<std::string>());
+
+    /** @brief Rebuild the lookup table from the current entries of the matrix */
+    void compile();
+
+    virtual const CompiledAllowedCollisionMatrix* getCompiled() const;
+
+    const robot_model::RobotModelConstPtr& getRobotModel() const
+    {
+      return robot_model_;
+    }
+
+    /** @brief Get the number of elements in the lookup table */
+    std::size_t getIndexCount() const
+    {
+      return names_.size();
+    }
+
+    /** @brief Get the index of \e link in the lookup table. Return NO_INDEX if \e link is not part of the robot model the table was compiled for */
+    std::size_t getIndex(const robot_model::LinkModel *link) const
+    {
+      const std::size_t index = link->getLinkIndex();
+      return index < link_count_ && robot_model_->getLinkModels()[index] == link ? index : NO_INDEX;
+    }
+
+    /** @brief Get the index of the element named \e name in the lookup table. Return NO_INDEX if the element is unknown */
+    std::size_t getIndex(const std::string &name) const;
+
+    /** @brief Get the type of the allowed collision between the elements at \e index1 and \e index2. Same as the name based
+     *  version of this function, but in constant time. */
+    bool getAllowedCollision(std::size_t index1, std::size_t index2, AllowedCollision::Type& allowed_collision) const
+    {
+      const unsigned char v = table_[index1 * names_.size() + index2];
+      if (v == NO_ENTRY)
+        return false;
+      allowed_collision = static_cast<AllowedCollision::Type>(v);
+      return true;
+    }
+
+    /** @brief Get the allowed collision predicate between the elements at \e index1 and \e index2 */
+    bool getAllowedCollision(std::size_t index1, std::size_t index2, DecideContactFn &fn) const
+    {
+      return AllowedCollisionMatrix::getAllowedCollision(names_[index1], names_[index2], fn);
+    }
+
+    using AllowedCollisionMatrix::getAllowedCollision;
+
+  private:
+
+    static const unsigned char NO_ENTRY = 255;
+
+    robot_model::RobotModelConstPtr                 robot_model_;
+
+    /// The number of links in robot_model_; these occupy the first indices of the table
+    std::size_t                                     link_count_;
+
+    /// True if the names of the elements that are not links were given by the user, rather than taken from the entries of the matrix
+    bool                                            fixed_names_;
+
+    /// The names of the elements in the table, in the order of their indices
+    std::vector<std::string>                        names_;
+    boost::unordered_map<std::string, std::size_t>  index_;
+
+    /// Row major table of AllowedCollision::Type values, or NO_ENTRY
+    std::vector<unsigned char>                      table_;
+
+    /// The revision of the matrix the table was compiled from
+    std::size_t                                     compiled_revision_;
+  };
+
+  typedef boost::shared_ptr<CompiledAllowedCollisionMatrix> CompiledAllowedCollisionMatrixPtr;
+  typedef boost::shared_ptr<const CompiledAllowedCollisionMatrix> CompiledAllowedCollisionMatrixConstPtr;
+}
+
+#endif
@@ -36,20 +36,26 @@
 
 #include <moveit/collision_detection/collision_matrix.h>
 #include <boost/bind.hpp>
+#include <boost/atomic.hpp>
 #include <iomanip>
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix()
+namespace
 {
+boost::atomic<std::size_t> g_last_revision(0);
 }
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const std::vector<std::string>& names, bool allowed)
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix() : revision_(0)
+{
+}
+
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const std::vector<std::string>& names, bool allowed) : revision_(0)
 {
   for (std::size_t i = 0 ; i < names.size() ; ++i)
     for (std::size_t j = i; j < names.size() ; ++j)
       setEntry(names[i], names[j], allowed);
 }
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit_msgs::AllowedCollisionMatrix &msg)
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit_msgs::AllowedCollisionMatrix &msg) : revision_(0)
 {
   if (msg.entry_names.size() != msg.entry_values.size() || msg.default_entry_names.size() != msg.default_entry_values.size())
     logError("The number of links does not match the number of entries in AllowedCollisionMatrix message");
@@ -73,6 +79,21 @@ collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const Allowe
   allowed_contacts_ = acm.allowed_contacts_;
   default_entries_ = acm.default_entries_;
   default_allowed_contacts_ = acm.default_allowed_contacts_;
+  revision_ = acm.revision_;
+}
+
+void collision_detection::AllowedCollisionMatrix::updateRevision()
+{
+  revision_ = g_last_revision.fetch_add(1, boost::memory_order_relaxed) + 1;
+}
+
+collision_detection::AllowedCollisionMatrix::~AllowedCollisionMatrix()
+{
+}
+
+const collision_detection::CompiledAllowedCollisionMatrix* collision_detection::AllowedCollisionMatrix::getCompiled() const
+{
+  return NULL;
 }
 
 bool collision_detection::AllowedCollisionMatrix::getEntry(const std::string& name1, const std::string& name2, DecideContactFn &fn) const
@@ -117,6 +138,7 @@ bool collision_detection::AllowedCollisionMatrix::hasEntry(const std::string& na
 
 void collision_detection::AllowedCollisionMatrix::setEntry(const std::string &name1, const std::string &name2, bool allowed)
 {
+  updateRevision();
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
   entries_[name1][name2] = entries_[name2][name1] = v;
 
@@ -139,12 +161,14 @@ void collision_detection::AllowedCollisionMatrix::setEntry(const std::string &na
 
 void collision_detection::AllowedCollisionMatrix::setEntry(const std::string& name1, const std::string& name2, const DecideContactFn &fn)
 {
+  updateRevision();
   entries_[name1][name2] = entries_[name2][name1] = AllowedCollision::CONDITIONAL;
   allowed_contacts_[name1][name2] = allowed_contacts_[name2][name1] = fn;
 }
 
 void collision_detection::AllowedCollisionMatrix::removeEntry(const std::string& name)
 {
+  updateRevision();
   entries_.erase(name);
   allowed_contacts_.erase(name);
   for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator it = entries_.begin() ; it != entries_.end() ; ++it)
@@ -155,6 +179,7 @@ void collision_detection::AllowedCollisionMatrix::removeEntry(const std::string&
 
 void collision_detection::AllowedCollisionMatrix::removeEntry(const std::string& name1, const std::string &name2)
 {
+  updateRevision();
   std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator jt = entries_.find(name1);
   if (jt != entries_.end())
   {
@@ -212,6 +237,7 @@ void collision_detection::AllowedCollisionMatrix::setEntry(const std::string& na
 
 void collision_detection::AllowedCollisionMatrix::setEntry(bool allowed)
 {
+  updateRevision();
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
   for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator it1 = entries_.begin() ; it1 != entries_.end() ; ++it1)
     for (std::map<std::string, AllowedCollision::Type>::iterator it2 = it1->second.begin() ; it2 != it1->second.end() ; ++it2)
@@ -220,6 +246,7 @@ void collision_detection::AllowedCollisionMatrix::setEntry(bool allowed)
 
 void collision_detection::AllowedCollisionMatrix::setDefaultEntry(const std::string &name, bool allowed)
 {
+  updateRevision();
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
   default_entries_[name] = v;
   default_allowed_contacts_.erase(name);
@@ -227,6 +254,7 @@ void collision_detection::AllowedCollisionMatrix::setDefaultEntry(const std::str
 
 void collision_detection::AllowedCollisionMatrix::setDefaultEntry(const std::string &name, const DecideContactFn &fn)
 {
+  updateRevision();
   default_entries_[name] = AllowedCollision::CONDITIONAL;
   default_allowed_contacts_[name] = fn;
 }
@@ -315,6 +343,7 @@ bool collision_detection::AllowedCollisionMatrix::getAllowedCollision(const std:
 
 void collision_detection::AllowedCollisionMatrix::clear()
 {
+  updateRevision();
   entries_.clear();
   allowed_contacts_.clear();
   default_entries_.clear();
@@ -0,0 +1,100 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection/compiled_collision_matrix.h>
+
+const std::size_t collision_detection::CompiledAllowedCollisionMatrix::NO_INDEX;
+const unsigned char collision_detection::CompiledAllowedCollisionMatrix::NO_ENTRY;
+
+collision_detection::CompiledAllowedCollisionMatrix::CompiledAllowedCollisionMatrix(const AllowedCollisionMatrix &acm,
+                                                                                     const robot_model::RobotModelConstPtr &robot_model,
+                                                                                     const std::vector<std::string> &names)
+  : AllowedCollisionMatrix(acm)
+  , robot_model_(robot_model)
+  , link_count_(robot_model->getLinkModelCount())
+  , fixed_names_(!names.empty())
+  , compiled_revision_(0)
+{
+  const std::vector<const robot_model::LinkModel*> &links = robot_model_->getLinkModels();
+  names_.reserve(links.size() + names.size());
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    names_.push_back(links[i]->getName());
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+    if (!robot_model_->hasLinkModel(names[i]))
+      names_.push_back(names[i]);
+  compile();
+}
+
+void collision_detection::CompiledAllowedCollisionMatrix::compile()
+{
+  if (!fixed_names_)
+  {
+    // elements other than links are the ones known to the matrix
+    names_.resize(link_count_);
+    std::vector<std::string> names;
+    getAllEntryNames(names);
+    for (std::size_t i = 0 ; i < names.size() ; ++i)
+      if (!robot_model_->hasLinkModel(names[i]))
+        names_.push_back(names[i]);
+  }
+
+  index_.clear();
+  for (std::size_t i = 0 ; i < names_.size() ; ++i)
+    index_[names_[i]] = i;
+
+  const std::size_t n = names_.size();
+  table_.resize(n * n);
+  for (std::size_t i = 0 ; i < n ; ++i)
+    for (std::size_t j = i ; j < n ; ++j)
+    {
+      AllowedCollision::Type type;
+      unsigned char v = AllowedCollisionMatrix::getAllowedCollision(names_[i], names_[j], type) ? static_cast<unsigned char>(type) : NO_ENTRY;
+      table_[i * n + j] = table_[j * n + i] = v;
+    }
+
+  updateRevision();
+  compiled_revision_ = revision_;
+}
+
+const collision_detection::CompiledAllowedCollisionMatrix* collision_detection::CompiledAllowedCollisionMatrix::getCompiled() const
+{
+  // any modification of the matrix changes the revision, in which case the table may be out of date
+  return revision_ == compiled_revision_ ? this : NULL;
+}
+
+std::size_t collision_detection::CompiledAllowedCollisionMatrix::getIndex(const std::string &name) const
+{
+  boost::unordered_map<std::string, std::size_t>::const_iterator it = index_.find(name);
+  return it == index_.end() ? NO_INDEX : it->second;
+}
@@ -39,9 +39,11 @@
 
 #include <moveit/collision_detection/world.h>
 #include <moveit/collision_detection/collision_world.h>
+#include <moveit/collision_detection/compiled_collision_matrix.h>
 #include <fcl/broadphase/broadphase.h>
 #include <fcl/collision.h>
 #include <fcl/distance.h>
+#include <fcl/continuous_collision.h>
 #include <set>
 
 namespace collision_detection
@@ -117,12 +119,13 @@ struct CollisionGeometryData
 
 struct CollisionData
 {
-  CollisionData() : req_(NULL), active_components_only_(NULL), res_(NULL), acm_(NULL), done_(false)
+  CollisionData() : req_(NULL), active_components_only_(NULL), res_(NULL), acm_(NULL), compiled_acm_(NULL), done_(false)
   {
   }
 
   CollisionData(const CollisionRequest *req, CollisionResult *res,
-                const AllowedCollisionMatrix *acm) : req_(req), active_components_only_(NULL), res_(res), acm_(acm), done_(false)
+                const AllowedCollisionMatrix *acm) : req_(req), active_components_only_(NULL), res_(res), acm_(acm),
+                                                     compiled_acm_(acm ? acm->getCompiled() : NULL), done_(false)
   {
   }
 
@@ -147,6 +150,10 @@ struct CollisionData
   /// The user specified collision matrix (may be NULL)
   const AllowedCollisionMatrix *acm_;
 
+  /// The lookup table of the user specified collision matrix, if it has an up to date one (may be NULL)
+  const CompiledAllowedCollisionMatrix
+                               *compiled_acm_;
+
   /// Flag indicating whether collision checking is complete
   bool                          done_;
 };
@@ -154,7 +161,7 @@ struct CollisionData
 
 struct FCLGeometry
 {
-  FCLGeometry()
+  FCLGeometry() : rotation_radius_(0.0)
   {
   }
 
@@ -162,18 +169,21 @@ struct FCLGeometry
     collision_geometry_(collision_geometry), collision_geometry_data_(new CollisionGeometryData(link, shape_index))
   {
     collision_geometry_->setUserData(collision_geometry_data_.get());
+    computeRotationRadius();
   }
 
   FCLGeometry(fcl::CollisionGeometry *collision_geometry, const robot_state::AttachedBody *ab, int shape_index) :
     collision_geometry_(collision_geometry), collision_geometry_data_(new CollisionGeometryData(ab, shape_index))
   {
     collision_geometry_->setUserData(collision_geometry_data_.get());
+    computeRotationRadius();
   }
 
   FCLGeometry(fcl::CollisionGeometry *collision_geometry, const World::Object *obj, int shape_index) :
     collision_geometry_(collision_geometry), collision_geometry_data_(new CollisionGeometryData(obj, shape_index))
   {
     collision_geometry_->setUserData(collision_geometry_data_.get());
+    computeRotationRadius();
   }
 
   template<typename T>
@@ -188,6 +198,14 @@ struct FCLGeometry
 
   boost::shared_ptr<fcl::CollisionGeometry> collision_geometry_;
   boost::shared_ptr<CollisionGeometryData>  collision_geometry_data_;
+
+  /// An upper bound on the distance from the points of the geometry to the center its motions are rotated about
+  double                                    rotation_radius_;
+
+private:
+
+  /** \brief Compute \e rotation_radius_ from the local AABB of the geometry, which must have been computed */
+  void computeRotationRadius();
 };
 
 typedef boost::shared_ptr<FCLGeometry> FCLGeometryPtr;
@@ -209,8 +227,54 @@ struct FCLManager
   boost::shared_ptr<fcl::BroadPhaseCollisionManager> manager_;
 };
 
+/** \brief Collision objects that move between two poses, as needed for continuous collision checking. Every motion
+    has a proxy object (a box) whose AABB covers the complete motion; the proxies are what gets registered to broadphase
+    managers, and the user data of the proxy geometry points back to the corresponding Motion. */
+struct FCLSweptObject
+{
+  struct Motion
+  {
+    /// The collision object, at the start pose of the motion
+    boost::shared_ptr<fcl::CollisionObject> object_;
+
+    /// The pose the collision object moves to
+    fcl::Transform3f                        end_;
+
+    /// Box that bounds the volume swept by the object during the motion
+    boost::shared_ptr<fcl::CollisionObject> proxy_;
+  };
+
+  /** \brief Add the motion of \e geom from \e start to \e end. The pose of the object along the motion is assumed to be
+      the linear interpolation of the translations and the spherical linear interpolation of the rotations */
+  void addMotion(const FCLGeometryConstPtr &geom, const Eigen::Affine3d &start, const Eigen::Affine3d &end);
+
+  void registerTo(fcl::BroadPhaseCollisionManager *manager);
+  void clear();
+
+  std::vector<boost::shared_ptr<Motion> > motions_;
+  std::vector<FCLGeometryConstPtr>        collision_geometry_;
+};
+
+/** \brief Data passed to continuousCollisionCallback() */
+struct ContinuousCollisionData
+{
+  ContinuousCollisionData(CollisionData *cdata, const fcl::CollisionObject *query = NULL) : cdata_(cdata), query_(query)
+  {
+  }
+
+  /// The collision data the results are stored in
+  CollisionData              *cdata_;
+
+  /// If not NULL, the proxy of the motion the broadphase is queried with; the objects reported together with
+  /// this proxy are assumed to not move. If NULL, both reported objects are expected to be proxies.
+  const fcl::CollisionObject *query_;
+};
+
 bool collisionCallback(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void *data);
 
+/** \brief Broadphase callback for continuous collision checking; \e data is expected to be a ContinuousCollisionData */
+bool continuousCollisionCallback(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void *data);
+
 bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data, double& min_dist);
 
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
@@ -38,10 +38,14 @@
 #define MOVEIT_COLLISION_DETECTION_FCL_COLLISION_ROBOT_
 
 #include <moveit/collision_detection_fcl/collision_common.h>
+#include <moveit/background_processing/thread_local_cache.h>
+#include <boost/detail/atomic_count.hpp>
 
 namespace collision_detection
 {
 
+  struct FCLSelfCollisionCache;
+
   class CollisionRobotFCL : public CollisionRobot
   {
     friend class CollisionWorldFCL;
@@ -77,9 +81,47 @@ namespace collision_detection
 
   protected:
 
+    /** \brief Scoped access to a broadphase that holds the collision objects of this robot at a given state.
+        The broadphase cached for the calling thread is used when possible; otherwise a new one is allocated. */
+    class SelfCollisionBroadPhase
+    {
+    public:
+
+      SelfCollisionBroadPhase(const CollisionRobotFCL &robot, const robot_state::RobotState &state);
+      ~SelfCollisionBroadPhase();
+
+      fcl::BroadPhaseCollisionManager* getManager() const
+      {
+        return manager_;
+      }
+
+    private:
+
+      SelfCollisionBroadPhase(const SelfCollisionBroadPhase&);
+      SelfCollisionBroadPhase& operator=(const SelfCollisionBroadPhase&);
+
+      const CollisionRobotFCL         &robot_;
+      boost::shared_ptr<FCLSelfCollisionCache>
+                                       cache_;
+      FCLManager                       fallback_;
+      fcl::BroadPhaseCollisionManager *manager_;
+    };
+    friend class SelfCollisionBroadPhase;
+
     virtual void updatedPaddingOrScaling(const std::vector<std::string> &links);
     void constructFCLObject(const robot_state::RobotState &state, FCLObject &fcl_obj) const;
+
+    /** \brief Construct the collision objects of this robot moving from \e state1 to \e state2. Bodies attached in \e state1 are
+        included; if a body is not attached in \e state2 as well, it is assumed not to move. */
+    void constructFCLSweptObject(const robot_state::RobotState &state1, const robot_state::RobotState &state2, FCLSweptObject &fcl_obj) const;
     void allocSelfCollisionBroadPhase(const robot_state::RobotState &state, FCLManager &manager) const;
+
+    /** \brief Get the self collision broadphase cached for the calling thread, updated to \e state. Only the AABBs of the
+        collision objects whose transforms changed since the previous query are refit; the objects of bodies attached in \e state
+        are created when a body is first seen and dropped once it is no longer attached. Returns NULL if the cache is already
+        in use by this thread; releaseSelfCollisionCache() must be called once the query completes. */
+    boost::shared_ptr<FCLSelfCollisionCache> acquireSelfCollisionCache(const robot_state::RobotState &state) const;
+    void releaseSelfCollisionCache(const boost::shared_ptr<FCLSelfCollisionCache> &cache) const;
     void getAttachedBodyObjects(const robot_state::AttachedBody *ab, std::vector<FCLGeometryConstPtr> &geoms) const;
 
     void checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
@@ -87,11 +129,22 @@ namespace collision_detection
     void checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                    const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
                                    const AllowedCollisionMatrix *acm) const;
+    void checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                  const AllowedCollisionMatrix *acm) const;
+    void checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                   const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                   const AllowedCollisionMatrix *acm) const;
     double distanceSelfHelper(const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
     double distanceOtherHelper(const robot_state::RobotState &state, const CollisionRobot &other_robot,
                                const robot_state::RobotState &other_state, const AllowedCollisionMatrix *acm) const;
 
     std::vector<FCLGeometryConstPtr> geoms_;
+
+    /** \brief The self collision broadphases that threads keep for this instance; a thread keeps them for a few robots at most */
+    moveit::tools::ThreadLocalCache<FCLSelfCollisionCache> self_collision_caches_;
+
+    /** \brief Incremented every time geoms_ changes, so that cached broadphases are rebuilt; read by all querying threads */
+    boost::detail::atomic_count      geoms_version_;
   };
 
 }
@@ -39,22 +39,44 @@
 #include <fcl/shape/geometric_shapes.h>
 #include <fcl/octree.h>
 #include <boost/thread/mutex.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
 
 namespace collision_detection
 {
 
-bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data)
+/** \brief Get the index of the object described by \e cd in the lookup table of \e acm */
+static std::size_t getCompiledIndex(const CompiledAllowedCollisionMatrix *acm, const CollisionGeometryData *cd)
 {
-  CollisionData *cdata = reinterpret_cast<CollisionData*>(data);
-  if (cdata->done_)
-    return true;
-  const CollisionGeometryData *cd1 = static_cast<const CollisionGeometryData*>(o1->collisionGeometry()->getUserData());
-  const CollisionGeometryData *cd2 = static_cast<const CollisionGeometryData*>(o2->collisionGeometry()->getUserData());
+  return cd->type == BodyTypes::ROBOT_LINK ? acm->getIndex(cd->ptr.link) : acm->getIndex(cd->getID());
+}
 
-  // do not collision check geoms part of the same object / link / attached body
-  if (cd1->sameObject(*cd2))
-    return false;
-  
+/** \brief Get the allowed collision type for the pair of objects from the collision matrix in \e cdata; the lookup table
+    of the matrix is used when it is available */
+static bool getAllowedCollision(const CollisionData *cdata, const CollisionGeometryData *cd1, const CollisionGeometryData *cd2,
+                                AllowedCollision::Type &type)
+{
+  if (cdata->compiled_acm_)
+  {
+    std::size_t i1 = getCompiledIndex(cdata->compiled_acm_, cd1);
+    std::size_t i2 = getCompiledIndex(cdata->compiled_acm_, cd2);
+    if (i1 != CompiledAllowedCollisionMatrix::NO_INDEX && i2 != CompiledAllowedCollisionMatrix::NO_INDEX)
+      return cdata->compiled_acm_->getAllowedCollision(i1, i2, type);
+  }
+  return cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type);
+}
+
+/** \brief Get the predicate that decides on contacts between the pair of objects from the collision matrix in \e cdata */
+static bool getAllowedCollision(const CollisionData *cdata, const CollisionGeometryData *cd1, const CollisionGeometryData *cd2,
+                                DecideContactFn &fn)
+{
+  return cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), fn);
+}
+
+/** \brief Decide whether the pair of objects \e cd1, \e cd2 needs to be checked for collision, based on the active components,
+    the allowed collision matrix and the touch links. Returns true if collision between the two objects is always allowed.
+    If the collision is only conditionally allowed, \e dcf is set to the function that decides on the contacts. */
+static bool isCollisionAlwaysAllowed(const CollisionGeometryData *cd1, const CollisionGeometryData *cd2, const CollisionData *cdata, DecideContactFn &dcf)
+{
   // If active components are specified
   if (cdata->active_components_only_)
   {
@@ -64,16 +86,15 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
     // If neither of the involved components is active
     if ((!l1 || cdata->active_components_only_->find(l1) == cdata->active_components_only_->end()) &&
         (!l2 || cdata->active_components_only_->find(l2) == cdata->active_components_only_->end()))
-      return false;
+      return true;
   }
 
   // use the collision matrix (if any) to avoid certain collision checks
-  DecideContactFn dcf;
   bool always_allow_collision = false;
   if (cdata->acm_)
   {
     AllowedCollision::Type type;
-    bool found = cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type);
+    bool found = getAllowedCollision(cdata, cd1, cd2, type);
     if (found)
     {
       // if we have an entry in the collision matrix, we read it
@@ -90,7 +111,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
       else
         if (type == AllowedCollision::CONDITIONAL)
         {
-          cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), dcf);
+          getAllowedCollision(cdata, cd1, cd2, dcf);
           if (cdata->req_->verbose)
             logDebug("Collision between '%s' and '%s' is conditionally allowed", cd1->getID().c_str(), cd2->getID().c_str());
         }
@@ -128,14 +149,12 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
       always_allow_collision = true;
   }
 
-  // if collisions are always allowed, we are done
-  if (always_allow_collision)
-    return false;
-
-  if (cdata->req_->verbose)
-    logDebug("Actually checking collisions between %s and %s", cd1->getID().c_str(), cd2->getID().c_str());
+  return always_allow_collision;
+}
 
-  // see if we need to compute a contact
+/** \brief Get the number of contacts that still need to be stored for the pair of objects \e cd1, \e cd2 */
+static std::size_t getWantedContactCount(const CollisionGeometryData *cd1, const CollisionGeometryData *cd2, const CollisionData *cdata)
+{
   std::size_t want_contact_count = 0;
   if (cdata->req_->contacts)
     if (cdata->res_->contact_count < cdata->req_->max_contacts)
@@ -154,6 +173,52 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
       if (have < cdata->req_->max_contacts_per_pair)
         want_contact_count = std::min(cdata->req_->max_contacts_per_pair - have, cdata->req_->max_contacts - cdata->res_->contact_count);
     }
+  return want_contact_count;
+}
+
+/** \brief Update the \e done_ flag of \e cdata after a pair of objects was checked */
+static void updateDone(CollisionData *cdata)
+{
+  if (cdata->res_->collision)
+    if (!cdata->req_->contacts || cdata->res_->contact_count >= cdata->req_->max_contacts)
+    {
+      if (!cdata->req_->cost)
+        cdata->done_ = true;
+      if (cdata->req_->verbose)
+        logInform("Collision checking is considered complete (collision was found and %u contacts are stored)",
+                  (unsigned int)cdata->res_->contact_count);
+    }
+
+  if (!cdata->done_ && cdata->req_->is_done)
+  {
+    cdata->done_ = cdata->req_->is_done(*cdata->res_);
+    if (cdata->done_ && cdata->req_->verbose)
+      logInform("Collision checking is considered complete due to external callback. %s was found. %u contacts are stored.",
+                cdata->res_->collision ? "Collision" : "No collision", (unsigned int)cdata->res_->contact_count);
+  }
+}
+
+bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data)
+{
+  CollisionData *cdata = reinterpret_cast<CollisionData*>(data);
+  if (cdata->done_)
+    return true;
+  const CollisionGeometryData *cd1 = static_cast<const CollisionGeometryData*>(o1->collisionGeometry()->getUserData());
+  const CollisionGeometryData *cd2 = static_cast<const CollisionGeometryData*>(o2->collisionGeometry()->getUserData());
+
+  // do not collision check geoms part of the same object / link / attached body
+  if (cd1->sameObject(*cd2))
+    return false;
+  
+  DecideContactFn dcf;
+  if (isCollisionAlwaysAllowed(cd1, cd2, cdata, dcf))
+    return false;
+
+  if (cdata->req_->verbose)
+    logDebug("Actually checking collisions between %s and %s", cd1->getID().c_str(), cd2->getID().c_str());
+
+  // see if we need to compute a contact
+  std::size_t want_contact_count = getWantedContactCount(cd1, cd2, cdata);
 
   if (dcf)
   {
@@ -305,25 +370,119 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   }
 
 
-  if (cdata->res_->collision)
-    if (!cdata->req_->contacts || cdata->res_->contact_count >= cdata->req_->max_contacts)
+  updateDone(cdata);
+  return cdata->done_;
+}
+
+/// The maximum number of conservative advancement steps performed for a pair of moving objects
+static const std::size_t CONTINUOUS_MAX_ITERATIONS = 20;
+
+/// The number of poses sampled along the motion for pairs conservative advancement is not available for
+static const std::size_t CONTINUOUS_SAMPLE_COUNT = 20;
+
+/// The tolerance on the time of contact
+static const double CONTINUOUS_TOC_ERROR = 1e-4;
+
+/** \brief Check objects \e o1 and \e o2 for collision while they move from their current poses to \e tf1_end and \e tf2_end */
+static bool continuousCollisionCheck(const fcl::CollisionObject *o1, const fcl::Transform3f &tf1_end,
+                                     const fcl::CollisionObject *o2, const fcl::Transform3f &tf2_end, CollisionData *cdata)
+{
+  if (cdata->done_)
+    return true;
+  const CollisionGeometryData *cd1 = static_cast<const CollisionGeometryData*>(o1->collisionGeometry()->getUserData());
+  const CollisionGeometryData *cd2 = static_cast<const CollisionGeometryData*>(o2->collisionGeometry()->getUserData());
+
+  // do not collision check geoms part of the same object / link / attached body
+  if (cd1->sameObject(*cd2))
+    return false;
+
+  DecideContactFn dcf;
+  if (isCollisionAlwaysAllowed(cd1, cd2, cdata, dcf))
+    return false;
+
+  if (cdata->req_->verbose)
+    logDebug("Actually checking continuous collisions between %s and %s", cd1->getID().c_str(), cd2->getID().c_str());
+
+  const fcl::CollisionGeometry *g1 = o1->collisionGeometry().get();
+  const fcl::CollisionGeometry *g2 = o2->collisionGeometry().get();
+
+  // conservative advancement is not available for octrees, so for those the motion is sampled
+  bool sample = g1->getObjectType() == fcl::OT_OCTREE || g2->getObjectType() == fcl::OT_OCTREE;
+  fcl::ContinuousCollisionRequest ccd_req(sample ? CONTINUOUS_SAMPLE_COUNT : CONTINUOUS_MAX_ITERATIONS, CONTINUOUS_TOC_ERROR,
+                                          fcl::CCDM_LINEAR, fcl::GST_LIBCCD,
+                                          sample ? fcl::CCDC_NAIVE : fcl::CCDC_CONSERVATIVE_ADVANCEMENT);
+  fcl::ContinuousCollisionResult ccd_res;
+  fcl::continuousCollide(g1, o1->getTransform(), tf1_end, g2, o2->getTransform(), tf2_end, ccd_req, ccd_res);
+
+  if (ccd_res.is_collide)
+  {
+    std::size_t want_contact_count = getWantedContactCount(cd1, cd2, cdata);
+    bool collision = true;
+
+    // contacts are computed (and evaluated, if needed) at the time of first contact
+    if (dcf || want_contact_count > 0)
     {
-      if (!cdata->req_->cost)
-        cdata->done_ = true;
+      fcl::CollisionResult col_result;
+      int num_contacts = fcl::collide(g1, ccd_res.contact_tf1, g2, ccd_res.contact_tf2,
+                                      fcl::CollisionRequest(dcf ? std::numeric_limits<size_t>::max() : want_contact_count, true), col_result);
+
+      // at the time of contact the bodies may only be touching; if no contacts are reported, the collision cannot be
+      // evaluated by the decider, so it is assumed to be disallowed
+      if (dcf && num_contacts > 0)
+        collision = false;
+
+      const std::pair<std::string, std::string> &pc = cd1->getID() < cd2->getID() ?
+        std::make_pair(cd1->getID(), cd2->getID()) : std::make_pair(cd2->getID(), cd1->getID());
+      for (int i = 0 ; i < num_contacts ; ++i)
+      {
+        Contact c;
+        fcl2contact(col_result.getContact(i), c);
+        if (dcf && dcf(c))
+          continue;
+        collision = true;
+        if (want_contact_count > 0)
+        {
+          --want_contact_count;
+          cdata->res_->contacts[pc].push_back(c);
+          cdata->res_->contact_count++;
+        }
+        else
+          break;
+      }
+    }
+
+    if (collision)
+    {
+      cdata->res_->collision = true;
       if (cdata->req_->verbose)
-        logInform("Collision checking is considered complete (collision was found and %u contacts are stored)",
-                  (unsigned int)cdata->res_->contact_count);
+        logInform("Found a continuous collision between '%s' (type '%s') and '%s' (type '%s') at time %lf along the motion",
+                  cd1->getID().c_str(), cd1->getTypeString().c_str(), cd2->getID().c_str(), cd2->getTypeString().c_str(),
+                  ccd_res.time_of_contact);
     }
+  }
 
-  if (!cdata->done_ && cdata->req_->is_done)
+  updateDone(cdata);
+  return cdata->done_;
+}
+
+bool continuousCollisionCallback(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void *data)
+{
+  ContinuousCollisionData *ccdata = reinterpret_cast<ContinuousCollisionData*>(data);
+  if (ccdata->cdata_->done_)
+    return true;
+
+  if (ccdata->query_)
   {
-    cdata->done_ = cdata->req_->is_done(*cdata->res_);
-    if (cdata->done_ && cdata->req_->verbose)
-      logInform("Collision checking is considered complete due to external callback. %s was found. %u contacts are stored.",
-                cdata->res_->collision ? "Collision" : "No collision", (unsigned int)cdata->res_->contact_count);
+    // one of the objects is the proxy of the query motion, the other one does not move
+    const fcl::CollisionObject *proxy = o1 == ccdata->query_ ? o1 : o2;
+    const fcl::CollisionObject *fixed = o1 == ccdata->query_ ? o2 : o1;
+    const FCLSweptObject::Motion *m = static_cast<const FCLSweptObject::Motion*>(proxy->collisionGeometry()->getUserData());
+    return continuousCollisionCheck(m->object_.get(), m->end_, fixed, fixed->getTransform(), ccdata->cdata_);
   }
 
-  return cdata->done_;
+  const FCLSweptObject::Motion *m1 = static_cast<const FCLSweptObject::Motion*>(o1->collisionGeometry()->getUserData());
+  const FCLSweptObject::Motion *m2 = static_cast<const FCLSweptObject::Motion*>(o2->collisionGeometry()->getUserData());
+  return continuousCollisionCheck(m1->object_.get(), m1->end_, m2->object_.get(), m2->end_, ccdata->cdata_);
 }
 
 struct FCLShapeCache
@@ -389,7 +548,7 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
   {
     AllowedCollision::Type type;
 
-    bool found = cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type);
+    bool found = getAllowedCollision(cdata, cd1, cd2, type);
     if (found)
     {
       // if we have an entry in the collision matrix, we read it
@@ -762,3 +921,55 @@ void collision_detection::FCLObject::clear()
   collision_objects_.clear();
   collision_geometry_.clear();
 }
+
+void collision_detection::FCLGeometry::computeRotationRadius()
+{
+  // the rotation of interpolated motions is about the center of mass of the geometry, which is not at its origin for
+  // meshes; the center of mass of open meshes is not defined, so the bound also holds for rotations about the origin
+  const fcl::CollisionGeometry *g = collision_geometry_.get();
+  double center_distance = g->aabb_center.length();
+  fcl::Vec3f com = g->computeCOM();
+  if (boost::math::isfinite(com[0]) && boost::math::isfinite(com[1]) && boost::math::isfinite(com[2]))
+    center_distance = std::max(center_distance, (g->aabb_center - com).length());
+  rotation_radius_ = center_distance + g->aabb_radius;
+}
+
+void collision_detection::FCLSweptObject::addMotion(const FCLGeometryConstPtr &geom, const Eigen::Affine3d &start, const Eigen::Affine3d &end)
+{
+  boost::shared_ptr<Motion> m(new Motion());
+  m->object_.reset(new fcl::CollisionObject(geom->collision_geometry_, transform2fcl(start)));
+  m->end_ = transform2fcl(end);
+
+  // the AABBs at the two ends of the motion bound the translation of the center of rotation; with rotation, points of
+  // the object move along arcs that deviate from their chords by at most r * (1 - cos(angle / 2)), r being their
+  // distance to the center of rotation
+  fcl::CollisionObject end_object(geom->collision_geometry_, m->end_);
+  fcl::AABB aabb = m->object_->getAABB();
+  aabb += end_object.getAABB();
+  double angle = Eigen::AngleAxisd(start.linear().transpose() * end.linear()).angle();
+  double d = geom->rotation_radius_ * (1.0 - cos(angle / 2.0));
+  aabb.min_ -= fcl::Vec3f(d, d, d);
+  aabb.max_ += fcl::Vec3f(d, d, d);
+
+  fcl::Box *box = new fcl::Box(aabb.width(), aabb.height(), aabb.depth());
+  box->setUserData(m.get());
+  fcl::Transform3f center;
+  center.setTranslation(aabb.center());
+  m->proxy_.reset(new fcl::CollisionObject(boost::shared_ptr<fcl::CollisionGeometry>(box), center));
+  motions_.push_back(m);
+}
+
+void collision_detection::FCLSweptObject::registerTo(fcl::BroadPhaseCollisionManager *manager)
+{
+  std::vector<fcl::CollisionObject*> proxies(motions_.size());
+  for (std::size_t i = 0 ; i < motions_.size() ; ++i)
+    proxies[i] = motions_[i]->proxy_.get();
+  if (!proxies.empty())
+    manager->registerObjects(proxies);
+}
+
+void collision_detection::FCLSweptObject::clear()
+{
+  motions_.clear();
+  collision_geometry_.clear();
+}
@@ -35,9 +35,73 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <algorithm>
+
+namespace collision_detection
+{
+
+/// The number of robots a thread keeps self collision broadphases for
+static const std::size_t MAX_CACHED_ROBOTS_PER_THREAD = 4;
+
+/** \brief A broadphase with the link collision objects of one CollisionRobotFCL instance, kept alive across queries
+    made from the same thread. */
+struct FCLSelfCollisionCache
+{
+  /// The collision objects of a body attached to the robot, registered while the body is attached in the checked states
+  struct AttachedBodyObjects
+  {
+    /// The body the objects were created for
+    const robot_state::AttachedBody         *body_;
+
+    /// The shapes of the body; holding them ensures a different body at the same address is told apart
+    std::vector<shapes::ShapeConstPtr>       shapes_;
+
+    FCLObject                                objects_;
+
+    /// For every object in objects_, the index of its shape in the body
+    std::vector<std::size_t>                 shape_index_;
+
+    /// For every object in objects_, the transform it was last placed at
+    EigenSTL::vector_Affine3d                transforms_;
+
+    /// Flag indicating the body is attached in the state being checked
+    bool                                     attached_;
+  };
+
+  FCLSelfCollisionCache() : geoms_version_(0), in_use_(false)
+  {
+  }
+
+  /// The geoms_version_ of the owner at the time the broadphase was built
+  long                                     geoms_version_;
+
+  /// Flag indicating the cache is used by a query that has not completed yet
+  bool                                     in_use_;
+
+  /// The broadphase and the collision objects for the links, registered permanently
+  FCLManager                               manager_;
+
+  /// For every object in manager_.object_, the index of the corresponding geometry in CollisionRobotFCL::geoms_
+  std::vector<std::size_t>                 geom_index_;
+
+  /// For every object in manager_.object_, the transform it was last placed at
+  EigenSTL::vector_Affine3d                transforms_;
+
+  /// Objects for the bodies attached in the last checked state, registered in manager_
+  std::vector<AttachedBodyObjects>         attached_;
+
+  /// Scratch space, kept to avoid allocation
+  std::vector<fcl::CollisionObject*>       updated_;
+  std::vector<const robot_state::AttachedBody*>
+                                           attached_bodies_;
+};
+
+}
 
 collision_detection::CollisionRobotFCL::CollisionRobotFCL(const robot_model::RobotModelConstPtr &model, double padding, double scale) 
   : CollisionRobot(model, padding, scale)
+  , self_collision_caches_(MAX_CACHED_ROBOTS_PER_THREAD)
+  , geoms_version_(0)
 {
   const std::vector<const robot_model::LinkModel*>& links = robot_model_->getLinkModelsWithCollisionGeometry();
   geoms_.resize(robot_model_->getLinkGeometryCount());
@@ -54,6 +118,8 @@ collision_detection::CollisionRobotFCL::CollisionRobotFCL(const robot_model::Rob
 }
 
 collision_detection::CollisionRobotFCL::CollisionRobotFCL(const CollisionRobotFCL &other) : CollisionRobot(other)
+                                                                                        , self_collision_caches_(MAX_CACHED_ROBOTS_PER_THREAD)
+                                                                                        , geoms_version_(0)
 {
   geoms_ = other.geoms_;
 }
@@ -101,6 +167,40 @@ void collision_detection::CollisionRobotFCL::constructFCLObject(const robot_stat
   }
 }
 
+void collision_detection::CollisionRobotFCL::constructFCLSweptObject(const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                     FCLSweptObject &fcl_obj) const
+{
+  fcl_obj.motions_.reserve(geoms_.size());
+
+  for (std::size_t i = 0 ; i < geoms_.size() ; ++i)
+    if (geoms_[i] && geoms_[i]->collision_geometry_)
+    {
+      const robot_model::LinkModel *link = geoms_[i]->collision_geometry_data_->ptr.link;
+      int shape_index = geoms_[i]->collision_geometry_data_->shape_index;
+      fcl_obj.addMotion(geoms_[i], state1.getCollisionBodyTransform(link, shape_index), state2.getCollisionBodyTransform(link, shape_index));
+    }
+
+  std::vector<const robot_state::AttachedBody*> ab;
+  state1.getAttachedBodies(ab);
+  for (std::size_t j = 0 ; j < ab.size() ; ++j)
+  {
+    std::vector<FCLGeometryConstPtr> objs;
+    getAttachedBodyObjects(ab[j], objs);
+    const EigenSTL::vector_Affine3d &ab_t1 = ab[j]->getGlobalCollisionBodyTransforms();
+    const robot_state::AttachedBody *ab2 = state2.getAttachedBody(ab[j]->getName());
+    const EigenSTL::vector_Affine3d &ab_t2 = ab2 && ab2->getGlobalCollisionBodyTransforms().size() == ab_t1.size() ?
+      ab2->getGlobalCollisionBodyTransforms() : ab_t1;
+    for (std::size_t k = 0 ; k < objs.size() ; ++k)
+      if (objs[k]->collision_geometry_)
+      {
+        fcl_obj.addMotion(objs[k], ab_t1[k], ab_t2[k]);
+        // we copy the shared ptr to the CollisionGeometryData, as this is not stored by the class itself,
+        // and would be destroyed when objs goes out of scope.
+        fcl_obj.collision_geometry_.push_back(objs[k]);
+      }
+  }
+}
+
 void collision_detection::CollisionRobotFCL::allocSelfCollisionBroadPhase(const robot_state::RobotState &state, FCLManager &manager) const
 {
   fcl::DynamicAABBTreeCollisionManager* m = new fcl::DynamicAABBTreeCollisionManager();
@@ -111,6 +211,155 @@ void collision_detection::CollisionRobotFCL::allocSelfCollisionBroadPhase(const
   // manager.manager_->update();
 }
 
+boost::shared_ptr<collision_detection::FCLSelfCollisionCache> collision_detection::CollisionRobotFCL::acquireSelfCollisionCache(const robot_state::RobotState &state) const
+{
+  // hold the cache, so that a query for another robot made by this thread meanwhile cannot release it
+  boost::shared_ptr<FCLSelfCollisionCache> cache = self_collision_caches_.getShared();
+  if (!cache)
+  {
+    self_collision_caches_.set(new FCLSelfCollisionCache());
+    cache = self_collision_caches_.getShared();
+  }
+  else
+    if (cache->in_use_)
+      return boost::shared_ptr<FCLSelfCollisionCache>();
+
+  fcl::BroadPhaseCollisionManager *manager = cache->manager_.manager_.get();
+  cache->updated_.clear();
+  long geoms_version = geoms_version_;
+  if (!manager || cache->geoms_version_ != geoms_version)
+  {
+    // (re)build the broadphase for the link geometry
+    cache->manager_.object_.clear();
+    cache->geom_index_.clear();
+    cache->transforms_.clear();
+    cache->attached_.clear();
+    manager = new fcl::DynamicAABBTreeCollisionManager();
+    cache->manager_.manager_.reset(manager);
+    for (std::size_t i = 0 ; i < geoms_.size() ; ++i)
+      if (geoms_[i] && geoms_[i]->collision_geometry_)
+      {
+        const Eigen::Affine3d &t = state.getCollisionBodyTransform(geoms_[i]->collision_geometry_data_->ptr.link, geoms_[i]->collision_geometry_data_->shape_index);
+        cache->manager_.object_.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(new fcl::CollisionObject(geoms_[i]->collision_geometry_, transform2fcl(t))));
+        cache->geom_index_.push_back(i);
+        cache->transforms_.push_back(t);
+      }
+    cache->manager_.object_.registerTo(manager);
+    cache->updated_.reserve(cache->geom_index_.size());
+    cache->geoms_version_ = geoms_version;
+  }
+  else
+  {
+    // refit only the objects that moved since the last query
+    for (std::size_t k = 0 ; k < cache->geom_index_.size() ; ++k)
+    {
+      const FCLGeometryConstPtr &g = geoms_[cache->geom_index_[k]];
+      const Eigen::Affine3d &t = state.getCollisionBodyTransform(g->collision_geometry_data_->ptr.link, g->collision_geometry_data_->shape_index);
+      if (t.matrix() != cache->transforms_[k].matrix())
+      {
+        cache->transforms_[k] = t;
+        fcl::CollisionObject *obj = cache->manager_.object_.collision_objects_[k].get();
+        obj->setTransform(transform2fcl(t));
+        obj->computeAABB();
+        cache->updated_.push_back(obj);
+      }
+    }
+  }
+
+  // the objects of bodies that are still attached are reused and refit like those of the links; the objects of
+  // bodies that are no longer attached are dropped
+  for (std::size_t i = 0 ; i < cache->attached_.size() ; ++i)
+    cache->attached_[i].attached_ = false;
+  state.getAttachedBodies(cache->attached_bodies_);
+  for (std::size_t j = 0 ; j < cache->attached_bodies_.size() ; ++j)
+  {
+    const robot_state::AttachedBody *ab = cache->attached_bodies_[j];
+    const EigenSTL::vector_Affine3d &ab_t = ab->getGlobalCollisionBodyTransforms();
+    std::size_t i = 0;
+    while (i < cache->attached_.size() && (cache->attached_[i].body_ != ab || cache->attached_[i].shapes_ != ab->getShapes()))
+      ++i;
+
+    if (i < cache->attached_.size())
+    {
+      FCLSelfCollisionCache::AttachedBodyObjects &abo = cache->attached_[i];
+      abo.attached_ = true;
+      for (std::size_t k = 0 ; k < abo.shape_index_.size() ; ++k)
+      {
+        const Eigen::Affine3d &t = ab_t[abo.shape_index_[k]];
+        if (t.matrix() != abo.transforms_[k].matrix())
+        {
+          abo.transforms_[k] = t;
+          fcl::CollisionObject *obj = abo.objects_.collision_objects_[k].get();
+          obj->setTransform(transform2fcl(t));
+          obj->computeAABB();
+          cache->updated_.push_back(obj);
+        }
+      }
+    }
+    else
+    {
+      cache->attached_.resize(cache->attached_.size() + 1);
+      FCLSelfCollisionCache::AttachedBodyObjects &abo = cache->attached_.back();
+      abo.body_ = ab;
+      abo.shapes_ = ab->getShapes();
+      abo.attached_ = true;
+      for (std::size_t k = 0 ; k < abo.shapes_.size() ; ++k)
+      {
+        FCLGeometryConstPtr g = createCollisionGeometry(abo.shapes_[k], ab, k);
+        if (g && g->collision_geometry_)
+        {
+          abo.objects_.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(new fcl::CollisionObject(g->collision_geometry_, transform2fcl(ab_t[k]))));
+          abo.objects_.collision_geometry_.push_back(g);
+          abo.shape_index_.push_back(k);
+          abo.transforms_.push_back(ab_t[k]);
+        }
+      }
+      abo.objects_.registerTo(manager);
+    }
+  }
+  for (std::size_t i = 0 ; i < cache->attached_.size() ; )
+    if (cache->attached_[i].attached_)
+      ++i;
+    else
+    {
+      cache->attached_[i].objects_.unregisterFrom(manager);
+      if (i + 1 < cache->attached_.size())
+        std::swap(cache->attached_[i], cache->attached_.back());
+      cache->attached_.pop_back();
+    }
+
+  if (!cache->updated_.empty())
+    manager->update(cache->updated_);
+
+  cache->in_use_ = true;
+  return cache;
+}
+
+void collision_detection::CollisionRobotFCL::releaseSelfCollisionCache(const boost::shared_ptr<FCLSelfCollisionCache> &cache) const
+{
+  cache->in_use_ = false;
+}
+
+collision_detection::CollisionRobotFCL::SelfCollisionBroadPhase::SelfCollisionBroadPhase(const CollisionRobotFCL &robot, const robot_state::RobotState &state)
+  : robot_(robot)
+  , cache_(robot.acquireSelfCollisionCache(state))
+{
+  if (cache_)
+    manager_ = cache_->manager_.manager_.get();
+  else
+  {
+    // the cache of this thread is busy (nested query), so we use a broadphase of our own
+    robot.allocSelfCollisionBroadPhase(state, fallback_);
+    manager_ = fallback_.manager_.get();
+  }
+}
+
+collision_detection::CollisionRobotFCL::SelfCollisionBroadPhase::~SelfCollisionBroadPhase()
+{
+  if (cache_)
+    robot_.releaseSelfCollisionCache(cache_);
+}
+
 void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state) const
 {
   checkSelfCollisionHelper(req, res, state, NULL);
@@ -124,24 +373,42 @@ void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionR
 
 void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkSelfCollisionHelper(req, res, state1, state2, NULL);
 }
 
 void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkSelfCollisionHelper(req, res, state1, state2, &acm);
 }
 
 void collision_detection::CollisionRobotFCL::checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                                                       const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  {
+    SelfCollisionBroadPhase manager(*this, state);
+    CollisionData cd(&req, &res, acm);
+    cd.enableGroup(getRobotModel());
+    manager.getManager()->collide(&cd, &collisionCallback);
+  }
+  if (req.distance)
+    res.distance = distanceSelfHelper(state, acm);
+}
+
+void collision_detection::CollisionRobotFCL::checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res,
+                                                                      const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                      const AllowedCollisionMatrix *acm) const
+{
+  FCLSweptObject swept;
+  constructFCLSweptObject(state1, state2, swept);
+  fcl::DynamicAABBTreeCollisionManager manager;
+  swept.registerTo(&manager);
+
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
-  manager.manager_->collide(&cd, &collisionCallback);
+  ContinuousCollisionData ccd(&cd);
+  manager.collide(&ccd, &continuousCollisionCallback);
   if (req.distance)
-    res.distance = distanceSelfHelper(state, acm);
+    res.distance = std::min(distanceSelfHelper(state1, acm), distanceSelfHelper(state2, acm));
 }
 
 void collision_detection::CollisionRobotFCL::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
@@ -160,33 +427,57 @@ void collision_detection::CollisionRobotFCL::checkOtherCollision(const Collision
 void collision_detection::CollisionRobotFCL::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
                                                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkOtherCollisionHelper(req, res, state1, state2, other_robot, other_state1, other_state2, NULL);
 }
 
 void collision_detection::CollisionRobotFCL::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
                                                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
                                                                  const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkOtherCollisionHelper(req, res, state1, state2, other_robot, other_state1, other_state2, &acm);
 }
 
 void collision_detection::CollisionRobotFCL::checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                                                        const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
                                                                        const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
-
   const CollisionRobotFCL &fcl_rob = dynamic_cast<const CollisionRobotFCL&>(other_robot);
   FCLObject other_fcl_obj;
   fcl_rob.constructFCLObject(other_state, other_fcl_obj);
 
+  {
+    SelfCollisionBroadPhase manager(*this, state);
+    CollisionData cd(&req, &res, acm);
+    cd.enableGroup(getRobotModel());
+    for (std::size_t i = 0 ; !cd.done_ && i < other_fcl_obj.collision_objects_.size() ; ++i)
+      manager.getManager()->collide(other_fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
+  }
+  if (req.distance)
+    res.distance = distanceOtherHelper(state, other_robot, other_state, acm);
+}
+
+void collision_detection::CollisionRobotFCL::checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res,
+                                                                       const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                       const CollisionRobot &other_robot,
+                                                                       const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                                                       const AllowedCollisionMatrix *acm) const
+{
+  FCLSweptObject swept;
+  constructFCLSweptObject(state1, state2, swept);
+  fcl::DynamicAABBTreeCollisionManager manager;
+  swept.registerTo(&manager);
+
+  const CollisionRobotFCL &fcl_rob = dynamic_cast<const CollisionRobotFCL&>(other_robot);
+  FCLSweptObject other_swept;
+  fcl_rob.constructFCLSweptObject(other_state1, other_state2, other_swept);
+
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
-  for (std::size_t i = 0 ; !cd.done_ && i < other_fcl_obj.collision_objects_.size() ; ++i)
-    manager.manager_->collide(other_fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
+  ContinuousCollisionData ccd(&cd);
+  for (std::size_t i = 0 ; !cd.done_ && i < other_swept.motions_.size() ; ++i)
+    manager.collide(other_swept.motions_[i]->proxy_.get(), &ccd, &continuousCollisionCallback);
   if (req.distance)
-    res.distance = distanceOtherHelper(state, other_robot, other_state, acm);
+    res.distance = std::min(distanceOtherHelper(state1, other_robot, other_state1, acm), distanceOtherHelper(state2, other_robot, other_state2, acm));
 }
 
 void collision_detection::CollisionRobotFCL::updatedPaddingOrScaling(const std::vector<std::string> &links)
@@ -206,6 +497,8 @@ void collision_detection::CollisionRobotFCL::updatedPaddingOrScaling(const std::
     else
       logError("Updating padding or scaling for unknown link: '%s'", links[i].c_str());
   }
+  // broadphases cached for the previous geometry need to be rebuilt
+  ++geoms_version_;
 }
 
 double collision_detection::CollisionRobotFCL::distanceSelf(const robot_state::RobotState &state) const
@@ -222,15 +515,14 @@ double collision_detection::CollisionRobotFCL::distanceSelf(const robot_state::R
 double collision_detection::CollisionRobotFCL::distanceSelfHelper(const robot_state::RobotState &state,
                                                                   const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  SelfCollisionBroadPhase manager(*this, state);
 
   CollisionRequest req;
   CollisionResult res;
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
 
-  manager.manager_->distance(&cd, &distanceCallback);
+  manager.getManager()->distance(&cd, &distanceCallback);
 
   return res.distance;
 }
@@ -255,8 +547,7 @@ double collision_detection::CollisionRobotFCL::distanceOtherHelper(const robot_s
                                                                    const robot_state::RobotState &other_state,
                                                                    const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  SelfCollisionBroadPhase manager(*this, state);
 
   const CollisionRobotFCL& fcl_rob = dynamic_cast<const CollisionRobotFCL&>(other_robot);
   FCLObject other_fcl_obj;
@@ -267,7 +558,7 @@ double collision_detection::CollisionRobotFCL::distanceOtherHelper(const robot_s
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
   for(std::size_t i = 0; !cd.done_ && i < other_fcl_obj.collision_objects_.size(); ++i)
-    manager.manager_->distance(other_fcl_obj.collision_objects_[i].get(), &cd, &distanceCallback);
+    manager.getManager()->distance(other_fcl_obj.collision_objects_[i].get(), &cd, &distanceCallback);
 
   return res.distance;
 }
@@ -96,12 +96,12 @@ void collision_detection::CollisionWorldFCL::checkRobotCollision(const Collision
 
 void collision_detection::CollisionWorldFCL::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkRobotCollisionHelper(req, res, robot, state1, state2, NULL);
 }
 
 void collision_detection::CollisionWorldFCL::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkRobotCollisionHelper(req, res, robot, state1, state2, &acm);
 }
 
 void collision_detection::CollisionWorldFCL::checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
@@ -119,6 +119,27 @@ void collision_detection::CollisionWorldFCL::checkRobotCollisionHelper(const Col
     res.distance = distanceRobotHelper(robot, state, acm);
 }
 
+void collision_detection::CollisionWorldFCL::checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                       const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                       const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotFCL &robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
+  FCLSweptObject swept;
+  robot_fcl.constructFCLSweptObject(state1, state2, swept);
+
+  CollisionData cd(&req, &res, acm);
+  cd.enableGroup(robot.getRobotModel());
+  for (std::size_t i = 0 ; !cd.done_ && i < swept.motions_.size() ; ++i)
+  {
+    // the objects in the world do not move, so they are reported along with the proxy of the motion
+    ContinuousCollisionData ccd(&cd, swept.motions_[i]->proxy_.get());
+    manager_->collide(swept.motions_[i]->proxy_.get(), &ccd, &continuousCollisionCallback);
+  }
+
+  if (req.distance)
+    res.distance = std::min(distanceRobotHelper(robot, state1, acm), distanceRobotHelper(robot, state2, acm));
+}
+
 void collision_detection::CollisionWorldFCL::checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const
 {
   checkWorldCollisionHelper(req, res, other_world, NULL);
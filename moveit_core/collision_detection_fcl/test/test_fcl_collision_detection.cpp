@@ -38,6 +38,9 @@
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/collision_detection_fcl/collision_world_fcl.h>
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <moveit/collision_detection_fcl/collision_common.h>
+#include <moveit/collision_detection/compiled_collision_matrix.h>
+#include <fcl/shape/geometric_shapes.h>
 
 #include <urdf_parser/urdf_parser.h>
 #include <geometric_shapes/shape_operations.h>
@@ -189,6 +192,352 @@ TEST_F(FclCollisionDetectionTester, LinksInCollision)
 }
 
 
+TEST_F(FclCollisionDetectionTester, CachedSelfCollisionBroadPhase)
+{
+  collision_detection::CollisionRequest req;
+  acm_->setEntry("base_link", "base_bellow_link", false);
+
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // warm up the broadphase cached for this thread
+  collision_detection::CollisionResult res1;
+  crobot_->checkSelfCollision(req, res1, kstate, *acm_);
+  ASSERT_FALSE(res1.collision);
+
+  // moving links into collision must refit the cached broadphase
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  kstate.updateStateWithLinkAt("base_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("base_bellow_link", offset);
+  kstate.update();
+
+  collision_detection::CollisionResult res2;
+  crobot_->checkSelfCollision(req, res2, kstate, *acm_);
+  ASSERT_TRUE(res2.collision);
+
+  // and moving them back must clear the collision again
+  robot_state::RobotState kstate2(kmodel_);
+  kstate2.setToDefaultValues();
+  kstate2.update();
+
+  collision_detection::CollisionResult res3;
+  crobot_->checkSelfCollision(req, res3, kstate2, *acm_);
+  ASSERT_FALSE(res3.collision);
+
+  // a copy of the collision robot keeps a cache of its own
+  DefaultCRobotType other(dynamic_cast<const DefaultCRobotType&>(*crobot_));
+  collision_detection::CollisionResult res4;
+  other.checkSelfCollision(req, res4, kstate, *acm_);
+  ASSERT_TRUE(res4.collision);
+
+  // changing the padding invalidates the cached geometry: the default state only collides with a padded bellow
+  collision_detection::CollisionResult res5;
+  other.checkSelfCollision(req, res5, kstate2, *acm_);
+  ASSERT_FALSE(res5.collision);
+
+  other.setLinkPadding("base_bellow_link", 1.0);
+  collision_detection::CollisionResult res6;
+  other.checkSelfCollision(req, res6, kstate2, *acm_);
+  ASSERT_TRUE(res6.collision);
+
+  other.setLinkPadding("base_bellow_link", 0.0);
+  collision_detection::CollisionResult res7;
+  other.checkSelfCollision(req, res7, kstate2, *acm_);
+  ASSERT_FALSE(res7.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, CachedSelfCollisionAttachedBodies)
+{
+  collision_detection::CollisionRequest req;
+  acm_.reset(new collision_detection::AllowedCollisionMatrix(kmodel_->getLinkModelNames(), true));
+
+  // the gripper is moved onto the base, so only the box attached to it can collide with the base
+  Eigen::Affine3d pos1 = Eigen::Affine3d::Identity();
+  pos1.translation().x() = 5.0;
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.updateStateWithLinkAt("base_link", pos1);
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", pos1);
+
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  std::vector<std::string> touch_links;
+  touch_links.push_back("r_gripper_palm_link");
+  touch_links.push_back("r_gripper_motor_accelerometer_link");
+  kstate.attachBody("box", shapes, poses, touch_links, "r_gripper_palm_link");
+  kstate.update();
+
+  collision_detection::CollisionResult res1;
+  crobot_->checkSelfCollision(req, res1, kstate, *acm_);
+  ASSERT_TRUE(res1.collision);
+
+  // the cached object of the box must follow the gripper away from the base
+  Eigen::Affine3d pos2 = Eigen::Affine3d::Identity();
+  pos2.translation().x() = 10.0;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", pos2);
+  collision_detection::CollisionResult res2;
+  crobot_->checkSelfCollision(req, res2, kstate, *acm_);
+  ASSERT_FALSE(res2.collision);
+
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", pos1);
+  collision_detection::CollisionResult res3;
+  crobot_->checkSelfCollision(req, res3, kstate, *acm_);
+  ASSERT_TRUE(res3.collision);
+
+  // a state without the box must not see its cached object
+  robot_state::RobotState kstate2(kstate);
+  kstate2.clearAttachedBody("box");
+  collision_detection::CollisionResult res4;
+  crobot_->checkSelfCollision(req, res4, kstate2, *acm_);
+  ASSERT_FALSE(res4.collision);
+
+  // and a box attached again is checked again, even if it is attached to a copy of the state
+  robot_state::RobotState kstate3(kstate);
+  collision_detection::CollisionResult res5;
+  crobot_->checkSelfCollision(req, res5, kstate3, *acm_);
+  ASSERT_TRUE(res5.collision);
+  collision_detection::CollisionResult res6;
+  crobot_->checkSelfCollision(req, res6, kstate, *acm_);
+  ASSERT_TRUE(res6.collision);
+
+  // touch links of the body are taken from the body currently attached
+  kstate.clearAttachedBody("box");
+  kstate.attachBody("box", shapes, poses, kmodel_->getLinkModelNames(), "r_gripper_palm_link");
+  kstate.update();
+  collision_detection::CollisionResult res7;
+  crobot_->checkSelfCollision(req, res7, kstate, *acm_);
+  ASSERT_FALSE(res7.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, ContinuousCollisionWorld)
+{
+  robot_state::RobotState kstate1(kmodel_);
+  kstate1.setToDefaultValues();
+  kstate1.setVariablePosition("world_joint/x", -2.0);
+  kstate1.update();
+
+  robot_state::RobotState kstate2(kmodel_);
+  kstate2.setToDefaultValues();
+  kstate2.setVariablePosition("world_joint/x", 2.0);
+  kstate2.update();
+
+  // a thin wall the robot drives through
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().z() = 0.5;
+  shapes::ShapeConstPtr shape(new shapes::Box(.05, 1.0, 1.0));
+  cworld_->getWorld()->addToObject("wall", shape, pos);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res1;
+  cworld_->checkRobotCollision(req, res1, *crobot_, kstate1, *acm_);
+  ASSERT_FALSE(res1.collision);
+
+  collision_detection::CollisionResult res2;
+  cworld_->checkRobotCollision(req, res2, *crobot_, kstate2, *acm_);
+  ASSERT_FALSE(res2.collision);
+
+  collision_detection::CollisionResult res3;
+  cworld_->checkRobotCollision(req, res3, *crobot_, kstate1, kstate2, *acm_);
+  ASSERT_TRUE(res3.collision);
+
+  // without the wall, the motion is collision free
+  cworld_->getWorld()->removeObject("wall");
+  collision_detection::CollisionResult res4;
+  cworld_->checkRobotCollision(req, res4, *crobot_, kstate1, kstate2, *acm_);
+  ASSERT_FALSE(res4.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, ContinuousSelfCollision)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // not moving at all is equivalent to a discrete check
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res1;
+  crobot_->checkSelfCollision(req, res1, kstate, kstate, *acm_);
+  ASSERT_FALSE(res1.collision);
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  robot_state::RobotState kstate2(kstate);
+  kstate2.updateStateWithLinkAt("base_link", Eigen::Affine3d::Identity());
+  kstate2.updateStateWithLinkAt("base_bellow_link", offset);
+  kstate2.update();
+
+  acm_->setEntry("base_link", "base_bellow_link", false);
+  collision_detection::CollisionResult res2;
+  crobot_->checkSelfCollision(req, res2, kstate, kstate2, *acm_);
+  ASSERT_TRUE(res2.collision);
+
+  acm_->setEntry("base_link", "base_bellow_link", true);
+  collision_detection::CollisionResult res3;
+  crobot_->checkSelfCollision(req, res3, kstate, kstate2, *acm_);
+  ASSERT_FALSE(res3.collision);
+}
+
+/* Add the \e box-th closed box of \e mesh, with the given center and size */
+static void addBoxToMesh(shapes::Mesh *mesh, unsigned int box, const Eigen::Vector3d &center, double size)
+{
+  static const unsigned int triangles[36] = { 0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6, 0, 1, 5, 0, 5, 4,
+                                              2, 6, 7, 2, 7, 3, 0, 4, 6, 0, 6, 2, 1, 3, 7, 1, 7, 5 };
+  for (unsigned int i = 0 ; i < 8 ; ++i)
+    for (unsigned int k = 0 ; k < 3 ; ++k)
+      mesh->vertices[3 * (8 * box + i) + k] = center[k] + (((i >> k) & 1) ? 0.5 : -0.5) * size;
+  for (unsigned int i = 0 ; i < 36 ; ++i)
+    mesh->triangles[36 * box + i] = 8 * box + triangles[i];
+}
+
+TEST_F(FclCollisionDetectionTester, SweptOffCenterMesh)
+{
+  // a heavy cube and a light one at the other end of the mesh: the center of mass is far from the center of the AABB
+  shapes::Mesh *mesh = new shapes::Mesh(16, 24);
+  addBoxToMesh(mesh, 0, Eigen::Vector3d(1.0, 0.0, 0.0), 0.4);
+  addBoxToMesh(mesh, 1, Eigen::Vector3d(-1.0, 0.0, 0.0), 0.05);
+  shapes::ShapeConstPtr shape(mesh);
+  collision_detection::World::Object object("mesh");
+  collision_detection::FCLGeometryConstPtr geom = collision_detection::createCollisionGeometry(shape, &object);
+  ASSERT_TRUE(geom);
+
+  // the mesh turns by 170 degrees about the z axis
+  Eigen::Affine3d start = Eigen::Affine3d::Identity();
+  Eigen::Affine3d end(Eigen::AngleAxisd(170.0 * M_PI / 180.0, Eigen::Vector3d::UnitZ()));
+  collision_detection::FCLSweptObject swept;
+  swept.addMotion(geom, start, end);
+  ASSERT_EQ(1u, swept.motions_.size());
+  const fcl::AABB &proxy = swept.motions_[0]->proxy_->getAABB();
+
+  // the mesh stays within the proxy whether its rotation is interpolated about its center of mass or its origin
+  fcl::Vec3f com = geom->collision_geometry_->computeCOM();
+  Eigen::Vector3d centers[2] = { Eigen::Vector3d(com[0], com[1], com[2]), Eigen::Vector3d::Zero() };
+  EXPECT_GT(centers[0].x(), 0.9);
+  Eigen::Quaterniond q_start(start.linear()), q_end(end.linear());
+  for (int c = 0 ; c < 2 ; ++c)
+    for (int step = 0 ; step <= 20 ; ++step)
+    {
+      double t = step / 20.0;
+      Eigen::Vector3d center = (1.0 - t) * (start * centers[c]) + t * (end * centers[c]);
+      Eigen::Matrix3d rotation = q_start.slerp(t, q_end).toRotationMatrix();
+      for (unsigned int i = 0 ; i < mesh->vertex_count ; ++i)
+      {
+        Eigen::Vector3d v = center + rotation * (Eigen::Vector3d(mesh->vertices[3 * i], mesh->vertices[3 * i + 1],
+                                                                 mesh->vertices[3 * i + 2]) - centers[c]);
+        EXPECT_TRUE(proxy.contain(fcl::Vec3f(v.x(), v.y(), v.z())));
+      }
+    }
+
+  // halfway through a rotation about the center of mass, the light cube is far from the AABBs at both ends of the
+  // motion; an obstacle it moves through there is still paired with the proxy by the broadphase
+  Eigen::Vector3d center = 0.5 * (start * centers[0] + end * centers[0]);
+  Eigen::Vector3d light_cube = center + q_start.slerp(0.5, q_end) * (Eigen::Vector3d(-1.0, 0.0, 0.0) - centers[0]);
+  EXPECT_LT(light_cube.y(), -1.5);
+  fcl::CollisionObject obstacle(boost::shared_ptr<fcl::CollisionGeometry>(new fcl::Box(0.1, 0.1, 0.1)),
+                                collision_detection::transform2fcl(Eigen::Affine3d(Eigen::Translation3d(light_cube))));
+  EXPECT_TRUE(proxy.overlap(obstacle.getAABB()));
+}
+
+TEST_F(FclCollisionDetectionTester, CompiledCollisionMatrix)
+{
+  acm_->setEntry("base_link", "base_bellow_link", false);
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+  acm_->setEntry("box", "base_link", true);
+  acm_->setDefaultEntry("r_gripper_palm_link", false);
+
+  collision_detection::CompiledAllowedCollisionMatrix cacm(*acm_, kmodel_);
+  ASSERT_TRUE(cacm.getCompiled() == &cacm);
+  ASSERT_TRUE(acm_->getCompiled() == NULL);
+  EXPECT_NE(collision_detection::CompiledAllowedCollisionMatrix::NO_INDEX, cacm.getIndex("box"));
+  EXPECT_EQ(collision_detection::CompiledAllowedCollisionMatrix::NO_INDEX, cacm.getIndex("unknown_object"));
+
+  // index based lookups agree with name based ones
+  std::vector<std::string> names;
+  acm_->getAllEntryNames(names);
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+    for (std::size_t j = 0 ; j < names.size() ; ++j)
+    {
+      collision_detection::AllowedCollision::Type t1 = collision_detection::AllowedCollision::NEVER;
+      collision_detection::AllowedCollision::Type t2 = collision_detection::AllowedCollision::NEVER;
+      bool f1 = acm_->getAllowedCollision(names[i], names[j], t1);
+      bool f2 = cacm.getAllowedCollision(cacm.getIndex(names[i]), cacm.getIndex(names[j]), t2);
+      ASSERT_EQ(f1, f2);
+      ASSERT_EQ(t1, t2);
+    }
+  std::size_t link_index = cacm.getIndex(kmodel_->getLinkModel("base_link"));
+  ASSERT_EQ(cacm.getIndex("base_link"), link_index);
+
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  kstate.updateStateWithLinkAt("base_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("base_bellow_link", offset);
+  kstate.update();
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res1;
+  crobot_->checkSelfCollision(req, res1, kstate, cacm);
+  ASSERT_TRUE(res1.collision);
+
+  // modifying the matrix disables the lookup table until it is compiled again
+  cacm.setEntry("base_link", "base_bellow_link", true);
+  ASSERT_TRUE(cacm.getCompiled() == NULL);
+  collision_detection::CollisionResult res2;
+  crobot_->checkSelfCollision(req, res2, kstate, cacm);
+  ASSERT_FALSE(res2.collision);
+
+  cacm.compile();
+  ASSERT_TRUE(cacm.getCompiled() == &cacm);
+  collision_detection::CollisionResult res3;
+  crobot_->checkSelfCollision(req, res3, kstate, cacm);
+  ASSERT_FALSE(res3.collision);
+
+  // a compiled matrix can be owned and destroyed as a plain matrix
+  collision_detection::AllowedCollisionMatrix *base = new collision_detection::CompiledAllowedCollisionMatrix(cacm, kmodel_);
+  ASSERT_TRUE(base->getCompiled() == base);
+  collision_detection::CollisionResult res4;
+  crobot_->checkSelfCollision(req, res4, kstate, *base);
+  ASSERT_FALSE(res4.collision);
+  delete base;
+}
+
+TEST_F(FclCollisionDetectionTester, CompiledCollisionMatrixWorld)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // a box inside the base of the robot
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().z() = 0.3;
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.5, 0.5, 0.5)), pos);
+
+  std::vector<std::string> names(1, "box");
+  collision_detection::CompiledAllowedCollisionMatrix cacm(*acm_, kmodel_, names);
+  ASSERT_TRUE(cacm.getCompiled() == &cacm);
+  ASSERT_NE(collision_detection::CompiledAllowedCollisionMatrix::NO_INDEX, cacm.getIndex("box"));
+
+  // the lookup table gives the same results as the names in the collision and distance callbacks
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res1;
+  cworld_->checkRobotCollision(req, res1, *crobot_, kstate, *acm_);
+  ASSERT_TRUE(res1.collision);
+  collision_detection::CollisionResult res2;
+  cworld_->checkRobotCollision(req, res2, *crobot_, kstate, cacm);
+  ASSERT_TRUE(res2.collision);
+  EXPECT_DOUBLE_EQ(cworld_->distanceRobot(*crobot_, kstate, *acm_), cworld_->distanceRobot(*crobot_, kstate, cacm));
+
+  acm_->setDefaultEntry("box", true);
+  collision_detection::CompiledAllowedCollisionMatrix allowed(*acm_, kmodel_, names);
+  ASSERT_TRUE(allowed.getCompiled() == &allowed);
+  collision_detection::CollisionResult res3;
+  cworld_->checkRobotCollision(req, res3, *crobot_, kstate, allowed);
+  ASSERT_FALSE(res3.collision);
+  EXPECT_DOUBLE_EQ(cworld_->distanceRobot(*crobot_, kstate, *acm_), cworld_->distanceRobot(*crobot_, kstate, allowed));
+}
+
 TEST_F(FclCollisionDetectionTester, ContactReporting)
 {
   collision_detection::CollisionRequest req;
@@ -0,0 +1,82 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_DETECTOR_ALLOCATOR_HYBRID_
+#define MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_DETECTOR_ALLOCATOR_HYBRID_
+
+#include <moveit/collision_detection/collision_detector_allocator.h>
+#include <moveit/collision_distance_field/collision_robot_hybrid.h>
+#include <moveit/collision_distance_field/collision_world_hybrid.h>
+
+namespace collision_detection
+{
+  /** \brief An allocator for collision detectors that check the spheres of the robot against a distance field of the world */
+  class CollisionDetectorAllocatorHybrid : public CollisionDetectorAllocatorTemplate<CollisionWorldHybrid, CollisionRobotHybrid, CollisionDetectorAllocatorHybrid>
+  {
+    typedef CollisionDetectorAllocatorTemplate<CollisionWorldHybrid, CollisionRobotHybrid, CollisionDetectorAllocatorHybrid> Base;
+
+  public:
+    static const std::string NAME_; // defined in collision_world_hybrid.cpp
+
+    CollisionDetectorAllocatorHybrid()
+    {
+    }
+
+    /** \brief The worlds allocated from scratch use a distance field described by \e params */
+    explicit CollisionDetectorAllocatorHybrid(const DistanceFieldParameters &params)
+      : params_(params)
+    {
+    }
+
+    using Base::allocateWorld;
+
+    virtual CollisionWorldPtr allocateWorld(const WorldPtr& world) const
+    {
+      return CollisionWorldPtr(new CollisionWorldHybrid(world, params_));
+    }
+
+    using Base::create;
+
+    /** \brief Create an allocator whose worlds use a distance field described by \e params */
+    static CollisionDetectorAllocatorPtr create(const DistanceFieldParameters &params)
+    {
+      return CollisionDetectorAllocatorPtr(new CollisionDetectorAllocatorHybrid(params));
+    }
+
+  private:
+    DistanceFieldParameters params_;
+  };
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_DETECTOR_HYBRID_PLUGIN_LOADER_
+#define MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_DETECTOR_HYBRID_PLUGIN_LOADER_
+
+#include <moveit/collision_detection/collision_plugin.h>
+#include <moveit/collision_distance_field/collision_world_hybrid.h>
+
+namespace collision_detection
+{
+  /** \brief Makes the hybrid collision detector available to the CollisionPluginLoader under the name "HYBRID".
+
+      The distance field is configured by the parameters size_x, size_y, size_z, origin_x, origin_y, origin_z,
+      resolution, max_propagation_distance and collision_tolerance; see DistanceFieldParameters. */
+  class CollisionDetectorHybridPluginLoader : public CollisionPlugin
+  {
+  public:
+    virtual bool initialize(const planning_scene::PlanningScenePtr& scene, bool exclusive) const;
+    virtual void setParameters(const std::map<std::string, double>& parameters);
+
+  private:
+    DistanceFieldParameters params_;
+  };
+}
+
+#endif
@@ -0,0 +1,125 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_DISTANCE_FIELD_TYPES_
+#define MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_DISTANCE_FIELD_TYPES_
+
+#include <moveit/collision_detection/collision_common.h>
+#include <geometric_shapes/shapes.h>
+#include <eigen_stl_containers/eigen_stl_containers.h>
+#include <boost/shared_ptr.hpp>
+#include <limits>
+
+namespace collision_detection
+{
+
+  /** \brief A sphere used to approximate the geometry of a body, with its center given in the frame of the body */
+  struct CollisionSphere
+  {
+    CollisionSphere(const Eigen::Vector3d &relative_vec, double radius) :
+      relative_vec_(relative_vec),
+      radius_(radius)
+    {
+    }
+
+    Eigen::Vector3d relative_vec_;
+    double          radius_;
+  };
+
+  /** \brief The spheres of one body of the robot, along with their distances to the world and the gradients of those distances */
+  struct GradientInfo
+  {
+    GradientInfo() : closest_distance(std::numeric_limits<double>::max()),
+                     collision(false),
+                     body_type(BodyTypes::ROBOT_LINK)
+    {
+    }
+
+    /** \brief Clear the spheres and results, keeping the allocated memory */
+    void clear()
+    {
+      closest_distance = std::numeric_limits<double>::max();
+      collision = false;
+      sphere_locations.clear();
+      distances.clear();
+      gradients.clear();
+      sphere_radii.clear();
+    }
+
+    /** \brief The smallest distance between the surface of a sphere and the world */
+    double                    closest_distance;
+
+    /** \brief True if any of the spheres is in collision */
+    bool                      collision;
+
+    /** \brief The centers of the spheres, in the world frame */
+    EigenSTL::vector_Vector3d sphere_locations;
+
+    /** \brief The distances from the sphere centers to the world */
+    std::vector<double>       distances;
+
+    /** \brief The gradients of the distances at the sphere centers; they point away from the closest obstacles */
+    EigenSTL::vector_Vector3d gradients;
+
+    /** \brief The radii of the spheres */
+    std::vector<double>       sphere_radii;
+
+    /** \brief The name of the link or attached body the spheres approximate */
+    std::string               body_name;
+
+    /** \brief The type of the body the spheres approximate */
+    BodyType                  body_type;
+
+    /** \brief The name of the joint that moves the body */
+    std::string               joint_name;
+  };
+
+  /** \brief The spheres of a group of the robot at a particular state, one entry for each body */
+  struct GroupStateRepresentation
+  {
+    std::vector<GradientInfo> gradients_;
+  };
+
+  typedef boost::shared_ptr<GroupStateRepresentation> GroupStateRepresentationPtr;
+
+  /** \brief Compute spheres that together contain a shape, in the frame of the shape.
+
+      The shape, grown by \e padding and scaled by \e scale, is enclosed by a cylinder along its longest axis, and the
+      cylinder is covered by a row of overlapping spheres. Boxes and meshes are handled through their axis-aligned bounding
+      box. Planes and octrees cannot be approximated and produce no spheres. The spheres are appended to \e spheres.
+      \return False if the shape type is not supported */
+  bool determineCollisionSpheres(const shapes::Shape *shape, double padding, double scale, std::vector<CollisionSphere> &spheres);
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_ROBOT_HYBRID_
+#define MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_ROBOT_HYBRID_
+
+#include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <moveit/collision_distance_field/collision_distance_field_types.h>
+
+namespace collision_detection
+{
+
+  /** \brief A collision robot that approximates each link by a set of spheres, for checks against the distance field of a
+      CollisionWorldHybrid. Self collisions and collisions with other robots are checked by FCL. */
+  class CollisionRobotHybrid : public CollisionRobotFCL
+  {
+  public:
+
+    CollisionRobotHybrid(const robot_model::RobotModelConstPtr &kmodel, double padding = 0.0, double scale = 1.0);
+
+    CollisionRobotHybrid(const CollisionRobotHybrid &other);
+
+    /** \brief The spheres that contain the collision geometry of \e link, with centers in the frame of the link. The padding
+        and scaling of the link are included. Links without collision geometry have no spheres. */
+    const std::vector<CollisionSphere>& getLinkSpheres(const robot_model::LinkModel *link) const
+    {
+      return link_spheres_[link->getLinkIndex()];
+    }
+
+    /** \brief Check whether the spheres of \e link cover all of its collision geometry. Links with shapes that cannot be
+        approximated by spheres (such as octrees) are checked against the world by FCL. */
+    bool hasCompleteLinkSpheres(const robot_model::LinkModel *link) const
+    {
+      return link_spheres_complete_[link->getLinkIndex()];
+    }
+
+  protected:
+
+    virtual void updatedPaddingOrScaling(const std::vector<std::string> &links);
+
+  private:
+
+    void updateLinkSpheres(const robot_model::LinkModel *link);
+
+    /** \brief The spheres of each link, indexed by link index */
+    std::vector<std::vector<CollisionSphere> > link_spheres_;
+
+    /** \brief Whether the spheres of each link cover all of its shapes, indexed by link index */
+    std::vector<bool>                          link_spheres_complete_;
+  };
+
+  typedef boost::shared_ptr<CollisionRobotHybrid> CollisionRobotHybridPtr;
+  typedef boost::shared_ptr<const CollisionRobotHybrid> CollisionRobotHybridConstPtr;
+}
+
+#endif
@@ -0,0 +1,215 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_WORLD_HYBRID_
+#define MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_WORLD_HYBRID_
+
+#include <moveit/collision_detection_fcl/collision_world_fcl.h>
+#include <moveit/collision_distance_field/collision_robot_hybrid.h>
+#include <moveit/distance_field/propagation_distance_field.h>
+#include <boost/thread/mutex.hpp>
+
+namespace collision_detection
+{
+
+  /** \brief The volume covered by the distance field of a CollisionWorldHybrid and how it is computed.
+
+      The field is dense, so its memory grows with the volume divided by the cube of the resolution: about 44 bytes
+      per voxel, or 22 MB for the defaults. Every CollisionWorldHybrid that changes its world holds a field of its own. */
+  struct DistanceFieldParameters
+  {
+    /** \brief A 2x2x2 m volume around an arm mounted at the origin, from the ground up, with 2.5 cm voxels */
+    DistanceFieldParameters();
+
+    /** \brief The number of voxels of the field */
+    std::size_t getVoxelCount() const;
+
+    /** \brief The approximate memory used by the field, in bytes */
+    std::size_t getMemoryUsage() const;
+
+    /** \brief The size of the volume along each axis */
+    Eigen::Vector3d size;
+
+    /** \brief The corner of the volume with the smallest coordinates */
+    Eigen::Vector3d origin;
+
+    /** \brief The size of a voxel */
+    double resolution;
+
+    /** \brief Distances larger than this are not computed */
+    double max_propagation_distance;
+
+    /** \brief Spheres closer to the world than this distance are reported as colliding */
+    double collision_tolerance;
+  };
+
+  /** \brief A collision world that, in addition to the FCL representation of its objects, keeps a signed
+      PropagationDistanceField of them.
+
+      Discrete collision and distance queries for a CollisionRobotHybrid are answered by looking up the distance of each
+      sphere of the robot in the field, so their cost only depends on the number of spheres. Queries for other robots,
+      continuous queries and queries between worlds are answered by FCL.
+
+      Distances read from the field are reduced by half the diagonal of a voxel, so that a surface lying between voxel
+      centers is never reported further away than it is.
+
+      Objects are voxelized when they are added or changed, and the field is updated incrementally. A world copied from
+      another one shares its field until one of them is changed. As the field merges all objects, a link is only
+      excluded by the allowed collision matrix if it is allowed to collide with every object of the world; while a
+      link or attached body is allowed to collide with only some of the objects, the queries are answered by FCL.
+
+      The field only covers a bounded volume. While an object of the world is not entirely represented in it (because
+      it extends beyond the volume, or one of its shapes cannot be voxelized or is too thin to contain a voxel center),
+      or a sphere of the robot lies outside of it, the queries are answered by FCL instead. So are queries for robots with
+      links or attached bodies whose shapes cannot be approximated by spheres. */
+  class CollisionWorldHybrid : public CollisionWorldFCL
+  {
+  public:
+
+    /** \brief The body name reported for the world in contacts found in the distance field */
+    static const std::string DISTANCE_FIELD_ID_;
+
+    CollisionWorldHybrid();
+    explicit CollisionWorldHybrid(const WorldPtr& world);
+    CollisionWorldHybrid(const WorldPtr& world, const DistanceFieldParameters &params);
+    CollisionWorldHybrid(const CollisionWorldHybrid &other, const WorldPtr& world);
+    virtual ~CollisionWorldHybrid();
+
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const;
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+
+    // continuous checks are done by FCL
+    using CollisionWorldFCL::checkRobotCollision;
+
+    virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const;
+    virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+
+    // distances between worlds are computed by FCL
+    using CollisionWorldFCL::distanceRobot;
+
+    /** \brief Compute the distances and distance gradients of the spheres of \e robot, which must be a CollisionRobotHybrid.
+        The bodies of the group named in \e req (or the whole robot) are reported in \e gsr, which is allocated if needed;
+        \e res is filled as by checkRobotCollision(), so it may come from FCL. */
+    void getCollisionGradients(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                               const robot_state::RobotState &state, const AllowedCollisionMatrix *acm,
+                               GroupStateRepresentationPtr &gsr) const;
+
+    /** \brief Set the volume covered by the distance field and rebuild it */
+    void setDistanceFieldParameters(const DistanceFieldParameters &params);
+
+    /** \brief Get the volume covered by the distance field */
+    const DistanceFieldParameters& getDistanceFieldParameters() const
+    {
+      return params_;
+    }
+
+    /** \brief Spheres closer to the world than this distance are reported as colliding */
+    void setCollisionTolerance(double tolerance)
+    {
+      params_.collision_tolerance = tolerance;
+    }
+
+    /** \brief Get the distance below which spheres are reported as colliding */
+    double getCollisionTolerance() const
+    {
+      return params_.collision_tolerance;
+    }
+
+    /** \brief Check whether every object of the world is entirely represented in the distance field */
+    bool isWorldInDistanceField() const;
+
+    /** \brief Get the distance field of the world */
+    const distance_field::PropagationDistanceField& getDistanceField() const;
+
+    virtual void setWorld(const WorldPtr& world);
+
+  private:
+
+    struct DistanceFieldData;
+
+    /** \brief How many objects of the world a body is allowed to collide with */
+    enum WorldAllowance
+    {
+      ALLOWED_NONE,
+      ALLOWED_SOME,
+      ALLOWED_ALL
+    };
+
+    void initialize();
+    void checkRobotSpheres(const CollisionRequest &req, CollisionResult &res, const CollisionRobotHybrid &robot,
+                           const robot_state::RobotState &state, const AllowedCollisionMatrix *acm,
+                           GroupStateRepresentation &gsr) const;
+    /** \brief Fill \e gsr with the spheres of the robot and their distances in the field. Return false if the field
+        cannot answer the query, because a sphere lies outside of it or a body has a partial allowance in \e acm */
+    bool getSphereDistances(const CollisionRequest &req, const CollisionRobotHybrid &robot, const robot_state::RobotState &state,
+                            const AllowedCollisionMatrix *acm, GroupStateRepresentation &gsr) const;
+    WorldAllowance getWorldAllowance(const std::string &name, const AllowedCollisionMatrix *acm) const;
+
+    /** \brief The allowance of every link of a robot model, for a revision of an allowed collision matrix and the
+        objects of the world at some revision */
+    struct LinkAllowances
+    {
+      robot_model::RobotModelConstPtr model_;
+      std::size_t                     acm_revision_;
+      std::size_t                     world_revision_;
+
+      /** \brief Indexed by link index */
+      std::vector<WorldAllowance>     allowances_;
+    };
+    typedef boost::shared_ptr<const LinkAllowances> LinkAllowancesConstPtr;
+
+    /** \brief Get the allowances of the links of \e model in \e acm; they are only computed again when the revision of
+        the matrix, the model or the objects of the world change */
+    LinkAllowancesConstPtr getLinkAllowances(const robot_model::RobotModelConstPtr &model, const AllowedCollisionMatrix &acm) const;
+    double distanceRobotHybrid(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+
+    void rebuildDistanceField();
+    void notifyObjectChange(const ObjectConstPtr& obj, World::Action action);
+
+    DistanceFieldParameters                params_;
+
+    /** \brief The distance field and the voxels of each object; shared with copies of this world until either is changed */
+    boost::shared_ptr<DistanceFieldData>   distance_field_data_;
+
+    World::ObserverHandle                  observer_handle_;
+
+    /** \brief Incremented every time an object is added to or removed from the world */
+    std::size_t                            world_revision_;
+
+    mutable boost::mutex                   link_allowances_lock_;
+    mutable LinkAllowancesConstPtr         link_allowances_;
+  };
+}
+
+#endif
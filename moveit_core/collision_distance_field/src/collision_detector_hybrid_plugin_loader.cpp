@@ -0,0 +1,82 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_distance_field/collision_detector_hybrid_plugin_loader.h>
+#include <moveit/collision_distance_field/collision_detector_allocator_hybrid.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <pluginlib/class_list_macros.h>
+#include <console_bridge/console.h>
+
+namespace
+{
+void readParameter(const std::map<std::string, double>& parameters, const std::string &name, double &value)
+{
+  std::map<std::string, double>::const_iterator it = parameters.find(name);
+  if (it != parameters.end())
+    value = it->second;
+}
+}
+
+bool collision_detection::CollisionDetectorHybridPluginLoader::initialize(const planning_scene::PlanningScenePtr& scene, bool exclusive) const
+{
+  scene->setActiveCollisionDetector(CollisionDetectorAllocatorHybrid::create(params_), exclusive);
+  return true;
+}
+
+// The volume of the field is read from the "collision_detector_parameters" map (size_x, size_y, size_z, origin_x,
+// origin_y, origin_z, resolution, max_propagation_distance and collision_tolerance). The field is dense and every scene
+// whose world differs from its parent's holds its own, so large volumes at fine resolutions quickly cost hundreds of MB.
+void collision_detection::CollisionDetectorHybridPluginLoader::setParameters(const std::map<std::string, double>& parameters)
+{
+  params_ = DistanceFieldParameters();
+  readParameter(parameters, "size_x", params_.size.x());
+  readParameter(parameters, "size_y", params_.size.y());
+  readParameter(parameters, "size_z", params_.size.z());
+  readParameter(parameters, "origin_x", params_.origin.x());
+  readParameter(parameters, "origin_y", params_.origin.y());
+  readParameter(parameters, "origin_z", params_.origin.z());
+  readParameter(parameters, "resolution", params_.resolution);
+  readParameter(parameters, "max_propagation_distance", params_.max_propagation_distance);
+  readParameter(parameters, "collision_tolerance", params_.collision_tolerance);
+
+  if (params_.resolution <= 0.0 || params_.size.minCoeff() < params_.resolution)
+  {
+    logError("Invalid distance field parameters for the HYBRID collision detector; using the defaults");
+    params_ = DistanceFieldParameters();
+  }
+  logInform("The distance field of the HYBRID collision detector has %u voxels and uses about %.1f MB per world",
+            (unsigned int)params_.getVoxelCount(), params_.getMemoryUsage() / (1024.0 * 1024.0));
+}
+
+PLUGINLIB_EXPORT_CLASS(collision_detection::CollisionDetectorHybridPluginLoader, collision_detection::CollisionPlugin)
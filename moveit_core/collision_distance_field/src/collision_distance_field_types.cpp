@@ -0,0 +1,123 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_distance_field/collision_distance_field_types.h>
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace collision_detection
+{
+
+namespace
+{
+
+// cover a cylinder with a row of spheres; the spacing is at most the cylinder radius, so that each sphere
+// circumscribes a short slice of the cylinder without growing much beyond it
+void addCylinderSpheres(const Eigen::Vector3d &center, const Eigen::Vector3d &axis, double radius, double length,
+                        std::vector<CollisionSphere> &spheres)
+{
+  int count = radius > 0.0 ? std::max(1, (int)ceil(length / radius)) : 1;
+  double spacing = length / count;
+  double sphere_radius = sqrt(radius * radius + 0.25 * spacing * spacing);
+  for (int i = 0 ; i < count ; ++i)
+    spheres.push_back(CollisionSphere(center + axis * (-0.5 * length + (i + 0.5) * spacing), sphere_radius));
+}
+
+void addBoxSpheres(const Eigen::Vector3d &center, const Eigen::Vector3d &size, std::vector<CollisionSphere> &spheres)
+{
+  int longest;
+  size.maxCoeff(&longest);
+  double a = size[(longest + 1) % 3];
+  double b = size[(longest + 2) % 3];
+  addCylinderSpheres(center, Eigen::Vector3d::Unit(longest), 0.5 * sqrt(a * a + b * b), size[longest], spheres);
+}
+
+}
+
+bool determineCollisionSpheres(const shapes::Shape *shape, double padding, double scale, std::vector<CollisionSphere> &spheres)
+{
+  // scale and pad the same way the FCL collision geometry is
+  if (fabs(scale - 1.0) > std::numeric_limits<double>::epsilon() || fabs(padding) > std::numeric_limits<double>::epsilon())
+  {
+    boost::scoped_ptr<shapes::Shape> scaled_shape(shape->clone());
+    scaled_shape->scaleAndPadd(scale, padding);
+    return determineCollisionSpheres(scaled_shape.get(), 0.0, 1.0, spheres);
+  }
+
+  switch (shape->type)
+  {
+  case shapes::SPHERE:
+    spheres.push_back(CollisionSphere(Eigen::Vector3d::Zero(), static_cast<const shapes::Sphere*>(shape)->radius));
+    return true;
+  case shapes::CYLINDER:
+    {
+      const shapes::Cylinder *cylinder = static_cast<const shapes::Cylinder*>(shape);
+      addCylinderSpheres(Eigen::Vector3d::Zero(), Eigen::Vector3d::UnitZ(), cylinder->radius, cylinder->length, spheres);
+      return true;
+    }
+  case shapes::CONE:
+    {
+      const shapes::Cone *cone = static_cast<const shapes::Cone*>(shape);
+      addCylinderSpheres(Eigen::Vector3d::Zero(), Eigen::Vector3d::UnitZ(), cone->radius, cone->length, spheres);
+      return true;
+    }
+  case shapes::BOX:
+    {
+      const shapes::Box *box = static_cast<const shapes::Box*>(shape);
+      addBoxSpheres(Eigen::Vector3d::Zero(), Eigen::Vector3d(box->size[0], box->size[1], box->size[2]), spheres);
+      return true;
+    }
+  case shapes::MESH:
+    {
+      const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
+      if (mesh->vertex_count == 0)
+        return true;
+      Eigen::Vector3d min_corner = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+      Eigen::Vector3d max_corner = -min_corner;
+      for (unsigned int i = 0 ; i < mesh->vertex_count ; ++i)
+      {
+        Eigen::Vector3d v(mesh->vertices[3 * i], mesh->vertices[3 * i + 1], mesh->vertices[3 * i + 2]);
+        min_corner = min_corner.cwiseMin(v);
+        max_corner = max_corner.cwiseMax(v);
+      }
+      addBoxSpheres(0.5 * (min_corner + max_corner), max_corner - min_corner, spheres);
+      return true;
+    }
+  default:
+    return false;
+  }
+}
+
+}
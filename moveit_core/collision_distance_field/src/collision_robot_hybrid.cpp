@@ -0,0 +1,84 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_distance_field/collision_robot_hybrid.h>
+
+collision_detection::CollisionRobotHybrid::CollisionRobotHybrid(const robot_model::RobotModelConstPtr &kmodel, double padding, double scale)
+  : CollisionRobotFCL(kmodel, padding, scale)
+{
+  link_spheres_.resize(robot_model_->getLinkModelCount());
+  link_spheres_complete_.resize(robot_model_->getLinkModelCount(), true);
+  const std::vector<const robot_model::LinkModel*>& links = robot_model_->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    updateLinkSpheres(links[i]);
+}
+
+collision_detection::CollisionRobotHybrid::CollisionRobotHybrid(const CollisionRobotHybrid &other)
+  : CollisionRobotFCL(other)
+  , link_spheres_(other.link_spheres_)
+  , link_spheres_complete_(other.link_spheres_complete_)
+{
+}
+
+void collision_detection::CollisionRobotHybrid::updateLinkSpheres(const robot_model::LinkModel *link)
+{
+  std::vector<CollisionSphere> &spheres = link_spheres_[link->getLinkIndex()];
+  spheres.clear();
+  link_spheres_complete_[link->getLinkIndex()] = true;
+  const std::vector<shapes::ShapeConstPtr> &shapes = link->getShapes();
+  const EigenSTL::vector_Affine3d &origins = link->getCollisionOriginTransforms();
+  for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+  {
+    std::size_t first = spheres.size();
+    if (!determineCollisionSpheres(shapes[j].get(), getLinkPadding(link->getName()), getLinkScale(link->getName()), spheres))
+    {
+      logWarn("Unable to approximate shape %u of link '%s' by spheres; the link is checked against the world by FCL",
+              (unsigned int)j, link->getName().c_str());
+      link_spheres_complete_[link->getLinkIndex()] = false;
+    }
+    for (std::size_t k = first ; k < spheres.size() ; ++k)
+      spheres[k].relative_vec_ = origins[j] * spheres[k].relative_vec_;
+  }
+}
+
+void collision_detection::CollisionRobotHybrid::updatedPaddingOrScaling(const std::vector<std::string> &links)
+{
+  CollisionRobotFCL::updatedPaddingOrScaling(links);
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const robot_model::LinkModel *lmodel = robot_model_->getLinkModel(links[i]);
+    if (lmodel)
+      updateLinkSpheres(lmodel);
+  }
+}
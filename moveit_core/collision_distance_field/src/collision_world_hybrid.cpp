@@ -0,0 +1,620 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_distance_field/collision_world_hybrid.h>
+#include <moveit/distance_field/find_internal_points.h>
+#include <geometric_shapes/bodies.h>
+#include <octomap/octomap.h>
+#include <boost/unordered_map.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/bind.hpp>
+#include <console_bridge/console.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+
+namespace collision_detection
+{
+
+const std::string CollisionWorldHybrid::DISTANCE_FIELD_ID_("<distance_field>");
+
+DistanceFieldParameters::DistanceFieldParameters()
+  : size(2.0, 2.0, 2.0)
+  , origin(-1.0, -1.0, 0.0)
+  , resolution(0.025)
+  , max_propagation_distance(0.25)
+  , collision_tolerance(0.0)
+{
+}
+
+std::size_t DistanceFieldParameters::getVoxelCount() const
+{
+  return (std::size_t)ceil(size.x() / resolution) * (std::size_t)ceil(size.y() / resolution) * (std::size_t)ceil(size.z() / resolution);
+}
+
+std::size_t DistanceFieldParameters::getMemoryUsage() const
+{
+  // every voxel keeps its propagation state and a float copy of its distance for the interpolated queries
+  return getVoxelCount() * (sizeof(distance_field::PropDistanceFieldVoxel) + sizeof(float));
+}
+
+struct CollisionWorldHybrid::DistanceFieldData
+{
+  explicit DistanceFieldData(const DistanceFieldParameters &params)
+    : field_(new distance_field::PropagationDistanceField(params.size.x(), params.size.y(), params.size.z(), params.resolution,
+                                                          params.origin.x(), params.origin.y(), params.origin.z(),
+                                                          params.max_propagation_distance, true))
+    , resolution_(params.resolution)
+  {
+    field_->setFloatDistanceCache(true);
+  }
+
+  std::size_t getVoxelKey(const Eigen::Vector3i &voxel) const
+  {
+    return ((std::size_t)voxel.x() * field_->getYNumCells() + voxel.y()) * field_->getZNumCells() + voxel.z();
+  }
+
+  Eigen::Vector3d getVoxelCenter(const Eigen::Vector3i &voxel) const
+  {
+    Eigen::Vector3d center;
+    field_->gridToWorld(voxel.x(), voxel.y(), voxel.z(), center.x(), center.y(), center.z());
+    return center;
+  }
+
+  /** \brief Distances in the field are measured to the centers of occupied voxels, while the surface of an object may lie
+      anywhere around them; the distance from the center of a voxel to its corners bounds that error */
+  double getDiscretizationMargin() const
+  {
+    return resolution_ * sqrt(3.0) / 2.0;
+  }
+
+  bool addVoxel(const Eigen::Vector3d &point, std::vector<Eigen::Vector3i> &voxels) const
+  {
+    Eigen::Vector3i voxel;
+    if (!field_->worldToGrid(point.x(), point.y(), point.z(), voxel.x(), voxel.y(), voxel.z()))
+      return false;
+    voxels.push_back(voxel);
+    return true;
+  }
+
+  /** \brief Compute the voxels of the field that are inside the shapes of \e obj. Return false if part of the object
+      could not be represented, because it is outside of the field or its shape cannot be voxelized. */
+  bool getObjectVoxels(const World::Object &obj, std::vector<Eigen::Vector3i> &voxels) const
+  {
+    voxels.clear();
+    bool complete = true;
+    EigenSTL::vector_Vector3d points;
+    for (std::size_t i = 0 ; i < obj.shapes_.size() ; ++i)
+    {
+      if (obj.shapes_[i]->type == shapes::OCTREE)
+      {
+        const octomap::OcTree *octree = static_cast<const shapes::OcTree*>(obj.shapes_[i].get())->octree.get();
+        for (octomap::OcTree::leaf_iterator it = octree->begin_leafs(), end = octree->end_leafs() ; it != end ; ++it)
+          if (octree->isNodeOccupied(*it))
+          {
+            // leaves larger than a voxel are filled with points spaced by the resolution of the field
+            int steps = it.getSize() > resolution_ ? (int)ceil(it.getSize() / resolution_) : 1;
+            double first = -0.5 * (steps - 1) * resolution_;
+            for (int x = 0 ; x < steps ; ++x)
+              for (int y = 0 ; y < steps ; ++y)
+                for (int z = 0 ; z < steps ; ++z)
+                  if (!addVoxel(obj.shape_poses_[i] * Eigen::Vector3d(it.getX() + first + x * resolution_,
+                                                                      it.getY() + first + y * resolution_,
+                                                                      it.getZ() + first + z * resolution_), voxels))
+                    complete = false;
+          }
+        continue;
+      }
+
+      boost::scoped_ptr<bodies::Body> body(bodies::createBodyFromShape(obj.shapes_[i].get()));
+      if (!body)
+      {
+        logDebug("Unable to add a shape of object '%s' to the distance field; FCL is used while it is in the world", obj.id_.c_str());
+        complete = false;
+        continue;
+      }
+      body->setPose(obj.shape_poses_[i]);
+      points.clear();
+      distance_field::findInternalPointsConvex(*body, resolution_, points);
+      if (points.empty())
+      {
+        // the shape is thinner than a voxel; leaving it out of the field would hide it from the queries
+        logDebug("A shape of object '%s' contains no voxel center of the distance field; FCL is used while it is in the world", obj.id_.c_str());
+        complete = false;
+        continue;
+      }
+      for (std::size_t j = 0 ; j < points.size() ; ++j)
+        if (!addVoxel(points[j], voxels))
+          complete = false;
+    }
+
+    std::sort(voxels.begin(), voxels.end(), distance_field::compareEigen_Vector3i());
+    voxels.erase(std::unique(voxels.begin(), voxels.end()), voxels.end());
+    return complete;
+  }
+
+  /** \brief Record whether object \e id is entirely represented in the field */
+  void setObjectComplete(const std::string &id, bool complete)
+  {
+    if (complete)
+      incomplete_objects_.erase(id);
+    else
+      incomplete_objects_.insert(id);
+  }
+
+  /** \brief Replace the voxels of object \e id, updating only the voxels of the field that change */
+  void setObjectVoxels(const std::string &id, const std::vector<Eigen::Vector3i> &voxels)
+  {
+    EigenSTL::vector_Vector3d removed_points;
+    EigenSTL::vector_Vector3d added_points;
+
+    std::map<std::string, std::vector<Eigen::Vector3i> >::iterator it = object_voxels_.find(id);
+    if (it != object_voxels_.end())
+    {
+      for (std::size_t i = 0 ; i < it->second.size() ; ++i)
+      {
+        boost::unordered_map<std::size_t, unsigned int>::iterator count = voxel_counts_.find(getVoxelKey(it->second[i]));
+        if (--count->second == 0)
+        {
+          voxel_counts_.erase(count);
+          removed_points.push_back(getVoxelCenter(it->second[i]));
+        }
+      }
+      if (voxels.empty())
+        object_voxels_.erase(it);
+    }
+
+    for (std::size_t i = 0 ; i < voxels.size() ; ++i)
+      if (++voxel_counts_[getVoxelKey(voxels[i])] == 1)
+        added_points.push_back(getVoxelCenter(voxels[i]));
+    if (!voxels.empty())
+      object_voxels_[id] = voxels;
+
+    // voxels that are both removed and added are left untouched by the update
+    if (removed_points.empty())
+      field_->addPointsToField(added_points);
+    else
+      field_->updatePointsInField(removed_points, added_points);
+  }
+
+  /** \brief Add the voxels of all objects to an empty field at once */
+  void addAllObjects()
+  {
+    EigenSTL::vector_Vector3d points;
+    for (std::map<std::string, std::vector<Eigen::Vector3i> >::const_iterator it = object_voxels_.begin() ; it != object_voxels_.end() ; ++it)
+      for (std::size_t i = 0 ; i < it->second.size() ; ++i)
+        if (++voxel_counts_[getVoxelKey(it->second[i])] == 1)
+          points.push_back(getVoxelCenter(it->second[i]));
+    field_->addPointsToField(points);
+  }
+
+  boost::scoped_ptr<distance_field::PropagationDistanceField> field_;
+  double resolution_;
+
+  /** \brief The voxels of each object, sorted */
+  std::map<std::string, std::vector<Eigen::Vector3i> > object_voxels_;
+
+  /** \brief The number of objects occupying each voxel of the field */
+  boost::unordered_map<std::size_t, unsigned int> voxel_counts_;
+
+  /** \brief The objects that are only partially represented in the field */
+  std::set<std::string> incomplete_objects_;
+};
+
+}
+
+collision_detection::CollisionWorldHybrid::CollisionWorldHybrid()
+  : CollisionWorldFCL()
+  , world_revision_(0)
+{
+  initialize();
+}
+
+collision_detection::CollisionWorldHybrid::CollisionWorldHybrid(const WorldPtr& world)
+  : CollisionWorldFCL(world)
+  , world_revision_(0)
+{
+  initialize();
+}
+
+collision_detection::CollisionWorldHybrid::CollisionWorldHybrid(const WorldPtr& world, const DistanceFieldParameters &params)
+  : CollisionWorldFCL(world)
+  , params_(params)
+  , world_revision_(0)
+{
+  initialize();
+}
+
+collision_detection::CollisionWorldHybrid::CollisionWorldHybrid(const CollisionWorldHybrid &other, const WorldPtr& world)
+  : CollisionWorldFCL(other, world)
+  , params_(other.params_)
+  , distance_field_data_(other.distance_field_data_)
+  , world_revision_(0)
+{
+  // the world is a copy of the world of other, so the field is shared until either of them changes
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldHybrid::notifyObjectChange, this, _1, _2));
+}
+
+collision_detection::CollisionWorldHybrid::~CollisionWorldHybrid()
+{
+  getWorld()->removeObserver(observer_handle_);
+}
+
+void collision_detection::CollisionWorldHybrid::initialize()
+{
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldHybrid::notifyObjectChange, this, _1, _2));
+  rebuildDistanceField();
+}
+
+void collision_detection::CollisionWorldHybrid::setWorld(const WorldPtr& world)
+{
+  if (world == getWorld())
+    return;
+
+  getWorld()->removeObserver(observer_handle_);
+  CollisionWorldFCL::setWorld(world);
+  world_revision_++;
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldHybrid::notifyObjectChange, this, _1, _2));
+  rebuildDistanceField();
+}
+
+void collision_detection::CollisionWorldHybrid::setDistanceFieldParameters(const DistanceFieldParameters &params)
+{
+  params_ = params;
+  rebuildDistanceField();
+}
+
+bool collision_detection::CollisionWorldHybrid::isWorldInDistanceField() const
+{
+  return distance_field_data_->incomplete_objects_.empty();
+}
+
+const distance_field::PropagationDistanceField& collision_detection::CollisionWorldHybrid::getDistanceField() const
+{
+  return *distance_field_data_->field_;
+}
+
+void collision_detection::CollisionWorldHybrid::rebuildDistanceField()
+{
+  boost::shared_ptr<DistanceFieldData> data(new DistanceFieldData(params_));
+  for (World::const_iterator it = getWorld()->begin() ; it != getWorld()->end() ; ++it)
+  {
+    std::vector<Eigen::Vector3i> voxels;
+    data->setObjectComplete(it->first, data->getObjectVoxels(*it->second, voxels));
+    if (!voxels.empty())
+      data->object_voxels_[it->first].swap(voxels);
+  }
+  data->addAllObjects();
+  distance_field_data_ = data;
+}
+
+void collision_detection::CollisionWorldHybrid::notifyObjectChange(const ObjectConstPtr& obj, World::Action action)
+{
+  if (action & (World::CREATE | World::DESTROY))
+    world_revision_++;
+
+  std::vector<Eigen::Vector3i> voxels;
+  bool complete = true;
+  if (action != World::DESTROY)
+    complete = distance_field_data_->getObjectVoxels(*obj, voxels);
+
+  if (distance_field_data_.unique())
+  {
+    distance_field_data_->setObjectVoxels(obj->id_, voxels);
+    distance_field_data_->setObjectComplete(obj->id_, complete);
+  }
+  else
+  {
+    // the field is still shared with the world this one was copied from, so the change goes to a new field
+    boost::shared_ptr<DistanceFieldData> data(new DistanceFieldData(params_));
+    data->object_voxels_ = distance_field_data_->object_voxels_;
+    data->incomplete_objects_ = distance_field_data_->incomplete_objects_;
+    data->setObjectComplete(obj->id_, complete);
+    if (voxels.empty())
+      data->object_voxels_.erase(obj->id_);
+    else
+      data->object_voxels_[obj->id_].swap(voxels);
+    data->addAllObjects();
+    distance_field_data_ = data;
+  }
+}
+
+collision_detection::CollisionWorldHybrid::WorldAllowance
+collision_detection::CollisionWorldHybrid::getWorldAllowance(const std::string &name, const AllowedCollisionMatrix *acm) const
+{
+  if (!acm || getWorld()->size() == 0)
+    return ALLOWED_NONE;
+  std::size_t allowed = 0;
+  bool conditional = false;
+  for (World::const_iterator it = getWorld()->begin() ; it != getWorld()->end() ; ++it)
+  {
+    AllowedCollision::Type type;
+    if (!acm->getAllowedCollision(name, it->first, type))
+      continue;
+    if (type == AllowedCollision::ALWAYS)
+      allowed++;
+    else if (type == AllowedCollision::CONDITIONAL)
+      conditional = true;
+  }
+  if (allowed == getWorld()->size())
+    return ALLOWED_ALL;
+  return allowed == 0 && !conditional ? ALLOWED_NONE : ALLOWED_SOME;
+}
+
+collision_detection::CollisionWorldHybrid::LinkAllowancesConstPtr
+collision_detection::CollisionWorldHybrid::getLinkAllowances(const robot_model::RobotModelConstPtr &model, const AllowedCollisionMatrix &acm) const
+{
+  // finding the allowance of a body takes a lookup for every object, while the matrix and the objects rarely change
+  // between queries
+  boost::mutex::scoped_lock slock(link_allowances_lock_);
+  if (!link_allowances_ || link_allowances_->model_ != model || link_allowances_->acm_revision_ != acm.getRevision() ||
+      link_allowances_->world_revision_ != world_revision_)
+  {
+    boost::shared_ptr<LinkAllowances> allowances(new LinkAllowances());
+    allowances->model_ = model;
+    allowances->acm_revision_ = acm.getRevision();
+    allowances->world_revision_ = world_revision_;
+    allowances->allowances_.resize(model->getLinkModelCount(), ALLOWED_NONE);
+    const std::vector<const robot_model::LinkModel*> &links = model->getLinkModelsWithCollisionGeometry();
+    for (std::size_t i = 0 ; i < links.size() ; ++i)
+      allowances->allowances_[links[i]->getLinkIndex()] = getWorldAllowance(links[i]->getName(), &acm);
+    link_allowances_ = allowances;
+  }
+  return link_allowances_;
+}
+
+bool collision_detection::CollisionWorldHybrid::getSphereDistances(const CollisionRequest &req, const CollisionRobotHybrid &robot,
+                                                                   const robot_state::RobotState &state, const AllowedCollisionMatrix *acm,
+                                                                   GroupStateRepresentation &gsr) const
+{
+  const robot_model::RobotModelConstPtr &model = robot.getRobotModel();
+  const robot_model::JointModelGroup *group = req.group_name.empty() ? NULL : model->getJointModelGroup(req.group_name);
+  const std::vector<const robot_model::LinkModel*> &links = group ? group->getUpdatedLinkModelsWithGeometry() : model->getLinkModelsWithCollisionGeometry();
+  std::vector<const robot_state::AttachedBody*> attached_bodies;
+  if (group)
+    state.getAttachedBodies(attached_bodies, group);
+  else
+    state.getAttachedBodies(attached_bodies);
+
+  // the field merges all objects, so bodies allowed to touch only some of them need FCL; so do bodies with shapes that
+  // are not covered by spheres
+  bool field_applies = true;
+  std::size_t count = 0;
+  gsr.gradients_.resize(links.size() + attached_bodies.size());
+  LinkAllowancesConstPtr link_allowances;
+  if (acm && getWorld()->size() > 0)
+    link_allowances = getLinkAllowances(model, *acm);
+
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    WorldAllowance allowance = link_allowances ? link_allowances->allowances_[links[i]->getLinkIndex()] : ALLOWED_NONE;
+    if (allowance == ALLOWED_ALL)
+      continue;
+    if (allowance == ALLOWED_SOME || !robot.hasCompleteLinkSpheres(links[i]))
+      field_applies = false;
+    const std::vector<CollisionSphere> &spheres = robot.getLinkSpheres(links[i]);
+    if (spheres.empty())
+      continue;
+
+    GradientInfo &info = gsr.gradients_[count++];
+    info.clear();
+    info.body_name = links[i]->getName();
+    info.body_type = BodyTypes::ROBOT_LINK;
+    info.joint_name = links[i]->getParentJointModel()->getName();
+    const Eigen::Affine3d &pose = state.getGlobalLinkTransform(links[i]);
+    for (std::size_t j = 0 ; j < spheres.size() ; ++j)
+    {
+      info.sphere_locations.push_back(pose * spheres[j].relative_vec_);
+      info.sphere_radii.push_back(spheres[j].radius_);
+    }
+  }
+
+  std::vector<CollisionSphere> spheres;
+  for (std::size_t i = 0 ; i < attached_bodies.size() ; ++i)
+  {
+    const robot_state::AttachedBody *ab = attached_bodies[i];
+    WorldAllowance allowance = getWorldAllowance(ab->getName(), acm);
+    if (allowance == ALLOWED_ALL)
+      continue;
+    if (allowance == ALLOWED_SOME)
+      field_applies = false;
+
+    GradientInfo &info = gsr.gradients_[count];
+    info.clear();
+    info.body_name = ab->getName();
+    info.body_type = BodyTypes::ROBOT_ATTACHED;
+    info.joint_name = ab->getAttachedLink()->getParentJointModel()->getName();
+    const std::vector<shapes::ShapeConstPtr> &shapes = ab->getShapes();
+    const EigenSTL::vector_Affine3d &poses = ab->getGlobalCollisionBodyTransforms();
+    for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+    {
+      spheres.clear();
+      if (!determineCollisionSpheres(shapes[j].get(), 0.0, 1.0, spheres))
+        field_applies = false;
+      for (std::size_t k = 0 ; k < spheres.size() ; ++k)
+      {
+        info.sphere_locations.push_back(poses[j] * spheres[k].relative_vec_);
+        info.sphere_radii.push_back(spheres[k].radius_);
+      }
+    }
+    if (!info.sphere_locations.empty())
+      ++count;
+  }
+  gsr.gradients_.resize(count);
+
+  // spheres outside of the field read the maximum distance, which says nothing about the world there
+  const distance_field::PropagationDistanceField &field = *distance_field_data_->field_;
+  const double discretization_margin = distance_field_data_->getDiscretizationMargin();
+  for (std::size_t i = 0 ; i < count ; ++i)
+  {
+    GradientInfo &info = gsr.gradients_[i];
+    if (field.getInterpolatedDistances(info.sphere_locations, info.distances, &info.gradients) < info.sphere_locations.size())
+      field_applies = false;
+    for (std::size_t j = 0 ; j < info.distances.size() ; ++j)
+    {
+      // the spheres contain the robot, so subtracting the error of the field keeps the check conservative
+      info.distances[j] -= discretization_margin;
+      double margin = info.distances[j] - info.sphere_radii[j];
+      if (margin < info.closest_distance)
+        info.closest_distance = margin;
+      if (margin <= params_.collision_tolerance)
+        info.collision = true;
+    }
+  }
+  return field_applies;
+}
+
+void collision_detection::CollisionWorldHybrid::checkRobotSpheres(const CollisionRequest &req, CollisionResult &res, const CollisionRobotHybrid &robot,
+                                                                  const robot_state::RobotState &state, const AllowedCollisionMatrix *acm,
+                                                                  GroupStateRepresentation &gsr) const
+{
+  if (!getSphereDistances(req, robot, state, acm, gsr) || !isWorldInDistanceField())
+  {
+    if (req.verbose)
+      logInform("The distance field cannot answer this query (the robot or the world is not entirely inside it, or "
+                "a body is allowed to touch only some objects); checking collisions with FCL");
+    checkRobotCollisionHelper(req, res, robot, state, acm);
+    return;
+  }
+
+  double distance = std::numeric_limits<double>::max();
+  for (std::size_t i = 0 ; i < gsr.gradients_.size() ; ++i)
+  {
+    const GradientInfo &info = gsr.gradients_[i];
+    distance = std::min(distance, info.closest_distance);
+    if (!info.collision)
+      continue;
+
+    res.collision = true;
+    if (req.verbose)
+      logInform("Found collision between '%s' and the world (distance %lf)", info.body_name.c_str(), info.closest_distance);
+    if (!req.contacts || res.contact_count >= req.max_contacts)
+      continue;
+
+    std::vector<Contact> &contacts = res.contacts[std::make_pair(info.body_name, DISTANCE_FIELD_ID_)];
+    for (std::size_t j = 0 ; j < info.distances.size() && contacts.size() < req.max_contacts_per_pair &&
+                             res.contact_count < req.max_contacts ; ++j)
+    {
+      double margin = info.distances[j] - info.sphere_radii[j];
+      if (margin > params_.collision_tolerance)
+        continue;
+      Contact contact;
+      double norm = info.gradients[j].norm();
+      if (norm > 0.0)
+        contact.normal = info.gradients[j] / norm;
+      else
+        contact.normal.setZero();
+      contact.pos = info.sphere_locations[j] - contact.normal * info.distances[j];
+      contact.depth = -margin;
+      contact.body_name_1 = info.body_name;
+      contact.body_type_1 = info.body_type;
+      contact.body_name_2 = DISTANCE_FIELD_ID_;
+      contact.body_type_2 = BodyTypes::WORLD_OBJECT;
+      contacts.push_back(contact);
+      res.contact_count++;
+    }
+  }
+
+  if (req.distance)
+    res.distance = distance;
+}
+
+void collision_detection::CollisionWorldHybrid::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const
+{
+  const CollisionRobotHybrid *robot_hybrid = dynamic_cast<const CollisionRobotHybrid*>(&robot);
+  if (!robot_hybrid)
+  {
+    checkRobotCollisionHelper(req, res, robot, state, NULL);
+    return;
+  }
+  GroupStateRepresentation gsr;
+  checkRobotSpheres(req, res, *robot_hybrid, state, NULL, gsr);
+}
+
+void collision_detection::CollisionWorldHybrid::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  const CollisionRobotHybrid *robot_hybrid = dynamic_cast<const CollisionRobotHybrid*>(&robot);
+  if (!robot_hybrid)
+  {
+    checkRobotCollisionHelper(req, res, robot, state, &acm);
+    return;
+  }
+  GroupStateRepresentation gsr;
+  checkRobotSpheres(req, res, *robot_hybrid, state, &acm, gsr);
+}
+
+void collision_detection::CollisionWorldHybrid::getCollisionGradients(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                      const robot_state::RobotState &state, const AllowedCollisionMatrix *acm,
+                                                                      GroupStateRepresentationPtr &gsr) const
+{
+  const CollisionRobotHybrid *robot_hybrid = dynamic_cast<const CollisionRobotHybrid*>(&robot);
+  if (!robot_hybrid)
+  {
+    logError("Collision gradients can only be computed for a CollisionRobotHybrid");
+    return;
+  }
+  if (!gsr)
+    gsr.reset(new GroupStateRepresentation());
+  checkRobotSpheres(req, res, *robot_hybrid, state, acm, *gsr);
+}
+
+double collision_detection::CollisionWorldHybrid::distanceRobotHybrid(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotHybrid *robot_hybrid = dynamic_cast<const CollisionRobotHybrid*>(&robot);
+  if (!robot_hybrid)
+    return distanceRobotHelper(robot, state, acm);
+
+  CollisionRequest req;
+  GroupStateRepresentation gsr;
+  if (!getSphereDistances(req, *robot_hybrid, state, acm, gsr) || !isWorldInDistanceField())
+    return distanceRobotHelper(robot, state, acm);
+  double distance = std::numeric_limits<double>::max();
+  for (std::size_t i = 0 ; i < gsr.gradients_.size() ; ++i)
+    distance = std::min(distance, gsr.gradients_[i].closest_distance);
+  return distance;
+}
+
+double collision_detection::CollisionWorldHybrid::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const
+{
+  return distanceRobotHybrid(robot, state, NULL);
+}
+
+double collision_detection::CollisionWorldHybrid::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  return distanceRobotHybrid(robot, state, &acm);
+}
+
+#include <moveit/collision_distance_field/collision_detector_allocator_hybrid.h>
+const std::string collision_detection::CollisionDetectorAllocatorHybrid::NAME_("HYBRID");
@@ -0,0 +1,461 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/collision_distance_field/collision_world_hybrid.h>
+#include <moveit/collision_distance_field/collision_robot_hybrid.h>
+#include <moveit/collision_distance_field/collision_detector_allocator_hybrid.h>
+
+#include <urdf_parser/urdf_parser.h>
+#include <geometric_shapes/shape_operations.h>
+#include <ros/package.h>
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <limits>
+
+#include <boost/filesystem.hpp>
+
+class HybridCollisionDetectionTester : public testing::Test
+{
+
+protected:
+
+  virtual void SetUp()
+  {
+    std::string resource_dir = ros::package::getPath("moveit_resources");
+    if(resource_dir == "")
+    {
+      FAIL() << "Failed to find package moveit_resources.";
+      return;
+    }
+    boost::filesystem::path res_path(resource_dir);
+    std::string urdf_file = (res_path / "test/urdf/robot.xml").string();
+    std::string srdf_file = (res_path / "test/srdf/robot.xml").string();
+
+    srdf_model_.reset(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file(urdf_file.c_str(), std::fstream::in);
+
+    if (xml_file.is_open())
+    {
+      while ( xml_file.good() )
+      {
+        std::string line;
+        std::getline( xml_file, line);
+        xml_string += (line + "\n");
+      }
+      xml_file.close();
+      urdf_model_ = urdf::parseURDF(xml_string);
+      urdf_ok_ = urdf_model_;
+    }
+    else
+    {
+      EXPECT_EQ("FAILED TO OPEN FILE", urdf_file);
+      urdf_ok_ = false;
+    }
+    srdf_ok_ = srdf_model_->initFile(*urdf_model_, srdf_file);
+
+    kmodel_.reset(new robot_model::RobotModel(urdf_model_, srdf_model_));
+
+    acm_.reset(new collision_detection::AllowedCollisionMatrix(kmodel_->getLinkModelNames(), true));
+
+    crobot_.reset(new collision_detection::CollisionRobotHybrid(kmodel_));
+    cworld_.reset(new collision_detection::CollisionWorldHybrid());
+    collision_detection::DistanceFieldParameters params;
+    params.size = Eigen::Vector3d(2.0, 2.0, 2.0);
+    params.origin = Eigen::Vector3d(-1.0, -1.0, -0.5);
+    cworld_->setDistanceFieldParameters(params);
+  }
+
+  virtual void TearDown()
+  {
+
+  }
+
+  void addBox(const std::string &id, double x, double y, double z)
+  {
+    Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+    pose.translation() = Eigen::Vector3d(x, y, z);
+    cworld_->getWorld()->addToObject(id, shapes::ShapeConstPtr(new shapes::Box(0.2, 0.2, 0.2)), pose);
+  }
+
+protected:
+
+  bool urdf_ok_;
+  bool srdf_ok_;
+
+  boost::shared_ptr<urdf::ModelInterface>  urdf_model_;
+  boost::shared_ptr<srdf::Model>           srdf_model_;
+
+  robot_model::RobotModelPtr               kmodel_;
+
+  boost::shared_ptr<collision_detection::CollisionRobotHybrid>  crobot_;
+  boost::shared_ptr<collision_detection::CollisionWorldHybrid>  cworld_;
+
+  collision_detection::AllowedCollisionMatrixPtr acm_;
+};
+
+TEST_F(HybridCollisionDetectionTester, InitOK)
+{
+  ASSERT_TRUE(urdf_ok_);
+  ASSERT_TRUE(srdf_ok_);
+}
+
+TEST_F(HybridCollisionDetectionTester, LinkSpheres)
+{
+  const std::vector<const robot_model::LinkModel*> &links = kmodel_->getLinkModelsWithCollisionGeometry();
+  ASSERT_FALSE(links.empty());
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const std::vector<collision_detection::CollisionSphere> &spheres = crobot_->getLinkSpheres(links[i]);
+    EXPECT_FALSE(spheres.empty()) << links[i]->getName();
+    for (std::size_t j = 0 ; j < spheres.size() ; ++j)
+      EXPECT_LT(0.0, spheres[j].radius_);
+  }
+}
+
+TEST_F(HybridCollisionDetectionTester, WorldCollision)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  // a box inside the base
+  addBox("box", 0.0, 0.0, 0.2);
+  req.contacts = true;
+  req.max_contacts = 10;
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  EXPECT_LT(0u, res.contact_count);
+  EXPECT_GE(10u, res.contact_count);
+  EXPECT_LT(0.0, cworld_->getDistanceField().getDistance(0.0, 0.0, 0.5));
+  EXPECT_GE(0.0, cworld_->getDistanceField().getDistance(0.0, 0.0, 0.2));
+
+  // the box is ignored when every link is allowed to touch it
+  acm_->setDefaultEntry("box", true);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  acm_->setDefaultEntry("box", false);
+
+  // moving the box away from the robot updates the field
+  Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+  pose.translation() = Eigen::Vector3d(0.0, 0.0, -0.4);
+  cworld_->getWorld()->moveShapeInObject("box", cworld_->getWorld()->getObject("box")->shapes_[0], pose);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  EXPECT_LT(0.0, cworld_->distanceRobot(*crobot_, kstate, *acm_));
+
+  cworld_->getWorld()->removeObject("box");
+  EXPECT_LT(0.0, cworld_->getDistanceField().getDistance(0.0, 0.0, -0.4));
+}
+
+TEST_F(HybridCollisionDetectionTester, Gradients)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // a box close to the front of the base
+  addBox("box", 0.55, 0.0, 0.2);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  collision_detection::GroupStateRepresentationPtr gsr;
+  cworld_->getCollisionGradients(req, res, *crobot_, kstate, acm_.get(), gsr);
+  ASSERT_TRUE(gsr);
+
+  bool found = false;
+  for (std::size_t i = 0 ; i < gsr->gradients_.size() ; ++i)
+  {
+    const collision_detection::GradientInfo &info = gsr->gradients_[i];
+    ASSERT_EQ(info.sphere_locations.size(), info.distances.size());
+    ASSERT_EQ(info.sphere_locations.size(), info.gradients.size());
+    if (info.body_name != "base_link")
+      continue;
+    found = true;
+
+    // the sphere closest to the box is pushed away from it
+    std::size_t closest = 0;
+    for (std::size_t j = 1 ; j < info.distances.size() ; ++j)
+      if (info.distances[j] < info.distances[closest])
+        closest = j;
+    EXPECT_GT(0.0, info.gradients[closest].x());
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST_F(HybridCollisionDetectionTester, CopiedWorld)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  addBox("box", 0.0, 0.0, 0.2);
+  collision_detection::WorldPtr world(new collision_detection::World(*cworld_->getWorld()));
+  collision_detection::CollisionWorldHybrid copy(*cworld_, world);
+  EXPECT_EQ(&cworld_->getDistanceField(), &copy.getDistanceField());
+
+  // changing the copy leaves the original untouched
+  copy.getWorld()->removeObject("box");
+  EXPECT_NE(&cworld_->getDistanceField(), &copy.getDistanceField());
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  copy.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+}
+
+TEST_F(HybridCollisionDetectionTester, OutsideDistanceField)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // a box inside the base, in a field that does not cover the robot
+  collision_detection::DistanceFieldParameters params;
+  params.size = Eigen::Vector3d(0.5, 0.5, 0.5);
+  params.origin = Eigen::Vector3d(5.0, 5.0, 5.0);
+  cworld_->setDistanceFieldParameters(params);
+  addBox("box", 0.0, 0.0, 0.2);
+  EXPECT_FALSE(cworld_->isWorldInDistanceField());
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  EXPECT_GE(0.0, cworld_->distanceRobot(*crobot_, kstate, *acm_));
+
+  // once the field covers the box, it is used again
+  params.size = Eigen::Vector3d(2.0, 2.0, 2.0);
+  params.origin = Eigen::Vector3d(-1.0, -1.0, -0.5);
+  cworld_->setDistanceFieldParameters(params);
+  EXPECT_TRUE(cworld_->isWorldInDistanceField());
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // a box that sticks out of the field
+  Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+  pose.translation() = Eigen::Vector3d(0.0, 0.0, 1.5);
+  cworld_->getWorld()->addToObject("tall_box", shapes::ShapeConstPtr(new shapes::Box(0.2, 0.2, 0.5)), pose);
+  EXPECT_FALSE(cworld_->isWorldInDistanceField());
+  cworld_->getWorld()->removeObject("tall_box");
+  EXPECT_TRUE(cworld_->isWorldInDistanceField());
+
+  // planes cannot be voxelized
+  cworld_->getWorld()->addToObject("plane", shapes::ShapeConstPtr(new shapes::Plane(0.0, 0.0, 1.0, 0.0)), Eigen::Affine3d::Identity());
+  EXPECT_FALSE(cworld_->isWorldInDistanceField());
+}
+
+TEST_F(HybridCollisionDetectionTester, ThinObject)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // a plate through the base that lies between two planes of voxel centers, so no voxel of the field is inside it
+  const double resolution = cworld_->getDistanceFieldParameters().resolution;
+  Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+  pose.translation() = Eigen::Vector3d(0.0, 0.0, 0.2 + resolution / 2.0);
+  cworld_->getWorld()->addToObject("plate", shapes::ShapeConstPtr(new shapes::Box(0.5, 0.5, resolution / 5.0)), pose);
+  EXPECT_FALSE(cworld_->isWorldInDistanceField());
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  cworld_->getWorld()->removeObject("plate");
+  EXPECT_TRUE(cworld_->isWorldInDistanceField());
+}
+
+TEST_F(HybridCollisionDetectionTester, SurfaceBetweenVoxelCenters)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // the sphere of the robot that reaches furthest along x
+  Eigen::Vector3d center;
+  double radius = 0.0;
+  double front = -std::numeric_limits<double>::max();
+  const std::vector<const robot_model::LinkModel*> &links = kmodel_->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const std::vector<collision_detection::CollisionSphere> &spheres = crobot_->getLinkSpheres(links[i]);
+    for (std::size_t j = 0 ; j < spheres.size() ; ++j)
+    {
+      Eigen::Vector3d c = kstate.getGlobalLinkTransform(links[i]) * spheres[j].relative_vec_;
+      if (c.x() + spheres[j].radius_ > front)
+      {
+        front = c.x() + spheres[j].radius_;
+        center = c;
+        radius = spheres[j].radius_;
+      }
+    }
+  }
+  ASSERT_LT(0.0, radius);
+
+  // a box that the sphere penetrates by 5 mm, with its face half way between two planes of voxel centers; the closest
+  // occupied voxel centers are then further from the sphere than its radius
+  collision_detection::DistanceFieldParameters params = cworld_->getDistanceFieldParameters();
+  const double face = front - 0.005;
+  params.size.x() = 3.0;
+  params.origin.x() = face + params.resolution / 2.0 - 60.0 * params.resolution;
+  cworld_->setDistanceFieldParameters(params);
+  Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+  pose.translation() = Eigen::Vector3d(face + 0.1, center.y(), center.z());
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.2, 0.1, 0.1)), pose);
+  ASSERT_TRUE(cworld_->isWorldInDistanceField());
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  EXPECT_GT(0.0, cworld_->distanceRobot(*crobot_, kstate, *acm_));
+
+  // the distances of the spheres never exceed their distance to the surface of the box
+  collision_detection::GroupStateRepresentationPtr gsr;
+  res.clear();
+  cworld_->getCollisionGradients(req, res, *crobot_, kstate, acm_.get(), gsr);
+  ASSERT_TRUE(gsr);
+  for (std::size_t i = 0 ; i < gsr->gradients_.size() ; ++i)
+  {
+    const collision_detection::GradientInfo &info = gsr->gradients_[i];
+    for (std::size_t j = 0 ; j < info.sphere_locations.size() ; ++j)
+    {
+      const Eigen::Vector3d &p = info.sphere_locations[j];
+      if (fabs(p.y() - center.y()) < 0.05 && fabs(p.z() - center.z()) < 0.05 && p.x() < face)
+        EXPECT_GE(face - p.x() + 1e-6, info.distances[j]);
+    }
+  }
+}
+
+TEST_F(HybridCollisionDetectionTester, PartiallyAllowedWorld)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // the robot is allowed to touch a box inside its base, but not a box far from it
+  addBox("target", 0.0, 0.0, 0.2);
+  addBox("other", -0.8, 0.8, 1.3);
+  acm_->setEntry("target", kmodel_->getLinkModelNames(), true);
+  EXPECT_TRUE(cworld_->isWorldInDistanceField());
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  EXPECT_LT(0.0, cworld_->distanceRobot(*crobot_, kstate, *acm_));
+
+  // an object added after the allowances were computed is not allowed
+  addBox("new_target", 0.0, 0.0, 0.25);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  cworld_->getWorld()->removeObject("new_target");
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  // without the allowance, the box inside the base is found
+  acm_->removeEntry("target");
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+}
+
+TEST_F(HybridCollisionDetectionTester, AttachedBodyWithoutSpheres)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // a box far from the robot, and a plane attached to the robot that cannot be approximated by spheres but goes through the box
+  addBox("box", -0.8, 0.8, 1.3);
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Plane(0.0, 0.0, 1.0, 0.0)));
+  Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+  pose.translation().z() = 1.3 - kstate.getGlobalLinkTransform("base_link").translation().z();
+  EigenSTL::vector_Affine3d poses(1, pose);
+  kstate.attachBody("plane", shapes, poses, std::vector<std::string>(), "base_link");
+  kstate.update();
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+}
+
+TEST_F(HybridCollisionDetectionTester, AllocatorParameters)
+{
+  collision_detection::DistanceFieldParameters params;
+  params.size = Eigen::Vector3d(1.0, 2.0, 3.0);
+  params.origin = Eigen::Vector3d(-0.5, -1.0, 0.0);
+  params.resolution = 0.05;
+
+  collision_detection::WorldPtr world(new collision_detection::World());
+  collision_detection::CollisionWorldPtr cworld = collision_detection::CollisionDetectorAllocatorHybrid::create(params)->allocateWorld(world);
+  const collision_detection::CollisionWorldHybrid *hybrid = dynamic_cast<const collision_detection::CollisionWorldHybrid*>(cworld.get());
+  ASSERT_TRUE(hybrid);
+  EXPECT_EQ(params.size, hybrid->getDistanceFieldParameters().size);
+  EXPECT_EQ(params.origin, hybrid->getDistanceFieldParameters().origin);
+  EXPECT_DOUBLE_EQ(0.05, hybrid->getDistanceField().getResolution());
+  EXPECT_NEAR(-0.5, hybrid->getDistanceField().getOriginX(), 1e-9);
+  EXPECT_EQ(20u * 40u * 60u, params.getVoxelCount());
+
+  // the default field fits an arm workspace in a few tens of MB
+  collision_detection::DistanceFieldParameters defaults;
+  EXPECT_EQ(80u * 80u * 80u, defaults.getVoxelCount());
+  EXPECT_GT(32u * 1024u * 1024u, defaults.getMemoryUsage());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
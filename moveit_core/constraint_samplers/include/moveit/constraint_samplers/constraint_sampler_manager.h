@@ -38,6 +38,7 @@
 #define MOVEIT_CONSTRAINT_SAMPLERS_CONSTRAINT_SAMPLER_MANAGER_
 
 #include <moveit/constraint_samplers/constraint_sampler_allocator.h>
+#include <moveit/constraint_samplers/reachability_map.h>
 #include <boost/shared_ptr.hpp>
 
 namespace constraint_samplers
@@ -72,6 +73,15 @@ public:
   {
     sampler_alloc_.push_back(sa);
   }
+  /**
+   * \brief Register a reachability map to be used by the IK samplers this manager selects for the map's group
+   * @param map The reachability map; it replaces any map previously registered for the same group
+   */
+  void registerReachabilityMap(const ReachabilityMapConstPtr &map)
+  {
+    reachability_maps_[map->getGroupName()] = map;
+  }
+
   /**
    * \brief Selects among the potential sampler allocators.
    *
@@ -131,7 +141,11 @@ public:
 
 private:
 
+  /** \brief Pass the registered reachability maps to the IK samplers within \e sampler */
+  void setReachabilityMaps(const ConstraintSamplerPtr &sampler) const;
+
   std::vector<ConstraintSamplerAllocatorPtr> sampler_alloc_; /**< \brief Holds the constraint sampler allocators, which will be tested in order  */
+  std::map<std::string, ReachabilityMapConstPtr> reachability_maps_; /**< \brief The reachability maps, by group name */
 };
 
 MOVEIT_CLASS_FORWARD(ConstraintSamplerManager);
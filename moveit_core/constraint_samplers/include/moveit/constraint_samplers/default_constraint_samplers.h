@@ -38,6 +38,7 @@
 #define MOVEIT_CONSTRAINT_SAMPLERS_DEFAULT_CONSTRAINT_SAMPLERS_
 
 #include <moveit/constraint_samplers/constraint_sampler.h>
+#include <moveit/constraint_samplers/reachability_map.h>
 #include <random_numbers/random_numbers.h>
 
 namespace constraint_samplers
@@ -383,6 +384,32 @@ public:
     ik_timeout_ = timeout;
   }
 
+  /**
+   * \brief Use a precomputed reachability map when sampling.
+   *
+   * Sampled poses that fall in cells the map does not contain are
+   * rejected without calling IK, and IK is seeded with a
+   * configuration recorded for the cell of the sampled pose. The
+   * sampler must be configured, and the map must have been computed
+   * for the same group, for the tip frame of the IK solver and in the
+   * frame IK requests are expressed in.
+   *
+   * @param map The reachability map, or an empty pointer to stop using one
+   *
+   * @return True if the map matches the configured sampler (or is empty), otherwise false
+   */
+  bool setReachabilityMap(const ReachabilityMapConstPtr &map);
+
+  /**
+   * \brief Gets the reachability map used by this sampler
+   *
+   * @return The map, or an empty pointer if none is used
+   */
+  const ReachabilityMapConstPtr& getReachabilityMap() const
+  {
+    return reachability_map_;
+  }
+
   /**
    * \brief Gets the position constraint associated with this sampler.
    *
@@ -507,11 +534,12 @@ protected:
    * @param timeout The timeout for the IK search
    * @param jsg The joint state group into which to place the solution
    * @param use_as_seed If true, the state values in jsg are used as seed for the IK
+   * @param seed_values If not NULL and \e use_as_seed is false, the group values used as seed for the IK
    *
    * @return True if IK returns successfully with the timeout, and otherwise false.
    */
   bool callIK(const geometry_msgs::Pose &ik_query, const kinematics::KinematicsBase::IKCallbackFn &adapted_ik_validity_callback,
-              double timeout, robot_state::RobotState &state, bool use_as_seed);
+              double timeout, robot_state::RobotState &state, bool use_as_seed, const std::vector<double> *seed_values = NULL);
   bool sampleHelper(robot_state::RobotState &state, const robot_state::RobotState &reference_state, unsigned int max_attempts, bool project);
   bool validate(robot_state::RobotState &state) const;
 
@@ -521,6 +549,8 @@ protected:
   double                                ik_timeout_; /**< \brief Holds the timeout associated with IK */
   std::string                           ik_frame_; /**< \brief Holds the base from of the IK solver */
   bool                                  transform_ik_; /**< \brief True if the frame associated with the kinematic model is different than the base frame of the IK solver */
+  ReachabilityMapConstPtr               reachability_map_; /**< \brief Optional map used to reject unreachable poses and seed IK */
+  std::vector<double>                   map_seed_; /**< \brief Seed taken from the reachability map, to avoid reallocating */
 };
 
 
@@ -0,0 +1,188 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CONSTRAINT_SAMPLERS_REACHABILITY_MAP_
+#define MOVEIT_CONSTRAINT_SAMPLERS_REACHABILITY_MAP_
+
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/macros/class_forward.h>
+#include <random_numbers/random_numbers.h>
+#include <boost/cstdint.hpp>
+#include <Eigen/Geometry>
+#include <string>
+#include <vector>
+
+namespace constraint_samplers
+{
+
+MOVEIT_CLASS_FORWARD(ReachabilityMap);
+
+/**
+ * \brief A discretization of the poses a link of a group can reach.
+ *
+ * Positions are binned in a regular grid and orientations by the
+ * direction of the link's z axis (on the faces of a cube) and the
+ * rotation about that axis. Poses are expressed in the base frame
+ * of the IK solver for the group. Each reachable cell keeps a few
+ * group configurations that reach it, to be used as IK seeds.
+ *
+ * The map is computed by sampling random configurations of the
+ * group, so it can only tell that a pose is reachable with the
+ * confidence that the sampling density allows: cells that were
+ * never visited are reported as unreachable.
+ */
+class ReachabilityMap
+{
+public:
+
+  /** \brief The parameters of the discretization */
+  struct Options
+  {
+    Options() :
+      resolution(0.05),
+      direction_divisions(4),
+      roll_divisions(8),
+      seeds_per_cell(4),
+      samples(1000000)
+    {
+    }
+
+    /** \brief The side of a position cell (m) */
+    double resolution;
+
+    /** \brief The number of divisions of each side of the cube used to bin the link's z axis */
+    unsigned int direction_divisions;
+
+    /** \brief The number of divisions of the rotation about the link's z axis; 1 ignores that rotation */
+    unsigned int roll_divisions;
+
+    /** \brief The maximum number of seed configurations kept per cell */
+    unsigned int seeds_per_cell;
+
+    /** \brief The number of random configurations sampled by compute() */
+    unsigned int samples;
+  };
+
+  ReachabilityMap();
+
+  /**
+   * \brief Compute the map by sampling random configurations of \e group
+   * @param reference The state used for the joints outside the group and to locate \e base_frame
+   * @param group The group whose reachable workspace is discretized
+   * @param tip_frame The link whose poses are recorded (the tip of the IK solver)
+   * @param base_frame The frame poses are expressed in (the base of the IK solver)
+   * @return False if the frames are not known to the robot model
+   */
+  bool compute(const robot_state::RobotState &reference, const robot_model::JointModelGroup *group,
+               const std::string &tip_frame, const std::string &base_frame, const Options &options = Options());
+
+  /** \brief Save the map in a compact binary form */
+  bool save(const std::string &filename) const;
+
+  /** \brief Load a map written by save() */
+  bool load(const std::string &filename);
+
+  const std::string& getGroupName() const
+  {
+    return group_name_;
+  }
+
+  const std::string& getTipFrame() const
+  {
+    return tip_frame_;
+  }
+
+  const std::string& getBaseFrame() const
+  {
+    return base_frame_;
+  }
+
+  const Options& getOptions() const
+  {
+    return options_;
+  }
+
+  /** \brief The number of reachable cells */
+  std::size_t getCellCount() const
+  {
+    return keys_.size();
+  }
+
+  /** \brief The number of values in a seed configuration (the variable count of the group) */
+  std::size_t getVariableCount() const
+  {
+    return variable_count_;
+  }
+
+  /** \brief Check whether the cell containing the pose (\e pos, \e quat), expressed in the base frame, was reached */
+  bool isReachable(const Eigen::Vector3d &pos, const Eigen::Quaterniond &quat) const;
+
+  /**
+   * \brief Pick one of the seed configurations recorded for the cell containing the pose (\e pos, \e quat)
+   * @param seed The group variable values, in the order used by RobotState::copyJointGroupPositions()
+   * @return False if the cell was not reached
+   */
+  bool getSeed(const Eigen::Vector3d &pos, const Eigen::Quaterniond &quat,
+               random_numbers::RandomNumberGenerator &rng, std::vector<double> &seed) const;
+
+private:
+
+  /** \brief The key of the cell containing a pose; false if the position is outside the grid */
+  bool getCellKey(const Eigen::Vector3d &pos, const Eigen::Quaterniond &quat, boost::uint64_t &key) const;
+
+  /** \brief The index of the cell with \e key in keys_, or -1 */
+  int findCell(const Eigen::Vector3d &pos, const Eigen::Quaterniond &quat) const;
+
+  unsigned int getOrientationBin(const Eigen::Quaterniond &quat) const;
+
+  std::string group_name_;
+  std::string tip_frame_;
+  std::string base_frame_;
+  Options options_;
+
+  Eigen::Vector3d origin_;
+  boost::uint32_t size_[3];
+  std::size_t variable_count_;
+
+  /** \brief Sorted keys of the reachable cells */
+  std::vector<boost::uint64_t> keys_;
+
+  /** \brief The seeds of cell i are seeds_[seed_offsets_[i] * variable_count_ .. seed_offsets_[i + 1] * variable_count_) */
+  std::vector<boost::uint32_t> seed_offsets_;
+  std::vector<float> seeds_;
+};
+
+}
+
+#endif
@@ -48,7 +48,26 @@ constraint_samplers::ConstraintSamplerPtr constraint_samplers::ConstraintSampler
       return sampler_alloc_[i]->alloc(scene, group_name, constr);
 
   // if no default sampler was used, try a default one
-  return selectDefaultSampler(scene, group_name, constr);
+  ConstraintSamplerPtr sampler = selectDefaultSampler(scene, group_name, constr);
+  if (sampler && !reachability_maps_.empty())
+    setReachabilityMaps(sampler);
+  return sampler;
+}
+
+void constraint_samplers::ConstraintSamplerManager::setReachabilityMaps(const ConstraintSamplerPtr &sampler) const
+{
+  if (IKConstraintSampler *iks = dynamic_cast<IKConstraintSampler*>(sampler.get()))
+  {
+    std::map<std::string, ReachabilityMapConstPtr>::const_iterator it = reachability_maps_.find(iks->getGroupName());
+    if (it != reachability_maps_.end())
+      iks->setReachabilityMap(it->second);
+  }
+  else if (UnionConstraintSampler *ucs = dynamic_cast<UnionConstraintSampler*>(sampler.get()))
+  {
+    const std::vector<ConstraintSamplerPtr> &samplers = ucs->getSamplers();
+    for (std::size_t i = 0 ; i < samplers.size() ; ++i)
+      setReachabilityMaps(samplers[i]);
+  }
 }
 
 constraint_samplers::ConstraintSamplerPtr constraint_samplers::ConstraintSamplerManager::selectDefaultSampler(const planning_scene::PlanningSceneConstPtr &scene,
@@ -376,6 +376,29 @@ bool constraint_samplers::IKConstraintSampler::loadIKSolver()
   return true;
 }
 
+bool constraint_samplers::IKConstraintSampler::setReachabilityMap(const ReachabilityMapConstPtr &map)
+{
+  if (map)
+  {
+    if (!is_valid_)
+    {
+      logError("IKConstraintSampler must be configured before a reachability map is set");
+      return false;
+    }
+    const std::string &expected_frame = transform_ik_ ? ik_frame_ : jmg_->getParentModel().getModelFrame();
+    if (map->getGroupName() != jmg_->getName() || !robot_state::Transforms::sameFrame(map->getTipFrame(), kb_->getTipFrame()) ||
+        !robot_state::Transforms::sameFrame(map->getBaseFrame(), expected_frame) || map->getVariableCount() != jmg_->getVariableCount())
+    {
+      logError("Reachability map for group '%s' (tip '%s', frame '%s') cannot be used for IK on group '%s' (tip '%s', frame '%s')",
+               map->getGroupName().c_str(), map->getTipFrame().c_str(), map->getBaseFrame().c_str(),
+               jmg_->getName().c_str(), kb_->getTipFrame().c_str(), expected_frame.c_str());
+      return false;
+    }
+  }
+  reachability_map_ = map;
+  return true;
+}
+
 bool constraint_samplers::IKConstraintSampler::samplePose(Eigen::Vector3d &pos, Eigen::Quaterniond &quat,
                                                           const robot_state::RobotState &ks,
                                                           unsigned int max_attempts)
@@ -513,6 +536,15 @@ bool constraint_samplers::IKConstraintSampler::sampleHelper(robot_state::RobotSt
       return false;
     }
 
+    // poses in cells the map never reached are rejected without calling IK
+    const std::vector<double> *seed_values = NULL;
+    if (reachability_map_)
+    {
+      if (!reachability_map_->getSeed(point, quat, random_number_generator_, map_seed_))
+        continue;
+      seed_values = &map_seed_;
+    }
+
     geometry_msgs::Pose ik_query;
     ik_query.position.x = point.x();
     ik_query.position.y = point.y();
@@ -522,7 +554,7 @@ bool constraint_samplers::IKConstraintSampler::sampleHelper(robot_state::RobotSt
     ik_query.orientation.z = quat.z();
     ik_query.orientation.w = quat.w();
 
-    if (callIK(ik_query, adapted_ik_validity_callback, ik_timeout_, state, project && a == 0))
+    if (callIK(ik_query, adapted_ik_validity_callback, ik_timeout_, state, project && a == 0, seed_values))
       return true;
   }
   return false;
@@ -542,7 +574,8 @@ bool constraint_samplers::IKConstraintSampler::validate(robot_state::RobotState
 }
 
 bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose &ik_query, const kinematics::KinematicsBase::IKCallbackFn &adapted_ik_validity_callback,
-                                                      double timeout, robot_state::RobotState &state, bool use_as_seed)
+                                                      double timeout, robot_state::RobotState &state, bool use_as_seed,
+                                                      const std::vector<double> *seed_values)
 {
   const std::vector<unsigned int>& ik_joint_bijection = jmg_->getKinematicsSolverJointBijection();
   std::vector<double> seed(ik_joint_bijection.size(), 0.0);
@@ -550,6 +583,8 @@ bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose
   
   if (use_as_seed)
     state.copyJointGroupPositions(jmg_, vals);
+  else if (seed_values)
+    vals = *seed_values;
   else
     // sample a seed value
     jmg_->getVariableRandomPositions(random_number_generator_, vals);
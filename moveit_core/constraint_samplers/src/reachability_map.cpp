@@ -0,0 +1,395 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/constraint_samplers/reachability_map.h>
+#include <moveit/transforms/transforms.h>
+#include <console_bridge/console.h>
+#include <boost/math/constants/constants.hpp>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <cstring>
+
+namespace constraint_samplers
+{
+namespace
+{
+const char MAP_MAGIC[8] = { 'M', 'O', 'V', 'E', 'I', 'T', 'R', 'M' };
+const boost::uint32_t MAP_VERSION = 1;
+
+/** \brief The integer coordinates of a cell, before the extent of the grid is known */
+struct CellCoordinates
+{
+  boost::int64_t x, y, z;
+  unsigned int orientation;
+
+  bool operator<(const CellCoordinates &other) const
+  {
+    if (x != other.x)
+      return x < other.x;
+    if (y != other.y)
+      return y < other.y;
+    if (z != other.z)
+      return z < other.z;
+    return orientation < other.orientation;
+  }
+};
+
+struct CellSeeds
+{
+  CellSeeds() : visits(0)
+  {
+  }
+
+  std::size_t visits;
+  std::vector<float> seeds;
+};
+
+template<typename T>
+void writeValue(std::ofstream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::ifstream &in, T &value)
+{
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template<typename T>
+void writeVector(std::ofstream &out, const std::vector<T> &values)
+{
+  if (!values.empty())
+    out.write(reinterpret_cast<const char*>(&values[0]), values.size() * sizeof(T));
+}
+
+template<typename T>
+bool readVector(std::ifstream &in, std::vector<T> &values, std::size_t count)
+{
+  values.resize(count);
+  return count == 0 || static_cast<bool>(in.read(reinterpret_cast<char*>(&values[0]), count * sizeof(T)));
+}
+
+void writeString(std::ofstream &out, const std::string &s)
+{
+  writeValue(out, (boost::uint32_t)s.size());
+  out.write(s.data(), s.size());
+}
+
+bool readString(std::ifstream &in, std::string &s)
+{
+  boost::uint32_t size;
+  if (!readValue(in, size) || size > 4096)
+    return false;
+  s.resize(size);
+  return size == 0 || static_cast<bool>(in.read(&s[0], size));
+}
+
+std::string stripSlash(const std::string &frame)
+{
+  return !frame.empty() && frame[0] == '/' ? frame.substr(1) : frame;
+}
+}
+}
+
+constraint_samplers::ReachabilityMap::ReachabilityMap() :
+  origin_(Eigen::Vector3d::Zero()), variable_count_(0)
+{
+  size_[0] = size_[1] = size_[2] = 0;
+}
+
+unsigned int constraint_samplers::ReachabilityMap::getOrientationBin(const Eigen::Quaterniond &quat) const
+{
+  static const double pi = boost::math::constants::pi<double>();
+  const Eigen::Matrix3d r = quat.toRotationMatrix();
+
+  // bin the direction of the z axis by the cube face it points to and the position on that face
+  const Eigen::Vector3d d = r.col(2);
+  int axis;
+  d.cwiseAbs().maxCoeff(&axis);
+  unsigned int face = 2 * axis + (d[axis] < 0.0 ? 1 : 0);
+  unsigned int n = options_.direction_divisions;
+  double u = d[(axis + 1) % 3] / fabs(d[axis]);
+  double v = d[(axis + 2) % 3] / fabs(d[axis]);
+  unsigned int iu = std::min(n - 1, (unsigned int)((u + 1.0) * 0.5 * n));
+  unsigned int iv = std::min(n - 1, (unsigned int)((v + 1.0) * 0.5 * n));
+
+  // bin the rotation of the x axis about z, measured from a reference direction that depends only on z
+  unsigned int nr = options_.roll_divisions;
+  unsigned int ir = 0;
+  if (nr > 1)
+  {
+    Eigen::Vector3d ref = fabs(d.x()) < 0.9 ? Eigen::Vector3d::UnitX() : Eigen::Vector3d::UnitY();
+    Eigen::Vector3d b1 = (ref - ref.dot(d) * d).normalized();
+    Eigen::Vector3d b2 = d.cross(b1);
+    double roll = atan2(r.col(0).dot(b2), r.col(0).dot(b1));
+    ir = std::min(nr - 1, (unsigned int)((roll + pi) / (2.0 * pi) * nr));
+  }
+  return ((face * n + iu) * n + iv) * nr + ir;
+}
+
+bool constraint_samplers::ReachabilityMap::compute(const robot_state::RobotState &reference, const robot_model::JointModelGroup *group,
+                                                   const std::string &tip_frame, const std::string &base_frame, const Options &options)
+{
+  const robot_model::RobotModel &model = group->getParentModel();
+  std::string tip = stripSlash(tip_frame);
+  std::string base = stripSlash(base_frame);
+  const robot_model::LinkModel *tip_link = model.getLinkModel(tip);
+  if (!tip_link)
+  {
+    logError("Cannot compute reachability map: link '%s' is not known", tip.c_str());
+    return false;
+  }
+  if (!model.hasLinkModel(base) && !robot_state::Transforms::sameFrame(base, model.getModelFrame()))
+  {
+    logError("Cannot compute reachability map: frame '%s' is not known", base.c_str());
+    return false;
+  }
+  if (options.resolution <= 0.0 || options.direction_divisions == 0 || options.roll_divisions == 0 || options.seeds_per_cell == 0)
+  {
+    logError("Cannot compute reachability map: invalid discretization options");
+    return false;
+  }
+
+  group_name_ = group->getName();
+  tip_frame_ = tip;
+  base_frame_ = base;
+  options_ = options;
+  variable_count_ = group->getVariableCount();
+
+  robot_state::RobotState state(reference);
+  state.update();
+  const Eigen::Affine3d base_inv = model.hasLinkModel(base) ? state.getFrameTransform(base).inverse() : Eigen::Affine3d::Identity();
+
+  random_numbers::RandomNumberGenerator rng;
+  std::vector<double> values(variable_count_);
+  std::map<CellCoordinates, CellSeeds> cells;
+  for (unsigned int s = 0 ; s < options_.samples ; ++s)
+  {
+    group->getVariableRandomPositions(rng, values);
+    state.setJointGroupPositions(group, values);
+    const Eigen::Affine3d pose = base_inv * state.getGlobalLinkTransform(tip_link);
+
+    CellCoordinates c;
+    c.x = (boost::int64_t)floor(pose.translation().x() / options_.resolution);
+    c.y = (boost::int64_t)floor(pose.translation().y() / options_.resolution);
+    c.z = (boost::int64_t)floor(pose.translation().z() / options_.resolution);
+    c.orientation = getOrientationBin(Eigen::Quaterniond(pose.rotation()));
+
+    // reservoir sampling keeps a uniform selection of the configurations that reached the cell
+    CellSeeds &cs = cells[c];
+    std::size_t slot = cs.visits < options_.seeds_per_cell ? cs.visits : rng.uniformInteger(0, cs.visits);
+    ++cs.visits;
+    if (slot < options_.seeds_per_cell)
+    {
+      if (slot * variable_count_ >= cs.seeds.size())
+        cs.seeds.resize((slot + 1) * variable_count_);
+      std::copy(values.begin(), values.end(), cs.seeds.begin() + slot * variable_count_);
+    }
+  }
+
+  keys_.clear();
+  seed_offsets_.clear();
+  seeds_.clear();
+  size_[0] = size_[1] = size_[2] = 0;
+  if (cells.empty())
+    return true;
+
+  // the extent of the grid is the bounding box of the reached cells
+  boost::int64_t lo[3], hi[3];
+  lo[0] = lo[1] = lo[2] = std::numeric_limits<boost::int64_t>::max();
+  hi[0] = hi[1] = hi[2] = std::numeric_limits<boost::int64_t>::min();
+  for (std::map<CellCoordinates, CellSeeds>::const_iterator it = cells.begin() ; it != cells.end() ; ++it)
+  {
+    const boost::int64_t c[3] = { it->first.x, it->first.y, it->first.z };
+    for (int i = 0 ; i < 3 ; ++i)
+    {
+      lo[i] = std::min(lo[i], c[i]);
+      hi[i] = std::max(hi[i], c[i]);
+    }
+  }
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    origin_[i] = lo[i] * options_.resolution;
+    size_[i] = hi[i] - lo[i] + 1;
+  }
+
+  // sort the cells by their key and lay out their seeds contiguously
+  const boost::uint64_t bins = 6 * options_.direction_divisions * options_.direction_divisions * options_.roll_divisions;
+  std::vector<std::pair<boost::uint64_t, const CellSeeds*> > sorted;
+  sorted.reserve(cells.size());
+  for (std::map<CellCoordinates, CellSeeds>::const_iterator it = cells.begin() ; it != cells.end() ; ++it)
+  {
+    boost::uint64_t key = (((boost::uint64_t)(it->first.x - lo[0]) * size_[1] + (it->first.y - lo[1])) * size_[2] + (it->first.z - lo[2])) * bins + it->first.orientation;
+    sorted.push_back(std::make_pair(key, &it->second));
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  keys_.reserve(sorted.size());
+  seed_offsets_.reserve(sorted.size() + 1);
+  seed_offsets_.push_back(0);
+  for (std::size_t i = 0 ; i < sorted.size() ; ++i)
+  {
+    keys_.push_back(sorted[i].first);
+    seeds_.insert(seeds_.end(), sorted[i].second->seeds.begin(), sorted[i].second->seeds.end());
+    seed_offsets_.push_back(seeds_.size() / variable_count_);
+  }
+
+  logInform("Reachability map for group '%s' has %u reachable cells out of %lu sampled configurations",
+            group_name_.c_str(), (unsigned int)keys_.size(), (unsigned long)options_.samples);
+  return true;
+}
+
+bool constraint_samplers::ReachabilityMap::getCellKey(const Eigen::Vector3d &pos, const Eigen::Quaterniond &quat, boost::uint64_t &key) const
+{
+  boost::uint64_t idx[3];
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    double c = (pos[i] - origin_[i]) / options_.resolution;
+    if (!(c >= 0.0) || c >= size_[i])
+      return false;
+    idx[i] = (boost::uint64_t)c;
+  }
+  const boost::uint64_t bins = 6 * options_.direction_divisions * options_.direction_divisions * options_.roll_divisions;
+  key = ((idx[0] * size_[1] + idx[1]) * size_[2] + idx[2]) * bins + getOrientationBin(quat);
+  return true;
+}
+
+int constraint_samplers::ReachabilityMap::findCell(const Eigen::Vector3d &pos, const Eigen::Quaterniond &quat) const
+{
+  boost::uint64_t key;
+  if (!getCellKey(pos, quat, key))
+    return -1;
+  std::vector<boost::uint64_t>::const_iterator it = std::lower_bound(keys_.begin(), keys_.end(), key);
+  if (it == keys_.end() || *it != key)
+    return -1;
+  return it - keys_.begin();
+}
+
+bool constraint_samplers::ReachabilityMap::isReachable(const Eigen::Vector3d &pos, const Eigen::Quaterniond &quat) const
+{
+  return findCell(pos, quat) >= 0;
+}
+
+bool constraint_samplers::ReachabilityMap::getSeed(const Eigen::Vector3d &pos, const Eigen::Quaterniond &quat,
+                                                   random_numbers::RandomNumberGenerator &rng, std::vector<double> &seed) const
+{
+  int cell = findCell(pos, quat);
+  if (cell < 0)
+    return false;
+  boost::uint32_t first = seed_offsets_[cell];
+  boost::uint32_t count = seed_offsets_[cell + 1] - first;
+  if (count == 0)
+    return false;
+  std::size_t k = first + (count > 1 ? rng.uniformInteger(0, count - 1) : 0);
+  seed.assign(seeds_.begin() + k * variable_count_, seeds_.begin() + (k + 1) * variable_count_);
+  return true;
+}
+
+bool constraint_samplers::ReachabilityMap::save(const std::string &filename) const
+{
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  out.write(MAP_MAGIC, sizeof(MAP_MAGIC));
+  writeValue(out, MAP_VERSION);
+  writeString(out, group_name_);
+  writeString(out, tip_frame_);
+  writeString(out, base_frame_);
+  writeValue(out, options_.resolution);
+  writeValue(out, (boost::uint32_t)options_.direction_divisions);
+  writeValue(out, (boost::uint32_t)options_.roll_divisions);
+  writeValue(out, (boost::uint32_t)options_.seeds_per_cell);
+  writeValue(out, (boost::uint32_t)options_.samples);
+  for (int i = 0 ; i < 3 ; ++i)
+    writeValue(out, origin_[i]);
+  for (int i = 0 ; i < 3 ; ++i)
+    writeValue(out, size_[i]);
+  writeValue(out, (boost::uint64_t)variable_count_);
+  writeValue(out, (boost::uint64_t)keys_.size());
+  writeValue(out, (boost::uint64_t)seeds_.size());
+  writeVector(out, keys_);
+  writeVector(out, seed_offsets_);
+  writeVector(out, seeds_);
+  out.close();
+  if (!out.good())
+  {
+    logError("Unable to write reachability map to '%s'", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool constraint_samplers::ReachabilityMap::load(const std::string &filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(MAP_MAGIC)];
+  boost::uint32_t version;
+  if (!in.read(magic, sizeof(magic)) || memcmp(magic, MAP_MAGIC, sizeof(MAP_MAGIC)) != 0 || !readValue(in, version) || version != MAP_VERSION)
+  {
+    logError("File '%s' is not a reachability map", filename.c_str());
+    return false;
+  }
+
+  boost::uint32_t direction_divisions, roll_divisions, seeds_per_cell, samples;
+  boost::uint64_t variable_count, cell_count, seed_value_count;
+  bool ok = readString(in, group_name_) && readString(in, tip_frame_) && readString(in, base_frame_) &&
+    readValue(in, options_.resolution) && readValue(in, direction_divisions) && readValue(in, roll_divisions) &&
+    readValue(in, seeds_per_cell) && readValue(in, samples);
+  for (int i = 0 ; ok && i < 3 ; ++i)
+    ok = readValue(in, origin_[i]);
+  for (int i = 0 ; ok && i < 3 ; ++i)
+    ok = readValue(in, size_[i]);
+  ok = ok && readValue(in, variable_count) && readValue(in, cell_count) && readValue(in, seed_value_count) &&
+    options_.resolution > 0.0 && direction_divisions > 0 && roll_divisions > 0 && variable_count > 0 &&
+    cell_count < std::numeric_limits<boost::uint32_t>::max() && seed_value_count % variable_count == 0;
+  ok = ok && readVector(in, keys_, cell_count) && readVector(in, seed_offsets_, cell_count + 1) && readVector(in, seeds_, seed_value_count);
+  for (std::size_t i = 0 ; ok && i < cell_count ; ++i)
+    ok = seed_offsets_[i] <= seed_offsets_[i + 1] && (i == 0 || keys_[i - 1] < keys_[i]);
+  if (!ok || seed_offsets_.back() * variable_count != seed_value_count)
+  {
+    logError("Reachability map '%s' is truncated or corrupted", filename.c_str());
+    keys_.clear();
+    seed_offsets_.clear();
+    seeds_.clear();
+    return false;
+  }
+
+  options_.direction_divisions = direction_divisions;
+  options_.roll_divisions = roll_divisions;
+  options_.seeds_per_cell = seeds_per_cell;
+  options_.samples = samples;
+  variable_count_ = variable_count;
+  return true;
+}
@@ -52,6 +52,7 @@
 #include <fstream>
 #include <boost/bind.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
 
 #include "pr2_arm_kinematics_plugin.h"
 
@@ -477,6 +478,104 @@ TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerValid)
   }
 }
 
+TEST_F(LoadPlanningModelsPr2, ReachabilityMapIKSampler)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+  robot_state::RobotState ks_const(kmodel);
+  ks_const.setToDefaultValues();
+  ks_const.update();
+
+  const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("left_arm");
+  constraint_samplers::ReachabilityMap::Options options;
+  options.samples = 20000;
+  options.resolution = 0.1;
+  options.direction_divisions = 1;
+  options.roll_divisions = 1;
+  constraint_samplers::ReachabilityMapPtr map(new constraint_samplers::ReachabilityMap());
+  ASSERT_TRUE(map->compute(ks_const, jmg, "l_wrist_roll_link", "torso_lift_link", options));
+  EXPECT_GT(map->getCellCount(), 0u);
+  EXPECT_EQ(jmg->getVariableCount(), map->getVariableCount());
+
+  // seeds recorded for a cell reach that cell
+  const Eigen::Affine3d base_inv = ks_const.getFrameTransform("torso_lift_link").inverse();
+  random_numbers::RandomNumberGenerator rng;
+  std::vector<double> seed;
+  int seeded = 0;
+  for (int t = 0 ; t < 100 ; ++t)
+  {
+    ks.setToRandomPositions(jmg);
+    Eigen::Affine3d pose = base_inv * ks.getGlobalLinkTransform("l_wrist_roll_link");
+    Eigen::Quaterniond quat(pose.rotation());
+    if (!map->getSeed(pose.translation(), quat, rng, seed))
+      continue;
+    ++seeded;
+    EXPECT_TRUE(map->isReachable(pose.translation(), quat));
+    ks.setJointGroupPositions(jmg, seed);
+    Eigen::Affine3d seed_pose = base_inv * ks.getGlobalLinkTransform("l_wrist_roll_link");
+    EXPECT_TRUE(map->isReachable(seed_pose.translation(), Eigen::Quaterniond(seed_pose.rotation())));
+  }
+  EXPECT_GT(seeded, 0);
+  EXPECT_FALSE(map->isReachable(Eigen::Vector3d(100.0, 0.0, 0.0), Eigen::Quaterniond::Identity()));
+
+  // the map survives a round trip through a file
+  std::string filename = (boost::filesystem::temp_directory_path() / "test_reachability_map.bin").string();
+  ASSERT_TRUE(map->save(filename));
+  constraint_samplers::ReachabilityMapPtr loaded(new constraint_samplers::ReachabilityMap());
+  ASSERT_TRUE(loaded->load(filename));
+  boost::filesystem::remove(filename);
+  EXPECT_EQ(map->getCellCount(), loaded->getCellCount());
+  EXPECT_EQ("left_arm", loaded->getGroupName());
+  for (int t = 0 ; t < 100 ; ++t)
+  {
+    ks.setToRandomPositions(jmg);
+    Eigen::Affine3d pose = base_inv * ks.getGlobalLinkTransform("l_wrist_roll_link");
+    Eigen::Quaterniond quat(pose.rotation());
+    EXPECT_EQ(map->isReachable(pose.translation(), quat), loaded->isReachable(pose.translation(), quat));
+  }
+
+  robot_state::Transforms &tf = ps->getTransformsNonConst();
+  kinematic_constraints::PositionConstraint pc(kmodel);
+  moveit_msgs::PositionConstraint pcm;
+  pcm.link_name = "l_wrist_roll_link";
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = 0.001;
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = 0.55;
+  pcm.constraint_region.primitive_poses[0].position.y = 0.2;
+  pcm.constraint_region.primitive_poses[0].position.z = 1.25;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+  EXPECT_TRUE(pc.configure(pcm, tf));
+
+  constraint_samplers::IKConstraintSampler iks(ps, "left_arm");
+  EXPECT_FALSE(iks.setReachabilityMap(map));
+  EXPECT_TRUE(iks.configure(constraint_samplers::IKSamplingPose(pc)));
+  EXPECT_TRUE(iks.setReachabilityMap(map));
+
+  int succ = 0;
+  for (int t = 0 ; t < 20 ; ++t)
+    if (iks.sample(ks, ks_const, 100))
+    {
+      ++succ;
+      EXPECT_TRUE(pc.decide(ks).satisfied);
+    }
+  EXPECT_GT(succ, 0);
+
+  // a map for another group is refused
+  constraint_samplers::IKConstraintSampler iks_right(ps, "right_arm");
+  moveit_msgs::PositionConstraint pcm_right = pcm;
+  pcm_right.link_name = "r_wrist_roll_link";
+  kinematic_constraints::PositionConstraint pc_right(kmodel);
+  EXPECT_TRUE(pc_right.configure(pcm_right, tf));
+  EXPECT_TRUE(iks_right.configure(constraint_samplers::IKSamplingPose(pc_right)));
+  EXPECT_FALSE(iks_right.setReachabilityMap(map));
+}
+
 TEST_F(LoadPlanningModelsPr2, UnionConstraintSampler)
 {
   robot_state::RobotState ks(kmodel);
@@ -323,6 +323,47 @@ public:
   double getDistanceGradient(double x, double y, double z,
                              double& gradient_x, double& gradient_y, double& gradient_z,
                              bool& in_bounds) const;
+  /**
+   * \brief Gets the distances at a batch of locations, interpolated
+   * trilinearly between the centers of the eight surrounding cells,
+   * and optionally the analytic gradients of the interpolated
+   * distances.
+   *
+   * Unlike \ref getDistanceGradient, which returns the distance of
+   * the nearest cell and a central difference, the results vary
+   * continuously with the location, which suits gradient-based
+   * optimizers.  Locations that are not enclosed by cell centers get
+   * the uninitialized distance and a zero gradient.
+   *
+   * The default implementation reads eight cells per location through
+   * \ref getDistance(int,int,int); derived classes may read their
+   * storage directly.
+   *
+   * @param [in] points The locations, as consecutive x, y, z triples
+   * @param [in] count The number of locations
+   * @param [out] distances Receives count distances
+   * @param [out] gradients If not NULL, receives count gradients as consecutive x, y, z triples
+   *
+   * @return The number of locations that were enclosed by cell centers
+   */
+  virtual std::size_t getInterpolatedDistances(const double* points, std::size_t count,
+                                               double* distances, double* gradients = NULL) const;
+
+  /**
+   * \brief Gets interpolated distances, and optionally gradients, for
+   * a set of points.  See
+   * \ref getInterpolatedDistances(const double*, std::size_t, double*, double*) const.
+   *
+   * @param [in] points The locations
+   * @param [out] distances Resized to hold a distance for each location
+   * @param [out] gradients If not NULL, resized to hold a gradient for each location
+   *
+   * @return The number of locations that were enclosed by cell centers
+   */
+  std::size_t getInterpolatedDistances(const EigenSTL::vector_Vector3d& points,
+                                       std::vector<double>& distances,
+                                       EigenSTL::vector_Vector3d* gradients = NULL) const;
+
   /**
    * \brief Gets the distance to the closest obstacle at the given
    * integer cell location. The particulars of this function are
@@ -0,0 +1,214 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_DISTANCE_FIELD_MAPPED_DISTANCE_FIELD_
+#define MOVEIT_DISTANCE_FIELD_MAPPED_DISTANCE_FIELD_
+
+#include <moveit/distance_field/propagation_distance_field.h>
+#include <moveit/distance_field/sparse_propagation_distance_field.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+
+namespace distance_field
+{
+
+/**
+ * \brief A read-only DistanceField that answers queries directly from
+ * a memory-mapped file written by \ref save.
+ *
+ * The file stores the distances of a propagated field as single
+ * precision values in cubic chunks of \ref CHUNK_SIZE cells along each
+ * axis.  Chunks in which every cell has the same distance - free space
+ * beyond the propagation distance, or the inside of large obstacles -
+ * are stored as a single value in the chunk table, so files of mostly
+ * empty workspaces are small.  Loading a file only maps it; no
+ * propagation is run, and processes that map the same file share its
+ * pages.
+ *
+ * The mapped data is never modified.  The first call that changes the
+ * field (adding, removing or updating points, \ref reset or \ref
+ * readFromStream) copies the occupancy of the mapped field into an
+ * in-memory \ref PropagationDistanceField, and all later queries are
+ * answered by that copy.  As the copy is propagated again from the
+ * occupancy, its distances can differ from the saved ones by the
+ * approximation error of the propagation.
+ */
+class MappedDistanceField: public DistanceField
+{
+public:
+
+  static const int CHUNK_SIZE = 8; /**< \brief Number of cells along each axis of a chunk */
+
+  /**
+   * \brief Constructor that maps a file written by \ref save.
+   *
+   * A field that failed to map would read as free space, so if the
+   * file cannot be mapped or is not a valid distance field file, a
+   * moveit::ConstructException is thrown.
+   *
+   * @param [in] filename The file to map
+   */
+  MappedDistanceField(const std::string& filename);
+
+  virtual ~MappedDistanceField();
+
+  /**
+   * \brief Writes the distances of a propagated field to a file that
+   * can be mapped by this class.
+   *
+   * The file is written under a temporary name and then renamed, so
+   * processes that have the previous version mapped are not affected.
+   *
+   * @return True if the file was written; otherwise False.
+   */
+  static bool save(const std::string& filename, const PropagationDistanceField& field);
+
+  /**
+   * \brief Writes the distances of a sparse field to a file that can
+   * be mapped by this class.  See \ref save.
+   */
+  static bool save(const std::string& filename, const SparsePropagationDistanceField& field);
+
+  /**
+   * \brief Checks whether a file starts with the signature written by \ref save.
+   */
+  static bool isMappedDistanceFieldFile(const std::string& filename);
+
+  /**
+   * \brief Whether the field has been modified, so that queries are
+   * answered by an in-memory copy rather than the mapped file.
+   */
+  bool hasOverlay() const
+  {
+    return overlay_.get() != NULL;
+  }
+
+  /**
+   * \brief Whether the saved field propagated negative distances.
+   */
+  bool getPropagateNegativeDistances() const
+  {
+    return propagate_negative_;
+  }
+
+  //passthrough docs to DistanceField
+  virtual void addPointsToField(const EigenSTL::vector_Vector3d& points);
+  virtual void removePointsFromField(const EigenSTL::vector_Vector3d& points);
+  virtual void updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                   const EigenSTL::vector_Vector3d& new_points);
+  virtual void reset();
+  virtual double getDistance(double x, double y, double z) const;
+  virtual double getDistance(int x, int y, int z) const;
+  virtual bool isCellValid(int x, int y, int z) const;
+  virtual int getXNumCells() const;
+  virtual int getYNumCells() const;
+  virtual int getZNumCells() const;
+  virtual bool gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const;
+  virtual bool worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const;
+
+  /**
+   * \brief Writes the occupancy of the field to the supplied stream,
+   * in the format used by \ref PropagationDistanceField::writeToStream.
+   */
+  virtual bool writeToStream(std::ostream& stream) const;
+
+  /**
+   * \brief Replaces the field with an in-memory copy read from the
+   * format used by \ref PropagationDistanceField::readFromStream.  The
+   * maximum distance and negative propagation of the mapped file are
+   * kept.
+   */
+  virtual bool readFromStream(std::istream& stream);
+
+  //passthrough docs to DistanceField
+  virtual double getUninitializedDistance() const
+  {
+    return max_distance_;
+  }
+
+private:
+
+  /** \brief An entry of the chunk table */
+  struct ChunkEntry
+  {
+    boost::uint32_t index_;     /**< \brief Index of the stored chunk, or UNIFORM_CHUNK */
+    float           value_;     /**< \brief Distance of every cell if the chunk is uniform */
+  };
+
+  static const boost::uint32_t UNIFORM_CHUNK = 0xffffffff;
+
+  template <typename Field>
+  static bool saveField(const std::string& filename, const Field& field);
+
+  /** \brief Computes the cell counts and world to grid conversion from the DistanceField parameters */
+  void initializeGeometry();
+
+  /** \brief Creates the in-memory copy of the mapped field, if it does not exist yet */
+  PropagationDistanceField& getOverlay();
+
+  /** \brief Gets the distance of a valid cell from the mapped file */
+  double getMappedDistance(int x, int y, int z) const
+  {
+    const ChunkEntry& chunk = chunks_[(std::size_t(x / CHUNK_SIZE) * num_chunks_[DIM_Y] + std::size_t(y / CHUNK_SIZE)) *
+                                      num_chunks_[DIM_Z] + std::size_t(z / CHUNK_SIZE)];
+    if (chunk.index_ == UNIFORM_CHUNK)
+      return chunk.value_;
+    return chunk_data_[std::size_t(chunk.index_) * CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE +
+                       ((x % CHUNK_SIZE) * CHUNK_SIZE + (y % CHUNK_SIZE)) * CHUNK_SIZE + (z % CHUNK_SIZE)];
+  }
+
+  boost::interprocess::file_mapping file_;    /**< \brief The mapped file */
+  boost::interprocess::mapped_region region_; /**< \brief The mapped region covering the whole file */
+
+  const ChunkEntry* chunks_;    /**< \brief The chunk table */
+  const float* chunk_data_;     /**< \brief The stored chunks, each with Z varying fastest */
+
+  bool propagate_negative_;     /**< \brief Whether or not the saved field propagated negative distances */
+  double max_distance_;         /**< \brief Maximum distance of the saved field */
+  double out_of_bounds_distance_; /**< \brief Distance reported for locations outside the field */
+
+  int num_cells_[3];            /**< \brief The number of cells in each dimension */
+  int num_chunks_[3];           /**< \brief The number of chunks in each dimension */
+  double origin_minus_[3];      /**< \brief origin - 0.5*resolution in each dimension */
+  double oo_resolution_;        /**< \brief 1.0/resolution_ */
+
+  boost::scoped_ptr<PropagationDistanceField> overlay_; /**< \brief In-memory copy that replaces the mapping once the field is modified */
+};
+
+}
+
+#endif
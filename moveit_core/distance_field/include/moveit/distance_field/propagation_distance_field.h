@@ -330,6 +330,43 @@ public:
    */
   virtual double getDistance(int x, int y, int z) const;
 
+  using DistanceField::getInterpolatedDistances;
+
+  /**
+   * \brief Gets interpolated distances, and optionally gradients, for
+   * a batch of locations.  See
+   * \ref DistanceField::getInterpolatedDistances.
+   *
+   * Locations are handled in small blocks: the enclosing cells of a
+   * block are read straight from the voxel grid, or from the float
+   * distance cache if it is enabled, and the block is then
+   * interpolated in plain loops that the compiler can vectorize.
+   */
+  virtual std::size_t getInterpolatedDistances(const double* points, std::size_t count,
+                                               double* distances, double* gradients = NULL) const;
+
+  /**
+   * \brief Enables or disables a cache holding the distance of every
+   * cell as a float.
+   *
+   * Interpolated queries then read 4 contiguous bytes per cell instead
+   * of a full \ref PropDistanceFieldVoxel, which makes large batches
+   * much more cache friendly; their results are rounded to float
+   * precision.  The cache takes 4 bytes per cell and is refreshed
+   * around the changed cells whenever obstacles are added or removed.
+   *
+   * @param [in] enable Whether to keep the cache
+   */
+  void setFloatDistanceCache(bool enable);
+
+  /**
+   * \brief Checks whether the float distance cache is enabled.
+   */
+  bool hasFloatDistanceCache() const
+  {
+    return float_distance_cache_;
+  }
+
   virtual bool isCellValid(int x, int y, int z) const;
   virtual int getXNumCells() const;
   virtual int getYNumCells() const;
@@ -437,6 +474,37 @@ public:
     return NULL;
   }
 
+  /**
+   * \brief Sets the number of threads used to propagate distances.
+   *
+   * Bucket queue levels that hold many cells are expanded by all
+   * threads at once; the resulting distances are identical to those
+   * computed by a single thread.  A value of 0 means one thread per
+   * hardware core.  The default is 1.
+   *
+   * @param [in] threads The number of threads
+   */
+  void setPropagationThreads(unsigned int threads)
+  {
+    propagation_threads_ = threads;
+  }
+
+  /**
+   * \brief Gets the number of threads used to propagate distances.
+   */
+  unsigned int getPropagationThreads() const
+  {
+    return propagation_threads_;
+  }
+
+  /**
+   * \brief Gets whether or not negative distances are propagated.
+   */
+  bool getPropagateNegativeDistances() const
+  {
+    return propagate_negative_;
+  }
+
   /**
    * \brief Gets the maximum distance squared value.
    *
@@ -454,6 +522,11 @@ private:
 
   typedef std::set<Eigen::Vector3i, compareEigen_Vector3i> VoxelSet; /**< \brief Typedef for set of integer indices */
 
+  typedef std::vector<std::vector<Eigen::Vector3i> > BucketQueue; /**< \brief Cells to expand, indexed by distance squared */
+
+  /** \brief Shared state of the threads of a parallel propagation, defined in the source file */
+  struct ParallelPropagation;
+
   /**
    * \brief Initializes the field, resetting the voxel grid and
    * building a sqrt lookup table for efficiency based on
@@ -492,6 +565,58 @@ private:
    */
   void propagateNegative();
 
+  /**
+   * \brief Propagates the contents of a bucket queue, on
+   * \ref propagation_threads_ threads, and clears the queue.  The
+   * member pointers select the positive or negative distance fields
+   * of the voxels.
+   */
+  void propagate(BucketQueue& bucket_queue,
+                 int PropDistanceFieldVoxel::*distance_square,
+                 Eigen::Vector3i PropDistanceFieldVoxel::*closest_point,
+                 int PropDistanceFieldVoxel::*update_direction);
+
+  /**
+   * \brief Expands the cells at one level of a bucket queue on the
+   * calling thread, and clears that level.
+   */
+  void propagateLevel(BucketQueue& bucket_queue, unsigned int level,
+                      int PropDistanceFieldVoxel::*distance_square,
+                      Eigen::Vector3i PropDistanceFieldVoxel::*closest_point,
+                      int PropDistanceFieldVoxel::*update_direction);
+
+  /**
+   * \brief Computes the updates that one thread's share of the
+   * current level could make, without modifying any voxel.
+   */
+  void collectPropagationCandidates(ParallelPropagation& state, unsigned int thread) const;
+
+  /**
+   * \brief Applies, in serial order, the updates to the cells owned
+   * by one thread.
+   */
+  void applyPropagationCandidates(ParallelPropagation& state, unsigned int thread);
+
+  /**
+   * \brief Loop run by the helper threads of a parallel propagation.
+   */
+  void propagationWorker(ParallelPropagation* state, unsigned int thread);
+
+  /**
+   * \brief Refreshes the float distance cache for all cells that may
+   * have changed because the given cells were added or removed, which
+   * are those within the maximum distance of them.
+   *
+   * @param voxel_points The cells that were added or removed
+   */
+  void updateFloatDistances(const std::vector<Eigen::Vector3i>& voxel_points);
+
+  /**
+   * \brief Refreshes the float distance cache within a box of cells,
+   * bounds included.
+   */
+  void updateFloatDistances(const Eigen::Vector3i& min_cell, const Eigen::Vector3i& max_cell);
+
   /**
    * \brief Determines distance based on actual voxel data
    *
@@ -556,6 +681,8 @@ private:
 
   bool propagate_negative_;     /**< \brief Whether or not to propagate negative distances */
 
+  unsigned int propagation_threads_; /**< \brief Number of threads used for propagation, 0 for one per core */
+
   boost::shared_ptr<VoxelGrid<PropDistanceFieldVoxel> > voxel_grid_; /**< \brief Actual container for distance data */
 
   /// \brief Structure used to hold propagation frontier
@@ -568,6 +695,9 @@ private:
 
   std::vector<double> sqrt_table_; /**< \brief Precomputed square root table for faster distance lookups */
 
+  bool float_distance_cache_;   /**< \brief Whether \ref float_distances_ is maintained */
+  std::vector<float> float_distances_; /**< \brief The distance of every cell, in voxel grid order, if \ref float_distance_cache_ is set */
+
   /**
    * \brief Holds information on neighbor direction, with 27 different
    * directions.  Shows where to propagate given an integer distance
@@ -0,0 +1,292 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_DISTANCE_FIELD_SPARSE_PROPAGATION_DISTANCE_FIELD_
+#define MOVEIT_DISTANCE_FIELD_SPARSE_PROPAGATION_DISTANCE_FIELD_
+
+#include <moveit/distance_field/propagation_distance_field.h>
+#include <boost/unordered_map.hpp>
+#include <vector>
+
+namespace distance_field
+{
+
+/**
+ * \brief A DistanceField implementation that computes the same
+ * values as \ref PropagationDistanceField, but only stores voxels in
+ * the vicinity of obstacles.
+ *
+ * The volume is divided into cubic blocks of \ref BLOCK_SIZE cells
+ * along each axis.  A block is allocated the first time propagation
+ * writes to one of its cells, so memory is proportional to the volume
+ * within max_distance of the obstacles rather than to the bounding
+ * box.  Cells in blocks that have never been allocated are free space
+ * beyond the propagation distance, and report
+ * \ref getUninitializedDistance.
+ *
+ * Propagation uses the same bucket queue as the dense field and
+ * crosses block boundaries transparently.  The class is a good fit
+ * for large workspaces with few obstacles; for small, cluttered
+ * volumes the dense \ref PropagationDistanceField is faster.
+ */
+class SparsePropagationDistanceField: public DistanceField
+{
+public:
+
+  static const int BLOCK_SIZE = 8; /**< \brief Number of cells along each axis of a block */
+
+  /**
+   * \brief Constructor that initializes entire distance field to
+   * empty - no blocks are allocated and all cells report the maximum
+   * distance.  Arguments are as for the equivalent
+   * \ref PropagationDistanceField constructor.
+   *
+   * @param [in] size_x The X dimension in meters of the volume to represent
+   * @param [in] size_y The Y dimension in meters of the volume to represent
+   * @param [in] size_z The Z dimension in meters of the volume to represent
+   * @param [in] resolution The resolution in meters of the volume
+   * @param [in] origin_x The minimum X point of the volume
+   * @param [in] origin_y The minimum Y point of the volume
+   * @param [in] origin_z The minimum Z point of the volume
+   *
+   * @param [in] max_distance The maximum distance to which to
+   * propagate distance values.
+   *
+   * @param [in] propagate_negative_distances Whether or not to
+   * propagate negative distances.
+   */
+  SparsePropagationDistanceField(double size_x,
+                                 double size_y,
+                                 double size_z,
+                                 double resolution,
+                                 double origin_x, double origin_y, double origin_z,
+                                 double max_distance,
+                                 bool propagate_negative_distances=false);
+
+  /**
+   * \brief Constructor that reads a distance field saved with
+   * \ref writeToStream (or with
+   * \ref PropagationDistanceField::writeToStream, as the formats are
+   * the same).
+   *
+   * @param [in] stream The stream from which to read the data
+   * @param [in] max_distance The maximum distance to which to propagate distance values.
+   * @param [in] propagate_negative_distances Whether or not to propagate negative distances.
+   */
+  SparsePropagationDistanceField(std::istream& stream,
+                                 double max_distance,
+                                 bool propagate_negative_distances=false);
+
+  virtual ~SparsePropagationDistanceField(){}
+
+  //passthrough docs to DistanceField
+  virtual void addPointsToField(const EigenSTL::vector_Vector3d& points);
+  virtual void removePointsFromField(const EigenSTL::vector_Vector3d& points);
+  virtual void updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                   const EigenSTL::vector_Vector3d& new_points);
+
+  /**
+   * \brief Resets the distance field by releasing all allocated blocks.
+   */
+  virtual void reset();
+
+  virtual double getDistance(double x, double y, double z) const;
+  virtual double getDistance(int x, int y, int z) const;
+  virtual bool isCellValid(int x, int y, int z) const;
+  virtual int getXNumCells() const;
+  virtual int getYNumCells() const;
+  virtual int getZNumCells() const;
+  virtual bool gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const;
+  virtual bool worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const;
+
+  /**
+   * \brief Writes the occupancy of the field to the supplied stream,
+   * in the format used by \ref PropagationDistanceField::writeToStream.
+   */
+  virtual bool writeToStream(std::ostream& stream) const;
+
+  /**
+   * \brief Reads, parameterizes, and populates the distance field in
+   * the format used by \ref PropagationDistanceField::readFromStream.
+   */
+  virtual bool readFromStream(std::istream& stream);
+
+  //passthrough docs to DistanceField
+  virtual double getUninitializedDistance() const
+  {
+    return max_distance_;
+  }
+
+  /**
+   * \brief Gets full cell data given an index.
+   *
+   * x,y,z MUST be valid.  If the cell lies in a block that has not
+   * been allocated, a shared voxel holding the maximum distance is
+   * returned; its closest points are uninitialized.
+   *
+   * @param [in] x The integer X location
+   * @param [in] y The integer Y location
+   * @param [in] z The integer Z location
+   *
+   * @return The data in the indicated cell.
+   */
+  const PropDistanceFieldVoxel& getCell(int x, int y, int z) const
+  {
+    const PropDistanceFieldVoxel* cell = findCell(x, y, z);
+    return cell ? *cell : unallocated_voxel_;
+  }
+
+  /**
+   * \brief Checks whether the block holding the given cell has been
+   * allocated.  x,y,z MUST be valid.
+   */
+  bool isCellAllocated(int x, int y, int z) const
+  {
+    return findCell(x, y, z) != NULL;
+  }
+
+  /**
+   * \brief Gets the number of blocks currently allocated.
+   */
+  std::size_t getAllocatedBlockCount() const
+  {
+    return blocks_.size();
+  }
+
+  /**
+   * \brief Gets whether or not negative distances are propagated.
+   */
+  bool getPropagateNegativeDistances() const
+  {
+    return propagate_negative_;
+  }
+
+  /**
+   * \brief Gets the maximum distance squared value, in cells.
+   */
+  int getMaximumDistanceSquared() const
+  {
+    return max_distance_sq_;
+  }
+
+private:
+
+  /** \brief The cells of one block, stored with Z varying fastest */
+  struct VoxelBlock
+  {
+    PropDistanceFieldVoxel cells_[BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE];
+  };
+
+  typedef boost::unordered_map<std::size_t, VoxelBlock> BlockMap;
+
+  typedef std::set<Eigen::Vector3i, compareEigen_Vector3i> VoxelSet; /**< \brief Typedef for set of integer indices */
+
+  /**
+   * \brief Initializes the grid dimensions, the sqrt lookup table and
+   * the neighborhoods, and releases all blocks.
+   */
+  void initialize();
+
+  /** \brief Gets the key of the block containing a valid cell */
+  std::size_t getBlockKey(int x, int y, int z) const
+  {
+    return (std::size_t(x / BLOCK_SIZE) * num_blocks_[DIM_Y] + std::size_t(y / BLOCK_SIZE)) * num_blocks_[DIM_Z] +
+      std::size_t(z / BLOCK_SIZE);
+  }
+
+  /** \brief Gets the index of a valid cell within its block */
+  static int getIndexInBlock(int x, int y, int z)
+  {
+    return ((x % BLOCK_SIZE) * BLOCK_SIZE + (y % BLOCK_SIZE)) * BLOCK_SIZE + (z % BLOCK_SIZE);
+  }
+
+  /** \brief Gets a valid cell, or NULL if its block is not allocated */
+  const PropDistanceFieldVoxel* findCell(int x, int y, int z) const;
+
+  /** \brief Gets a valid cell, or NULL if its block is not allocated */
+  PropDistanceFieldVoxel* findCell(int x, int y, int z);
+
+  /** \brief Gets a valid cell, allocating its block if needed */
+  PropDistanceFieldVoxel& getOrCreateCell(int x, int y, int z);
+
+  void addNewObstacleVoxels(const std::vector<Eigen::Vector3i>& voxel_points);
+  void removeObstacleVoxels(const std::vector<Eigen::Vector3i>& voxel_points);
+  void propagatePositive();
+  void propagateNegative();
+
+  double getDistance(const PropDistanceFieldVoxel& object) const
+  {
+    return sqrt_table_[object.distance_square_]-sqrt_table_[object.negative_distance_square_];
+  }
+
+  static int getDirectionNumber(int dx, int dy, int dz)
+  {
+    return (dx+1)*9 + (dy+1)*3 + dz+1;
+  }
+
+  void initNeighborhoods();
+
+  static int eucDistSq(const Eigen::Vector3i& point1, const Eigen::Vector3i& point2);
+
+  bool propagate_negative_;     /**< \brief Whether or not to propagate negative distances */
+
+  double max_distance_;         /**< \brief Holds maximum distance  */
+  int max_distance_sq_;         /**< \brief Holds maximum distance squared in cells */
+
+  int num_cells_[3];            /**< \brief The number of cells in each dimension */
+  int num_blocks_[3];           /**< \brief The number of blocks in each dimension */
+  double origin_minus_[3];      /**< \brief origin - 0.5*resolution in each dimension */
+  double oo_resolution_;        /**< \brief 1.0/resolution_ */
+
+  BlockMap blocks_;             /**< \brief The allocated blocks, keyed by \ref getBlockKey */
+
+  std::size_t last_block_key_;  /**< \brief Key of the most recently looked up block, used during propagation */
+  VoxelBlock* last_block_;      /**< \brief Most recently looked up block, or NULL */
+
+  PropDistanceFieldVoxel unallocated_voxel_; /**< \brief Value returned by \ref getCell for unallocated cells */
+
+  std::vector<std::vector<Eigen::Vector3i> > bucket_queue_; /**< \brief Positive propagation frontier, indexed by distance squared */
+  std::vector<std::vector<Eigen::Vector3i> > negative_bucket_queue_; /**< \brief Negative propagation frontier, indexed by distance squared */
+
+  std::vector<double> sqrt_table_; /**< \brief Precomputed square root table for faster distance lookups */
+
+  /** \brief Neighborhoods to expand, as in \ref PropagationDistanceField */
+  std::vector<std::vector<std::vector<Eigen::Vector3i > > > neighborhoods_;
+
+  std::vector<Eigen::Vector3i > direction_number_to_direction_; /**< \brief Holds conversion from direction number to integer changes */
+};
+
+}
+
+#endif
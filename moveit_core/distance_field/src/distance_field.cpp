@@ -85,6 +85,87 @@ double distance_field::DistanceField::getDistanceGradient(double x, double y, do
   return getDistance(gx,gy,gz);
 }
 
+std::size_t distance_field::DistanceField::getInterpolatedDistances(const double* points, std::size_t count,
+                                                                   double* distances, double* gradients) const
+{
+  const int num_cells[3] = { getXNumCells(), getYNumCells(), getZNumCells() };
+  const double origin[3] = { origin_x_, origin_y_, origin_z_ };
+  std::size_t in_bounds = 0;
+
+  for (std::size_t i = 0 ; i < count ; ++i, points += 3)
+  {
+    // the cell whose center is the lower corner of the enclosing cube, and the location within the cube
+    int cell[3];
+    double t[3];
+    bool valid = true;
+    for (int d = 0 ; d < 3 ; ++d)
+    {
+      double f = (points[d] - origin[d]) / resolution_;
+      if (num_cells[d] < 2 || !(f >= 0.0 && f <= num_cells[d] - 1))
+      {
+        valid = false;
+        break;
+      }
+      cell[d] = std::min(static_cast<int>(f), num_cells[d] - 2);
+      t[d] = f - cell[d];
+    }
+
+    if (!valid)
+    {
+      distances[i] = getUninitializedDistance();
+      if (gradients)
+        std::fill(gradients + 3 * i, gradients + 3 * i + 3, 0.0);
+      continue;
+    }
+    ++in_bounds;
+
+    double c[2][2][2];
+    for (int dx = 0 ; dx < 2 ; ++dx)
+      for (int dy = 0 ; dy < 2 ; ++dy)
+        for (int dz = 0 ; dz < 2 ; ++dz)
+          c[dx][dy][dz] = getDistance(cell[0] + dx, cell[1] + dy, cell[2] + dz);
+
+    // interpolate along Z, then Y, then X
+    double cz[2][2];
+    for (int dx = 0 ; dx < 2 ; ++dx)
+      for (int dy = 0 ; dy < 2 ; ++dy)
+        cz[dx][dy] = c[dx][dy][0] + t[2] * (c[dx][dy][1] - c[dx][dy][0]);
+    double cy0 = cz[0][0] + t[1] * (cz[0][1] - cz[0][0]);
+    double cy1 = cz[1][0] + t[1] * (cz[1][1] - cz[1][0]);
+    distances[i] = cy0 + t[0] * (cy1 - cy0);
+
+    if (gradients)
+    {
+      double* g = gradients + 3 * i;
+      g[0] = (cy1 - cy0) / resolution_;
+      double dy0 = cz[0][1] - cz[0][0];
+      double dy1 = cz[1][1] - cz[1][0];
+      g[1] = (dy0 + t[0] * (dy1 - dy0)) / resolution_;
+      double dz[2][2];
+      for (int dx = 0 ; dx < 2 ; ++dx)
+        for (int dy = 0 ; dy < 2 ; ++dy)
+          dz[dx][dy] = c[dx][dy][1] - c[dx][dy][0];
+      double dz0 = dz[0][0] + t[1] * (dz[0][1] - dz[0][0]);
+      double dz1 = dz[1][0] + t[1] * (dz[1][1] - dz[1][0]);
+      g[2] = (dz0 + t[0] * (dz1 - dz0)) / resolution_;
+    }
+  }
+  return in_bounds;
+}
+
+std::size_t distance_field::DistanceField::getInterpolatedDistances(const EigenSTL::vector_Vector3d& points,
+                                                                   std::vector<double>& distances,
+                                                                   EigenSTL::vector_Vector3d* gradients) const
+{
+  distances.resize(points.size());
+  if (points.empty())
+    return 0;
+  if (gradients)
+    gradients->resize(points.size());
+  return getInterpolatedDistances(points[0].data(), points.size(), &distances[0],
+                                  gradients ? (*gradients)[0].data() : NULL);
+}
+
 void distance_field::DistanceField::getIsoSurfaceMarkers(double min_distance, double max_distance,
                                          const std::string & frame_id, const ros::Time stamp,
                                          visualization_msgs::Marker& inf_marker) const
@@ -0,0 +1,502 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/distance_field/mapped_distance_field.h>
+#include <moveit/exceptions/exceptions.h>
+#include <console_bridge/console.h>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <algorithm>
+#include <bitset>
+#include <fstream>
+#include <limits>
+#include <cstring>
+
+namespace distance_field
+{
+
+const int MappedDistanceField::CHUNK_SIZE;
+const boost::uint32_t MappedDistanceField::UNIFORM_CHUNK;
+
+namespace
+{
+
+// Sections are stored in native byte order; the byte order mark rejects files written on a machine with a
+// different one. The layout is:
+//   FileHeader
+//   ChunkEntry chunks[chunk_count_]                       at chunks_offset_
+//   float data[stored_chunk_count_][CHUNK_CELLS]          at data_offset_
+// Chunks are ordered with Z varying fastest, as are the cells within a chunk. Cells of partial chunks that lie
+// outside the field hold the value of the first cell of the chunk.
+const char FILE_MAGIC[8] = { 'M', 'O', 'V', 'E', 'I', 'T', 'D', 'F' };
+const boost::uint32_t FILE_VERSION = 1;
+const boost::uint32_t FILE_BYTE_ORDER_MARK = 0x01020304;
+const int CHUNK_CELLS = MappedDistanceField::CHUNK_SIZE * MappedDistanceField::CHUNK_SIZE * MappedDistanceField::CHUNK_SIZE;
+
+struct FileHeader
+{
+  char            magic_[8];
+  boost::uint32_t version_;
+  boost::uint32_t byte_order_;
+  double          resolution_;
+  double          size_[3];
+  double          origin_[3];
+  double          max_distance_;
+  boost::uint64_t propagate_negative_;
+  boost::uint64_t num_cells_[3];
+  boost::uint64_t chunk_count_;
+  boost::uint64_t stored_chunk_count_;
+  boost::uint64_t chunks_offset_;
+  boost::uint64_t data_offset_;
+};
+
+boost::uint64_t align8(boost::uint64_t value)
+{
+  return (value + 7) & ~(boost::uint64_t)7;
+}
+
+boost::uint64_t getChunkCount(boost::uint64_t num_cells)
+{
+  return (num_cells + MappedDistanceField::CHUNK_SIZE - 1) / MappedDistanceField::CHUNK_SIZE;
+}
+
+// true if count elements of element_size bytes starting at offset fit in a file of file_size bytes
+bool sectionFits(boost::uint64_t offset, boost::uint64_t count, boost::uint64_t element_size, boost::uint64_t file_size)
+{
+  if (offset % 8 != 0 || offset > file_size)
+    return false;
+  return count <= (file_size - offset) / element_size;
+}
+
+bool checkFileHeader(const char *data, std::size_t size, const std::string &filename)
+{
+  const FileHeader *header = reinterpret_cast<const FileHeader*>(data);
+  if (size < sizeof(FileHeader) || memcmp(header->magic_, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+  {
+    logError("'%s' is not a distance field file", filename.c_str());
+    return false;
+  }
+  if (header->version_ != FILE_VERSION || header->byte_order_ != FILE_BYTE_ORDER_MARK)
+  {
+    logError("Distance field file '%s' has version %u and byte order mark %x. Expected version %u and byte order mark %x",
+             filename.c_str(), header->version_, header->byte_order_, FILE_VERSION, FILE_BYTE_ORDER_MARK);
+    return false;
+  }
+  boost::uint64_t chunk_count = 1;
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    if (header->num_cells_[i] > (boost::uint64_t)std::numeric_limits<int>::max())
+      chunk_count = 0;
+    else
+      chunk_count *= getChunkCount(header->num_cells_[i]);
+  }
+  if (!(header->resolution_ > 0.0) || chunk_count != header->chunk_count_)
+  {
+    logError("Distance field file '%s' has inconsistent dimensions", filename.c_str());
+    return false;
+  }
+  if (!sectionFits(header->chunks_offset_, header->chunk_count_, 2 * sizeof(boost::uint32_t), size) ||
+      !sectionFits(header->data_offset_, header->stored_chunk_count_, CHUNK_CELLS * sizeof(float), size))
+  {
+    logError("Distance field file '%s' is truncated", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+void writePadding(std::ofstream &out, std::size_t count)
+{
+  static const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  out.write(zeros, count);
+}
+
+}
+
+MappedDistanceField::MappedDistanceField(const std::string& filename) :
+  DistanceField(0,0,0,0,0,0,0),
+  chunks_(NULL),
+  chunk_data_(NULL),
+  propagate_negative_(false),
+  max_distance_(0.0)
+{
+  num_cells_[DIM_X] = num_cells_[DIM_Y] = num_cells_[DIM_Z] = 0;
+  initializeGeometry();
+
+  try
+  {
+    boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+    const char *data = static_cast<const char*>(region.get_address());
+    if (!checkFileHeader(data, region.get_size(), filename))
+      throw moveit::ConstructException("Unable to map distance field file '" + filename + "'");
+
+    const FileHeader *header = reinterpret_cast<const FileHeader*>(data);
+    const ChunkEntry *chunks = reinterpret_cast<const ChunkEntry*>(data + header->chunks_offset_);
+    for (std::size_t i = 0 ; i < header->chunk_count_ ; ++i)
+      if (chunks[i].index_ != UNIFORM_CHUNK && chunks[i].index_ >= header->stored_chunk_count_)
+      {
+        logError("Distance field file '%s' has an inconsistent chunk table", filename.c_str());
+        throw moveit::ConstructException("Unable to map distance field file '" + filename + "'");
+      }
+
+    resolution_ = header->resolution_;
+    size_x_ = header->size_[DIM_X];
+    size_y_ = header->size_[DIM_Y];
+    size_z_ = header->size_[DIM_Z];
+    origin_x_ = header->origin_[DIM_X];
+    origin_y_ = header->origin_[DIM_Y];
+    origin_z_ = header->origin_[DIM_Z];
+    max_distance_ = header->max_distance_;
+    propagate_negative_ = header->propagate_negative_ != 0;
+    for (int i = DIM_X ; i <= DIM_Z ; ++i)
+      num_cells_[i] = header->num_cells_[i];
+    initializeGeometry();
+
+    chunks_ = chunks;
+    chunk_data_ = reinterpret_cast<const float*>(data + header->data_offset_);
+    file_.swap(file);
+    region_.swap(region);
+  }
+  catch(boost::interprocess::interprocess_exception &ex)
+  {
+    throw moveit::ConstructException("Unable to map distance field file '" + filename + "': " + ex.what());
+  }
+}
+
+MappedDistanceField::~MappedDistanceField()
+{
+}
+
+void MappedDistanceField::initializeGeometry()
+{
+  const double origin[3] = { origin_x_, origin_y_, origin_z_ };
+  oo_resolution_ = resolution_ > 0.0 ? 1.0 / resolution_ : 0.0;
+  for (int i = DIM_X ; i <= DIM_Z ; ++i)
+  {
+    num_chunks_[i] = getChunkCount(num_cells_[i]);
+    origin_minus_[i] = origin[i] - 0.5 * resolution_;
+  }
+
+  // the value of the voxel grid's default object in PropagationDistanceField
+  double max_cells = resolution_ > 0.0 ? ceil(max_distance_ / resolution_) : 0.0;
+  out_of_bounds_distance_ = sqrt(max_cells * max_cells) * resolution_;
+}
+
+bool MappedDistanceField::isMappedDistanceFieldFile(const std::string& filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(FILE_MAGIC)];
+  if (!in.read(magic, sizeof(magic)))
+    return false;
+  return memcmp(magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0;
+}
+
+bool MappedDistanceField::save(const std::string& filename, const PropagationDistanceField& field)
+{
+  return saveField(filename, field);
+}
+
+bool MappedDistanceField::save(const std::string& filename, const SparsePropagationDistanceField& field)
+{
+  return saveField(filename, field);
+}
+
+template <typename Field>
+bool MappedDistanceField::saveField(const std::string& filename, const Field& field)
+{
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic_, FILE_MAGIC, sizeof(FILE_MAGIC));
+  header.version_ = FILE_VERSION;
+  header.byte_order_ = FILE_BYTE_ORDER_MARK;
+  header.resolution_ = field.getResolution();
+  header.size_[DIM_X] = field.getSizeX();
+  header.size_[DIM_Y] = field.getSizeY();
+  header.size_[DIM_Z] = field.getSizeZ();
+  header.origin_[DIM_X] = field.getOriginX();
+  header.origin_[DIM_Y] = field.getOriginY();
+  header.origin_[DIM_Z] = field.getOriginZ();
+  header.max_distance_ = field.getUninitializedDistance();
+  header.propagate_negative_ = field.getPropagateNegativeDistances();
+
+  const int num_cells[3] = { field.getXNumCells(), field.getYNumCells(), field.getZNumCells() };
+  int num_chunks[3];
+  for (int i = DIM_X ; i <= DIM_Z ; ++i)
+  {
+    header.num_cells_[i] = num_cells[i];
+    num_chunks[i] = getChunkCount(num_cells[i]);
+  }
+  header.chunk_count_ = boost::uint64_t(num_chunks[DIM_X]) * num_chunks[DIM_Y] * num_chunks[DIM_Z];
+  header.chunks_offset_ = align8(sizeof(FileHeader));
+  header.data_offset_ = header.chunks_offset_ + header.chunk_count_ * sizeof(ChunkEntry);
+
+  // the chunk table is written once all chunks are known, so the data of large fields never has to be held in memory
+  std::string temp_filename = filename + ".tmp";
+  std::ofstream out(temp_filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  std::vector<ChunkEntry> chunks(header.chunk_count_);
+  out.seekp(header.data_offset_);
+
+  float values[CHUNK_CELLS];
+  std::size_t c = 0;
+  for (int cx = 0 ; cx < num_chunks[DIM_X] ; ++cx)
+    for (int cy = 0 ; cy < num_chunks[DIM_Y] ; ++cy)
+      for (int cz = 0 ; cz < num_chunks[DIM_Z] ; ++cz, ++c)
+      {
+        const int x0 = cx * CHUNK_SIZE, y0 = cy * CHUNK_SIZE, z0 = cz * CHUNK_SIZE;
+        const int nx = std::min(CHUNK_SIZE, num_cells[DIM_X] - x0);
+        const int ny = std::min(CHUNK_SIZE, num_cells[DIM_Y] - y0);
+        const int nz = std::min(CHUNK_SIZE, num_cells[DIM_Z] - z0);
+        const float first = field.getDistance(x0, y0, z0);
+        std::fill(values, values + CHUNK_CELLS, first);
+        bool uniform = true;
+        for (int i = 0 ; i < nx ; ++i)
+          for (int j = 0 ; j < ny ; ++j)
+            for (int k = 0 ; k < nz ; ++k)
+            {
+              float value = field.getDistance(x0 + i, y0 + j, z0 + k);
+              values[(i * CHUNK_SIZE + j) * CHUNK_SIZE + k] = value;
+              uniform = uniform && value == first;
+            }
+
+        if (uniform)
+        {
+          chunks[c].index_ = UNIFORM_CHUNK;
+          chunks[c].value_ = first;
+        }
+        else
+        {
+          // chunk indices are 32 bits; a larger field is reported as a write error below
+          if (header.stored_chunk_count_ >= UNIFORM_CHUNK)
+          {
+            out.setstate(std::ios::failbit);
+            break;
+          }
+          chunks[c].index_ = header.stored_chunk_count_++;
+          chunks[c].value_ = 0.0f;
+          out.write(reinterpret_cast<const char*>(values), sizeof(values));
+        }
+      }
+
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  writePadding(out, header.chunks_offset_ - sizeof(header));
+  if (!chunks.empty())
+    out.write(reinterpret_cast<const char*>(&chunks[0]), chunks.size() * sizeof(ChunkEntry));
+  out.close();
+
+  if (!out.good())
+  {
+    logError("Unable to write distance field file '%s'", temp_filename.c_str());
+    boost::system::error_code ec;
+    boost::filesystem::remove(temp_filename, ec);
+    return false;
+  }
+
+  // renaming replaces the file atomically for processes that have it mapped
+  try
+  {
+    boost::filesystem::rename(temp_filename, filename);
+  }
+  catch(boost::filesystem::filesystem_error &ex)
+  {
+    logError("Unable to rename '%s' to '%s': %s", temp_filename.c_str(), filename.c_str(), ex.what());
+    return false;
+  }
+  return true;
+}
+
+PropagationDistanceField& MappedDistanceField::getOverlay()
+{
+  if (overlay_)
+    return *overlay_;
+
+  overlay_.reset(new PropagationDistanceField(size_x_, size_y_, size_z_, resolution_,
+                                              origin_x_, origin_y_, origin_z_,
+                                              max_distance_, propagate_negative_));
+
+  // obstacle cells are the ones with a distance of zero, or a negative distance if negative distances were
+  // propagated; they are added in the order readFromStream() uses, so the copy matches a field read from a stream
+  EigenSTL::vector_Vector3d points;
+  for (int x = 0 ; x < num_cells_[DIM_X] ; ++x)
+    for (int y = 0 ; y < num_cells_[DIM_Y] ; ++y)
+      for (int z = 0 ; z < num_cells_[DIM_Z] ; ++z)
+        if (getMappedDistance(x, y, z) <= 0.0)
+        {
+          Eigen::Vector3d point;
+          gridToWorld(x, y, z, point.x(), point.y(), point.z());
+          points.push_back(point);
+        }
+  overlay_->addPointsToField(points);
+  return *overlay_;
+}
+
+void MappedDistanceField::addPointsToField(const EigenSTL::vector_Vector3d& points)
+{
+  getOverlay().addPointsToField(points);
+}
+
+void MappedDistanceField::removePointsFromField(const EigenSTL::vector_Vector3d& points)
+{
+  getOverlay().removePointsFromField(points);
+}
+
+void MappedDistanceField::updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                              const EigenSTL::vector_Vector3d& new_points)
+{
+  getOverlay().updatePointsInField(old_points, new_points);
+}
+
+void MappedDistanceField::reset()
+{
+  if (overlay_)
+    overlay_->reset();
+  else
+    overlay_.reset(new PropagationDistanceField(size_x_, size_y_, size_z_, resolution_,
+                                                origin_x_, origin_y_, origin_z_,
+                                                max_distance_, propagate_negative_));
+}
+
+double MappedDistanceField::getDistance(double x, double y, double z) const
+{
+  int cell_x, cell_y, cell_z;
+  if (!worldToGrid(x, y, z, cell_x, cell_y, cell_z))
+    return out_of_bounds_distance_;
+  return getDistance(cell_x, cell_y, cell_z);
+}
+
+double MappedDistanceField::getDistance(int x, int y, int z) const
+{
+  if (overlay_)
+    return overlay_->getDistance(x, y, z);
+  return getMappedDistance(x, y, z);
+}
+
+bool MappedDistanceField::isCellValid(int x, int y, int z) const
+{
+  return (x>=0 && x<num_cells_[DIM_X] &&
+          y>=0 && y<num_cells_[DIM_Y] &&
+          z>=0 && z<num_cells_[DIM_Z]);
+}
+
+int MappedDistanceField::getXNumCells() const
+{
+  return num_cells_[DIM_X];
+}
+
+int MappedDistanceField::getYNumCells() const
+{
+  return num_cells_[DIM_Y];
+}
+
+int MappedDistanceField::getZNumCells() const
+{
+  return num_cells_[DIM_Z];
+}
+
+bool MappedDistanceField::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
+{
+  world_x = origin_x_ + resolution_ * double(x);
+  world_y = origin_y_ + resolution_ * double(y);
+  world_z = origin_z_ + resolution_ * double(z);
+  return true;
+}
+
+bool MappedDistanceField::worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const
+{
+  x = int(floor((world_x - origin_minus_[DIM_X]) * oo_resolution_));
+  y = int(floor((world_y - origin_minus_[DIM_Y]) * oo_resolution_));
+  z = int(floor((world_z - origin_minus_[DIM_Z]) * oo_resolution_));
+  return isCellValid(x, y, z);
+}
+
+bool MappedDistanceField::writeToStream(std::ostream& os) const
+{
+  if (overlay_)
+    return overlay_->writeToStream(os);
+
+  os << "resolution: " << resolution_ << std::endl;
+  os << "size_x: " << size_x_ << std::endl;
+  os << "size_y: " << size_y_ << std::endl;
+  os << "size_z: " << size_z_ << std::endl;
+  os << "origin_x: " << origin_x_ << std::endl;
+  os << "origin_y: " << origin_y_ << std::endl;
+  os << "origin_z: " << origin_z_ << std::endl;
+
+  boost::iostreams::filtering_ostream out;
+  out.push(boost::iostreams::zlib_compressor());
+  out.push(os);
+
+  for(unsigned int x = 0; x < static_cast<unsigned int>(getXNumCells()); x++) {
+    for(unsigned int y = 0; y < static_cast<unsigned int>(getYNumCells()); y++) {
+      for(unsigned int z = 0; z < static_cast<unsigned int>(getZNumCells()); z+=8) {
+        std::bitset<8> bs(0);
+        unsigned int zv = std::min((unsigned int)8, getZNumCells()-z);
+        for(unsigned int zi = 0; zi < zv; zi++) {
+          if(getMappedDistance(x,y,z+zi) <= 0.0) {
+            bs[zi] = 1;
+          }
+        }
+        out.write((char*)&bs, sizeof(char));
+      }
+    }
+  }
+  out.flush();
+  return true;
+}
+
+bool MappedDistanceField::readFromStream(std::istream& is)
+{
+  // the stream sets the dimensions, so the field it is read into starts out empty
+  boost::scoped_ptr<PropagationDistanceField> field(new PropagationDistanceField(0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0,
+                                                                                 max_distance_, propagate_negative_));
+  if (!field->readFromStream(is))
+    return false;
+
+  resolution_ = field->getResolution();
+  size_x_ = field->getSizeX();
+  size_y_ = field->getSizeY();
+  size_z_ = field->getSizeZ();
+  origin_x_ = field->getOriginX();
+  origin_y_ = field->getOriginY();
+  origin_z_ = field->getOriginZ();
+  num_cells_[DIM_X] = field->getXNumCells();
+  num_cells_[DIM_Y] = field->getYNumCells();
+  num_cells_[DIM_Z] = field->getZNumCells();
+  initializeGeometry();
+  overlay_.swap(field);
+  return true;
+}
+
+}
@@ -40,10 +40,88 @@
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/bind.hpp>
 
 namespace distance_field
 {
 
+namespace
+{
+// levels of the bucket queue with fewer cells per thread than this are expanded serially
+const std::size_t MIN_PARALLEL_CELLS_PER_THREAD = 1024;
+
+// the cells of a level that a thread owns during a parallel propagation; interleaved slabs
+// along X keep the work balanced when obstacles are clustered
+inline unsigned int getPropagationOwner(const Eigen::Vector3i& loc, unsigned int threads)
+{
+  return (loc.x() / 4) % threads;
+}
+
+// a possible update of a voxel by a cell of the level being expanded
+struct PropagationCandidate
+{
+  std::size_t order_;           // position of the update in serial expansion order
+  Eigen::Vector3i loc_;
+  Eigen::Vector3i closest_point_;
+  int distance_square_;
+  int update_direction_;
+};
+
+// an update that was applied, and must be queued in serial expansion order
+struct PropagationUpdate
+{
+  std::size_t order_;
+  int distance_square_;
+  Eigen::Vector3i loc_;
+};
+}
+
+struct PropagationDistanceField::ParallelPropagation
+{
+  ParallelPropagation(BucketQueue& bucket_queue,
+                      int PropDistanceFieldVoxel::*distance_square,
+                      Eigen::Vector3i PropDistanceFieldVoxel::*closest_point,
+                      int PropDistanceFieldVoxel::*update_direction,
+                      unsigned int threads) :
+    bucket_queue_(bucket_queue),
+    distance_square_(distance_square),
+    closest_point_(closest_point),
+    update_direction_(update_direction),
+    threads_(threads),
+    level_(0),
+    done_(false),
+    barrier_(threads),
+    candidates_(threads, std::vector<std::vector<PropagationCandidate> >(threads)),
+    updates_(threads),
+    order_dependent_(threads, 0)
+  {
+  }
+
+  /// true if some update of the current level reaches cells that are still to be expanded at that level
+  bool isOrderDependent() const
+  {
+    return std::find(order_dependent_.begin(), order_dependent_.end(), 1) != order_dependent_.end();
+  }
+
+  BucketQueue& bucket_queue_;
+  int PropDistanceFieldVoxel::*distance_square_;
+  Eigen::Vector3i PropDistanceFieldVoxel::*closest_point_;
+  int PropDistanceFieldVoxel::*update_direction_;
+
+  unsigned int threads_;
+  unsigned int level_;
+  bool done_;
+  boost::barrier barrier_;
+
+  /// candidates_[t][o] holds the candidates found by thread t for the cells owned by thread o
+  std::vector<std::vector<std::vector<PropagationCandidate> > > candidates_;
+  /// updates_[o] holds the updates applied by thread o, in serial order
+  std::vector<std::vector<PropagationUpdate> > updates_;
+  std::vector<char> order_dependent_;
+};
+
 PropagationDistanceField::PropagationDistanceField(double size_x, double size_y, double size_z,
                                                    double resolution,
                                                    double origin_x, double origin_y, double origin_z,
@@ -51,7 +129,9 @@ PropagationDistanceField::PropagationDistanceField(double size_x, double size_y,
                                                    bool propagate_negative):
   DistanceField(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z),
   propagate_negative_(propagate_negative),
-  max_distance_(max_distance)
+  propagation_threads_(1),
+  max_distance_(max_distance),
+  float_distance_cache_(false)
 {
   initialize();
 }
@@ -69,7 +149,9 @@ PropagationDistanceField::PropagationDistanceField(const octomap::OcTree& octree
                 bbx_min.y(),
                 bbx_min.z()),
   propagate_negative_(propagate_negative_distances),
-  max_distance_(max_distance)
+  propagation_threads_(1),
+  max_distance_(max_distance),
+  float_distance_cache_(false)
 {
   initialize();
   addOcTreeToField(&octree);
@@ -80,7 +162,9 @@ PropagationDistanceField::PropagationDistanceField(std::istream& is,
                                                    bool propagate_negative_distances) :
   DistanceField(0,0,0,0,0,0,0),
   propagate_negative_(propagate_negative_distances),
-  max_distance_(max_distance)
+  propagation_threads_(1),
+  max_distance_(max_distance),
+  float_distance_cache_(false)
 {
   readFromStream(is);
 }
@@ -103,6 +187,9 @@ void PropagationDistanceField::initialize()
   for (int i=0; i<=max_distance_sq_; ++i)
     sqrt_table_[i] = sqrt(double(i))*resolution_;
 
+  if (float_distance_cache_)
+    float_distances_.resize(static_cast<std::size_t>(getXNumCells()) * getYNumCells() * getZNumCells());
+
   reset();
 }
 
@@ -317,6 +404,9 @@ void PropagationDistanceField::addNewObstacleVoxels(const std::vector<Eigen::Vec
     }
     propagateNegative();
   }
+
+  if (float_distance_cache_)
+    updateFloatDistances(voxel_points);
 }
 
 void PropagationDistanceField::removeObstacleVoxels(const std::vector<Eigen::Vector3i>& voxel_points)
@@ -399,124 +489,261 @@ void PropagationDistanceField::removeObstacleVoxels(const std::vector<Eigen::Vec
   if(propagate_negative_) {
     propagateNegative();
   }
+
+  if (float_distance_cache_)
+    updateFloatDistances(voxel_points);
 }
 
 void PropagationDistanceField::propagatePositive()
 {
+  propagate(bucket_queue_, &PropDistanceFieldVoxel::distance_square_,
+            &PropDistanceFieldVoxel::closest_point_, &PropDistanceFieldVoxel::update_direction_);
+}
+
+void PropagationDistanceField::propagateNegative()
+{
+  propagate(negative_bucket_queue_, &PropDistanceFieldVoxel::negative_distance_square_,
+            &PropDistanceFieldVoxel::closest_negative_point_, &PropDistanceFieldVoxel::negative_update_direction_);
+}
+
+void PropagationDistanceField::propagate(BucketQueue& bucket_queue,
+                                         int PropDistanceFieldVoxel::*distance_square,
+                                         Eigen::Vector3i PropDistanceFieldVoxel::*closest_point,
+                                         int PropDistanceFieldVoxel::*update_direction)
+{
+  unsigned int threads = propagation_threads_ > 0 ? propagation_threads_ : std::max(1u, boost::thread::hardware_concurrency());
+  if (threads <= 1)
+  {
+    for (unsigned int i=0; i<bucket_queue.size(); ++i)
+      propagateLevel(bucket_queue, i, distance_square, closest_point, update_direction);
+    return;
+  }
 
-  // now process the queue:
-  for (unsigned int i=0; i<bucket_queue_.size(); ++i)
+  // The cells of a level are expanded in two steps.  First every thread
+  // computes the updates its share of the cells could make, reading the
+  // voxels only.  Then every thread applies the updates to the voxels it
+  // owns, in the order the serial loop would have made them, so that ties
+  // resolve exactly as they do serially.  This is only equivalent to the
+  // serial loop if no update reaches a cell that is still to be expanded
+  // at the same level; such levels are expanded serially.
+  ParallelPropagation state(bucket_queue, distance_square, closest_point, update_direction, threads);
+  boost::thread_group workers;
+  bool workers_started = false;
+
+  for (unsigned int i=0; i<bucket_queue.size(); ++i)
   {
-    std::vector<Eigen::Vector3i>::iterator list_it = bucket_queue_[i].begin();
-    std::vector<Eigen::Vector3i>::iterator list_end = bucket_queue_[i].end();
-    for ( ; list_it != list_end ; ++list_it)
+    if (bucket_queue[i].size() < threads * MIN_PARALLEL_CELLS_PER_THREAD)
     {
-      const Eigen::Vector3i& loc = *list_it;
-      PropDistanceFieldVoxel* vptr = &voxel_grid_->getCell(loc.x(), loc.y(), loc.z());
+      propagateLevel(bucket_queue, i, distance_square, closest_point, update_direction);
+      continue;
+    }
 
-      // select the neighborhood list based on the update direction:
-      std::vector<Eigen::Vector3i >* neighborhood;
-      int D = i;
-      if (D>1)
-        D=1;
+    if (!workers_started)
+    {
+      for (unsigned int t = 1 ; t < threads ; ++t)
+        workers.create_thread(boost::bind(&PropagationDistanceField::propagationWorker, this, &state, t));
+      workers_started = true;
+    }
 
-      // This will never happen.  update_direction_ is always set before voxel is added to bucket queue.
-      if (vptr->update_direction_<0 || vptr->update_direction_>26)
-      {
-        logError("PROGRAMMING ERROR: Invalid update direction detected: %d", vptr->update_direction_);
-        continue;
-      }
+    state.level_ = i;
+    state.barrier_.wait();
+    collectPropagationCandidates(state, 0);
+    state.barrier_.wait();
+    if (state.isOrderDependent())
+    {
+      propagateLevel(bucket_queue, i, distance_square, closest_point, update_direction);
+      continue;
+    }
+    applyPropagationCandidates(state, 0);
+    state.barrier_.wait();
 
-      neighborhood = &neighborhoods_[D][vptr->update_direction_];
+    // queue the applied updates in serial order, merging the per-thread lists
+    std::vector<std::size_t> next(threads, 0);
+    while (true)
+    {
+      int best = -1;
+      for (unsigned int t = 0 ; t < threads ; ++t)
+        if (next[t] < state.updates_[t].size() &&
+            (best < 0 || state.updates_[t][next[t]].order_ < state.updates_[best][next[best]].order_))
+          best = t;
+      if (best < 0)
+        break;
+      const PropagationUpdate& update = state.updates_[best][next[best]++];
+      bucket_queue[update.distance_square_].push_back(update.loc_);
+    }
+    bucket_queue[i].clear();
+  }
 
-      for (unsigned int n=0; n<neighborhood->size(); n++)
-      {
-        Eigen::Vector3i diff = (*neighborhood)[n];
-        Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
-        if (!isCellValid(nloc.x(), nloc.y(), nloc.z()) )
-          continue;
+  if (workers_started)
+  {
+    state.done_ = true;
+    state.barrier_.wait();
+    workers.join_all();
+  }
+}
 
-        // the real update code:
-        // calculate the neighbor's new distance based on my closest filled voxel:
-        PropDistanceFieldVoxel* neighbor = &voxel_grid_->getCell(nloc.x(),nloc.y(),nloc.z());
-        int new_distance_sq = eucDistSq(vptr->closest_point_, nloc);
-        if (new_distance_sq > max_distance_sq_)
-          continue;
+void PropagationDistanceField::propagationWorker(ParallelPropagation* state, unsigned int thread)
+{
+  while (true)
+  {
+    state->barrier_.wait();
+    if (state->done_)
+      return;
+    collectPropagationCandidates(*state, thread);
+    state->barrier_.wait();
+    if (state->isOrderDependent())
+      continue;
+    applyPropagationCandidates(*state, thread);
+    state->barrier_.wait();
+  }
+}
 
+void PropagationDistanceField::collectPropagationCandidates(ParallelPropagation& state, unsigned int thread) const
+{
+  const unsigned int level = state.level_;
+  const std::vector<Eigen::Vector3i>& cells = state.bucket_queue_[level];
+  std::size_t begin = cells.size() * thread / state.threads_;
+  std::size_t end = cells.size() * (thread + 1) / state.threads_;
+
+  std::vector<std::vector<PropagationCandidate> >& candidates = state.candidates_[thread];
+  for (std::size_t o = 0 ; o < candidates.size() ; ++o)
+    candidates[o].clear();
+  state.order_dependent_[thread] = 0;
+
+  int D = level > 1 ? 1 : level;
+  for (std::size_t k = begin ; k < end ; ++k)
+  {
+    const Eigen::Vector3i& loc = cells[k];
+    const PropDistanceFieldVoxel& voxel = voxel_grid_->getCell(loc.x(), loc.y(), loc.z());
+    int direction = voxel.*state.update_direction_;
+    if (direction<0 || direction>26)
+    {
+      logError("PROGRAMMING ERROR: Invalid update direction detected: %d", direction);
+      continue;
+    }
+    // cells queued farther than their level (removal seeds cells at level 0
+    // regardless of their distance) may be updated by cells expanded before them
+    if (voxel.*state.distance_square_ > static_cast<int>(level))
+    {
+      state.order_dependent_[thread] = 1;
+      return;
+    }
 
-        if (new_distance_sq < neighbor->distance_square_)
-        {
-          // update the neighboring voxel
-          neighbor->distance_square_ = new_distance_sq;
-          neighbor->closest_point_ = vptr->closest_point_;
-          neighbor->update_direction_ = getDirectionNumber(diff.x(), diff.y(), diff.z());
+    const std::vector<Eigen::Vector3i>& neighborhood = neighborhoods_[D][direction];
+    for (unsigned int n=0; n<neighborhood.size(); n++)
+    {
+      const Eigen::Vector3i& diff = neighborhood[n];
+      Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
+      if (!isCellValid(nloc.x(), nloc.y(), nloc.z()) )
+        continue;
 
-          // and put it in the queue:
-          bucket_queue_[new_distance_sq].push_back(nloc);
-        }
+      int new_distance_sq = eucDistSq(voxel.*state.closest_point_, nloc);
+      if (new_distance_sq > max_distance_sq_)
+        continue;
+      // distances only decrease, so an update that does not improve on the
+      // distance the neighbor had before this level never applies
+      if (new_distance_sq >= voxel_grid_->getCell(nloc.x(), nloc.y(), nloc.z()).*state.distance_square_)
+        continue;
+      if (new_distance_sq <= static_cast<int>(level))
+      {
+        state.order_dependent_[thread] = 1;
+        return;
       }
+
+      PropagationCandidate candidate;
+      candidate.order_ = k * 27 + n;
+      candidate.loc_ = nloc;
+      candidate.closest_point_ = voxel.*state.closest_point_;
+      candidate.distance_square_ = new_distance_sq;
+      candidate.update_direction_ = getDirectionNumber(diff.x(), diff.y(), diff.z());
+      candidates[getPropagationOwner(nloc, state.threads_)].push_back(candidate);
     }
-    bucket_queue_[i].clear();
   }
 }
 
-void PropagationDistanceField::propagateNegative()
+void PropagationDistanceField::applyPropagationCandidates(ParallelPropagation& state, unsigned int thread)
 {
+  std::vector<PropagationUpdate>& updates = state.updates_[thread];
+  updates.clear();
 
-  // now process the queue:
-  for (unsigned int i=0; i<negative_bucket_queue_.size(); ++i)
+  // the candidates of thread t precede those of thread t+1 in serial order
+  for (unsigned int t = 0 ; t < state.threads_ ; ++t)
   {
-    std::vector<Eigen::Vector3i>::iterator list_it = negative_bucket_queue_[i].begin();
-    std::vector<Eigen::Vector3i>::iterator list_end = negative_bucket_queue_[i].end();
-    for ( ; list_it != list_end ; ++list_it)
+    const std::vector<PropagationCandidate>& candidates = state.candidates_[t][thread];
+    for (std::size_t c = 0 ; c < candidates.size() ; ++c)
     {
-      const Eigen::Vector3i& loc = *list_it;
-      PropDistanceFieldVoxel* vptr = &voxel_grid_->getCell(loc.x(), loc.y(), loc.z());
+      const PropagationCandidate& candidate = candidates[c];
+      PropDistanceFieldVoxel& neighbor = voxel_grid_->getCell(candidate.loc_.x(), candidate.loc_.y(), candidate.loc_.z());
+      if (candidate.distance_square_ < neighbor.*state.distance_square_)
+      {
+        neighbor.*state.distance_square_ = candidate.distance_square_;
+        neighbor.*state.closest_point_ = candidate.closest_point_;
+        neighbor.*state.update_direction_ = candidate.update_direction_;
+
+        PropagationUpdate update;
+        update.order_ = candidate.order_;
+        update.distance_square_ = candidate.distance_square_;
+        update.loc_ = candidate.loc_;
+        updates.push_back(update);
+      }
+    }
+  }
+}
 
-      // select the neighborhood list based on the update direction:
-      std::vector<Eigen::Vector3i >* neighborhood;
-      int D = i;
-      if (D>1)
-        D=1;
+void PropagationDistanceField::propagateLevel(BucketQueue& bucket_queue, unsigned int level,
+                                              int PropDistanceFieldVoxel::*distance_square,
+                                              Eigen::Vector3i PropDistanceFieldVoxel::*closest_point,
+                                              int PropDistanceFieldVoxel::*update_direction)
+{
+  std::vector<Eigen::Vector3i>::iterator list_it = bucket_queue[level].begin();
+  std::vector<Eigen::Vector3i>::iterator list_end = bucket_queue[level].end();
+  for ( ; list_it != list_end ; ++list_it)
+  {
+    const Eigen::Vector3i& loc = *list_it;
+    PropDistanceFieldVoxel* vptr = &voxel_grid_->getCell(loc.x(), loc.y(), loc.z());
 
-      // This will never happen.  negative_update_direction_ is always set before voxel is added to negative_bucket_queue_.
-      if (vptr->negative_update_direction_<0 || vptr->negative_update_direction_>26)
-      {
-        logError("PROGRAMMING ERROR: Invalid update direction detected: %d", vptr->update_direction_);
+    // select the neighborhood list based on the update direction:
+    std::vector<Eigen::Vector3i >* neighborhood;
+    int D = level;
+    if (D>1)
+      D=1;
+
+    // This will never happen.  The update direction is always set before voxel is added to the bucket queue.
+    if (vptr->*update_direction<0 || vptr->*update_direction>26)
+    {
+      logError("PROGRAMMING ERROR: Invalid update direction detected: %d", vptr->*update_direction);
+      continue;
+    }
+
+    neighborhood = &neighborhoods_[D][vptr->*update_direction];
+
+    for (unsigned int n=0; n<neighborhood->size(); n++)
+    {
+      Eigen::Vector3i diff = (*neighborhood)[n];
+      Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
+      if (!isCellValid(nloc.x(), nloc.y(), nloc.z()) )
         continue;
-      }
 
-      neighborhood = &neighborhoods_[D][vptr->negative_update_direction_];
+      // the real update code:
+      // calculate the neighbor's new distance based on my closest filled voxel:
+      PropDistanceFieldVoxel* neighbor = &voxel_grid_->getCell(nloc.x(),nloc.y(),nloc.z());
+      int new_distance_sq = eucDistSq(vptr->*closest_point, nloc);
+      if (new_distance_sq > max_distance_sq_)
+        continue;
 
-      for (unsigned int n=0; n<neighborhood->size(); n++)
+      if (new_distance_sq < neighbor->*distance_square)
       {
-        Eigen::Vector3i diff = (*neighborhood)[n];
-        Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
-        if (!isCellValid(nloc.x(), nloc.y(), nloc.z()) )
-          continue;
-
-        // the real update code:
-        // calculate the neighbor's new distance based on my closest filled voxel:
-        PropDistanceFieldVoxel* neighbor = &voxel_grid_->getCell(nloc.x(),nloc.y(),nloc.z());
-        int new_distance_sq = eucDistSq(vptr->closest_negative_point_, nloc);
-        if (new_distance_sq > max_distance_sq_)
-          continue;
-        //std::cout << "Looking at " << nloc.x() << " " << nloc.y() << " " << nloc.z() << " " << new_distance_sq << " " << neighbor->negative_distance_square_ << std::endl;
-        if (new_distance_sq < neighbor->negative_distance_square_)
-        {
-          //std::cout << "Updating " << nloc.x() << " " << nloc.y() << " " << nloc.z() << " " << new_distance_sq << std::endl;
-          // update the neighboring voxel
-          neighbor->negative_distance_square_ = new_distance_sq;
-          neighbor->closest_negative_point_ = vptr->closest_negative_point_;
-          neighbor->negative_update_direction_ = getDirectionNumber(diff.x(), diff.y(), diff.z());
-
-          // and put it in the queue:
-          negative_bucket_queue_[new_distance_sq].push_back(nloc);
-        }
+        // update the neighboring voxel
+        neighbor->*distance_square = new_distance_sq;
+        neighbor->*closest_point = vptr->*closest_point;
+        neighbor->*update_direction = getDirectionNumber(diff.x(), diff.y(), diff.z());
+
+        // and put it in the queue:
+        bucket_queue[new_distance_sq].push_back(nloc);
       }
     }
-    negative_bucket_queue_[i].clear();
   }
+  bucket_queue[level].clear();
 }
 
 void PropagationDistanceField::reset()
@@ -537,6 +764,163 @@ void PropagationDistanceField::reset()
     }
   }
   //object_voxel_locations_.clear();
+
+  if (float_distance_cache_)
+    updateFloatDistances(Eigen::Vector3i(0, 0, 0),
+                         Eigen::Vector3i(getXNumCells() - 1, getYNumCells() - 1, getZNumCells() - 1));
+}
+
+void PropagationDistanceField::setFloatDistanceCache(bool enable)
+{
+  if (enable == float_distance_cache_)
+    return;
+  float_distance_cache_ = enable;
+  if (enable)
+  {
+    float_distances_.resize(static_cast<std::size_t>(getXNumCells()) * getYNumCells() * getZNumCells());
+    updateFloatDistances(Eigen::Vector3i(0, 0, 0),
+                         Eigen::Vector3i(getXNumCells() - 1, getYNumCells() - 1, getZNumCells() - 1));
+  }
+  else
+    std::vector<float>().swap(float_distances_);
+}
+
+void PropagationDistanceField::updateFloatDistances(const std::vector<Eigen::Vector3i>& voxel_points)
+{
+  if (voxel_points.empty())
+    return;
+
+  Eigen::Vector3i min_cell = voxel_points[0];
+  Eigen::Vector3i max_cell = voxel_points[0];
+  for (std::size_t i = 1 ; i < voxel_points.size() ; ++i)
+  {
+    min_cell = min_cell.cwiseMin(voxel_points[i]);
+    max_cell = max_cell.cwiseMax(voxel_points[i]);
+  }
+
+  // adding or removing a cell only changes distances up to the maximum distance away from it
+  int margin = ceil(max_distance_/resolution_) + 1;
+  min_cell -= Eigen::Vector3i::Constant(margin);
+  max_cell += Eigen::Vector3i::Constant(margin);
+  updateFloatDistances(min_cell.cwiseMax(Eigen::Vector3i::Zero()),
+                       max_cell.cwiseMin(Eigen::Vector3i(getXNumCells() - 1, getYNumCells() - 1, getZNumCells() - 1)));
+}
+
+void PropagationDistanceField::updateFloatDistances(const Eigen::Vector3i& min_cell, const Eigen::Vector3i& max_cell)
+{
+  const std::size_t stride1 = static_cast<std::size_t>(getYNumCells()) * getZNumCells();
+  const std::size_t stride2 = getZNumCells();
+  for (int x = min_cell.x(); x <= max_cell.x(); ++x)
+    for (int y = min_cell.y(); y <= max_cell.y(); ++y)
+    {
+      float* row = &float_distances_[x * stride1 + y * stride2];
+      for (int z = min_cell.z(); z <= max_cell.z(); ++z)
+        row[z] = getDistance(voxel_grid_->getCell(x, y, z));
+    }
+}
+
+std::size_t PropagationDistanceField::getInterpolatedDistances(const double* points, std::size_t count,
+                                                               double* distances, double* gradients) const
+{
+  // number of locations interpolated together
+  static const std::size_t BLOCK_SIZE = 16;
+
+  const int num_x = getXNumCells();
+  const int num_y = getYNumCells();
+  const int num_z = getZNumCells();
+  const double oo_resolution = 1.0 / resolution_;
+  const double uninitialized = getUninitializedDistance();
+  const std::size_t stride1 = static_cast<std::size_t>(num_y) * num_z;
+  const std::size_t stride2 = num_z;
+  // offsets of the eight enclosing cells, indexed by dx*4 + dy*2 + dz
+  const std::size_t corner_offset[8] = { 0, 1, stride2, stride2 + 1,
+                                         stride1, stride1 + 1, stride1 + stride2, stride1 + stride2 + 1 };
+
+  std::size_t in_bounds = 0;
+  double tx[BLOCK_SIZE], ty[BLOCK_SIZE], tz[BLOCK_SIZE];
+  double c[8][BLOCK_SIZE];
+  int cell[BLOCK_SIZE][3];
+  bool valid[BLOCK_SIZE];
+
+  for (std::size_t begin = 0 ; begin < count ; begin += BLOCK_SIZE)
+  {
+    const std::size_t n = std::min(BLOCK_SIZE, count - begin);
+    const double* p = points + 3 * begin;
+
+    // locate the enclosing cells; locations outside the field read the
+    // uninitialized distance at every corner, which interpolates to that
+    // distance with a zero gradient
+    for (std::size_t s = 0 ; s < n ; ++s)
+    {
+      double fx = (p[3 * s] - origin_x_) * oo_resolution;
+      double fy = (p[3 * s + 1] - origin_y_) * oo_resolution;
+      double fz = (p[3 * s + 2] - origin_z_) * oo_resolution;
+      valid[s] = fx >= 0.0 && fx <= num_x - 1 && num_x > 1 &&
+        fy >= 0.0 && fy <= num_y - 1 && num_y > 1 &&
+        fz >= 0.0 && fz <= num_z - 1 && num_z > 1;
+      if (valid[s])
+      {
+        cell[s][0] = std::min(static_cast<int>(fx), num_x - 2);
+        cell[s][1] = std::min(static_cast<int>(fy), num_y - 2);
+        cell[s][2] = std::min(static_cast<int>(fz), num_z - 2);
+        tx[s] = fx - cell[s][0];
+        ty[s] = fy - cell[s][1];
+        tz[s] = fz - cell[s][2];
+        ++in_bounds;
+      }
+      else
+        tx[s] = ty[s] = tz[s] = 0.0;
+    }
+
+    // gather the corner distances
+    for (std::size_t s = 0 ; s < n ; ++s)
+    {
+      if (!valid[s])
+      {
+        for (int k = 0 ; k < 8 ; ++k)
+          c[k][s] = uninitialized;
+      }
+      else if (float_distance_cache_)
+      {
+        const float* base = &float_distances_[cell[s][0] * stride1 + cell[s][1] * stride2 + cell[s][2]];
+        for (int k = 0 ; k < 8 ; ++k)
+          c[k][s] = base[corner_offset[k]];
+      }
+      else
+      {
+        for (int k = 0 ; k < 8 ; ++k)
+          c[k][s] = getDistance(voxel_grid_->getCell(cell[s][0] + (k >> 2), cell[s][1] + ((k >> 1) & 1), cell[s][2] + (k & 1)));
+      }
+    }
+
+    // interpolate along Z, then Y, then X, differentiating along the way
+    for (std::size_t s = 0 ; s < n ; ++s)
+    {
+      double z00 = c[0][s] + tz[s] * (c[1][s] - c[0][s]);
+      double z01 = c[2][s] + tz[s] * (c[3][s] - c[2][s]);
+      double z10 = c[4][s] + tz[s] * (c[5][s] - c[4][s]);
+      double z11 = c[6][s] + tz[s] * (c[7][s] - c[6][s]);
+      double y0 = z00 + ty[s] * (z01 - z00);
+      double y1 = z10 + ty[s] * (z11 - z10);
+      distances[begin + s] = y0 + tx[s] * (y1 - y0);
+      if (gradients)
+      {
+        double* g = gradients + 3 * (begin + s);
+        g[0] = (y1 - y0) * oo_resolution;
+        double dy0 = z01 - z00;
+        double dy1 = z11 - z10;
+        g[1] = (dy0 + tx[s] * (dy1 - dy0)) * oo_resolution;
+        double dz00 = c[1][s] - c[0][s];
+        double dz01 = c[3][s] - c[2][s];
+        double dz10 = c[5][s] - c[4][s];
+        double dz11 = c[7][s] - c[6][s];
+        double dz0 = dz00 + ty[s] * (dz01 - dz00);
+        double dz1 = dz10 + ty[s] * (dz11 - dz10);
+        g[2] = (dz0 + tx[s] * (dz1 - dz0)) * oo_resolution;
+      }
+    }
+  }
+  return in_bounds;
 }
 
 void PropagationDistanceField::initNeighborhoods()
@@ -0,0 +1,677 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/distance_field/sparse_propagation_distance_field.h>
+#include <console_bridge/console.h>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <bitset>
+
+namespace distance_field
+{
+
+const int SparsePropagationDistanceField::BLOCK_SIZE;
+
+SparsePropagationDistanceField::SparsePropagationDistanceField(double size_x, double size_y, double size_z,
+                                                               double resolution,
+                                                               double origin_x, double origin_y, double origin_z,
+                                                               double max_distance,
+                                                               bool propagate_negative):
+  DistanceField(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z),
+  propagate_negative_(propagate_negative),
+  max_distance_(max_distance),
+  last_block_(NULL)
+{
+  initialize();
+}
+
+SparsePropagationDistanceField::SparsePropagationDistanceField(std::istream& is,
+                                                               double max_distance,
+                                                               bool propagate_negative_distances) :
+  DistanceField(0,0,0,0,0,0,0),
+  propagate_negative_(propagate_negative_distances),
+  max_distance_(max_distance),
+  last_block_(NULL)
+{
+  readFromStream(is);
+}
+
+void SparsePropagationDistanceField::initialize()
+{
+  max_distance_sq_ = ceil(max_distance_/resolution_)*ceil(max_distance_/resolution_);
+
+  // same discretization as VoxelGrid, so that sparse and dense fields agree cell for cell
+  const double size[3] = { size_x_, size_y_, size_z_ };
+  const double origin[3] = { origin_x_, origin_y_, origin_z_ };
+  oo_resolution_ = 1.0 / resolution_;
+  for (int i=DIM_X; i<=DIM_Z; ++i)
+  {
+    num_cells_[i] = size[i] * oo_resolution_;
+    num_blocks_[i] = (num_cells_[i] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    origin_minus_[i] = origin[i] - 0.5 * resolution_;
+  }
+
+  int initial_update_direction = getDirectionNumber(0,0,0);
+  unallocated_voxel_ = PropDistanceFieldVoxel(max_distance_sq_,0);
+  unallocated_voxel_.update_direction_ = initial_update_direction;
+  unallocated_voxel_.negative_update_direction_ = initial_update_direction;
+
+  initNeighborhoods();
+
+  bucket_queue_.resize(max_distance_sq_+1);
+  negative_bucket_queue_.resize(max_distance_sq_+1);
+
+  // create a sqrt table:
+  sqrt_table_.resize(max_distance_sq_+1);
+  for (int i=0; i<=max_distance_sq_; ++i)
+    sqrt_table_[i] = sqrt(double(i))*resolution_;
+
+  reset();
+}
+
+int SparsePropagationDistanceField::eucDistSq(const Eigen::Vector3i& point1, const Eigen::Vector3i& point2)
+{
+  int dx = point1.x() - point2.x();
+  int dy = point1.y() - point2.y();
+  int dz = point1.z() - point2.z();
+  return dx*dx + dy*dy + dz*dz;
+}
+
+const PropDistanceFieldVoxel* SparsePropagationDistanceField::findCell(int x, int y, int z) const
+{
+  BlockMap::const_iterator it = blocks_.find(getBlockKey(x, y, z));
+  if (it == blocks_.end())
+    return NULL;
+  return &it->second.cells_[getIndexInBlock(x, y, z)];
+}
+
+PropDistanceFieldVoxel* SparsePropagationDistanceField::findCell(int x, int y, int z)
+{
+  // propagation visits neighboring cells, which are nearly always in the block looked up last
+  std::size_t key = getBlockKey(x, y, z);
+  if (!last_block_ || key != last_block_key_)
+  {
+    BlockMap::iterator it = blocks_.find(key);
+    if (it == blocks_.end())
+      return NULL;
+    last_block_key_ = key;
+    last_block_ = &it->second;
+  }
+  return &last_block_->cells_[getIndexInBlock(x, y, z)];
+}
+
+PropDistanceFieldVoxel& SparsePropagationDistanceField::getOrCreateCell(int x, int y, int z)
+{
+  PropDistanceFieldVoxel* cell = findCell(x, y, z);
+  if (cell)
+    return *cell;
+
+  // a new block is free space beyond the propagation distance, which is
+  // what the dense field holds after reset()
+  std::size_t key = getBlockKey(x, y, z);
+  VoxelBlock& block = blocks_[key];
+  int bx = x - x % BLOCK_SIZE;
+  int by = y - y % BLOCK_SIZE;
+  int bz = z - z % BLOCK_SIZE;
+  for (int i = 0; i < BLOCK_SIZE; ++i)
+    for (int j = 0; j < BLOCK_SIZE; ++j)
+      for (int k = 0; k < BLOCK_SIZE; ++k)
+      {
+        PropDistanceFieldVoxel& voxel = block.cells_[getIndexInBlock(i, j, k)];
+        voxel = unallocated_voxel_;
+        voxel.closest_negative_point_ = Eigen::Vector3i(bx + i, by + j, bz + k);
+      }
+
+  last_block_key_ = key;
+  last_block_ = &block;
+  return block.cells_[getIndexInBlock(x, y, z)];
+}
+
+void SparsePropagationDistanceField::updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                                         const EigenSTL::vector_Vector3d& new_points)
+{
+  VoxelSet old_point_set;
+  for(unsigned int i = 0; i < old_points.size(); i++) {
+    Eigen::Vector3i voxel_loc;
+    if( worldToGrid(old_points[i].x(), old_points[i].y(), old_points[i].z(),
+                    voxel_loc.x(), voxel_loc.y(), voxel_loc.z() ) )
+      old_point_set.insert(voxel_loc);
+  }
+
+  VoxelSet new_point_set;
+  for(unsigned int i = 0; i < new_points.size(); i++) {
+    Eigen::Vector3i voxel_loc;
+    if( worldToGrid(new_points[i].x(), new_points[i].y(), new_points[i].z(),
+                    voxel_loc.x(), voxel_loc.y(), voxel_loc.z() ) )
+      new_point_set.insert(voxel_loc);
+  }
+  compareEigen_Vector3i comp;
+
+  std::vector<Eigen::Vector3i> old_not_new;
+  std::set_difference(old_point_set.begin(), old_point_set.end(),
+                      new_point_set.begin(), new_point_set.end(),
+                      std::inserter(old_not_new, old_not_new.end()),
+                      comp);
+
+  std::vector<Eigen::Vector3i> new_not_old;
+  std::set_difference(new_point_set.begin(), new_point_set.end(),
+                      old_point_set.begin(), old_point_set.end(),
+                      std::inserter(new_not_old, new_not_old.end()),
+                      comp);
+
+  std::vector<Eigen::Vector3i> new_not_in_current;
+  for(unsigned int i = 0; i < new_not_old.size(); i++) {
+    const PropDistanceFieldVoxel* voxel = findCell(new_not_old[i].x(), new_not_old[i].y(), new_not_old[i].z());
+    if(!voxel || voxel->distance_square_ != 0)
+      new_not_in_current.push_back(new_not_old[i]);
+  }
+
+  removeObstacleVoxels(old_not_new);
+  addNewObstacleVoxels(new_not_in_current);
+}
+
+void SparsePropagationDistanceField::addPointsToField(const EigenSTL::vector_Vector3d& points)
+{
+  std::vector<Eigen::Vector3i> voxel_points;
+
+  for( unsigned int i=0; i<points.size(); i++)
+  {
+    Eigen::Vector3i voxel_loc;
+    if( worldToGrid(points[i].x(), points[i].y(), points[i].z(),
+                    voxel_loc.x(), voxel_loc.y(), voxel_loc.z() ) )
+    {
+      const PropDistanceFieldVoxel* voxel = findCell(voxel_loc.x(), voxel_loc.y(), voxel_loc.z());
+      if(!voxel || voxel->distance_square_ > 0)
+        voxel_points.push_back(voxel_loc);
+    }
+  }
+  addNewObstacleVoxels(voxel_points);
+}
+
+void SparsePropagationDistanceField::removePointsFromField(const EigenSTL::vector_Vector3d& points)
+{
+  std::vector<Eigen::Vector3i> voxel_points;
+
+  for( unsigned int i=0; i<points.size(); i++)
+  {
+    Eigen::Vector3i voxel_loc;
+    if( worldToGrid(points[i].x(), points[i].y(), points[i].z(),
+                    voxel_loc.x(), voxel_loc.y(), voxel_loc.z() ) )
+      voxel_points.push_back(voxel_loc);
+  }
+
+  removeObstacleVoxels( voxel_points );
+}
+
+void SparsePropagationDistanceField::addNewObstacleVoxels(const std::vector<Eigen::Vector3i>& voxel_points)
+{
+  int initial_update_direction = getDirectionNumber(0,0,0);
+  bucket_queue_[0].reserve(voxel_points.size());
+  std::vector<Eigen::Vector3i> negative_stack;
+  if(propagate_negative_) {
+    negative_stack.reserve(voxel_points.size());
+    negative_bucket_queue_[0].reserve(voxel_points.size());
+  }
+
+  for(unsigned int i = 0; i < voxel_points.size(); i++) {
+    const Eigen::Vector3i &loc = voxel_points[i];
+    PropDistanceFieldVoxel& voxel = getOrCreateCell(loc.x(), loc.y(), loc.z());
+    voxel.distance_square_ = 0;
+    voxel.closest_point_ = loc;
+    voxel.update_direction_ = initial_update_direction;
+    bucket_queue_[0].push_back(loc);
+    if(propagate_negative_) {
+      voxel.negative_distance_square_ = max_distance_sq_;
+      voxel.closest_negative_point_.x() = PropDistanceFieldVoxel::UNINITIALIZED;
+      voxel.closest_negative_point_.y() = PropDistanceFieldVoxel::UNINITIALIZED;
+      voxel.closest_negative_point_.z() = PropDistanceFieldVoxel::UNINITIALIZED;
+      negative_stack.push_back(loc);
+    }
+  }
+  propagatePositive();
+
+  if(propagate_negative_) {
+    while(!negative_stack.empty())
+    {
+      Eigen::Vector3i loc = negative_stack.back();
+      negative_stack.pop_back();
+
+      for( int neighbor=0; neighbor<27; neighbor++ )
+      {
+        const Eigen::Vector3i& diff = direction_number_to_direction_[neighbor];
+        Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
+
+        if( !isCellValid(nloc.x(), nloc.y(), nloc.z()) )
+          continue;
+
+        // cells next to an obstacle are within the propagation distance, so allocating them is no waste
+        PropDistanceFieldVoxel& nvoxel = getOrCreateCell(nloc.x(), nloc.y(), nloc.z());
+        Eigen::Vector3i& close_point = nvoxel.closest_negative_point_;
+        if( !isCellValid( close_point.x(), close_point.y(), close_point.z() ) )
+        {
+          close_point = nloc;
+        }
+        const PropDistanceFieldVoxel* closest_point_voxel = findCell( close_point.x(), close_point.y(), close_point.z() );
+
+        //our closest non-obstacle cell has become an obstacle
+        if( closest_point_voxel && closest_point_voxel->negative_distance_square_ != 0 )
+        {
+          if( nvoxel.negative_distance_square_!=max_distance_sq_)
+          {
+            nvoxel.negative_distance_square_ = max_distance_sq_;
+            nvoxel.closest_negative_point_.x() = PropDistanceFieldVoxel::UNINITIALIZED;
+            nvoxel.closest_negative_point_.y() = PropDistanceFieldVoxel::UNINITIALIZED;
+            nvoxel.closest_negative_point_.z() = PropDistanceFieldVoxel::UNINITIALIZED;
+            negative_stack.push_back(nloc);
+          }
+        }
+        else
+        {
+          //this cell still has a valid non-obstacle cell, so we need to propogate from it
+          nvoxel.negative_update_direction_ = initial_update_direction;
+          negative_bucket_queue_[0].push_back(nloc);
+        }
+      }
+    }
+    propagateNegative();
+  }
+}
+
+void SparsePropagationDistanceField::removeObstacleVoxels(const std::vector<Eigen::Vector3i>& voxel_points)
+{
+  std::vector<Eigen::Vector3i> stack;
+  int initial_update_direction = getDirectionNumber(0,0,0);
+
+  stack.reserve(voxel_points.size());
+  bucket_queue_[0].reserve(voxel_points.size());
+  if(propagate_negative_)
+    negative_bucket_queue_[0].reserve(voxel_points.size());
+
+  for(unsigned int i = 0; i < voxel_points.size(); i++) {
+    // unallocated cells are free space beyond the propagation distance; nothing to remove
+    PropDistanceFieldVoxel* voxel = findCell(voxel_points[i].x(), voxel_points[i].y(), voxel_points[i].z());
+    if (!voxel)
+      continue;
+    voxel->distance_square_ = max_distance_sq_;
+    voxel->closest_point_ = voxel_points[i];
+    voxel->update_direction_ = initial_update_direction;
+    stack.push_back(voxel_points[i]);
+    if(propagate_negative_) {
+      voxel->negative_distance_square_ = 0;
+      voxel->closest_negative_point_ = voxel_points[i];
+      voxel->negative_update_direction_ = initial_update_direction;
+      negative_bucket_queue_[0].push_back(voxel_points[i]);
+    }
+  }
+
+  // Reset all neighbors who's closest point is now gone.
+  while(!stack.empty())
+  {
+    Eigen::Vector3i loc = stack.back();
+    stack.pop_back();
+
+    for( int neighbor=0; neighbor<27; neighbor++ )
+    {
+      const Eigen::Vector3i& diff = direction_number_to_direction_[neighbor];
+      Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
+
+      if( !isCellValid(nloc.x(), nloc.y(), nloc.z()) )
+        continue;
+
+      // an unallocated neighbor is beyond the propagation distance of every obstacle
+      PropDistanceFieldVoxel* nvoxel = findCell(nloc.x(), nloc.y(), nloc.z());
+      if( !nvoxel )
+        continue;
+      Eigen::Vector3i& close_point = nvoxel->closest_point_;
+      if( !isCellValid( close_point.x(), close_point.y(), close_point.z() ) )
+      {
+        close_point = nloc;
+      }
+      const PropDistanceFieldVoxel* closest_point_voxel = findCell( close_point.x(), close_point.y(), close_point.z() );
+
+      if( !closest_point_voxel || closest_point_voxel->distance_square_ != 0 )
+      {       // closest point no longer exists
+        if( nvoxel->distance_square_!=max_distance_sq_)
+        {
+          nvoxel->distance_square_ = max_distance_sq_;
+          nvoxel->closest_point_ = nloc;
+          nvoxel->update_direction_ = initial_update_direction;
+          stack.push_back(nloc);
+        }
+      }
+      else
+      {       // add to queue so we can propagate the values
+        nvoxel->update_direction_ = initial_update_direction;
+        bucket_queue_[0].push_back(nloc);
+      }
+    }
+  }
+  propagatePositive();
+
+  if(propagate_negative_) {
+    propagateNegative();
+  }
+}
+
+void SparsePropagationDistanceField::propagatePositive()
+{
+  for (unsigned int i=0; i<bucket_queue_.size(); ++i)
+  {
+    std::vector<Eigen::Vector3i>::iterator list_it = bucket_queue_[i].begin();
+    std::vector<Eigen::Vector3i>::iterator list_end = bucket_queue_[i].end();
+    for ( ; list_it != list_end ; ++list_it)
+    {
+      const Eigen::Vector3i& loc = *list_it;
+      // cells in the queue have always been allocated, and blocks never move once allocated
+      PropDistanceFieldVoxel* vptr = findCell(loc.x(), loc.y(), loc.z());
+
+      if (vptr->update_direction_<0 || vptr->update_direction_>26)
+      {
+        logError("PROGRAMMING ERROR: Invalid update direction detected: %d", vptr->update_direction_);
+        continue;
+      }
+
+      const std::vector<Eigen::Vector3i>& neighborhood = neighborhoods_[i > 1 ? 1 : i][vptr->update_direction_];
+
+      for (unsigned int n=0; n<neighborhood.size(); n++)
+      {
+        const Eigen::Vector3i& diff = neighborhood[n];
+        Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
+        if (!isCellValid(nloc.x(), nloc.y(), nloc.z()) )
+          continue;
+
+        int new_distance_sq = eucDistSq(vptr->closest_point_, nloc);
+        if (new_distance_sq >= max_distance_sq_)
+          continue;
+
+        PropDistanceFieldVoxel* neighbor = &getOrCreateCell(nloc.x(), nloc.y(), nloc.z());
+        if (new_distance_sq < neighbor->distance_square_)
+        {
+          neighbor->distance_square_ = new_distance_sq;
+          neighbor->closest_point_ = vptr->closest_point_;
+          neighbor->update_direction_ = getDirectionNumber(diff.x(), diff.y(), diff.z());
+
+          bucket_queue_[new_distance_sq].push_back(nloc);
+        }
+      }
+    }
+    bucket_queue_[i].clear();
+  }
+}
+
+void SparsePropagationDistanceField::propagateNegative()
+{
+  for (unsigned int i=0; i<negative_bucket_queue_.size(); ++i)
+  {
+    std::vector<Eigen::Vector3i>::iterator list_it = negative_bucket_queue_[i].begin();
+    std::vector<Eigen::Vector3i>::iterator list_end = negative_bucket_queue_[i].end();
+    for ( ; list_it != list_end ; ++list_it)
+    {
+      const Eigen::Vector3i& loc = *list_it;
+      PropDistanceFieldVoxel* vptr = findCell(loc.x(), loc.y(), loc.z());
+
+      if (vptr->negative_update_direction_<0 || vptr->negative_update_direction_>26)
+      {
+        logError("PROGRAMMING ERROR: Invalid update direction detected: %d", vptr->negative_update_direction_);
+        continue;
+      }
+
+      const std::vector<Eigen::Vector3i>& neighborhood = neighborhoods_[i > 1 ? 1 : i][vptr->negative_update_direction_];
+
+      for (unsigned int n=0; n<neighborhood.size(); n++)
+      {
+        const Eigen::Vector3i& diff = neighborhood[n];
+        Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
+        if (!isCellValid(nloc.x(), nloc.y(), nloc.z()) )
+          continue;
+
+        // unallocated cells are unoccupied, so their negative distance is already zero
+        PropDistanceFieldVoxel* neighbor = findCell(nloc.x(), nloc.y(), nloc.z());
+        if (!neighbor)
+          continue;
+        int new_distance_sq = eucDistSq(vptr->closest_negative_point_, nloc);
+        if (new_distance_sq > max_distance_sq_)
+          continue;
+        if (new_distance_sq < neighbor->negative_distance_square_)
+        {
+          neighbor->negative_distance_square_ = new_distance_sq;
+          neighbor->closest_negative_point_ = vptr->closest_negative_point_;
+          neighbor->negative_update_direction_ = getDirectionNumber(diff.x(), diff.y(), diff.z());
+
+          negative_bucket_queue_[new_distance_sq].push_back(nloc);
+        }
+      }
+    }
+    negative_bucket_queue_[i].clear();
+  }
+}
+
+void SparsePropagationDistanceField::reset()
+{
+  blocks_.clear();
+  last_block_ = NULL;
+}
+
+void SparsePropagationDistanceField::initNeighborhoods()
+{
+  direction_number_to_direction_.resize(27);
+  for (int dx=-1; dx<=1; ++dx)
+    for (int dy=-1; dy<=1; ++dy)
+      for (int dz=-1; dz<=1; ++dz)
+        direction_number_to_direction_[getDirectionNumber(dx, dy, dz)] = Eigen::Vector3i(dx, dy, dz);
+
+  // same neighborhoods as PropagationDistanceField::initNeighborhoods()
+  neighborhoods_.clear();
+  neighborhoods_.resize(2);
+  for (int n=0; n<2; n++)
+  {
+    neighborhoods_[n].resize(27);
+    for (int d=0; d<27; ++d)
+    {
+      const Eigen::Vector3i& dir = direction_number_to_direction_[d];
+      for (int t=0; t<27; ++t)
+      {
+        const Eigen::Vector3i& target = direction_number_to_direction_[t];
+        if (target.x()==0 && target.y()==0 && target.z()==0)
+          continue;
+        if (n>=1)
+        {
+          if ((abs(target.x()) + abs(target.y()) + abs(target.z()))!=1)
+            continue;
+          if (dir.x()*target.x()<0 || dir.y()*target.y()<0 || dir.z()*target.z()<0)
+            continue;
+        }
+        neighborhoods_[n][d].push_back(target);
+      }
+    }
+  }
+}
+
+double SparsePropagationDistanceField::getDistance(double x, double y, double z) const
+{
+  int cell_x, cell_y, cell_z;
+  if (!worldToGrid(x, y, z, cell_x, cell_y, cell_z))
+    return getDistance(unallocated_voxel_);
+  return getDistance(cell_x, cell_y, cell_z);
+}
+
+double SparsePropagationDistanceField::getDistance(int x, int y, int z) const
+{
+  return getDistance(getCell(x, y, z));
+}
+
+bool SparsePropagationDistanceField::isCellValid(int x, int y, int z) const
+{
+  return (x>=0 && x<num_cells_[DIM_X] &&
+          y>=0 && y<num_cells_[DIM_Y] &&
+          z>=0 && z<num_cells_[DIM_Z]);
+}
+
+int SparsePropagationDistanceField::getXNumCells() const
+{
+  return num_cells_[DIM_X];
+}
+
+int SparsePropagationDistanceField::getYNumCells() const
+{
+  return num_cells_[DIM_Y];
+}
+
+int SparsePropagationDistanceField::getZNumCells() const
+{
+  return num_cells_[DIM_Z];
+}
+
+bool SparsePropagationDistanceField::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
+{
+  world_x = origin_x_ + resolution_ * double(x);
+  world_y = origin_y_ + resolution_ * double(y);
+  world_z = origin_z_ + resolution_ * double(z);
+  return true;
+}
+
+bool SparsePropagationDistanceField::worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const
+{
+  x = int(floor((world_x - origin_minus_[DIM_X]) * oo_resolution_));
+  y = int(floor((world_y - origin_minus_[DIM_Y]) * oo_resolution_));
+  z = int(floor((world_z - origin_minus_[DIM_Z]) * oo_resolution_));
+  return isCellValid(x, y, z);
+}
+
+bool SparsePropagationDistanceField::writeToStream(std::ostream& os) const
+{
+  os << "resolution: " << resolution_ << std::endl;
+  os << "size_x: " << size_x_ << std::endl;
+  os << "size_y: " << size_y_ << std::endl;
+  os << "size_z: " << size_z_ << std::endl;
+  os << "origin_x: " << origin_x_ << std::endl;
+  os << "origin_y: " << origin_y_ << std::endl;
+  os << "origin_z: " << origin_z_ << std::endl;
+
+  boost::iostreams::filtering_ostream out;
+  out.push(boost::iostreams::zlib_compressor());
+  out.push(os);
+
+  for(unsigned int x = 0; x < static_cast<unsigned int>(getXNumCells()); x++) {
+    for(unsigned int y = 0; y < static_cast<unsigned int>(getYNumCells()); y++) {
+      // each byte covers 8 cells along Z, which never straddle two blocks
+      for(unsigned int z = 0; z < static_cast<unsigned int>(getZNumCells()); z+=8) {
+        std::bitset<8> bs(0);
+        if(isCellAllocated(x,y,z)) {
+          unsigned int zv = std::min((unsigned int)8, getZNumCells()-z);
+          for(unsigned int zi = 0; zi < zv; zi++) {
+            if(getCell(x,y,z+zi).distance_square_ == 0) {
+              bs[zi] = 1;
+            }
+          }
+        }
+        out.write((char*)&bs, sizeof(char));
+      }
+    }
+  }
+  out.flush();
+  return true;
+}
+
+bool SparsePropagationDistanceField::readFromStream(std::istream& is)
+{
+  if(!is.good()) return false;
+
+  std::string temp;
+
+  is >> temp;
+  if(temp != "resolution:") return false;
+  is >> resolution_;
+
+  is >> temp;
+  if(temp != "size_x:") return false;
+  is >> size_x_;
+
+  is >> temp;
+  if(temp != "size_y:") return false;
+  is >> size_y_;
+
+  is >> temp;
+  if(temp != "size_z:") return false;
+  is >> size_z_;
+
+  is >> temp;
+  if(temp != "origin_x:") return false;
+  is >> origin_x_;
+
+  is >> temp;
+  if(temp != "origin_y:") return false;
+  is >> origin_y_;
+
+  is >> temp;
+  if(temp != "origin_z:") return false;
+  is >> origin_z_;
+
+  //previous values for propogation_negative_ and max_distance_ will be used
+
+  initialize();
+
+  //this should be newline
+  char nl;
+  is.get(nl);
+
+  boost::iostreams::filtering_istream in;
+  in.push(boost::iostreams::zlib_decompressor());
+  in.push(is);
+
+  std::vector<Eigen::Vector3i> obs_points;
+  for(unsigned int x = 0; x < static_cast<unsigned int>(getXNumCells()); x++) {
+    for(unsigned int y = 0; y < static_cast<unsigned int>(getYNumCells()); y++) {
+      for(unsigned int z = 0; z < static_cast<unsigned int>(getZNumCells()); z+=8) {
+        char inchar;
+        if(!in.good()) {
+          return false;
+        }
+        in.get(inchar);
+        std::bitset<8> inbit((unsigned long long) inchar);
+        unsigned int zv = std::min((unsigned int)8, getZNumCells()-z);
+        for(unsigned int zi = 0; zi < zv; zi++) {
+          if(inbit[zi] == 1) {
+            obs_points.push_back(Eigen::Vector3i(x,y,z+zi));
+          }
+        }
+      }
+    }
+  }
+  addNewObstacleVoxels(obs_points);
+  return true;
+}
+
+}
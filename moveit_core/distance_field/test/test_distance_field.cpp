@@ -38,12 +38,18 @@
 
 #include <moveit/distance_field/voxel_grid.h>
 #include <moveit/distance_field/propagation_distance_field.h>
+#include <moveit/distance_field/sparse_propagation_distance_field.h>
+#include <moveit/distance_field/mapped_distance_field.h>
 #include <moveit/distance_field/find_internal_points.h>
+#include <moveit/exceptions/exceptions.h>
 #include <console_bridge/console.h>
 #include <geometric_shapes/body_operations.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <octomap/octomap.h>
 #include <boost/make_shared.hpp>
+#include <fstream>
+#include <iterator>
+#include <cstring>
 
 
 using namespace distance_field;
@@ -151,8 +157,9 @@ void printBoth(PropagationDistanceField& pdf, int numX, int numY, int numZ)
   }
 }
 
-bool areDistanceFieldsDistancesEqual(const PropagationDistanceField& df1,
-                                     const PropagationDistanceField& df2)
+template <typename DF1, typename DF2>
+bool areDistanceFieldsDistancesEqual(const DF1& df1,
+                                     const DF2& df2)
 {
   if(df1.getXNumCells() != df2.getXNumCells()) return false;
   if(df1.getYNumCells() != df2.getYNumCells()) return false;
@@ -176,6 +183,27 @@ bool areDistanceFieldsDistancesEqual(const PropagationDistanceField& df1,
   return true;
 }
 
+bool areDistanceFieldsDistancesNear(const DistanceField& df1,
+                                    const DistanceField& df2,
+                                    double tolerance)
+{
+  if(df1.getXNumCells() != df2.getXNumCells()) return false;
+  if(df1.getYNumCells() != df2.getYNumCells()) return false;
+  if(df1.getZNumCells() != df2.getZNumCells()) return false;
+  for (int z=0; z<df1.getZNumCells(); z++) {
+    for (int x=0; x<df1.getXNumCells(); x++) {
+      for (int y=0; y<df1.getYNumCells(); y++) {
+        if(fabs(df1.getDistance(x,y,z) - df2.getDistance(x,y,z)) > tolerance) {
+          printf("Cell %d %d %d distances not near %g %g\n",x,y,z,
+                 df1.getDistance(x,y,z),df2.getDistance(x,y,z));
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
 bool checkOctomapVersusDistanceField(const PropagationDistanceField& df,
                                      const octomap::OcTree& octree)
 {
@@ -881,6 +909,294 @@ TEST(TestSignedPropagationDistanceField, TestReadWrite)
   EXPECT_FALSE(areDistanceFieldsDistancesEqual(df, df3));
 }
 
+TEST(TestSparsePropagationDistanceField, TestMatchesDense)
+{
+  PropagationDistanceField df(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                              PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true);
+  SparsePropagationDistanceField sdf(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                                     PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true);
+  EXPECT_EQ(0u, sdf.getAllocatedBlockCount());
+  EXPECT_EQ(df.getXNumCells(), sdf.getXNumCells());
+  EXPECT_EQ(df.getYNumCells(), sdf.getYNumCells());
+  EXPECT_EQ(df.getZNumCells(), sdf.getZNumCells());
+
+  shapes::Sphere sphere(.25);
+  Eigen::Affine3d p = Eigen::Translation3d(0.5, 0.5, 0.5) * Eigen::Quaterniond(0.0, 0.0, 0.0, 1.0);
+  bodies::Body* body = bodies::createBodyFromShape(&sphere);
+  body->setPose(p);
+  EigenSTL::vector_Vector3d points;
+  findInternalPointsConvex(*body, PERF_RESOLUTION, points);
+  delete body;
+  points.push_back(Eigen::Vector3d(2.9, 2.9, 3.9));
+
+  df.addPointsToField(points);
+  sdf.addPointsToField(points);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, sdf));
+
+  // only the neighborhood of the obstacles is stored
+  int blocks = ((sdf.getXNumCells() + 7) / 8) * ((sdf.getYNumCells() + 7) / 8) * ((sdf.getZNumCells() + 7) / 8);
+  EXPECT_LT(sdf.getAllocatedBlockCount(), static_cast<std::size_t>(blocks / 10));
+  EXPECT_FALSE(sdf.isCellAllocated(sdf.getXNumCells() / 2, 0, sdf.getZNumCells() - 1));
+  EXPECT_EQ(df.getDistance(1.5, 0.0, 3.9), sdf.getDistance(1.5, 0.0, 3.9));
+  EXPECT_EQ(df.getDistance(2.9, 2.9, 3.9), sdf.getDistance(2.9, 2.9, 3.9));
+
+  EigenSTL::vector_Vector3d removed(points.begin(), points.begin() + points.size() / 2);
+  removed.push_back(Eigen::Vector3d(1.5, 0.0, 3.9));
+  df.removePointsFromField(removed);
+  sdf.removePointsFromField(removed);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, sdf));
+
+  EigenSTL::vector_Vector3d moved;
+  moved.push_back(Eigen::Vector3d(2.0, 1.0, 0.0));
+  df.updatePointsInField(points, moved);
+  sdf.updatePointsInField(points, moved);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, sdf));
+
+  sdf.reset();
+  EXPECT_EQ(0u, sdf.getAllocatedBlockCount());
+  EXPECT_EQ(sdf.getDistance(2.0, 1.0, 0.0), sdf.getDistance(1.5, 0.0, 3.9));
+
+  // the sparse field reads files written by the dense field
+  std::ofstream f("test_sparse.df", std::ios::out);
+  df.writeToStream(f);
+  f.close();
+
+  std::ifstream i("test_sparse.df", std::ios::in);
+  SparsePropagationDistanceField sdf2(i, PERF_MAX_DIST, true);
+  std::ifstream i2("test_sparse.df", std::ios::in);
+  PropagationDistanceField df2(i2, PERF_MAX_DIST, true);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df2, sdf2));
+}
+
+TEST(TestSignedPropagationDistanceField, TestParallelPropagation)
+{
+  PropagationDistanceField df(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                              PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true);
+  PropagationDistanceField pdf(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                               PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true);
+  EXPECT_EQ(1u, pdf.getPropagationThreads());
+  pdf.setPropagationThreads(4);
+
+  shapes::Box box(0.5, 0.5, 0.5);
+  Eigen::Affine3d p = Eigen::Translation3d(1.5, 1.5, 2.0) * Eigen::Quaterniond(0.0, 0.0, 0.0, 1.0);
+  bodies::Body* body = bodies::createBodyFromShape(&box);
+  body->setPose(p);
+  EigenSTL::vector_Vector3d points;
+  findInternalPointsConvex(*body, PERF_RESOLUTION, points);
+  delete body;
+
+  // scattered points, so that many cells share a distance level
+  for (int i = 0; i < 20000; ++i)
+    points.push_back(Eigen::Vector3d(fmod(i * 0.618034, 1.0) * PERF_WIDTH,
+                                     fmod(i * 0.414214, 1.0) * PERF_HEIGHT,
+                                     fmod(i * 0.732051, 1.0) * PERF_DEPTH));
+
+  df.addPointsToField(points);
+  pdf.addPointsToField(points);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, pdf));
+
+  EigenSTL::vector_Vector3d removed(points.begin(), points.begin() + points.size() / 3);
+  df.removePointsFromField(removed);
+  pdf.removePointsFromField(removed);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, pdf));
+
+  EigenSTL::vector_Vector3d moved(points.begin() + points.size() / 2, points.end());
+  for (std::size_t i = 0; i < moved.size(); i += 2)
+    moved[i].z() = PERF_DEPTH - moved[i].z();
+  df.updatePointsInField(points, moved);
+  pdf.updatePointsInField(points, moved);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, pdf));
+}
+
+TEST(TestSignedPropagationDistanceField, TestInterpolatedDistances)
+{
+  PropagationDistanceField df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  SparsePropagationDistanceField sdf(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+
+  EigenSTL::vector_Vector3d points;
+  points.push_back(point1);
+  points.push_back(point2);
+  points.push_back(point3);
+  points.push_back(Eigen::Vector3d(0.5, 0.5, 0.5));
+  points.push_back(Eigen::Vector3d(0.5, 0.6, 0.5));
+  df.addPointsToField(points);
+  sdf.addPointsToField(points);
+
+  EigenSTL::vector_Vector3d queries;
+  for (int i = 0; i < 500; ++i)
+    queries.push_back(Eigen::Vector3d(fmod(i * 0.618034, 1.0) * (width - resolution),
+                                      fmod(i * 0.414214, 1.0) * (height - resolution),
+                                      fmod(i * 0.732051, 1.0) * (depth - resolution)));
+  // a cell center, the midpoint of two cells and a location outside the field
+  queries.push_back(Eigen::Vector3d(0.3, 0.5, 0.5));
+  queries.push_back(Eigen::Vector3d(0.35, 0.5, 0.5));
+  queries.push_back(Eigen::Vector3d(-0.1, 0.5, 0.5));
+
+  std::vector<double> distances;
+  EigenSTL::vector_Vector3d gradients;
+  std::size_t in_bounds = df.getInterpolatedDistances(queries, distances, &gradients);
+  ASSERT_EQ(queries.size(), distances.size());
+  ASSERT_EQ(queries.size(), gradients.size());
+  EXPECT_EQ(queries.size() - 1, in_bounds);
+
+  std::size_t n = queries.size();
+  EXPECT_NEAR(df.getDistance(3, 5, 5), distances[n - 3], 1e-9);
+  EXPECT_NEAR((df.getDistance(3, 5, 5) + df.getDistance(4, 5, 5)) / 2.0, distances[n - 2], 1e-9);
+  EXPECT_NEAR((df.getDistance(4, 5, 5) - df.getDistance(3, 5, 5)) / resolution, gradients[n - 2].x(), 1e-9);
+  EXPECT_EQ(df.getUninitializedDistance(), distances[n - 1]);
+  EXPECT_EQ(0.0, gradients[n - 1].norm());
+
+  // the default implementation, used by the sparse field, gives the same results
+  std::vector<double> sparse_distances;
+  EigenSTL::vector_Vector3d sparse_gradients;
+  EXPECT_EQ(in_bounds, sdf.getInterpolatedDistances(queries, sparse_distances, &sparse_gradients));
+  for (std::size_t i = 0; i < n - 1; ++i)
+  {
+    EXPECT_NEAR(distances[i], sparse_distances[i], 1e-9);
+    EXPECT_NEAR(0.0, (gradients[i] - sparse_gradients[i]).norm(), 1e-9);
+  }
+
+  // the gradients are the derivatives of the interpolated distances
+  for (std::size_t i = 0; i < n - 3; ++i)
+    for (int d = 0; d < 3; ++d)
+    {
+      Eigen::Vector3d plus = queries[i];
+      Eigen::Vector3d minus = queries[i];
+      plus[d] += 1e-6;
+      minus[d] -= 1e-6;
+      double distance_plus, distance_minus;
+      if (df.getInterpolatedDistances(plus.data(), 1, &distance_plus) == 1 &&
+          df.getInterpolatedDistances(minus.data(), 1, &distance_minus) == 1)
+        EXPECT_NEAR((distance_plus - distance_minus) / 2e-6, gradients[i][d], 1e-3);
+    }
+
+  // the float cache follows updates of the field
+  df.setFloatDistanceCache(true);
+  EXPECT_TRUE(df.hasFloatDistanceCache());
+  EigenSTL::vector_Vector3d moved;
+  moved.push_back(Eigen::Vector3d(0.8, 0.2, 0.7));
+  df.updatePointsInField(points, moved);
+  df.setFloatDistanceCache(false);
+  df.getInterpolatedDistances(queries, distances, &gradients);
+  df.setFloatDistanceCache(true);
+  df.removePointsFromField(moved);
+  df.addPointsToField(moved);
+
+  std::vector<double> float_distances;
+  EigenSTL::vector_Vector3d float_gradients;
+  EXPECT_EQ(in_bounds, df.getInterpolatedDistances(queries, float_distances, &float_gradients));
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    EXPECT_NEAR(distances[i], float_distances[i], 1e-5);
+    EXPECT_NEAR(0.0, (gradients[i] - float_gradients[i]).norm(), 1e-4);
+  }
+}
+
+TEST(TestSignedPropagationDistanceField, TestMappedFile)
+{
+  PropagationDistanceField df(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                              PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true);
+
+  shapes::Box box(0.5, 0.5, 0.5);
+  Eigen::Affine3d p = Eigen::Translation3d(1.5, 1.5, 2.0) * Eigen::Quaterniond(0.0, 0.0, 0.0, 1.0);
+  bodies::Body* body = bodies::createBodyFromShape(&box);
+  body->setPose(p);
+  EigenSTL::vector_Vector3d points;
+  findInternalPointsConvex(*body, PERF_RESOLUTION, points);
+  delete body;
+  points.push_back(Eigen::Vector3d(2.9, 2.9, 3.9));
+  df.addPointsToField(points);
+
+  ASSERT_TRUE(MappedDistanceField::save("test_mapped.df", df));
+  EXPECT_TRUE(MappedDistanceField::isMappedDistanceFieldFile("test_mapped.df"));
+
+  // chunks of free space are stored as a single value
+  std::ifstream size_check("test_mapped.df", std::ios::in | std::ios::binary | std::ios::ate);
+  std::size_t cells = std::size_t(df.getXNumCells()) * df.getYNumCells() * df.getZNumCells();
+  EXPECT_LT(static_cast<std::size_t>(size_check.tellg()), cells * sizeof(float) / 4);
+
+  MappedDistanceField mdf("test_mapped.df");
+  EXPECT_FALSE(mdf.hasOverlay());
+  EXPECT_TRUE(mdf.getPropagateNegativeDistances());
+  EXPECT_EQ(df.getUninitializedDistance(), mdf.getUninitializedDistance());
+  EXPECT_TRUE(areDistanceFieldsDistancesNear(df, mdf, 1e-6));
+  EXPECT_NEAR(df.getDistance(1.5, 1.5, 2.0), mdf.getDistance(1.5, 1.5, 2.0), 1e-6);
+  EXPECT_EQ(df.getDistance(-1.0, 0.0, 0.0), mdf.getDistance(-1.0, 0.0, 0.0));
+
+  // the occupancy written to a stream is the one of the saved field
+  std::ofstream f("test_mapped_stream.df", std::ios::out);
+  mdf.writeToStream(f);
+  f.close();
+  EXPECT_FALSE(MappedDistanceField::isMappedDistanceFieldFile("test_mapped_stream.df"));
+  std::ifstream i("test_mapped_stream.df", std::ios::in);
+  PropagationDistanceField df2(i, PERF_MAX_DIST, true);
+  EXPECT_TRUE(areDistanceFieldsDistancesNear(df2, mdf, 1e-6));
+
+  // updates go to an in-memory copy and leave the file untouched
+  EigenSTL::vector_Vector3d moved;
+  moved.push_back(Eigen::Vector3d(2.0, 1.0, 0.0));
+  df2.updatePointsInField(points, moved);
+  mdf.updatePointsInField(points, moved);
+  EXPECT_TRUE(mdf.hasOverlay());
+  EXPECT_TRUE(areDistanceFieldsDistancesNear(df2, mdf, 1e-9));
+
+  MappedDistanceField mdf2("test_mapped.df");
+  EXPECT_FALSE(mdf2.hasOverlay());
+  EXPECT_TRUE(areDistanceFieldsDistancesNear(df, mdf2, 1e-6));
+
+  mdf2.reset();
+  EXPECT_TRUE(mdf2.hasOverlay());
+  EXPECT_EQ(mdf2.getDistance(2.0, 1.0, 0.0), mdf2.getDistance(1.5, 1.5, 2.0));
+
+  // the sparse field writes the same file
+  SparsePropagationDistanceField sdf(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                                     PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true);
+  sdf.addPointsToField(points);
+  ASSERT_TRUE(MappedDistanceField::save("test_mapped_sparse.df", sdf));
+  MappedDistanceField mdf3("test_mapped_sparse.df");
+  EXPECT_TRUE(areDistanceFieldsDistancesNear(sdf, mdf3, 1e-6));
+}
+
+TEST(TestSignedPropagationDistanceField, TestMappedFileFailures)
+{
+  PropagationDistanceField df(PERF_WIDTH, PERF_HEIGHT, PERF_DEPTH, PERF_RESOLUTION,
+                              PERF_ORIGIN_X, PERF_ORIGIN_Y, PERF_ORIGIN_Z, PERF_MAX_DIST, true);
+  EigenSTL::vector_Vector3d points;
+  points.push_back(Eigen::Vector3d(1.5, 1.5, 2.0));
+  df.addPointsToField(points);
+  ASSERT_TRUE(MappedDistanceField::save("test_mapped_failures.df", df));
+  EXPECT_NO_THROW(MappedDistanceField("test_mapped_failures.df"));
+
+  std::ifstream in("test_mapped_failures.df", std::ios::in | std::ios::binary);
+  std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  in.close();
+
+  // a field that is not mapped would read as free space, so construction fails
+  EXPECT_THROW(MappedDistanceField("test_mapped_missing.df"), moveit::ConstructException);
+
+  std::ofstream text("test_mapped_text.df", std::ios::out);
+  df.writeToStream(text);
+  text.close();
+  EXPECT_THROW(MappedDistanceField("test_mapped_text.df"), moveit::ConstructException);
+
+  std::ofstream truncated("test_mapped_truncated.df", std::ios::out | std::ios::binary);
+  truncated.write(contents.data(), contents.size() / 2);
+  truncated.close();
+  EXPECT_THROW(MappedDistanceField("test_mapped_truncated.df"), moveit::ConstructException);
+
+  // the first entry of the chunk table refers to a chunk that is not stored; the offset of the
+  // table is the 64 bit value at byte 128 of the header
+  boost::uint64_t chunks_offset;
+  memcpy(&chunks_offset, contents.data() + 128, sizeof(chunks_offset));
+  ASSERT_LT(chunks_offset + sizeof(boost::uint32_t), contents.size());
+  boost::uint32_t bad_index = 0xfffffffe;
+  memcpy(&contents[chunks_offset], &bad_index, sizeof(bad_index));
+  std::ofstream corrupted("test_mapped_corrupted.df", std::ios::out | std::ios::binary);
+  corrupted.write(contents.data(), contents.size());
+  corrupted.close();
+  EXPECT_THROW(MappedDistanceField("test_mapped_corrupted.df"), moveit::ConstructException);
+}
+
 int main(int argc, char **argv){
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -41,6 +41,7 @@
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/transforms/transforms.h>
 #include <moveit/collision_detection/collision_world.h>
+#include <moveit/background_processing/thread_local_cache.h>
 
 #include <geometric_shapes/bodies.h>
 #include <moveit_msgs/Constraints.h>
@@ -48,6 +49,7 @@
 #include <iostream>
 #include <vector>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 
 /** \brief Representation and evaluation of kinematic constraints */
 namespace kinematic_constraints
@@ -650,6 +652,9 @@ protected:
   const robot_model::LinkModel *link_model_; /**< \brief The link model constraint subject */
 };
 
+/** \brief The collision world of the visibility cone that a thread keeps for a VisibilityConstraint */
+struct VisibilityConeEvaluator;
+
 /**
  * \brief Class for constraints on the visibility relationship between
  * a sensor and a target.
@@ -832,7 +837,32 @@ protected:
    */
   bool decideContact(const collision_detection::Contact &contact) const;
 
+  /**
+   * \brief Compute the vertices of the visibility cone: the sensor origin, the center of the base
+   * of the cone and then the points that approximate the base disc
+   *
+   * @param [in] state The state from which to produce the cone
+   * @param [out] vertices Storage for the (cone_sides_ + 2) * 3 vertex coordinates
+   */
+  void computeVisibilityConeVertices(const robot_state::RobotState &state, double *vertices) const;
+
+  /**
+   * \brief Check whether the bounding spheres of all robot links are outside the bounding box of the
+   * visibility cone. Only used when neither the sensor nor the target frame move with the robot.
+   *
+   * @param [in] state The state in which the links are checked
+   *
+   * @return True if no link can touch the cone, so the collision check can be skipped
+   */
+  bool linksClearOfFixedCone(const robot_state::RobotState &state) const;
+
   collision_detection::CollisionRobotPtr collision_robot_; /**< \brief A copy of the collision robot maintained for collision checking the cone against robot links */
+  moveit::tools::ThreadLocalCache<VisibilityConeEvaluator> cone_evaluators_; /**< \brief The cone collision worlds that threads keep for this constraint */
+  Eigen::Vector3d                        fixed_cone_min_; /**< \brief Minimum corner of the bounding box of the cone, when both frames are fixed */
+  Eigen::Vector3d                        fixed_cone_max_; /**< \brief Maximum corner of the bounding box of the cone, when both frames are fixed */
+  std::vector<const robot_model::LinkModel*> sphere_links_; /**< \brief The link that each of the bounding spheres belongs to */
+  EigenSTL::vector_Vector3d              sphere_centers_; /**< \brief The centers of the bounding spheres of the link shapes, in the link frames */
+  std::vector<double>                    sphere_radii_; /**< \brief The radii of the bounding spheres of the link shapes */
   bool                                   mobile_sensor_frame_; /**< \brief True if the sensor is a non-fixed frame relative to the transform frame */
   bool                                   mobile_target_frame_; /**< \brief True if the target is a non-fixed frame relative to the transform frame */
   std::string                            target_frame_id_; /**< \brief The target frame id */
@@ -845,6 +875,12 @@ protected:
   double                                 target_radius_; /**< \brief Storage for the target radius */
   double                                 max_view_angle_; /**< \brief Storage for the max view angle */
   double                                 max_range_angle_; /**< \brief Storage for the max range angle */
+
+private:
+
+  // a copy would share the cone collision worlds kept for cone_evaluators_ with the original
+  VisibilityConstraint(const VisibilityConstraint&);
+  VisibilityConstraint& operator=(const VisibilityConstraint&);
 };
 
 /**
@@ -40,6 +40,7 @@
 #include <moveit/robot_state/conversions.h>
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
 #include <moveit/collision_detection_fcl/collision_world_fcl.h>
+#include <fcl/BVH/BVH_model.h>
 #include <boost/scoped_ptr.hpp>
 #include <boost/math/constants/constants.hpp>
 #include <eigen_conversions/eigen_msg.h>
@@ -58,6 +59,133 @@ static double normalizeAngle(double angle)
       v -= 2.0 * boost::math::constants::pi<double>();
   return v;
 }
+
+namespace
+{
+// fill in the triangles of a cone mesh whose vertices are laid out as by VisibilityConstraint::computeVisibilityConeVertices()
+void setVisibilityConeTriangles(shapes::Mesh *m, std::size_t sides)
+{
+  std::size_t p3 = sides * 3;
+  for (std::size_t i = 1 ; i < sides ; ++i)
+  {
+    // triangle forming a side of the cone, using the sensor origin
+    std::size_t i3 = (i - 1) * 3;
+    m->triangles[i3] = i + 1;
+    m->triangles[i3 + 1] = 0;
+    m->triangles[i3 + 2] = i + 2;
+    // triangle forming a part of the base of the cone, using the center of the base
+    std::size_t i6 = p3 + i3;
+    m->triangles[i6] = i + 1;
+    m->triangles[i6 + 1] = 1;
+    m->triangles[i6 + 2] = i + 2;
+  }
+
+  // last triangles
+  m->triangles[p3 - 3] = sides + 1;
+  m->triangles[p3 - 2] = 0;
+  m->triangles[p3 - 1] = 2;
+  p3 *= 2;
+  m->triangles[p3 - 3] = sides + 1;
+  m->triangles[p3 - 2] = 1;
+  m->triangles[p3 - 1] = 2;
+}
+
+// allocate a cone mesh with the given vertices; we do NOT allocate normals because we do not compute them
+shapes::Mesh* createVisibilityCone(const double *vertices, std::size_t sides)
+{
+  shapes::Mesh *m = new shapes::Mesh();
+  m->vertex_count = sides + 2;
+  m->vertices = new double[m->vertex_count * 3];
+  m->triangle_count = sides * 2;
+  m->triangles = new unsigned int[m->triangle_count * 3];
+  std::copy(vertices, vertices + m->vertex_count * 3, m->vertices);
+  setVisibilityConeTriangles(m, sides);
+  return m;
+}
+
+// A collision world that contains only the visibility cone. The cone vertices can be moved
+// without reconstructing the world or the FCL geometry; the bounding volumes are refit instead.
+class VisibilityConeWorld : public collision_detection::CollisionWorldFCL
+{
+public:
+
+  VisibilityConeWorld(const double *vertices, std::size_t sides) : cone_(createVisibilityCone(vertices, sides))
+  {
+    getWorld()->addToObject("cone", shapes::ShapeConstPtr(cone_), Eigen::Affine3d::Identity());
+  }
+
+  shapes::Mesh* getCone() const
+  {
+    return cone_;
+  }
+
+  // bring the collision data up to date with the vertices of the cone mesh
+  void updateCone()
+  {
+    std::map<std::string, collision_detection::FCLObject>::iterator it = fcl_objs_.find("cone");
+    if (it == fcl_objs_.end() || it->second.collision_objects_.empty())
+      return;
+    fcl::CollisionObject *co = it->second.collision_objects_[0].get();
+    fcl::BVHModel<fcl::OBBRSS> *g = static_cast<fcl::BVHModel<fcl::OBBRSS>*>(it->second.collision_geometry_[0]->collision_geometry_.get());
+    g->beginUpdateModel();
+    for (unsigned int i = 0 ; i < cone_->vertex_count ; ++i)
+      g->updateVertex(fcl::Vec3f(cone_->vertices[3 * i], cone_->vertices[3 * i + 1], cone_->vertices[3 * i + 2]));
+    g->endUpdateModel(true, true);
+    g->computeLocalAABB();
+    co->computeAABB();
+    manager_->update(co);
+  }
+
+private:
+
+  // a copy would share the cone mesh, but not the collision data that is refit to it
+  VisibilityConeWorld(const VisibilityConeWorld&);
+  VisibilityConeWorld& operator=(const VisibilityConeWorld&);
+
+  shapes::Mesh *cone_; // owned by the world
+};
+
+}
+
+// the cone is allowed to touch the sensor and target frames, but nothing else; the cone worlds of the threads bind
+// copies of the frame ids, since a thread may still be checking its cone while the constraint is destroyed
+static bool decideConeContact(const std::string &sensor_frame_id, const std::string &target_frame_id, const collision_detection::Contact &contact)
+{
+  if (contact.body_type_1 == collision_detection::BodyTypes::ROBOT_ATTACHED ||
+      contact.body_type_2 == collision_detection::BodyTypes::ROBOT_ATTACHED)
+    return true;
+  if (contact.body_type_1 == collision_detection::BodyTypes::ROBOT_LINK &&
+      contact.body_type_2 == collision_detection::BodyTypes::WORLD_OBJECT &&
+      (robot_state::Transforms::sameFrame(contact.body_name_1, sensor_frame_id) ||
+       robot_state::Transforms::sameFrame(contact.body_name_1, target_frame_id)))
+  {
+    logDebug("Accepted collision with either sensor or target");
+    return true;
+  }
+  if (contact.body_type_2 == collision_detection::BodyTypes::ROBOT_LINK &&
+      contact.body_type_1 == collision_detection::BodyTypes::WORLD_OBJECT &&
+      (robot_state::Transforms::sameFrame(contact.body_name_2, sensor_frame_id) ||
+       robot_state::Transforms::sameFrame(contact.body_name_2, target_frame_id)))
+  {
+    logDebug("Accepted collision with either sensor or target");
+    return true;
+  }
+  return false;
+}
+
+// the collision world of the cone that a thread keeps for a visibility constraint
+struct VisibilityConeEvaluator
+{
+  VisibilityConeEvaluator(const double *vertices, std::size_t sides, const collision_detection::DecideContactFn &fn)
+    : world_(vertices, sides)
+  {
+    acm_.setDefaultEntry("cone", fn);
+  }
+
+  VisibilityConeWorld                          world_;
+  collision_detection::AllowedCollisionMatrix  acm_;
+};
+
 }
 
 kinematic_constraints::KinematicConstraint::KinematicConstraint(const robot_model::RobotModelConstPtr &model) :
@@ -649,10 +777,38 @@ kinematic_constraints::VisibilityConstraint::VisibilityConstraint(const robot_mo
   KinematicConstraint(model), collision_robot_(new collision_detection::CollisionRobotFCL(model))
 {
   type_ = VISIBILITY_CONSTRAINT;
+
+  // bounding spheres of the link shapes, in the link frames, used to quickly rule out collisions with a fixed cone
+  const std::vector<const robot_model::LinkModel*> &links = model->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const std::vector<shapes::ShapeConstPtr> &shapes = links[i]->getShapes();
+    for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+    {
+      sphere_links_.push_back(links[i]);
+      boost::scoped_ptr<bodies::Body> body(bodies::createBodyFromShape(shapes[j].get()));
+      if (body)
+      {
+        body->setPose(links[i]->getCollisionOriginTransforms()[j]);
+        bodies::BoundingSphere sphere;
+        body->computeBoundingSphere(sphere);
+        sphere_centers_.push_back(sphere.center);
+        sphere_radii_.push_back(sphere.radius);
+      }
+      else
+      {
+        // this shape cannot be bounded, so it is never ruled out
+        sphere_centers_.push_back(Eigen::Vector3d::Zero());
+        sphere_radii_.push_back(std::numeric_limits<double>::infinity());
+      }
+    }
+  }
 }
 
 void kinematic_constraints::VisibilityConstraint::clear()
 {
+  // cone collision worlds kept by threads for the previous configuration are released
+  cone_evaluators_.clear();
   mobile_sensor_frame_ = false;
   mobile_target_frame_ = false;
   target_frame_id_ = "";
@@ -737,6 +893,17 @@ bool kinematic_constraints::VisibilityConstraint::configure(const moveit_msgs::V
   max_range_angle_ = vc.max_range_angle;
   sensor_view_direction_ = vc.sensor_view_direction;
 
+  if (!mobile_sensor_frame_ && !mobile_target_frame_)
+  {
+    // the cone does not move with the robot
+    fixed_cone_min_ = fixed_cone_max_ = sensor_pose_.translation();
+    for (std::size_t i = 0 ; i < points_.size() ; ++i)
+    {
+      fixed_cone_min_ = fixed_cone_min_.cwiseMin(points_[i]);
+      fixed_cone_max_ = fixed_cone_max_.cwiseMax(points_[i]);
+    }
+  }
+
   return target_radius_ > std::numeric_limits<double>::epsilon();
 }
 
@@ -773,76 +940,59 @@ bool kinematic_constraints::VisibilityConstraint::enabled() const
   return target_radius_ > std::numeric_limits<double>::epsilon();
 }
 
-shapes::Mesh* kinematic_constraints::VisibilityConstraint::getVisibilityCone(const robot_state::RobotState &state) const
+void kinematic_constraints::VisibilityConstraint::computeVisibilityConeVertices(const robot_state::RobotState &state, double *vertices) const
 {
   // the current pose of the sensor
 
   const Eigen::Affine3d &sp = mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_id_) * sensor_pose_ : sensor_pose_;
   const Eigen::Affine3d &tp = mobile_target_frame_ ? state.getFrameTransform(target_frame_id_) * target_pose_ : target_pose_;
 
-  // transform the points on the disc to the desired target frame
-  const EigenSTL::vector_Vector3d *points = &points_;
-  boost::scoped_ptr<EigenSTL::vector_Vector3d> tempPoints;
-  if (mobile_target_frame_)
-  {
-    tempPoints.reset(new EigenSTL::vector_Vector3d(points_.size()));
-    for (std::size_t i = 0 ; i < points_.size() ; ++i)
-      tempPoints->at(i) = tp*points_[i];
-    points = tempPoints.get();
-  }
-
-  // allocate memory for a mesh to represent the visibility cone
-  shapes::Mesh *m = new shapes::Mesh();
-  m->vertex_count = cone_sides_ + 2;
-  m->vertices = new double[m->vertex_count * 3];
-  m->triangle_count = cone_sides_ * 2;
-  m->triangles = new unsigned int[m->triangle_count * 3];
-  // we do NOT allocate normals because we do not compute them
-
   // the sensor origin
-  m->vertices[0] = sp.translation().x();
-  m->vertices[1] = sp.translation().y();
-  m->vertices[2] = sp.translation().z();
+  vertices[0] = sp.translation().x();
+  vertices[1] = sp.translation().y();
+  vertices[2] = sp.translation().z();
 
   // the center of the base of the cone approximation
-  m->vertices[3] = tp.translation().x();
-  m->vertices[4] = tp.translation().y();
-  m->vertices[5] = tp.translation().z();
+  vertices[3] = tp.translation().x();
+  vertices[4] = tp.translation().y();
+  vertices[5] = tp.translation().z();
 
-  // the points that approximate the base disc
-  for (std::size_t i = 0 ; i < points->size() ; ++i)
+  // the points that approximate the base disc, transformed to the desired target frame
+  for (std::size_t i = 0 ; i < points_.size() ; ++i)
   {
-    m->vertices[i*3 + 6] = points->at(i).x();
-    m->vertices[i*3 + 7] = points->at(i).y();
-    m->vertices[i*3 + 8] = points->at(i).z();
+    const Eigen::Vector3d p = mobile_target_frame_ ? Eigen::Vector3d(tp * points_[i]) : points_[i];
+    vertices[i*3 + 6] = p.x();
+    vertices[i*3 + 7] = p.y();
+    vertices[i*3 + 8] = p.z();
   }
+}
+
+shapes::Mesh* kinematic_constraints::VisibilityConstraint::getVisibilityCone(const robot_state::RobotState &state) const
+{
+  std::vector<double> vertices((cone_sides_ + 2) * 3);
+  computeVisibilityConeVertices(state, &vertices[0]);
+  return createVisibilityCone(&vertices[0], cone_sides_);
+}
 
-  // add the triangles
-  std::size_t p3 = points->size() * 3;
-  for (std::size_t i = 1 ; i < points->size() ; ++i)
+bool kinematic_constraints::VisibilityConstraint::linksClearOfFixedCone(const robot_state::RobotState &state) const
+{
+  for (std::size_t i = 0 ; i < sphere_links_.size() ; ++i)
   {
-    // triangle forming a side of the cone, using the sensor origin
-    std::size_t i3 = (i - 1) * 3;
-    m->triangles[i3] = i + 1;
-    m->triangles[i3 + 1] = 0;
-    m->triangles[i3 + 2] = i + 2;
-    // triangle forming a part of the base of the cone, using the center of the base
-    std::size_t i6 = p3 + i3;
-    m->triangles[i6] = i + 1;
-    m->triangles[i6 + 1] = 1;
-    m->triangles[i6 + 2] = i + 2;
+    const Eigen::Vector3d c = state.getGlobalLinkTransform(sphere_links_[i]) * sphere_centers_[i];
+    // squared distance from the center of the sphere to the bounding box of the cone
+    double d2 = 0.0;
+    for (int k = 0 ; k < 3 ; ++k)
+    {
+      if (c[k] < fixed_cone_min_[k])
+        d2 += (fixed_cone_min_[k] - c[k]) * (fixed_cone_min_[k] - c[k]);
+      else
+        if (c[k] > fixed_cone_max_[k])
+          d2 += (c[k] - fixed_cone_max_[k]) * (c[k] - fixed_cone_max_[k]);
+    }
+    if (d2 <= sphere_radii_[i] * sphere_radii_[i])
+      return false;
   }
-
-  // last triangles
-  m->triangles[p3 - 3] = points->size() + 1;
-  m->triangles[p3 - 2] = 0;
-  m->triangles[p3 - 1] = 2;
-  p3 *= 2;
-  m->triangles[p3 - 3] = points->size() + 1;
-  m->triangles[p3 - 2] = 1;
-  m->triangles[p3 - 1] = 2;
-
-  return m;
+  return true;
 }
 
 void kinematic_constraints::VisibilityConstraint::getMarkers(const robot_state::RobotState &state, visualization_msgs::MarkerArray &markers) const
@@ -966,28 +1116,43 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Visibil
     }
   }
 
-  shapes::Mesh *m = getVisibilityCone(state);
-  if (!m)
-    return ConstraintEvaluationResult(false, 0.0);
+  // attached bodies are allowed to touch the cone, so when neither end of the cone moves with the robot
+  // it is enough to know that no link comes close to it
+  if (!mobile_sensor_frame_ && !mobile_target_frame_ && linksClearOfFixedCone(state))
+  {
+    if (verbose)
+      logInform("Visibility constraint satisfied. No robot link is near the visibility cone.");
+    return ConstraintEvaluationResult(true, 0.0);
+  }
 
-  // add the visibility cone as an object
-  collision_detection::CollisionWorldFCL collision_world;
-  collision_world.getWorld()->addToObject("cone", shapes::ShapeConstPtr(m), Eigen::Affine3d::Identity());
+  // every thread keeps the collision world of the cone, so only the cone vertices need updating
+  VisibilityConeEvaluator *evaluator = cone_evaluators_.get();
+  if (!evaluator)
+  {
+    std::vector<double> vertices((cone_sides_ + 2) * 3);
+    computeVisibilityConeVertices(state, &vertices[0]);
+    evaluator = cone_evaluators_.set(new VisibilityConeEvaluator(&vertices[0], cone_sides_, boost::bind(&decideConeContact,
+                                                                                                         sensor_frame_id_, target_frame_id_, _1)));
+  }
+  else
+    if (mobile_sensor_frame_ || mobile_target_frame_)
+    {
+      computeVisibilityConeVertices(state, evaluator->world_.getCone()->vertices);
+      evaluator->world_.updateCone();
+    }
 
   // check for collisions between the robot and the cone
   collision_detection::CollisionRequest req;
   collision_detection::CollisionResult res;
-  collision_detection::AllowedCollisionMatrix acm;
-  acm.setDefaultEntry("cone", boost::bind(&VisibilityConstraint::decideContact, this, _1));
   req.contacts = true;
   req.verbose = verbose;
   req.max_contacts = 1;
-  collision_world.checkRobotCollision(req, res, *collision_robot_, state, acm);
+  evaluator->world_.checkRobotCollision(req, res, *collision_robot_, state, evaluator->acm_);
 
   if (verbose)
   {
     std::stringstream ss;
-    m->print(ss);
+    evaluator->world_.getCone()->print(ss);
     logInform("Visibility constraint %ssatisfied. Visibility cone approximation:\n %s", res.collision ? "not " : "", ss.str().c_str());
   }
 
@@ -996,26 +1161,7 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Visibil
 
 bool kinematic_constraints::VisibilityConstraint::decideContact(const collision_detection::Contact &contact) const
 {
-    if (contact.body_type_1 == collision_detection::BodyTypes::ROBOT_ATTACHED ||
-        contact.body_type_2 == collision_detection::BodyTypes::ROBOT_ATTACHED)
-        return true;
-    if (contact.body_type_1 == collision_detection::BodyTypes::ROBOT_LINK &&
-        contact.body_type_2 == collision_detection::BodyTypes::WORLD_OBJECT &&
-        (robot_state::Transforms::sameFrame(contact.body_name_1, sensor_frame_id_) ||
-         robot_state::Transforms::sameFrame(contact.body_name_1, target_frame_id_)))
-    {
-      logDebug("Accepted collision with either sensor or target");
-      return true;
-    }
-    if (contact.body_type_2 == collision_detection::BodyTypes::ROBOT_LINK &&
-        contact.body_type_1 == collision_detection::BodyTypes::WORLD_OBJECT &&
-        (robot_state::Transforms::sameFrame(contact.body_name_2, sensor_frame_id_) ||
-         robot_state::Transforms::sameFrame(contact.body_name_2, target_frame_id_)))
-    {
-      logDebug("Accepted collision with either sensor or target");
-      return true;
-    }
-    return false;
+  return decideConeContact(sensor_frame_id_, target_frame_id_, contact);
 }
 
 void kinematic_constraints::VisibilityConstraint::print(std::ostream &out) const
@@ -41,6 +41,9 @@
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/filesystem/path.hpp>
 #include <ros/package.h>
+#include <boost/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/scoped_ptr.hpp>
 
 class LoadPlanningModelsPr2 : public testing::Test
 {
@@ -740,6 +743,16 @@ TEST_F(LoadPlanningModelsPr2, VisibilityConstraintsSimple)
     vcm.target_pose.pose.orientation.w = .9981;
     EXPECT_TRUE(vc.configure(vcm, tf));
     EXPECT_FALSE(vc.decide(ks, true).satisfied);
+
+    //a fixed cone that goes through the torso is in collision
+    vcm.sensor_pose.pose.position.z = 0.5;
+    vcm.target_pose.pose.position.z = 1.5;
+    vcm.target_pose.pose.orientation.y = 0.0;
+    vcm.target_pose.pose.orientation.w = 1.0;
+    vcm.max_view_angle = 0.0;
+    EXPECT_TRUE(vc.configure(vcm, tf));
+    EXPECT_FALSE(vc.decide(ks, true).satisfied);
+    EXPECT_FALSE(vc.decide(ks).satisfied);
 }
 
 TEST_F(LoadPlanningModelsPr2, VisibilityConstraintsPR2)
@@ -819,6 +832,63 @@ TEST_F(LoadPlanningModelsPr2, VisibilityConstraintsPR2)
   EXPECT_FALSE(vc.decide(ks, true).satisfied);
 }
 
+namespace
+{
+void checkVisibilityAcrossDestruction(const robot_model::RobotModelPtr &kmodel, const moveit_msgs::VisibilityConstraint &vcm,
+                                      const kinematic_constraints::VisibilityConstraint *vc, const robot_state::RobotState *ks,
+                                      boost::barrier *checked, boost::barrier *destroyed)
+{
+  // leave a cone world whose contact decision function comes from vc on this thread
+  EXPECT_TRUE(vc->decide(*ks).satisfied);
+  checked->wait();
+  destroyed->wait();
+
+  // vc is gone; the cone world of this thread is dropped once a new one is made, and nothing refers back to vc
+  robot_state::Transforms tf(kmodel->getModelFrame());
+  kinematic_constraints::VisibilityConstraint other(kmodel);
+  EXPECT_TRUE(other.configure(vcm, tf));
+  for (int i = 0 ; i < 10 ; ++i)
+    EXPECT_TRUE(other.decide(*ks).satisfied);
+}
+}
+
+TEST_F(LoadPlanningModelsPr2, VisibilityConstraintDestroyedWhileThreadsKeepCones)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+
+  // a cone that touches the finger tip it ends at, which the contact decision function allows
+  moveit_msgs::VisibilityConstraint vcm;
+  vcm.sensor_pose.header.frame_id = "narrow_stereo_optical_frame";
+  vcm.sensor_pose.pose.position.z = 0.05;
+  vcm.sensor_pose.pose.orientation.w = 1.0;
+  vcm.target_pose.header.frame_id = "l_gripper_r_finger_tip_link";
+  vcm.target_pose.pose.position.x = 0.035;
+  vcm.target_pose.pose.orientation.w = 1.0;
+  vcm.target_radius = .01;
+  vcm.cone_sides = 10;
+  vcm.sensor_view_direction = moveit_msgs::VisibilityConstraint::SENSOR_Z;
+  vcm.weight = 1.0;
+
+  boost::scoped_ptr<kinematic_constraints::VisibilityConstraint> vc(new kinematic_constraints::VisibilityConstraint(kmodel));
+  ASSERT_TRUE(vc->configure(vcm, tf));
+
+  static const unsigned int THREAD_COUNT = 4;
+  boost::barrier checked(THREAD_COUNT + 1);
+  boost::barrier destroyed(THREAD_COUNT + 1);
+  boost::thread_group threads;
+  for (unsigned int i = 0 ; i < THREAD_COUNT ; ++i)
+    threads.create_thread(boost::bind(&checkVisibilityAcrossDestruction, kmodel, vcm, vc.get(), &ks, &checked, &destroyed));
+
+  // destroy the constraint while every thread still keeps its cone world
+  checked.wait();
+  vc.reset();
+  destroyed.wait();
+  threads.join_all();
+}
+
 TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSet)
 {
   robot_state::RobotState ks(kmodel);
@@ -332,6 +332,31 @@ public:
     return false;
   }
 
+  /**
+   * @brief Solve a batch of independent IK queries for the tip of this solver. Unlike the multi-pose
+   * searchPositionIK(), each pose is a separate query with its own seed and its own solution.
+   *
+   * The default implementation calls searchPositionIK() once per query. Solvers can override it to reuse
+   * their setup across the batch or to solve queries in parallel; in the latter case \e solution_callback
+   * may be called from several threads at the same time.
+   *
+   * @param ik_poses the desired pose of the tip for each query
+   * @param ik_seed_states one seed per query, or a single seed used for all queries
+   * @param timeout The amount of time (in seconds) available to the solver for each query
+   * @param solutions the solution of each query; the entries of failed queries are left empty
+   * @param solution_callback A callback to validate each solution (may be empty)
+   * @param error_codes the error code of each query
+   * @param options container for other IK options
+   * @return True if every query was solved, false otherwise
+   */
+  virtual bool searchPositionIKBatch(const std::vector<geometry_msgs::Pose> &ik_poses,
+                                     const std::vector<std::vector<double> > &ik_seed_states,
+                                     double timeout,
+                                     std::vector<std::vector<double> > &solutions,
+                                     const IKCallbackFn &solution_callback,
+                                     std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+                                     const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
+
   /**
    * @brief Given a set of joint angles and a set of links, compute their pose
    * @param link_names A set of links for which FK needs to be computed
@@ -524,6 +549,17 @@ public:
   virtual bool supportsGroup(const moveit::core::JointModelGroup *jmg,
                                    std::string* error_text_out = NULL) const;
 
+  /**
+   * \brief Check if the const functions of this solver can be called from several threads at the same time.
+   *
+   * Callers that query the solver concurrently (e.g., when sampling goals on several threads) use a single
+   * thread unless this returns true. The default implementation returns false.
+   */
+  virtual bool supportsConcurrentQueries() const
+  {
+    return false;
+  }
+
   /**
    * @brief  Set the search discretization value for all the redundant joints
    */
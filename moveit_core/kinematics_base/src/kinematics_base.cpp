@@ -175,3 +175,36 @@ bool kinematics::KinematicsBase::getPositionIK(const std::vector<geometry_msgs::
 
   return true;
 }
+
+bool kinematics::KinematicsBase::searchPositionIKBatch(const std::vector<geometry_msgs::Pose> &ik_poses,
+                                                       const std::vector<std::vector<double> > &ik_seed_states,
+                                                       double timeout,
+                                                       std::vector<std::vector<double> > &solutions,
+                                                       const IKCallbackFn &solution_callback,
+                                                       std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+                                                       const kinematics::KinematicsQueryOptions &options) const
+{
+  solutions.clear();
+  solutions.resize(ik_poses.size());
+  error_codes.resize(ik_poses.size());
+  if (ik_seed_states.size() != 1 && ik_seed_states.size() != ik_poses.size())
+  {
+    logError("moveit.kinematics_base: Expected 1 or %u seed states but got %u",
+             (unsigned int)ik_poses.size(), (unsigned int)ik_seed_states.size());
+    for (std::size_t i = 0 ; i < error_codes.size() ; ++i)
+      error_codes[i].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  bool all_solved = true;
+  for (std::size_t i = 0 ; i < ik_poses.size() ; ++i)
+  {
+    const std::vector<double> &seed = ik_seed_states.size() == 1 ? ik_seed_states[0] : ik_seed_states[i];
+    if (!searchPositionIK(ik_poses[i], seed, timeout, solutions[i], solution_callback, error_codes[i], options))
+    {
+      solutions[i].clear();
+      all_solved = false;
+    }
+  }
+  return all_solved;
+}
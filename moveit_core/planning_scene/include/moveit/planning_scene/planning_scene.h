@@ -42,6 +42,7 @@
 #include <moveit/transforms/transforms.h>
 #include <moveit/collision_detection/collision_detector_allocator.h>
 #include <moveit/collision_detection/world_diff.h>
+#include <moveit/collision_detection/compiled_collision_matrix.h>
 #include <moveit/kinematic_constraints/kinematic_constraint.h>
 #include <moveit/kinematics_base/kinematics_base.h>
 #include <moveit/robot_trajectory/robot_trajectory.h>
@@ -54,6 +55,7 @@
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/concept_check.hpp>
 
 /** \brief This namespace includes the central class for representing planning contexts */
@@ -61,6 +63,7 @@ namespace planning_scene
 {
 
 class PlanningScene;
+class PathValidityWorkers;
 typedef boost::shared_ptr<PlanningScene> PlanningScenePtr;
 typedef boost::shared_ptr<const PlanningScene> PlanningSceneConstPtr;
 
@@ -79,6 +82,55 @@ typedef std::map<std::string, std_msgs::ColorRGBA> ObjectColorMap;
 /** \brief A map from object names (e.g., attached bodies, collision objects) to their types */
 typedef std::map<std::string, object_recognition_msgs::ObjectType> ObjectTypeMap;
 
+/** \brief Options for checking the validity of a trajectory in parallel, with PlanningScene::isPathValid() */
+struct PathValidityRequest
+{
+  PathValidityRequest() :
+    first_index(0),
+    thread_count(0),
+    block_size(4),
+    unpadded(false),
+    acm(NULL),
+    path_constraints(NULL),
+    check_region(false),
+    region_min(0.0, 0.0, 0.0),
+    region_max(0.0, 0.0, 0.0),
+    verbose(false)
+  {
+  }
+
+  /** \brief The group to check collisions for; the whole robot if empty */
+  std::string group_name;
+
+  /** \brief Waypoints before this one are not checked (e.g., because they have already been executed) */
+  std::size_t first_index;
+
+  /** \brief The number of threads to check with; one per hardware thread if 0 */
+  unsigned int thread_count;
+
+  /** \brief The number of consecutive waypoints a thread takes at a time */
+  std::size_t block_size;
+
+  /** \brief Use the collision robot without padding */
+  bool unpadded;
+
+  /** \brief The allowed collision matrix to use instead of the one of the scene, if not NULL */
+  const collision_detection::AllowedCollisionMatrix *acm;
+
+  /** \brief Constraints every checked waypoint has to satisfy, if not NULL */
+  const kinematic_constraints::KinematicConstraintSet *path_constraints;
+
+  /** \brief If true, only the waypoints at which the robot may overlap the box between \e region_min and \e region_max
+      are checked; the others are assumed valid. This is useful when the trajectory was valid before and only the
+      objects in that box (e.g., the bounding box of what changed in the world) have changed since. */
+  bool check_region;
+  Eigen::Vector3d region_min;
+  Eigen::Vector3d region_max;
+
+  /** \brief Check the first invalid waypoint again, in verbose mode, to report why it is invalid */
+  bool verbose;
+};
+
 /** \brief This class maintains the representation of the
     environment as seen by a planning instance. The environment
     geometry, the robot geometry and state are maintained. */
@@ -663,7 +715,11 @@ public:
   void loadGeometryFromStream(std::istream &in, const Eigen::Affine3d &offset);
   
   /** \brief Fill the message \e scene with the differences between this instance of PlanningScene with respect to the parent.
-      If there is no parent, everything is considered to be a diff and the function behaves like getPlanningSceneMsg() */
+      If there is no parent, everything is considered to be a diff and the function behaves like getPlanningSceneMsg().
+      Only the collision objects that the WorldDiff recorded as changed since the diffs were last cleared are included;
+      those that were only moved are sent as MOVE operations. Receivers that have such an object keep its shapes and
+      only update their poses; receivers that do not have it add it from the geometry, which is still sent. The octomap
+      is sent whole whenever it changed, as octomap_msgs has no partial update that existing subscribers understand. */
   void getPlanningSceneDiffMsg(moveit_msgs::PlanningScene &scene) const;
 
   /** \brief Construct a message (\e scene) with all the necessary data so that the scene can be later reconstructed to be
@@ -685,6 +741,8 @@ public:
   /** \brief Call setPlanningSceneMsg() or setPlanningSceneDiffMsg() depending on how the is_diff member of the message is set */
   bool usePlanningSceneMsg(const moveit_msgs::PlanningScene &scene);
 
+  /** \brief Apply the operation of a collision object message. A MOVE of an object that does not exist in this scene is
+      applied as an ADD if the message carries the geometry of the object */
   bool processCollisionObjectMsg(const moveit_msgs::CollisionObject &object);
   bool processAttachedCollisionObjectMsg(const moveit_msgs::AttachedCollisionObject &object);
 
@@ -843,6 +901,14 @@ public:
   bool isPathValid(const robot_trajectory::RobotTrajectory &trajectory,
                    const std::string &group = "", bool verbose = false, std::vector<std::size_t> *invalid_index = NULL) const;
 
+  /** \brief Check if a given path is valid, using several threads. Waypoints are handed out to the threads in order,
+      starting at \e req.first_index, so the waypoints closest to it are checked first, and all threads stop as soon
+      as an invalid waypoint is found. Each waypoint is checked for collision avoidance, feasibility and, if specified
+      in \e req, path constraint satisfaction. If \e first_invalid_index is not NULL, it is set to the index of the
+      first invalid waypoint, or to the number of waypoints if the path is valid. */
+  bool isPathValid(const robot_trajectory::RobotTrajectory &trajectory, const PathValidityRequest &req,
+                   std::size_t *first_invalid_index = NULL) const;
+
   /** \brief Get the top \e max_costs cost sources for a specified trajectory. The resulting costs are stored in \e costs */
   void getCostSources(const robot_trajectory::RobotTrajectory &trajectory, std::size_t max_costs,
                       std::set<collision_detection::CostSource> &costs, double overlap_fraction = 0.9) const;
@@ -887,7 +953,8 @@ private:
   static robot_model::RobotModelPtr createRobotModel(const boost::shared_ptr<const urdf::ModelInterface> &urdf_model,
                                                      const boost::shared_ptr<const srdf::Model> &srdf_model);
 
-  void getPlanningSceneMsgCollisionObject(moveit_msgs::PlanningScene &scene, const std::string &ns) const;
+  void getPlanningSceneMsgCollisionObject(moveit_msgs::PlanningScene &scene, const std::string &ns,
+                                          moveit_msgs::CollisionObject::_operation_type operation = moveit_msgs::CollisionObject::ADD) const;
   void getPlanningSceneMsgCollisionObjects(moveit_msgs::PlanningScene &scene) const;
   void getPlanningSceneMsgOctomap(moveit_msgs::PlanningScene &scene) const;
   void getPlanningSceneMsgObjectColors(moveit_msgs::PlanningScene &scene_msg) const;
@@ -929,6 +996,13 @@ private:
   void allocateCollisionDetectors();
   void allocateCollisionDetectors(CollisionDetector& detector);
 
+  /* \brief Get \e acm compiled for \e names; the last compiled matrix is reused while neither the entries of \e acm nor \e names change */
+  collision_detection::CompiledAllowedCollisionMatrixConstPtr getCompiledAllowedCollisionMatrix(const collision_detection::AllowedCollisionMatrix &acm,
+                                                                                                 const std::vector<std::string> &names) const;
+
+  /* \brief Get the threads that help check paths; they are started on first use and shared with the diff scenes of this scene */
+  boost::shared_ptr<PathValidityWorkers> getPathValidityWorkers() const;
+
 
 
   std::string                                    name_;         // may be empty
@@ -953,6 +1027,16 @@ private:
 
   collision_detection::AllowedCollisionMatrixPtr acm_;                // if NULL use parent's
 
+  // the matrix compiled by the last path validity check, the revision of the matrix it was compiled from and the names it was compiled for
+  mutable boost::mutex                                                compiled_acm_lock_;
+  mutable collision_detection::CompiledAllowedCollisionMatrixConstPtr compiled_acm_;
+  mutable std::size_t                                                 compiled_acm_revision_;
+  mutable std::vector<std::string>                                    compiled_acm_names_;
+
+  // the threads that help check paths; stopped when the scene is destroyed, once no path check uses them anymore
+  mutable boost::mutex                                                path_validity_workers_lock_;
+  mutable boost::shared_ptr<PathValidityWorkers>                      path_validity_workers_;
+
   StateFeasibilityFn                             state_feasibility_;
   MotionFeasibilityFn                            motion_feasibility_;
 
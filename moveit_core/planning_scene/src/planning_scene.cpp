@@ -39,12 +39,21 @@
 #include <moveit/collision_detection_fcl/collision_detector_allocator_fcl.h>
 #include <geometric_shapes/shape_operations.h>
 #include <moveit/collision_detection/collision_tools.h>
+#include <moveit/collision_detection/compiled_collision_matrix.h>
 #include <moveit/trajectory_processing/trajectory_tools.h>
 #include <moveit/robot_state/conversions.h>
 #include <moveit/exceptions/exceptions.h>
 #include <octomap_msgs/conversions.h>
 #include <eigen_conversions/eigen_msg.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <set>
+#include <limits>
 
 namespace planning_scene
 {
@@ -751,7 +760,10 @@ void planning_scene::PlanningScene::getPlanningSceneDiffMsg(moveit_msgs::Plannin
         scene_msg.world.collision_objects.push_back(co);
       }
       else
-        getPlanningSceneMsgCollisionObject(scene_msg, it->first);
+        // objects that were only moved are sent as MOVE operations: receivers that have them keep their shapes,
+        // and receivers that missed them (e.g. subscribers that joined late) add them from the geometry
+        getPlanningSceneMsgCollisionObject(scene_msg, it->first, it->second == collision_detection::World::MOVE_SHAPE ?
+                                           moveit_msgs::CollisionObject::MOVE : moveit_msgs::CollisionObject::ADD);
     }
     if (do_omap)
       getPlanningSceneMsgOctomap(scene_msg);
@@ -802,12 +814,13 @@ private:
 }
 }
 
-void planning_scene::PlanningScene::getPlanningSceneMsgCollisionObject(moveit_msgs::PlanningScene &scene_msg, const std::string &ns) const
+void planning_scene::PlanningScene::getPlanningSceneMsgCollisionObject(moveit_msgs::PlanningScene &scene_msg, const std::string &ns,
+                                                                       moveit_msgs::CollisionObject::_operation_type operation) const
 {
   moveit_msgs::CollisionObject co;
   co.header.frame_id = getPlanningFrame();
   co.id = ns;
-  co.operation = moveit_msgs::CollisionObject::ADD;
+  co.operation = operation;
   collision_detection::CollisionWorld::ObjectConstPtr obj = world_->getObject(ns);
   if (!obj)
     return;
@@ -1573,6 +1586,16 @@ bool planning_scene::PlanningScene::processCollisionObjectMsg(const moveit_msgs:
     return false;
   }
 
+  // a MOVE of an object this scene does not have can still be applied if the message carries the geometry
+  if (object.operation == moveit_msgs::CollisionObject::MOVE && !world_->hasObject(object.id) &&
+      (!object.primitives.empty() || !object.meshes.empty() || !object.planes.empty()))
+  {
+    logDebug("World object '%s' does not exist. Adding it instead of moving it.", object.id.c_str());
+    moveit_msgs::CollisionObject added = object;
+    added.operation = moveit_msgs::CollisionObject::ADD;
+    return processCollisionObjectMsg(added);
+  }
+
   if (object.operation == moveit_msgs::CollisionObject::ADD || object.operation == moveit_msgs::CollisionObject::APPEND)
   {
     if (object.primitives.empty() && object.meshes.empty() && object.planes.empty())
@@ -1653,44 +1676,60 @@ bool planning_scene::PlanningScene::processCollisionObjectMsg(const moveit_msgs:
   {
     if (world_->hasObject(object.id))
     {
+      // the geometry is only used when the object is missing, so the shapes and their collision geometry are kept
       if (!object.primitives.empty() || !object.meshes.empty() || !object.planes.empty())
-        logWarn("Move operation for object '%s' ignores the geometry specified in the message.");
+        logDebug("Move operation for object '%s' ignores the geometry specified in the message.", object.id.c_str());
 
       const Eigen::Affine3d &t = getTransforms().getTransform(object.header.frame_id);
+      collision_detection::World::ObjectConstPtr obj = world_->getObject(object.id);
+
+      // the poses are grouped by shape type; assign them to the shapes of each type in the order the shapes are stored
+      std::vector<shapes::ShapeConstPtr> shapes = obj->shapes_;
       EigenSTL::vector_Affine3d new_poses;
-      for (std::size_t i = 0 ; i < object.primitive_poses.size() ; ++i)
-      {
-        Eigen::Affine3d p;
-        tf::poseMsgToEigen(object.primitive_poses[i], p);
-        new_poses.push_back(t * p);
-      }
-      for (std::size_t i = 0 ; i < object.mesh_poses.size() ; ++i)
-      {
-        Eigen::Affine3d p;
-        tf::poseMsgToEigen(object.mesh_poses[i], p);
-        new_poses.push_back(t * p);
-      }
-      for (std::size_t i = 0 ; i < object.plane_poses.size() ; ++i)
+      std::size_t primitive_index = 0, mesh_index = 0, plane_index = 0;
+      for (std::size_t i = 0 ; i < shapes.size() ; ++i)
       {
+        const geometry_msgs::Pose *pose = NULL;
+        switch (shapes[i]->type)
+        {
+          case shapes::SPHERE:
+          case shapes::BOX:
+          case shapes::CYLINDER:
+          case shapes::CONE:
+            if (primitive_index < object.primitive_poses.size())
+              pose = &object.primitive_poses[primitive_index++];
+            break;
+          case shapes::MESH:
+            if (mesh_index < object.mesh_poses.size())
+              pose = &object.mesh_poses[mesh_index++];
+            break;
+          case shapes::PLANE:
+            if (plane_index < object.plane_poses.size())
+              pose = &object.plane_poses[plane_index++];
+            break;
+          default:
+            break;
+        }
+        if (!pose)
+          break;
         Eigen::Affine3d p;
-        tf::poseMsgToEigen(object.plane_poses[i], p);
+        tf::poseMsgToEigen(*pose, p);
         new_poses.push_back(t * p);
       }
 
-      collision_detection::World::ObjectConstPtr obj = world_->getObject(object.id);
-      if (obj->shapes_.size() == new_poses.size())
+      if (new_poses.size() != shapes.size() || primitive_index != object.primitive_poses.size() ||
+          mesh_index != object.mesh_poses.size() || plane_index != object.plane_poses.size())
       {
-        std::vector<shapes::ShapeConstPtr> shapes = obj->shapes_;
-        obj.reset();
-        world_->removeObject(object.id);
-        world_->addToObject(object.id, shapes, new_poses);
-      }
-      else
-      {
-        logError("Number of supplied poses (%u) for object '%s' does not match number of shapes (%u). Not moving.",
-                 (unsigned int)new_poses.size(), object.id.c_str(), (unsigned int)obj->shapes_.size());
+        logError("Supplied poses (%u primitive, %u mesh, %u plane) for object '%s' do not match its shapes. Not moving.",
+                 (unsigned int)object.primitive_poses.size(), (unsigned int)object.mesh_poses.size(),
+                 (unsigned int)object.plane_poses.size(), object.id.c_str());
         return false;
       }
+
+      // the shapes are kept, so their collision geometry does not need to be reconstructed
+      obj.reset();
+      for (std::size_t i = 0 ; i < shapes.size() ; ++i)
+        world_->moveShapeInObject(object.id, shapes[i], new_poses[i]);
       return true;
     }
     else
@@ -2087,6 +2126,393 @@ bool planning_scene::PlanningScene::isPathValid(const robot_trajectory::RobotTra
   return isPathValid(trajectory, emp_constraints, emp_constraints_vector, group, verbose, invalid_index);
 }
 
+namespace
+{
+
+// the radius of a sphere centered at the origin of the shape that contains the shape
+double computeShapeRadius(const shapes::Shape *shape)
+{
+  if (shape->type == shapes::OCTREE || shape->type == shapes::PLANE)
+    return std::numeric_limits<double>::infinity();
+  if (shape->type == shapes::MESH)
+  {
+    const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
+    double radius = 0.0;
+    for (unsigned int i = 0 ; i < mesh->vertex_count ; ++i)
+      radius = std::max(radius, Eigen::Map<const Eigen::Vector3d>(mesh->vertices + 3 * i).norm());
+    return radius;
+  }
+  return shapes::computeShapeExtents(shape).norm() / 2.0;
+}
+
+// the radius of a shape as the collision robot sees it, scaled and padded the same way
+double computeShapeRadius(const shapes::Shape *shape, double scale, double padding)
+{
+  if (std::fabs(scale - 1.0) <= std::numeric_limits<double>::epsilon() && std::fabs(padding) <= std::numeric_limits<double>::epsilon())
+    return computeShapeRadius(shape);
+  if (shape->type == shapes::OCTREE || shape->type == shapes::PLANE)
+    return std::numeric_limits<double>::infinity();
+  boost::scoped_ptr<shapes::Shape> scaled(shape->clone());
+  scaled->scaleAndPadd(scale, padding);
+  return computeShapeRadius(scaled.get());
+}
+
+}
+
+namespace planning_scene
+{
+
+// threads that help check paths; a scene starts them on first use and stops them when it is destroyed
+class PathValidityWorkers
+{
+public:
+
+  explicit PathValidityWorkers(unsigned int count) :
+    stop_(false)
+  {
+    for (unsigned int i = 0 ; i < count ; ++i)
+      threads_.create_thread(boost::bind(&PathValidityWorkers::work, this));
+  }
+
+  ~PathValidityWorkers()
+  {
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      stop_ = true;
+    }
+    work_available_.notify_all();
+    threads_.join_all();
+  }
+
+  // run \e job on the calling thread and on up to \e helpers threads of the pool; return once none of them runs it anymore
+  void run(const boost::function<void()> &job, unsigned int helpers)
+  {
+    Batch batch(job);
+    if (helpers > 0)
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      queue_.insert(queue_.end(), std::min<std::size_t>(helpers, threads_.size()), &batch);
+    }
+    work_available_.notify_all();
+
+    job();
+
+    // helpers that have not started yet are not needed anymore
+    boost::mutex::scoped_lock slock(lock_);
+    queue_.erase(std::remove(queue_.begin(), queue_.end(), &batch), queue_.end());
+    while (batch.running_ > 0)
+      batch.finished_.wait(slock);
+  }
+
+private:
+
+  struct Batch
+  {
+    explicit Batch(const boost::function<void()> &job) :
+      job_(job),
+      running_(0)
+    {
+    }
+
+    boost::function<void()> job_;
+    unsigned int running_;
+    boost::condition_variable finished_;
+  };
+
+  void work()
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    while (true)
+    {
+      while (!stop_ && queue_.empty())
+        work_available_.wait(slock);
+      if (stop_)
+        return;
+      Batch *batch = queue_.front();
+      queue_.pop_front();
+      batch->running_++;
+      slock.unlock();
+      batch->job_();
+      slock.lock();
+      if (--batch->running_ == 0)
+        batch->finished_.notify_all();
+    }
+  }
+
+  boost::thread_group threads_;
+  boost::mutex lock_;
+  boost::condition_variable work_available_;
+  std::deque<Batch*> queue_;
+  bool stop_;
+};
+
+}
+
+namespace
+{
+
+// true if \e state has bodies with the same names, links, shapes, poses and touch links as those of \e waypoint
+bool haveSameAttachedBodies(const robot_state::RobotState &state, const robot_state::RobotState &waypoint)
+{
+  std::vector<const robot_state::AttachedBody*> bodies, waypoint_bodies;
+  state.getAttachedBodies(bodies);
+  waypoint.getAttachedBodies(waypoint_bodies);
+  if (bodies.size() != waypoint_bodies.size())
+    return false;
+  for (std::size_t i = 0 ; i < waypoint_bodies.size() ; ++i)
+  {
+    const robot_state::AttachedBody *body = state.getAttachedBody(waypoint_bodies[i]->getName());
+    if (!body || body->getAttachedLink() != waypoint_bodies[i]->getAttachedLink() ||
+        body->getShapes() != waypoint_bodies[i]->getShapes() || body->getTouchLinks() != waypoint_bodies[i]->getTouchLinks())
+      return false;
+    const EigenSTL::vector_Affine3d &transforms = body->getFixedTransforms();
+    const EigenSTL::vector_Affine3d &waypoint_transforms = waypoint_bodies[i]->getFixedTransforms();
+    for (std::size_t j = 0 ; j < transforms.size() ; ++j)
+      if (transforms[j].matrix() != waypoint_transforms[j].matrix())
+        return false;
+  }
+  return true;
+}
+
+// the state shared by the threads that check a path
+class PathValidityCheck
+{
+public:
+
+  PathValidityCheck(const planning_scene::PlanningScene *scene, const robot_trajectory::RobotTrajectory &trajectory,
+                    const planning_scene::PathValidityRequest &req, const collision_detection::AllowedCollisionMatrix &acm) :
+    scene_(scene),
+    trajectory_(trajectory),
+    req_(req),
+    acm_(acm),
+    next_(req.first_index),
+    end_(trajectory.getWayPointCount()),
+    first_invalid_(end_)
+  {
+    collision_request_.group_name = req.group_name;
+    if (req.check_region)
+    {
+      // the bounding spheres of the collision geometry do not change along the trajectory; the links are scaled and
+      // padded like the collision robot that is checked, attached bodies are not
+      const robot_state::RobotState &state = trajectory.getWayPoint(std::min(req.first_index, end_ - 1));
+      const collision_detection::CollisionRobot &crobot = req.unpadded ? *scene->getCollisionRobotUnpadded() : *scene->getCollisionRobot();
+      const std::vector<const robot_model::LinkModel*> &links = scene->getRobotModel()->getLinkModelsWithCollisionGeometry();
+      for (std::size_t i = 0 ; i < links.size() ; ++i)
+      {
+        double scale = crobot.getLinkScale(links[i]->getName());
+        double padding = crobot.getLinkPadding(links[i]->getName());
+        for (std::size_t j = 0 ; j < links[i]->getShapes().size() ; ++j)
+          link_shapes_.push_back(std::make_pair(links[i], std::make_pair(j, computeShapeRadius(links[i]->getShapes()[j].get(), scale, padding))));
+      }
+      state.getAttachedBodies(attached_bodies_);
+      attached_body_radii_.resize(attached_bodies_.size());
+      for (std::size_t i = 0 ; i < attached_bodies_.size() ; ++i)
+        for (std::size_t j = 0 ; j < attached_bodies_[i]->getShapes().size() ; ++j)
+          attached_body_radii_[i].push_back(computeShapeRadius(attached_bodies_[i]->getShapes()[j].get()));
+    }
+  }
+
+  // check blocks of waypoints until all are handed out or an invalid one is found
+  void run()
+  {
+    robot_state::RobotState state(trajectory_.getWayPoint(req_.first_index));
+    while (true)
+    {
+      std::size_t begin, end;
+      {
+        boost::mutex::scoped_lock slock(lock_);
+        if (next_ >= first_invalid_)
+          return;
+        begin = next_;
+        end = next_ = std::min(next_ + std::max<std::size_t>(req_.block_size, 1), first_invalid_);
+      }
+
+      for (std::size_t i = begin ; i < end ; ++i)
+      {
+        {
+          // another thread found an earlier invalid waypoint
+          boost::mutex::scoped_lock slock(lock_);
+          if (i >= first_invalid_)
+            return;
+        }
+        if (!isValid(state, i, false))
+        {
+          boost::mutex::scoped_lock slock(lock_);
+          first_invalid_ = std::min(first_invalid_, i);
+          return;
+        }
+      }
+    }
+  }
+
+  bool isValid(robot_state::RobotState &state, std::size_t index, bool verbose) const
+  {
+    // only the values are copied into the state of the thread, so its attached bodies and the collision geometry
+    // cached for them are reused; the whole waypoint is copied if its attached bodies differ
+    const robot_state::RobotState &waypoint = trajectory_.getWayPoint(index);
+    if (haveSameAttachedBodies(state, waypoint))
+    {
+      state.setVariablePositions(waypoint.getVariablePositions());
+      if (waypoint.hasVelocities())
+        state.setVariableVelocities(waypoint.getVariableVelocities());
+      if (waypoint.hasAccelerations())
+        state.setVariableAccelerations(waypoint.getVariableAccelerations());
+    }
+    else
+      state = waypoint;
+    state.updateCollisionBodyTransforms();
+    if (req_.check_region && !overlapsRegion(state))
+      return true;
+
+    collision_detection::CollisionRequest collision_request = collision_request_;
+    collision_request.verbose = verbose;
+    collision_detection::CollisionResult res;
+    const robot_state::RobotState &cstate = state;
+    if (req_.unpadded)
+      scene_->checkCollisionUnpadded(collision_request, res, cstate, acm_);
+    else
+      scene_->checkCollision(collision_request, res, cstate, acm_);
+    if (res.collision)
+      return false;
+    if (!scene_->isStateFeasible(cstate, verbose))
+      return false;
+    if (req_.path_constraints && !req_.path_constraints->empty() && !req_.path_constraints->decide(cstate, verbose).satisfied)
+      return false;
+    return true;
+  }
+
+  std::size_t getFirstInvalidIndex() const
+  {
+    return first_invalid_;
+  }
+
+private:
+
+  bool overlapsRegion(const robot_state::RobotState &state) const
+  {
+    for (std::size_t i = 0 ; i < link_shapes_.size() ; ++i)
+      if (overlapsRegion(state.getCollisionBodyTransform(link_shapes_[i].first, link_shapes_[i].second.first).translation(),
+                         link_shapes_[i].second.second))
+        return true;
+    std::vector<const robot_state::AttachedBody*> attached_bodies;
+    state.getAttachedBodies(attached_bodies);
+    for (std::size_t i = 0 ; i < attached_bodies.size() ; ++i)
+    {
+      // the radii are known for the bodies attached at the first waypoint; they are computed for the others
+      const std::vector<shapes::ShapeConstPtr> &shapes = attached_bodies[i]->getShapes();
+      const std::vector<double> *radii = NULL;
+      for (std::size_t j = 0 ; j < attached_bodies_.size() && !radii ; ++j)
+        if (attached_bodies_[j]->getName() == attached_bodies[i]->getName() && attached_bodies_[j]->getShapes() == shapes)
+          radii = &attached_body_radii_[j];
+      const EigenSTL::vector_Affine3d &transforms = attached_bodies[i]->getGlobalCollisionBodyTransforms();
+      for (std::size_t j = 0 ; j < transforms.size() && j < shapes.size() ; ++j)
+        if (overlapsRegion(transforms[j].translation(), radii ? (*radii)[j] : computeShapeRadius(shapes[j].get())))
+          return true;
+    }
+    return false;
+  }
+
+  bool overlapsRegion(const Eigen::Vector3d &center, double radius) const
+  {
+    double distance_squared = 0.0;
+    for (int k = 0 ; k < 3 ; ++k)
+    {
+      double d = std::max(std::max(req_.region_min[k] - center[k], center[k] - req_.region_max[k]), 0.0);
+      distance_squared += d * d;
+    }
+    return distance_squared <= radius * radius;
+  }
+
+  const planning_scene::PlanningScene *scene_;
+  const robot_trajectory::RobotTrajectory &trajectory_;
+  const planning_scene::PathValidityRequest &req_;
+  const collision_detection::AllowedCollisionMatrix &acm_;
+  collision_detection::CollisionRequest collision_request_;
+
+  std::vector<std::pair<const robot_model::LinkModel*, std::pair<std::size_t, double> > > link_shapes_;
+  std::vector<const robot_state::AttachedBody*> attached_bodies_;
+  std::vector<std::vector<double> > attached_body_radii_;
+
+  boost::mutex lock_;
+  std::size_t next_;
+  std::size_t end_;
+  std::size_t first_invalid_;
+};
+
+}
+
+collision_detection::CompiledAllowedCollisionMatrixConstPtr
+planning_scene::PlanningScene::getCompiledAllowedCollisionMatrix(const collision_detection::AllowedCollisionMatrix &acm,
+                                                                 const std::vector<std::string> &names) const
+{
+  // compiling takes time quadratic in the number of links and objects, while the matrix and the objects rarely
+  // change between the checks of a path that is being executed
+  boost::mutex::scoped_lock slock(compiled_acm_lock_);
+  if (!compiled_acm_ || compiled_acm_revision_ != acm.getRevision() || compiled_acm_names_ != names)
+  {
+    compiled_acm_.reset(new collision_detection::CompiledAllowedCollisionMatrix(acm, getRobotModel(), names));
+    compiled_acm_revision_ = acm.getRevision();
+    compiled_acm_names_ = names;
+  }
+  return compiled_acm_;
+}
+
+boost::shared_ptr<planning_scene::PathValidityWorkers> planning_scene::PlanningScene::getPathValidityWorkers() const
+{
+  // diff scenes are short lived, so they use the threads of the scene they were made from
+  if (parent_)
+    return parent_->getPathValidityWorkers();
+  boost::mutex::scoped_lock slock(path_validity_workers_lock_);
+  if (!path_validity_workers_)
+    path_validity_workers_.reset(new PathValidityWorkers(std::max(1u, boost::thread::hardware_concurrency()) - 1));
+  return path_validity_workers_;
+}
+
+bool planning_scene::PlanningScene::isPathValid(const robot_trajectory::RobotTrajectory &trajectory, const PathValidityRequest &req,
+                                                std::size_t *first_invalid_index) const
+{
+  std::size_t count = trajectory.getWayPointCount();
+  if (first_invalid_index)
+    *first_invalid_index = count;
+  if (req.first_index >= count)
+    return true;
+
+  unsigned int thread_count = req.thread_count > 0 ? req.thread_count : std::max(1u, boost::thread::hardware_concurrency());
+  std::size_t block_size = std::max<std::size_t>(req.block_size, 1);
+  std::size_t block_count = (count - req.first_index + block_size - 1) / block_size;
+  thread_count = std::min<std::size_t>(thread_count, block_count);
+
+  // the same matrix is looked up for every pair of bodies at every waypoint, so the collision checkers get it as a table
+  const collision_detection::AllowedCollisionMatrix &acm = req.acm ? *req.acm : getAllowedCollisionMatrix();
+  std::vector<std::string> names = getWorld()->getObjectIds();
+  std::vector<const robot_state::AttachedBody*> attached_bodies;
+  trajectory.getWayPoint(req.first_index).getAttachedBodies(attached_bodies);
+  for (std::size_t i = 0 ; i < attached_bodies.size() ; ++i)
+    names.push_back(attached_bodies[i]->getName());
+  collision_detection::CompiledAllowedCollisionMatrixConstPtr compiled_acm = getCompiledAllowedCollisionMatrix(acm, names);
+
+  PathValidityCheck check(this, trajectory, req, *compiled_acm);
+  boost::shared_ptr<PathValidityWorkers> workers = thread_count > 1 ? getPathValidityWorkers() : boost::shared_ptr<PathValidityWorkers>();
+  if (workers)
+    workers->run(boost::bind(&PathValidityCheck::run, &check), thread_count - 1);
+  else
+    check.run();
+
+  std::size_t index = check.getFirstInvalidIndex();
+  if (index >= count)
+    return true;
+
+  if (first_invalid_index)
+    *first_invalid_index = index;
+  if (req.verbose)
+  {
+    logInform("Waypoint %u of the path is invalid", (unsigned int)index);
+    robot_state::RobotState state(trajectory.getWayPoint(index));
+    check.isValid(state, index, true);
+  }
+  return false;
+}
+
 void planning_scene::PlanningScene::getCostSources(const robot_trajectory::RobotTrajectory &trajectory, std::size_t max_costs,
                                                    std::set<collision_detection::CostSource> &costs, double overlap_fraction) const
 {
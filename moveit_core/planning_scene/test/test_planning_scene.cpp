@@ -37,6 +37,7 @@
 #include <gtest/gtest.h>
 #include <moveit/planning_scene/planning_scene.h>
 #include <urdf_parser/urdf_parser.h>
+#include <geometric_shapes/mesh_operations.h>
 #include <fstream>
 #include <boost/filesystem/path.hpp>
 #include <ros/package.h>
@@ -114,6 +115,98 @@ TEST(PlanningScene, LoadRestoreDiff)
   EXPECT_EQ(ps->getWorld()->size(), 2);
 }
 
+TEST(PlanningScene, MoveDiff)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model;
+  loadRobotModel(urdf_model);
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  Eigen::Affine3d id = Eigen::Affine3d::Identity();
+  shapes::ShapeConstPtr sphere(new shapes::Sphere(0.4));
+  ps->getWorldNonConst()->addToObject("sphere", sphere, id);
+
+  planning_scene::PlanningScenePtr other(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  moveit_msgs::PlanningScene ps_msg;
+  ps->getPlanningSceneMsg(ps_msg);
+  other->setPlanningSceneMsg(ps_msg);
+  collision_detection::World::ObjectConstPtr before = other->getWorld()->getObject("sphere");
+  ASSERT_TRUE(before);
+
+  // an object that was moved is sent as a MOVE operation
+  planning_scene::PlanningScenePtr next = ps->diff();
+  Eigen::Affine3d moved(Eigen::Translation3d(1.0, 2.0, 3.0));
+  EXPECT_TRUE(next->getWorldNonConst()->moveShapeInObject("sphere", sphere, moved));
+  next->getPlanningSceneDiffMsg(ps_msg);
+  ASSERT_EQ(ps_msg.world.collision_objects.size(), 1);
+  EXPECT_EQ(ps_msg.world.collision_objects[0].operation, moveit_msgs::CollisionObject::MOVE);
+  EXPECT_EQ(ps_msg.world.collision_objects[0].primitives.size(), 1);
+  EXPECT_EQ(ps_msg.world.collision_objects[0].primitive_poses.size(), 1);
+
+  // the receiving scene keeps its shape and only updates the pose
+  EXPECT_TRUE(other->setPlanningSceneDiffMsg(ps_msg));
+  collision_detection::World::ObjectConstPtr after = other->getWorld()->getObject("sphere");
+  ASSERT_TRUE(after);
+  ASSERT_EQ(after->shapes_.size(), 1);
+  EXPECT_EQ(before->shapes_[0], after->shapes_[0]);
+  EXPECT_TRUE(after->shape_poses_[0].isApprox(moved));
+
+  // a scene that missed the object adds it at its new pose
+  planning_scene::PlanningScenePtr late(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  EXPECT_TRUE(late->setPlanningSceneDiffMsg(ps_msg));
+  collision_detection::World::ObjectConstPtr added = late->getWorld()->getObject("sphere");
+  ASSERT_TRUE(added);
+  ASSERT_EQ(added->shapes_.size(), 1);
+  EXPECT_EQ(added->shapes_[0]->type, shapes::SPHERE);
+  EXPECT_TRUE(added->shape_poses_[0].isApprox(moved));
+
+  // a MOVE without geometry cannot be applied to a missing object
+  ps_msg.world.collision_objects[0].primitives.clear();
+  planning_scene::PlanningScenePtr empty(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  EXPECT_FALSE(empty->setPlanningSceneDiffMsg(ps_msg));
+  EXPECT_FALSE(empty->getWorld()->hasObject("sphere"));
+}
+
+TEST(PlanningScene, MoveDiffMixedShapes)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model;
+  loadRobotModel(urdf_model);
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+
+  // the mesh is stored before the box, while the message lists primitives before meshes
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  Eigen::Affine3d id = Eigen::Affine3d::Identity();
+  shapes::ShapeConstPtr mesh(shapes::createMeshFromShape(shapes::Box(1.0, 1.0, 1.0)));
+  shapes::ShapeConstPtr box(new shapes::Box(0.1, 0.2, 0.3));
+  ps->getWorldNonConst()->addToObject("mixed", mesh, id);
+  ps->getWorldNonConst()->addToObject("mixed", box, id);
+
+  planning_scene::PlanningScenePtr other(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  moveit_msgs::PlanningScene ps_msg;
+  ps->getPlanningSceneMsg(ps_msg);
+  other->setPlanningSceneMsg(ps_msg);
+
+  planning_scene::PlanningScenePtr next = ps->diff();
+  Eigen::Affine3d mesh_pose(Eigen::Translation3d(1.0, 0.0, 0.0));
+  Eigen::Affine3d box_pose(Eigen::Translation3d(0.0, 2.0, 0.0));
+  EXPECT_TRUE(next->getWorldNonConst()->moveShapeInObject("mixed", mesh, mesh_pose));
+  EXPECT_TRUE(next->getWorldNonConst()->moveShapeInObject("mixed", box, box_pose));
+  next->getPlanningSceneDiffMsg(ps_msg);
+  ASSERT_EQ(ps_msg.world.collision_objects.size(), 1);
+  EXPECT_EQ(ps_msg.world.collision_objects[0].operation, moveit_msgs::CollisionObject::MOVE);
+
+  // each pose is applied to the shape of its type
+  EXPECT_TRUE(other->setPlanningSceneDiffMsg(ps_msg));
+  collision_detection::World::ObjectConstPtr after = other->getWorld()->getObject("mixed");
+  ASSERT_TRUE(after);
+  ASSERT_EQ(after->shapes_.size(), 2);
+  for (std::size_t i = 0 ; i < after->shapes_.size() ; ++i)
+    if (after->shapes_[i]->type == shapes::MESH)
+      EXPECT_TRUE(after->shape_poses_[i].isApprox(mesh_pose));
+    else
+      EXPECT_TRUE(after->shape_poses_[i].isApprox(box_pose));
+}
+
 TEST(PlanningScene, MakeAttachedDiff)
 {
   boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
@@ -141,6 +234,193 @@ TEST(PlanningScene, MakeAttachedDiff)
   ps->checkCollision(req, res);
 }
 
+static bool isPanBelowLimit(const robot_state::RobotState &state, bool verbose)
+{
+  return state.getVariablePosition("r_shoulder_pan_joint") < 0.505;
+}
+
+TEST(PlanningScene, ParallelPathValidity)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model;
+  loadRobotModel(urdf_model);
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  const std::vector<std::string> &links = ps->getRobotModel()->getLinkModelNames();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    ps->getAllowedCollisionMatrixNonConst().setDefaultEntry(links[i], true);
+  ps->setStateFeasibilityPredicate(&isPanBelowLimit);
+
+  // waypoints from 51 on are infeasible
+  robot_trajectory::RobotTrajectory trajectory(ps->getRobotModel(), "");
+  robot_state::RobotState state = ps->getCurrentState();
+  for (std::size_t i = 0 ; i < 200 ; ++i)
+  {
+    state.setVariablePosition("r_shoulder_pan_joint", i * 0.01);
+    trajectory.addSuffixWayPoint(state, 0.1);
+  }
+
+  std::vector<std::size_t> invalid;
+  EXPECT_FALSE(ps->isPathValid(trajectory, "", false, &invalid));
+  ASSERT_FALSE(invalid.empty());
+
+  planning_scene::PathValidityRequest req;
+  req.thread_count = 4;
+  req.first_index = 10;
+  std::size_t first_invalid = 0;
+  EXPECT_FALSE(ps->isPathValid(trajectory, req, &first_invalid));
+  EXPECT_EQ(invalid[0], first_invalid);
+  EXPECT_EQ(51u, first_invalid);
+
+  req.first_index = 60;
+  EXPECT_FALSE(ps->isPathValid(trajectory, req, &first_invalid));
+  EXPECT_EQ(60u, first_invalid);
+
+  req.first_index = 0;
+  req.thread_count = 1;
+  req.block_size = 1;
+  EXPECT_FALSE(ps->isPathValid(trajectory, req, &first_invalid));
+  EXPECT_EQ(51u, first_invalid);
+
+  // waypoints at which the robot is far from the region are not checked
+  req.check_region = true;
+  req.region_min = Eigen::Vector3d(100.0, 100.0, 100.0);
+  req.region_max = Eigen::Vector3d(101.0, 101.0, 101.0);
+  EXPECT_TRUE(ps->isPathValid(trajectory, req, &first_invalid));
+  EXPECT_EQ(trajectory.getWayPointCount(), first_invalid);
+
+  req.region_min = Eigen::Vector3d(-5.0, -5.0, -5.0);
+  req.region_max = Eigen::Vector3d(5.0, 5.0, 5.0);
+  EXPECT_FALSE(ps->isPathValid(trajectory, req, &first_invalid));
+  EXPECT_EQ(51u, first_invalid);
+
+  // the padding of the checked collision robot grows the volume of the links
+  ps->getCollisionRobotNonConst()->setPadding(200.0);
+  ps->propogateRobotPadding();
+  req.region_min = Eigen::Vector3d(100.0, 100.0, 100.0);
+  req.region_max = Eigen::Vector3d(101.0, 101.0, 101.0);
+  EXPECT_FALSE(ps->isPathValid(trajectory, req, &first_invalid));
+  EXPECT_EQ(51u, first_invalid);
+  req.unpadded = true;
+  EXPECT_TRUE(ps->isPathValid(trajectory, req, &first_invalid));
+}
+
+TEST(PlanningScene, PathValidityAttachedBodies)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model;
+  loadRobotModel(urdf_model);
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  const std::vector<std::string> &links = ps->getRobotModel()->getLinkModelNamesWithCollisionGeometry();
+  ps->getAllowedCollisionMatrixNonConst().setEntry(links, links, true);
+
+  // a ball that collides with the arm is attached at the waypoints from 12 on only
+  robot_trajectory::RobotTrajectory trajectory(ps->getRobotModel(), "");
+  robot_state::RobotState state = ps->getCurrentState();
+  for (std::size_t i = 0 ; i < 20 ; ++i)
+  {
+    if (i == 12)
+      state.attachBody("ball", std::vector<shapes::ShapeConstPtr>(1, shapes::ShapeConstPtr(new shapes::Sphere(0.4))),
+                       EigenSTL::vector_Affine3d(1, Eigen::Affine3d::Identity()), std::vector<std::string>(), "r_wrist_roll_link");
+    trajectory.addSuffixWayPoint(state, 0.1);
+  }
+
+  planning_scene::PathValidityRequest req;
+  req.block_size = 1;
+  std::size_t first_invalid = 0;
+  for (unsigned int threads = 1 ; threads <= 4 ; threads += 3)
+  {
+    req.thread_count = threads;
+    req.check_region = false;
+    EXPECT_FALSE(ps->isPathValid(trajectory, req, &first_invalid));
+    EXPECT_EQ(12u, first_invalid);
+
+    // the body is taken into account by the region check as well
+    req.check_region = true;
+    req.region_min = Eigen::Vector3d(-5.0, -5.0, -5.0);
+    req.region_max = Eigen::Vector3d(5.0, 5.0, 5.0);
+    EXPECT_FALSE(ps->isPathValid(trajectory, req, &first_invalid));
+    EXPECT_EQ(12u, first_invalid);
+  }
+
+  // a ball with the same shape is attached far from the arm first, and moved onto it at waypoint 12
+  robot_trajectory::RobotTrajectory moved_trajectory(ps->getRobotModel(), "");
+  state = ps->getCurrentState();
+  shapes::ShapeConstPtr ball(new shapes::Sphere(0.4));
+  Eigen::Affine3d far_pose(Eigen::Translation3d(10.0, 0.0, 0.0));
+  state.attachBody("ball", std::vector<shapes::ShapeConstPtr>(1, ball), EigenSTL::vector_Affine3d(1, far_pose),
+                   std::vector<std::string>(), "r_wrist_roll_link");
+  for (std::size_t i = 0 ; i < 20 ; ++i)
+  {
+    if (i == 12)
+    {
+      state.clearAttachedBody("ball");
+      state.attachBody("ball", std::vector<shapes::ShapeConstPtr>(1, ball), EigenSTL::vector_Affine3d(1, Eigen::Affine3d::Identity()),
+                       std::vector<std::string>(), "r_wrist_roll_link");
+    }
+    moved_trajectory.addSuffixWayPoint(state, 0.1);
+  }
+  req.check_region = false;
+  for (unsigned int threads = 1 ; threads <= 4 ; threads += 3)
+  {
+    req.thread_count = threads;
+    EXPECT_FALSE(ps->isPathValid(moved_trajectory, req, &first_invalid));
+    EXPECT_EQ(12u, first_invalid);
+  }
+
+  // diff scenes check paths with the threads of their parent
+  planning_scene::PlanningScenePtr diff = ps->diff();
+  req.check_region = false;
+  EXPECT_FALSE(diff->isPathValid(trajectory, req, &first_invalid));
+  EXPECT_EQ(12u, first_invalid);
+  diff.reset();
+  ps.reset();
+}
+
+TEST(PlanningScene, PathValidityFollowsMatrixAndWorld)
+{
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  boost::shared_ptr<urdf::ModelInterface> urdf_model;
+  loadRobotModel(urdf_model);
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  const std::vector<std::string> &links = ps->getRobotModel()->getLinkModelNamesWithCollisionGeometry();
+  ps->getAllowedCollisionMatrixNonConst().setEntry(links, links, true);
+
+  robot_trajectory::RobotTrajectory trajectory(ps->getRobotModel(), "");
+  for (std::size_t i = 0 ; i < 3 ; ++i)
+    trajectory.addSuffixWayPoint(ps->getCurrentState(), 0.1);
+
+  planning_scene::PathValidityRequest req;
+  EXPECT_TRUE(ps->isPathValid(trajectory, req));
+
+  // the matrix compiled for the path checks is rebuilt when the objects or the entries of the matrix change
+  Eigen::Affine3d id = Eigen::Affine3d::Identity();
+  ps->getWorldNonConst()->addToObject("sphere", shapes::ShapeConstPtr(new shapes::Sphere(0.4)), id);
+  EXPECT_FALSE(ps->isPathValid(trajectory, req));
+
+  ps->getAllowedCollisionMatrixNonConst().setEntry("sphere", links, true);
+  EXPECT_TRUE(ps->isPathValid(trajectory, req));
+  EXPECT_TRUE(ps->isPathValid(trajectory, req));
+
+  ps->getAllowedCollisionMatrixNonConst().removeEntry("sphere");
+  EXPECT_FALSE(ps->isPathValid(trajectory, req));
+
+  ps->getAllowedCollisionMatrixNonConst().setEntry("sphere", links, true);
+  EXPECT_TRUE(ps->isPathValid(trajectory, req));
+  ps->getWorldNonConst()->addToObject("sphere2", shapes::ShapeConstPtr(new shapes::Sphere(0.4)), id);
+  EXPECT_FALSE(ps->isPathValid(trajectory, req));
+
+  // a matrix given with the request is used instead of the one of the scene
+  collision_detection::AllowedCollisionMatrix acm(ps->getAllowedCollisionMatrix());
+  acm.setEntry("sphere2", links, true);
+  req.acm = &acm;
+  EXPECT_TRUE(ps->isPathValid(trajectory, req));
+  req.acm = NULL;
+  EXPECT_FALSE(ps->isPathValid(trajectory, req));
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
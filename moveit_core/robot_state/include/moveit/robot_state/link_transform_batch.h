@@ -0,0 +1,126 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2012, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_ROBOT_STATE_LINK_TRANSFORM_BATCH_
+#define MOVEIT_ROBOT_STATE_LINK_TRANSFORM_BATCH_
+
+#include <moveit/robot_model/robot_model.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <vector>
+
+namespace moveit
+{
+namespace core
+{
+
+/** @brief Global link transforms computed for many states of the same robot model at once.
+
+    This is meant for callers that need forward kinematics for large sets of configurations
+    (sampling, trajectory evaluation, dataset generation) and would otherwise set the positions
+    of a RobotState and read its link transforms one state at a time.
+
+    The transforms are stored in structure-of-arrays layout: for every link, each of the 12
+    coefficients of the upper 3x4 block of its transform (in Eigen's column-major order) is
+    stored contiguously for all the states. Attached bodies and collision bodies are not
+    considered. */
+class LinkTransformBatch
+{
+public:
+
+  /** \brief Row-major matrix of variable positions, one state per row */
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> PositionMatrix;
+
+  LinkTransformBatch(const RobotModelConstPtr &robot_model);
+
+  const RobotModelConstPtr& getRobotModel() const
+  {
+    return robot_model_;
+  }
+
+  /** \brief The number of states for which transforms were last computed */
+  std::size_t getStateCount() const
+  {
+    return count_;
+  }
+
+  /** \brief Compute the global transforms of all links for \e count states. The variable positions of the states are
+      read from \e positions, one state after the other (each state occupies RobotModel::getVariableCount() values, in
+      the same order as in a RobotState). Mimic joints are set from the joints they mimic, regardless of the values given
+      for their variables. The states are split into contiguous chunks that are processed by up to \e thread_count
+      threads; 0 means one thread per hardware core. */
+  void compute(const double *positions, std::size_t count, unsigned int thread_count = 1);
+
+  /** \brief Compute the global transforms of all links for every row of \e positions.
+      The number of columns must equal RobotModel::getVariableCount() */
+  void compute(const PositionMatrix &positions, unsigned int thread_count = 1);
+
+  /** \brief Get the global transform of \e link for the state at index \e state */
+  Eigen::Affine3d getGlobalLinkTransform(const LinkModel *link, std::size_t state) const
+  {
+    Eigen::Affine3d transform;
+    getGlobalLinkTransform(link, state, transform);
+    return transform;
+  }
+
+  /** \brief Get the global transform of \e link for the state at index \e state */
+  void getGlobalLinkTransform(const LinkModel *link, std::size_t state, Eigen::Affine3d &transform) const;
+
+  /** \brief Get the values of coefficient (\e row, \e col) of the global transform of \e link, one per state.
+      \e row must be less than 3 and \e col less than 4. */
+  const double* getCoefficients(const LinkModel *link, unsigned int row, unsigned int col) const
+  {
+    return &data_[(link->getLinkIndex() * 12 + col * 3 + row) * count_];
+  }
+
+private:
+
+  void computeRange(const double *positions, std::size_t begin, std::size_t end);
+
+  RobotModelConstPtr robot_model_;
+
+  /** \brief The links of the model, parents before children */
+  std::vector<const LinkModel*> links_;
+
+  std::size_t variable_count_;
+
+  std::size_t count_;
+
+  std::vector<double> data_;
+};
+
+}
+}
+
+#endif
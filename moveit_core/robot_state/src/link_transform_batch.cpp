@@ -0,0 +1,168 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2012, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/robot_state/link_transform_batch.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+
+namespace
+{
+// states are processed in blocks of this size, so the joint transforms of a block stay in cache
+// while they are combined with the transforms of the parent links
+static const std::size_t BLOCK_SIZE = 64;
+}
+
+moveit::core::LinkTransformBatch::LinkTransformBatch(const RobotModelConstPtr &robot_model)
+  : robot_model_(robot_model)
+  , links_(robot_model->getRootJoint()->getDescendantLinkModels())
+  , variable_count_(robot_model->getVariableCount())
+  , count_(0)
+{
+}
+
+void moveit::core::LinkTransformBatch::compute(const PositionMatrix &positions, unsigned int thread_count)
+{
+  if (static_cast<std::size_t>(positions.cols()) != variable_count_)
+  {
+    logError("Expected %u variable positions per state but got %u", (unsigned int)variable_count_, (unsigned int)positions.cols());
+    count_ = 0;
+    data_.clear();
+    return;
+  }
+  compute(positions.data(), positions.rows(), thread_count);
+}
+
+void moveit::core::LinkTransformBatch::compute(const double *positions, std::size_t count, unsigned int thread_count)
+{
+  count_ = count;
+  data_.resize(robot_model_->getLinkModelCount() * 12 * count);
+  if (count == 0)
+    return;
+
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  // do not spawn threads for fewer states than a block
+  std::size_t chunk = std::max((count + thread_count - 1) / thread_count, BLOCK_SIZE);
+
+  boost::thread_group workers;
+  for (std::size_t begin = chunk ; begin < count ; begin += chunk)
+    workers.create_thread(boost::bind(&LinkTransformBatch::computeRange, this, positions, begin, std::min(begin + chunk, count)));
+  computeRange(positions, 0, std::min(chunk, count));
+  workers.join_all();
+}
+
+void moveit::core::LinkTransformBatch::computeRange(const double *positions, std::size_t begin, std::size_t end)
+{
+  // the local transforms (joint origin * joint transform) of one link for the states of a block, same layout as data_
+  double local[12][BLOCK_SIZE];
+  Eigen::Affine3d transform;
+
+  for (std::size_t b = begin ; b < end ; b += BLOCK_SIZE)
+  {
+    const std::size_t n = std::min(BLOCK_SIZE, end - b);
+    for (std::size_t i = 0 ; i < links_.size() ; ++i)
+    {
+      const LinkModel *link = links_[i];
+      const JointModel *joint = link->getParentJointModel();
+
+      if (link->parentJointIsFixed())
+      {
+        const Eigen::Matrix4d &origin = link->getJointOriginTransform().matrix();
+        for (unsigned int c = 0 ; c < 12 ; ++c)
+          std::fill(local[c], local[c] + n, origin(c % 3, c / 3));
+      }
+      else
+      {
+        const JointModel *mimic = joint->getMimic();
+        const double *values = positions + b * variable_count_;
+        for (std::size_t s = 0 ; s < n ; ++s, values += variable_count_)
+        {
+          if (mimic)
+          {
+            double value = joint->getMimicFactor() * values[mimic->getFirstVariableIndex()] + joint->getMimicOffset();
+            joint->computeTransform(&value, transform);
+          }
+          else
+            joint->computeTransform(values + joint->getFirstVariableIndex(), transform);
+          if (!link->jointOriginTransformIsIdentity())
+            transform.matrix() = link->getJointOriginTransform().matrix() * transform.matrix();
+          const Eigen::Matrix4d &m = transform.matrix();
+          for (unsigned int c = 0 ; c < 12 ; ++c)
+            local[c][s] = m(c % 3, c / 3);
+        }
+      }
+
+      double *out = &data_[link->getLinkIndex() * 12 * count_ + b];
+      const LinkModel *parent = link->getParentLinkModel();
+      if (!parent)
+      {
+        for (unsigned int c = 0 ; c < 12 ; ++c)
+          std::copy(local[c], local[c] + n, out + c * count_);
+        continue;
+      }
+
+      // global = parent global * local, for all the states of the block at once
+      const double *in = &data_[parent->getLinkIndex() * 12 * count_ + b];
+      for (unsigned int row = 0 ; row < 3 ; ++row)
+      {
+        const double *p0 = in + row * count_;
+        const double *p1 = in + (3 + row) * count_;
+        const double *p2 = in + (6 + row) * count_;
+        for (unsigned int col = 0 ; col < 3 ; ++col)
+        {
+          double *o = out + (col * 3 + row) * count_;
+          const double *l0 = local[col * 3];
+          const double *l1 = local[col * 3 + 1];
+          const double *l2 = local[col * 3 + 2];
+          for (std::size_t s = 0 ; s < n ; ++s)
+            o[s] = p0[s] * l0[s] + p1[s] * l1[s] + p2[s] * l2[s];
+        }
+        const double *p3 = in + (9 + row) * count_;
+        double *o = out + (9 + row) * count_;
+        for (std::size_t s = 0 ; s < n ; ++s)
+          o[s] = p0[s] * local[9][s] + p1[s] * local[10][s] + p2[s] * local[11][s] + p3[s];
+      }
+    }
+  }
+}
+
+void moveit::core::LinkTransformBatch::getGlobalLinkTransform(const LinkModel *link, std::size_t state, Eigen::Affine3d &transform) const
+{
+  const double *in = &data_[link->getLinkIndex() * 12 * count_ + state];
+  Eigen::Matrix4d &m = transform.matrix();
+  for (unsigned int c = 0 ; c < 12 ; ++c)
+    m(c % 3, c / 3) = in[c * count_];
+  m.row(3) << 0.0, 0.0, 0.0, 1.0;
+}
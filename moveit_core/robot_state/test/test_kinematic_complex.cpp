@@ -37,6 +37,7 @@
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/robot_state/conversions.h>
+#include <moveit/robot_state/link_transform_batch.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
 #include <gtest/gtest.h>
@@ -283,6 +284,37 @@ TEST_F(LoadPlanningModelsPr2, FullTest)
   ASSERT_EQ(attached_bodies_2.size(), 0);
 }
 
+TEST_F(LoadPlanningModelsPr2, LinkTransformBatch)
+{
+  moveit::core::RobotState ks(robot_model);
+  const std::size_t variable_count = robot_model->getVariableCount();
+  const std::size_t count = 150;
+
+  moveit::core::LinkTransformBatch::PositionMatrix positions(count, variable_count);
+  std::vector<moveit::core::RobotState> states(count, ks);
+  for (std::size_t i = 0 ; i < count ; ++i)
+  {
+    states[i].setToRandomPositions();
+    std::copy(states[i].getVariablePositions(), states[i].getVariablePositions() + variable_count, positions.row(i).data());
+  }
+
+  moveit::core::LinkTransformBatch batch(robot_model);
+  const std::vector<const moveit::core::LinkModel*> &links = robot_model->getLinkModels();
+  for (unsigned int threads = 1 ; threads <= 3 ; ++threads)
+  {
+    batch.compute(positions, threads);
+    ASSERT_EQ(count, batch.getStateCount());
+    for (std::size_t i = 0 ; i < count ; ++i)
+      for (std::size_t j = 0 ; j < links.size() ; ++j)
+      {
+        const Eigen::Affine3d &expected = states[i].getGlobalLinkTransform(links[j]);
+        Eigen::Affine3d actual = batch.getGlobalLinkTransform(links[j], i);
+        EXPECT_TRUE(expected.isApprox(actual, 1e-9)) << links[j]->getName();
+        EXPECT_NEAR(expected(1, 3), batch.getCoefficients(links[j], 1, 3)[i], 1e-9);
+      }
+  }
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,252 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_ROBOT_TRAJECTORY_COMPACT_ROBOT_TRAJECTORY_
+#define MOVEIT_ROBOT_TRAJECTORY_COMPACT_ROBOT_TRAJECTORY_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <vector>
+
+namespace robot_trajectory
+{
+
+/** \brief Maintain a sequence of waypoints of a group and the time durations between them, storing
+    the values of the group variables of all waypoints in contiguous arrays (one for positions, one
+    for velocities and one for accelerations) instead of one RobotState per waypoint.
+
+    The values of each waypoint are stored consecutively, in the order of the variables of the group.
+    Variables that are not part of the group take their values from a reference state. RobotState
+    objects are only built on request, and conversions to and from RobotTrajectory are provided for
+    code that works on waypoint states. */
+class CompactRobotTrajectory
+{
+public:
+
+  /** \brief Construct an empty trajectory for \e group; if \e group is NULL, all the variables of the robot are stored.
+      The reference state is set to default values. */
+  CompactRobotTrajectory(const robot_model::RobotModelConstPtr &robot_model, const robot_model::JointModelGroup* group);
+
+  /** \brief Construct a copy of \e trajectory; its first waypoint is used as reference state */
+  explicit CompactRobotTrajectory(const RobotTrajectory &trajectory);
+
+  const robot_model::RobotModelConstPtr& getRobotModel() const
+  {
+    return robot_model_;
+  }
+
+  const robot_model::JointModelGroup* getGroup() const
+  {
+    return group_;
+  }
+
+  const std::string& getGroupName() const;
+
+  /** \brief The state that provides the values of the variables not stored in the trajectory */
+  const robot_state::RobotState& getReferenceState() const
+  {
+    return *reference_state_;
+  }
+
+  void setReferenceState(const robot_state::RobotState &state);
+
+  /** \brief The number of values stored per waypoint */
+  std::size_t getVariableCount() const
+  {
+    return variable_count_;
+  }
+
+  /** \brief The indices in a full RobotState of the stored variables */
+  const std::vector<int>& getVariableIndexList() const
+  {
+    return variable_index_list_;
+  }
+
+  std::size_t getWayPointCount() const
+  {
+    return duration_from_previous_.size();
+  }
+
+  bool empty() const
+  {
+    return duration_from_previous_.empty();
+  }
+
+  bool hasVelocities() const
+  {
+    return !velocities_.empty();
+  }
+
+  bool hasAccelerations() const
+  {
+    return !accelerations_.empty();
+  }
+
+  /** \brief The positions of a waypoint, getVariableCount() values */
+  const double* getWayPointPositions(std::size_t index) const
+  {
+    return &positions_[index * variable_count_];
+  }
+
+  double* getWayPointPositions(std::size_t index)
+  {
+    return &positions_[index * variable_count_];
+  }
+
+  /** \brief The velocities of a waypoint, or NULL if the trajectory has no velocities */
+  const double* getWayPointVelocities(std::size_t index) const
+  {
+    return velocities_.empty() ? NULL : &velocities_[index * variable_count_];
+  }
+
+  /** \brief The velocities of a waypoint; velocities are added (as zero) to all waypoints if the trajectory has none */
+  double* getWayPointVelocities(std::size_t index)
+  {
+    if (velocities_.empty())
+      velocities_.resize(positions_.size(), 0.0);
+    return &velocities_[index * variable_count_];
+  }
+
+  /** \brief The accelerations of a waypoint, or NULL if the trajectory has no accelerations */
+  const double* getWayPointAccelerations(std::size_t index) const
+  {
+    return accelerations_.empty() ? NULL : &accelerations_[index * variable_count_];
+  }
+
+  /** \brief The accelerations of a waypoint; accelerations are added (as zero) to all waypoints if the trajectory has none */
+  double* getWayPointAccelerations(std::size_t index)
+  {
+    if (accelerations_.empty())
+      accelerations_.resize(positions_.size(), 0.0);
+    return &accelerations_[index * variable_count_];
+  }
+
+  /** \brief The positions of all waypoints, one waypoint after the other */
+  const std::vector<double>& getPositions() const
+  {
+    return positions_;
+  }
+
+  const std::vector<double>& getWayPointDurations() const
+  {
+    return duration_from_previous_;
+  }
+
+  double getWayPointDurationFromPrevious(std::size_t index) const
+  {
+    if (duration_from_previous_.size() > index)
+      return duration_from_previous_[index];
+    else
+      return 0.0;
+  }
+
+  void setWayPointDurationFromPrevious(std::size_t index, double value)
+  {
+    duration_from_previous_[index] = value;
+  }
+
+  /** \brief Set \e state to waypoint \e index: the stored variables are copied into \e state, which should otherwise
+      be a copy of the reference state */
+  void getWayPoint(std::size_t index, robot_state::RobotState &state) const;
+
+  /** \brief Construct a RobotState for waypoint \e index, starting from the reference state */
+  robot_state::RobotStatePtr getWayPointState(std::size_t index) const;
+
+  /** \brief Reserve memory for \e count waypoints */
+  void reserve(std::size_t count);
+
+  /**
+   * \brief Add a point to the trajectory
+   * \param state - a state from which the values of the stored variables are copied
+   * \param dt - duration from previous
+   */
+  void addSuffixWayPoint(const robot_state::RobotState &state, double dt);
+
+  /**
+   * \brief Add a point to the trajectory
+   * \param positions - getVariableCount() positions; velocities and accelerations, if any, are set to zero
+   * \param dt - duration from previous
+   */
+  void addSuffixWayPoint(const double *positions, double dt);
+
+  void append(const CompactRobotTrajectory &source, double dt);
+
+  void swap(CompactRobotTrajectory &other);
+
+  void clear();
+
+  void unwind();
+
+  /** \brief Replace the content of \e trajectory by the waypoints of this trajectory */
+  void getRobotTrajectory(RobotTrajectory &trajectory) const;
+
+  /** \brief Replace the content of this trajectory by the waypoints of \e trajectory, whose group becomes the group of this
+      trajectory; the first waypoint becomes the reference state */
+  void setRobotTrajectory(const RobotTrajectory &trajectory);
+
+  /** \brief Fill \e trajectory with the active joints of the group, copying values straight from the stored arrays */
+  void getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory &trajectory) const;
+
+  /** \brief Copy the content of the trajectory message into this class, straight into the stored arrays. Variables of the group
+      that are not in the message take their values from \e reference_state, which also becomes the reference state. Joints of the
+      message that are not part of the group are ignored. */
+  void setRobotTrajectoryMsg(const robot_state::RobotState &reference_state,
+                             const moveit_msgs::RobotTrajectory &trajectory);
+
+private:
+
+  void setVariables();
+  void updateMimicJoints(double *values, bool derivatives) const;
+
+  robot_model::RobotModelConstPtr robot_model_;
+  const robot_model::JointModelGroup *group_;
+  robot_state::RobotStatePtr reference_state_;
+
+  std::size_t variable_count_;
+  std::vector<int> variable_index_list_;
+
+  /** \brief For each variable of the robot, its index in the stored values, or -1 */
+  std::vector<int> stored_index_;
+
+  std::vector<double> positions_;
+  std::vector<double> velocities_;
+  std::vector<double> accelerations_;
+  std::vector<double> duration_from_previous_;
+};
+
+typedef boost::shared_ptr<CompactRobotTrajectory> CompactRobotTrajectoryPtr;
+typedef boost::shared_ptr<const CompactRobotTrajectory> CompactRobotTrajectoryConstPtr;
+
+}
+
+#endif
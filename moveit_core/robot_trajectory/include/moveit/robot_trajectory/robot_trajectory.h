@@ -40,7 +40,9 @@
 #include <moveit/robot_state/robot_state.h>
 #include <moveit_msgs/RobotTrajectory.h>
 #include <moveit_msgs/RobotState.h>
+#include <algorithm>
 #include <deque>
+#include <vector>
 
 namespace robot_trajectory
 {
@@ -109,11 +111,17 @@ public:
   }
 
   /** @brief  Returns the duration after start that a waypoint will be reached.
-   *  @param  The waypoint index.
-   *  @return The duration from start; retuns -1.0 if index is out of range.
+   *  @param  The waypoint index; indices past the end refer to the last waypoint.
+   *  @return The duration from start; runs in constant time.
    */
   double getWaypointDurationFromStart(std::size_t index) const;
 
+  /** @brief Returns the duration after start that the last waypoint will be reached. */
+  double getDuration() const
+  {
+    return duration_from_previous_.empty() ? 0.0 : getWaypointDurationFromStart(duration_from_previous_.size() - 1);
+  }
+
   double getWayPointDurationFromPrevious(std::size_t index) const
   {
     if (duration_from_previous_.size() > index)
@@ -124,9 +132,11 @@ public:
 
   void setWayPointDurationFromPrevious(std::size_t index, double value)
   {
+    std::size_t first = std::min(index, duration_from_previous_.size());
     if (duration_from_previous_.size() <= index)
       duration_from_previous_.resize(index + 1, 0.0);
     duration_from_previous_[index] = value;
+    updateTimeIndex(first);
   }
 
   bool empty() const
@@ -154,6 +164,7 @@ public:
     state->update();
     waypoints_.push_back(state);
     duration_from_previous_.push_back(dt);
+    time_from_start_.push_back(time_from_start_.empty() ? dt : time_from_start_.back() + dt);
   }
 
   void addPrefixWayPoint(const robot_state::RobotState &state, double dt)
@@ -166,6 +177,7 @@ public:
     state->update();
     waypoints_.push_front(state);
     duration_from_previous_.push_front(dt);
+    updateTimeIndex(0);
   }
 
   void insertWayPoint(std::size_t index, const robot_state::RobotState &state, double dt)
@@ -178,6 +190,7 @@ public:
     state->update();
     waypoints_.insert(waypoints_.begin() + index, state);
     duration_from_previous_.insert(duration_from_previous_.begin() + index, dt);
+    updateTimeIndex(index);
   }
 
   void append(const RobotTrajectory &source, double dt);
@@ -214,7 +227,7 @@ public:
   void unwind();
   void unwind(const robot_state::RobotState &state);
 
-  /** @brief Finds the waypoint indicies before and after a duration from start.
+  /** @brief Finds the waypoint indicies before and after a duration from start, by binary search in the time index.
    *  @param The duration from start.
    *  @param The waypoint index before the supplied duration.
    *  @param The waypoint index after (or equal to) the supplied duration.
@@ -233,10 +246,17 @@ public:
 
 private:
 
+  /** \brief Recompute the times from start of the waypoints from \e index on. The index is only
+      written by the functions that change the durations, so const queries can run concurrently. */
+  void updateTimeIndex(std::size_t index);
+
   robot_model::RobotModelConstPtr robot_model_;
   const robot_model::JointModelGroup *group_;
   std::deque<robot_state::RobotStatePtr> waypoints_;
   std::deque<double> duration_from_previous_;
+
+  /** \brief The cumulative sums of duration_from_previous_ */
+  std::vector<double> time_from_start_;
 };
 
 typedef boost::shared_ptr<RobotTrajectory> RobotTrajectoryPtr;
@@ -0,0 +1,96 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_ROBOT_TRAJECTORY_TRAJECTORY_CURSOR_
+#define MOVEIT_ROBOT_TRAJECTORY_TRAJECTORY_CURSOR_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+
+namespace robot_trajectory
+{
+
+/** \brief Samples a trajectory at a fixed rate, for playback, monitoring or streaming.
+
+    The cursor remembers the waypoint of the previous sample and only moves forward from it, so
+    walking a trajectory takes constant time per sample (amortized over the waypoints passed),
+    instead of a search from the start for every sample. The trajectory must outlive the cursor
+    and should not be changed while it is sampled; several cursors may sample the same
+    trajectory concurrently. */
+class TrajectoryCursor
+{
+public:
+
+  /** \brief Construct a cursor at the start of \e trajectory that advances by \e period seconds per sample.
+      Throws moveit::ConstructException if \e period is not positive. */
+  TrajectoryCursor(const RobotTrajectory &trajectory, double period);
+
+  /** \brief Move the cursor to \e time from the start of the trajectory; this is a binary search */
+  void seek(double time);
+
+  /** \brief The time from start of the next sample */
+  double getTime() const
+  {
+    return time_;
+  }
+
+  double getPeriod() const
+  {
+    return period_;
+  }
+
+  /** \brief True once all samples have been taken */
+  bool done() const
+  {
+    return done_;
+  }
+
+  /** \brief Interpolate the state at the current time into \e state and advance the cursor by one period.
+      The last sample is the last waypoint, even if it is less than one period after the previous sample.
+      @return False if the cursor was already done (or the trajectory is empty); \e state is unchanged then */
+  bool next(robot_state::RobotState &state);
+
+private:
+
+  const RobotTrajectory &trajectory_;
+  double period_;
+  double start_time_;
+  std::size_t sample_count_;
+  double time_;
+  std::size_t index_;     /// the first waypoint reached at or after time_
+  bool done_;
+};
+
+}
+
+#endif
@@ -0,0 +1,457 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_trajectory/compact_robot_trajectory.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <boost/math/constants/constants.hpp>
+#include <console_bridge/console.h>
+
+robot_trajectory::CompactRobotTrajectory::CompactRobotTrajectory(const robot_model::RobotModelConstPtr &robot_model,
+                                                                 const robot_model::JointModelGroup* group) :
+  robot_model_(robot_model),
+  group_(group),
+  reference_state_(new robot_state::RobotState(robot_model))
+{
+  reference_state_->setToDefaultValues();
+  setVariables();
+}
+
+robot_trajectory::CompactRobotTrajectory::CompactRobotTrajectory(const RobotTrajectory &trajectory) :
+  group_(NULL)
+{
+  setRobotTrajectory(trajectory);
+}
+
+const std::string& robot_trajectory::CompactRobotTrajectory::getGroupName() const
+{
+  if (group_)
+    return group_->getName();
+  static const std::string empty;
+  return empty;
+}
+
+void robot_trajectory::CompactRobotTrajectory::setVariables()
+{
+  if (group_)
+    variable_index_list_ = group_->getVariableIndexList();
+  else
+  {
+    variable_index_list_.resize(robot_model_->getVariableCount());
+    for (std::size_t i = 0 ; i < variable_index_list_.size() ; ++i)
+      variable_index_list_[i] = i;
+  }
+  variable_count_ = variable_index_list_.size();
+
+  stored_index_.assign(robot_model_->getVariableCount(), -1);
+  for (std::size_t i = 0 ; i < variable_count_ ; ++i)
+    stored_index_[variable_index_list_[i]] = i;
+}
+
+void robot_trajectory::CompactRobotTrajectory::setReferenceState(const robot_state::RobotState &state)
+{
+  reference_state_.reset(new robot_state::RobotState(state));
+}
+
+void robot_trajectory::CompactRobotTrajectory::updateMimicJoints(double *values, bool derivatives) const
+{
+  const std::vector<const robot_model::JointModel*> &mimic = group_ ? group_->getMimicJointModels() : robot_model_->getMimicJointModels();
+  for (std::size_t i = 0 ; i < mimic.size() ; ++i)
+  {
+    int index = stored_index_[mimic[i]->getFirstVariableIndex()];
+    int source = stored_index_[mimic[i]->getMimic()->getFirstVariableIndex()];
+    if (index >= 0 && source >= 0)
+      values[index] = mimic[i]->getMimicFactor() * values[source] + (derivatives ? 0.0 : mimic[i]->getMimicOffset());
+  }
+}
+
+void robot_trajectory::CompactRobotTrajectory::getWayPoint(std::size_t index, robot_state::RobotState &state) const
+{
+  const double *positions = getWayPointPositions(index);
+  for (std::size_t i = 0 ; i < variable_count_ ; ++i)
+    state.setVariablePosition(variable_index_list_[i], positions[i]);
+  if (const double *velocities = getWayPointVelocities(index))
+    for (std::size_t i = 0 ; i < variable_count_ ; ++i)
+      state.setVariableVelocity(variable_index_list_[i], velocities[i]);
+  if (const double *accelerations = getWayPointAccelerations(index))
+    for (std::size_t i = 0 ; i < variable_count_ ; ++i)
+      state.setVariableAcceleration(variable_index_list_[i], accelerations[i]);
+  state.update();
+}
+
+robot_state::RobotStatePtr robot_trajectory::CompactRobotTrajectory::getWayPointState(std::size_t index) const
+{
+  robot_state::RobotStatePtr state(new robot_state::RobotState(*reference_state_));
+  getWayPoint(index, *state);
+  return state;
+}
+
+void robot_trajectory::CompactRobotTrajectory::reserve(std::size_t count)
+{
+  positions_.reserve(count * variable_count_);
+  if (hasVelocities())
+    velocities_.reserve(count * variable_count_);
+  if (hasAccelerations())
+    accelerations_.reserve(count * variable_count_);
+  duration_from_previous_.reserve(count);
+}
+
+void robot_trajectory::CompactRobotTrajectory::addSuffixWayPoint(const robot_state::RobotState &state, double dt)
+{
+  std::size_t size = positions_.size();
+  for (std::size_t i = 0 ; i < variable_count_ ; ++i)
+    positions_.push_back(state.getVariablePosition(variable_index_list_[i]));
+
+  // waypoints added before the first one with velocities (or accelerations) get zero values
+  if (state.hasVelocities() || hasVelocities())
+  {
+    velocities_.resize(size, 0.0);
+    for (std::size_t i = 0 ; i < variable_count_ ; ++i)
+      velocities_.push_back(state.hasVelocities() ? state.getVariableVelocity(variable_index_list_[i]) : 0.0);
+  }
+  if (state.hasAccelerations() || hasAccelerations())
+  {
+    accelerations_.resize(size, 0.0);
+    for (std::size_t i = 0 ; i < variable_count_ ; ++i)
+      accelerations_.push_back(state.hasAccelerations() ? state.getVariableAcceleration(variable_index_list_[i]) : 0.0);
+  }
+  duration_from_previous_.push_back(dt);
+}
+
+void robot_trajectory::CompactRobotTrajectory::addSuffixWayPoint(const double *positions, double dt)
+{
+  positions_.insert(positions_.end(), positions, positions + variable_count_);
+  if (hasVelocities())
+    velocities_.resize(positions_.size(), 0.0);
+  if (hasAccelerations())
+    accelerations_.resize(positions_.size(), 0.0);
+  duration_from_previous_.push_back(dt);
+}
+
+void robot_trajectory::CompactRobotTrajectory::append(const CompactRobotTrajectory &source, double dt)
+{
+  if (source.variable_count_ != variable_count_)
+  {
+    logError("Cannot append a trajectory of group '%s' to a trajectory of group '%s'",
+             source.getGroupName().c_str(), getGroupName().c_str());
+    return;
+  }
+
+  std::size_t size = positions_.size();
+  positions_.insert(positions_.end(), source.positions_.begin(), source.positions_.end());
+  if (hasVelocities() || source.hasVelocities())
+  {
+    velocities_.resize(size, 0.0);
+    if (source.hasVelocities())
+      velocities_.insert(velocities_.end(), source.velocities_.begin(), source.velocities_.end());
+    else
+      velocities_.resize(positions_.size(), 0.0);
+  }
+  if (hasAccelerations() || source.hasAccelerations())
+  {
+    accelerations_.resize(size, 0.0);
+    if (source.hasAccelerations())
+      accelerations_.insert(accelerations_.end(), source.accelerations_.begin(), source.accelerations_.end());
+    else
+      accelerations_.resize(positions_.size(), 0.0);
+  }
+
+  std::size_t index = duration_from_previous_.size();
+  duration_from_previous_.insert(duration_from_previous_.end(), source.duration_from_previous_.begin(), source.duration_from_previous_.end());
+  if (duration_from_previous_.size() > index)
+    duration_from_previous_[index] += dt;
+}
+
+void robot_trajectory::CompactRobotTrajectory::swap(CompactRobotTrajectory &other)
+{
+  robot_model_.swap(other.robot_model_);
+  std::swap(group_, other.group_);
+  reference_state_.swap(other.reference_state_);
+  std::swap(variable_count_, other.variable_count_);
+  variable_index_list_.swap(other.variable_index_list_);
+  stored_index_.swap(other.stored_index_);
+  positions_.swap(other.positions_);
+  velocities_.swap(other.velocities_);
+  accelerations_.swap(other.accelerations_);
+  duration_from_previous_.swap(other.duration_from_previous_);
+}
+
+void robot_trajectory::CompactRobotTrajectory::clear()
+{
+  positions_.clear();
+  velocities_.clear();
+  accelerations_.clear();
+  duration_from_previous_.clear();
+}
+
+void robot_trajectory::CompactRobotTrajectory::unwind()
+{
+  if (empty())
+    return;
+
+  const std::vector<const robot_model::JointModel*> &cont_joints = group_ ?
+    group_->getContinuousJointModels() : robot_model_->getContinuousJointModels();
+
+  std::size_t count = getWayPointCount();
+  for (std::size_t i = 0 ; i < cont_joints.size() ; ++i)
+  {
+    int index = stored_index_[cont_joints[i]->getFirstVariableIndex()];
+    if (index < 0)
+      continue;
+
+    // unwrap continuous joints
+    double running_offset = 0.0;
+    double last_value = positions_[index];
+
+    for (std::size_t j = 1 ; j < count ; ++j)
+    {
+      double &current_value = positions_[j * variable_count_ + index];
+      if (last_value > current_value + boost::math::constants::pi<double>())
+        running_offset += 2.0 * boost::math::constants::pi<double>();
+      else
+        if (current_value > last_value + boost::math::constants::pi<double>())
+          running_offset -= 2.0 * boost::math::constants::pi<double>();
+
+      last_value = current_value;
+      current_value += running_offset;
+    }
+  }
+}
+
+void robot_trajectory::CompactRobotTrajectory::getRobotTrajectory(RobotTrajectory &trajectory) const
+{
+  RobotTrajectory result(robot_model_, group_);
+  for (std::size_t i = 0 ; i < getWayPointCount() ; ++i)
+    result.addSuffixWayPoint(getWayPointState(i), duration_from_previous_[i]);
+  trajectory.swap(result);
+}
+
+void robot_trajectory::CompactRobotTrajectory::setRobotTrajectory(const RobotTrajectory &trajectory)
+{
+  robot_model_ = trajectory.getRobotModel();
+  group_ = trajectory.getGroup();
+  setVariables();
+  clear();
+
+  if (trajectory.empty())
+  {
+    reference_state_.reset(new robot_state::RobotState(robot_model_));
+    reference_state_->setToDefaultValues();
+    return;
+  }
+
+  reference_state_.reset(new robot_state::RobotState(trajectory.getFirstWayPoint()));
+  reserve(trajectory.getWayPointCount());
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+    addSuffixWayPoint(trajectory.getWayPoint(i), trajectory.getWayPointDurationFromPrevious(i));
+}
+
+void robot_trajectory::CompactRobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory &trajectory) const
+{
+  trajectory = moveit_msgs::RobotTrajectory();
+  if (empty())
+    return;
+  const std::vector<const robot_model::JointModel*> &jnt = group_ ? group_->getActiveJointModels() : robot_model_->getActiveJointModels();
+
+  std::vector<int> onedof;
+  std::vector<const robot_model::JointModel*> mdof;
+  for (std::size_t i = 0 ; i < jnt.size() ; ++i)
+    if (jnt[i]->getVariableCount() == 1)
+    {
+      trajectory.joint_trajectory.joint_names.push_back(jnt[i]->getName());
+      onedof.push_back(stored_index_[jnt[i]->getFirstVariableIndex()]);
+    }
+    else
+    {
+      trajectory.multi_dof_joint_trajectory.joint_names.push_back(jnt[i]->getName());
+      mdof.push_back(jnt[i]);
+    }
+
+  std::size_t count = getWayPointCount();
+  if (!onedof.empty())
+  {
+    trajectory.joint_trajectory.header.frame_id = robot_model_->getModelFrame();
+    trajectory.joint_trajectory.header.stamp = ros::Time(0);
+    trajectory.joint_trajectory.points.resize(count);
+  }
+
+  if (!mdof.empty())
+  {
+    trajectory.multi_dof_joint_trajectory.header.frame_id = robot_model_->getModelFrame();
+    trajectory.multi_dof_joint_trajectory.header.stamp = ros::Time(0);
+    trajectory.multi_dof_joint_trajectory.points.resize(count);
+  }
+
+  std::vector<double> joint_values;
+  Eigen::Affine3d transform;
+  double total_time = 0.0;
+  for (std::size_t i = 0 ; i < count ; ++i)
+  {
+    total_time += duration_from_previous_[i];
+    const double *positions = getWayPointPositions(i);
+
+    if (!onedof.empty())
+    {
+      trajectory_msgs::JointTrajectoryPoint &point = trajectory.joint_trajectory.points[i];
+      point.positions.resize(onedof.size());
+      for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+        point.positions[j] = positions[onedof[j]];
+      if (const double *velocities = getWayPointVelocities(i))
+      {
+        point.velocities.resize(onedof.size());
+        for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+          point.velocities[j] = velocities[onedof[j]];
+      }
+      if (const double *accelerations = getWayPointAccelerations(i))
+      {
+        point.accelerations.resize(onedof.size());
+        for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+          point.accelerations[j] = accelerations[onedof[j]];
+      }
+      point.time_from_start = ros::Duration(total_time);
+    }
+
+    if (!mdof.empty())
+    {
+      trajectory_msgs::MultiDOFJointTrajectoryPoint &point = trajectory.multi_dof_joint_trajectory.points[i];
+      point.transforms.resize(mdof.size());
+      for (std::size_t j = 0 ; j < mdof.size() ; ++j)
+      {
+        joint_values.resize(mdof[j]->getVariableCount());
+        for (std::size_t k = 0 ; k < joint_values.size() ; ++k)
+          joint_values[k] = positions[stored_index_[mdof[j]->getFirstVariableIndex() + k]];
+        mdof[j]->computeTransform(&joint_values[0], transform);
+        tf::transformEigenToMsg(transform, point.transforms[j]);
+      }
+      point.time_from_start = ros::Duration(total_time);
+    }
+  }
+}
+
+void robot_trajectory::CompactRobotTrajectory::setRobotTrajectoryMsg(const robot_state::RobotState &reference_state,
+                                                                     const moveit_msgs::RobotTrajectory &trajectory)
+{
+  // make a copy just in case the reference is the current reference state
+  reference_state_.reset(new robot_state::RobotState(reference_state));
+  clear();
+
+  const trajectory_msgs::JointTrajectory &joint_trajectory = trajectory.joint_trajectory;
+  const trajectory_msgs::MultiDOFJointTrajectory &multi_dof_trajectory = trajectory.multi_dof_joint_trajectory;
+
+  // where the values of each joint of the message are stored
+  std::size_t ignored = 0;
+  std::vector<int> onedof(joint_trajectory.joint_names.size(), -1);
+  for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+  {
+    const robot_model::JointModel *jm = robot_model_->hasJointModel(joint_trajectory.joint_names[j]) ?
+      robot_model_->getJointModel(joint_trajectory.joint_names[j]) : NULL;
+    if (jm && jm->getVariableCount() == 1)
+      onedof[j] = stored_index_[jm->getFirstVariableIndex()];
+    if (onedof[j] < 0)
+      ++ignored;
+  }
+  std::vector<const robot_model::JointModel*> mdof(multi_dof_trajectory.joint_names.size(), NULL);
+  for (std::size_t j = 0 ; j < mdof.size() ; ++j)
+  {
+    const robot_model::JointModel *jm = robot_model_->hasJointModel(multi_dof_trajectory.joint_names[j]) ?
+      robot_model_->getJointModel(multi_dof_trajectory.joint_names[j]) : NULL;
+    if (jm && stored_index_[jm->getFirstVariableIndex()] >= 0)
+      mdof[j] = jm;
+    else
+      ++ignored;
+  }
+  if (ignored > 0)
+    logWarn("%u joints of the trajectory message are not part of group '%s' and are ignored",
+            (unsigned int)ignored, getGroupName().c_str());
+
+  std::vector<double> reference_values(variable_count_);
+  for (std::size_t i = 0 ; i < variable_count_ ; ++i)
+    reference_values[i] = reference_state_->getVariablePosition(variable_index_list_[i]);
+
+  std::size_t state_count = std::max(joint_trajectory.points.size(), multi_dof_trajectory.points.size());
+  ros::Time last_time_stamp = joint_trajectory.points.empty() ? multi_dof_trajectory.header.stamp : joint_trajectory.header.stamp;
+  ros::Time this_time_stamp = last_time_stamp;
+
+  std::vector<double> joint_values;
+  Eigen::Affine3d transform;
+  reserve(state_count);
+  for (std::size_t i = 0 ; i < state_count ; ++i)
+  {
+    addSuffixWayPoint(&reference_values[0], 0.0);
+    double *positions = getWayPointPositions(i);
+
+    if (joint_trajectory.points.size() > i)
+    {
+      const trajectory_msgs::JointTrajectoryPoint &point = joint_trajectory.points[i];
+      for (std::size_t j = 0 ; j < onedof.size() && j < point.positions.size() ; ++j)
+        if (onedof[j] >= 0)
+          positions[onedof[j]] = point.positions[j];
+      if (point.velocities.size() == onedof.size() && !onedof.empty())
+      {
+        double *velocities = getWayPointVelocities(i);
+        for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+          if (onedof[j] >= 0)
+            velocities[onedof[j]] = point.velocities[j];
+        updateMimicJoints(velocities, true);
+      }
+      if (point.accelerations.size() == onedof.size() && !onedof.empty())
+      {
+        double *accelerations = getWayPointAccelerations(i);
+        for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+          if (onedof[j] >= 0)
+            accelerations[onedof[j]] = point.accelerations[j];
+        updateMimicJoints(accelerations, true);
+      }
+      this_time_stamp = joint_trajectory.header.stamp + point.time_from_start;
+    }
+
+    if (multi_dof_trajectory.points.size() > i)
+    {
+      const trajectory_msgs::MultiDOFJointTrajectoryPoint &point = multi_dof_trajectory.points[i];
+      for (std::size_t j = 0 ; j < mdof.size() && j < point.transforms.size() ; ++j)
+        if (mdof[j])
+        {
+          tf::transformMsgToEigen(point.transforms[j], transform);
+          joint_values.resize(mdof[j]->getVariableCount());
+          mdof[j]->computeVariablePositions(transform, &joint_values[0]);
+          for (std::size_t k = 0 ; k < joint_values.size() ; ++k)
+            positions[stored_index_[mdof[j]->getFirstVariableIndex() + k]] = joint_values[k];
+        }
+      this_time_stamp = multi_dof_trajectory.header.stamp + point.time_from_start;
+    }
+
+    updateMimicJoints(positions, false);
+    duration_from_previous_[i] = (this_time_stamp - last_time_stamp).toSec();
+    last_time_stamp = this_time_stamp;
+  }
+}
@@ -39,6 +39,7 @@
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/math/constants/constants.hpp>
 #include <numeric>
+#include <algorithm>
 
 robot_trajectory::RobotTrajectory::RobotTrajectory(const robot_model::RobotModelConstPtr &robot_model, const std::string &group) :
   robot_model_(robot_model),
@@ -80,6 +81,7 @@ void robot_trajectory::RobotTrajectory::swap(robot_trajectory::RobotTrajectory &
   std::swap(group_, other.group_);
   waypoints_.swap(other.waypoints_);
   duration_from_previous_.swap(other.duration_from_previous_);
+  time_from_start_.swap(other.time_from_start_);
 }
 
 void robot_trajectory::RobotTrajectory::append(const RobotTrajectory &source, double dt)
@@ -89,6 +91,7 @@ void robot_trajectory::RobotTrajectory::append(const RobotTrajectory &source, do
   duration_from_previous_.insert(duration_from_previous_.end(), source.duration_from_previous_.begin(), source.duration_from_previous_.end());
   if (duration_from_previous_.size() > index)
     duration_from_previous_[index] += dt;
+  updateTimeIndex(index);
 }
 
 void robot_trajectory::RobotTrajectory::reverse()
@@ -100,6 +103,7 @@ void robot_trajectory::RobotTrajectory::reverse()
     std::reverse(duration_from_previous_.begin(), duration_from_previous_.end());
     duration_from_previous_.pop_back();
   }
+  updateTimeIndex(0);
 }
 
 void robot_trajectory::RobotTrajectory::unwind()
@@ -186,6 +190,7 @@ void robot_trajectory::RobotTrajectory::clear()
 {
   waypoints_.clear();
   duration_from_previous_.clear();
+  time_from_start_.clear();
 }
 
 void robot_trajectory::RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory &trajectory) const
@@ -354,6 +359,18 @@ void robot_trajectory::RobotTrajectory::setRobotTrajectoryMsg(const robot_state:
   setRobotTrajectoryMsg(st, trajectory);
 }
 
+void robot_trajectory::RobotTrajectory::updateTimeIndex(std::size_t index)
+{
+  std::size_t count = duration_from_previous_.size();
+  time_from_start_.resize(count);
+  double time = index > 0 && index <= count ? time_from_start_[index - 1] : 0.0;
+  for (std::size_t i = index ; i < count ; ++i)
+  {
+    time += duration_from_previous_[i];
+    time_from_start_[i] = time;
+  }
+}
+
 void robot_trajectory::RobotTrajectory::findWayPointIndicesForDurationAfterStart(const double& duration, int& before, int& after, double &blend) const
 {
   if (duration < 0.0)
@@ -364,20 +381,21 @@ void robot_trajectory::RobotTrajectory::findWayPointIndicesForDurationAfterStart
     return;
   }
 
-  // Find indicies
-  std::size_t index = 0, num_points = waypoints_.size();
-  double running_duration = 0.0;
-  for ( ; index < num_points; ++index)
+  // Find the first waypoint reached at or after duration; durations may have been set past the last waypoint
+  std::size_t num_points = std::min(waypoints_.size(), time_from_start_.size());
+  std::size_t index = std::lower_bound(time_from_start_.begin(), time_from_start_.begin() + num_points, duration) - time_from_start_.begin();
+  if (index >= num_points)
   {
-    running_duration += duration_from_previous_[index];
-    if (running_duration >= duration)
-      break;
+    // past the end of the trajectory
+    before = after = std::max<int>((int)num_points - 1, 0);
+    blend = 1.0;
+    return;
   }
   before = std::max<int>(index - 1, 0);
-  after = std::min<int>(index, num_points - 1);
+  after = index;
 
   // Compute duration blend
-  double before_time = running_duration - duration_from_previous_[index];
+  double before_time = time_from_start_[index] - duration_from_previous_[index];
   if (after == before)
     blend = 1.0;
   else
@@ -390,11 +408,8 @@ double robot_trajectory::RobotTrajectory::getWaypointDurationFromStart(std::size
     return 0.0;
   if (index >= duration_from_previous_.size())
     index = duration_from_previous_.size() - 1;
-  
-  double time = 0.0;
-  for (std::size_t i = 0; i <= index; ++i)
-    time += duration_from_previous_[i];
-  return time;
+
+  return time_from_start_[index];
 }
 
 bool robot_trajectory::RobotTrajectory::getStateAtDurationFromStart(const double request_duration, robot_state::RobotStatePtr& output_state) const
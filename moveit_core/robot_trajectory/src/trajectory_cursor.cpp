@@ -0,0 +1,90 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_trajectory/trajectory_cursor.h>
+#include <moveit/exceptions/exceptions.h>
+#include <algorithm>
+
+robot_trajectory::TrajectoryCursor::TrajectoryCursor(const RobotTrajectory &trajectory, double period) :
+  trajectory_(trajectory),
+  period_(period)
+{
+  // a period that is not positive would never reach the end of the trajectory
+  if (!(period_ > 0.0))
+    throw moveit::ConstructException("The sampling period of a trajectory cursor must be positive");
+  seek(0.0);
+}
+
+void robot_trajectory::TrajectoryCursor::seek(double time)
+{
+  // the time of each sample is computed from the number of samples taken, so that errors do not accumulate
+  start_time_ = std::max(time, 0.0);
+  sample_count_ = 0;
+  time_ = start_time_;
+  done_ = trajectory_.empty();
+
+  int before, after;
+  double blend;
+  trajectory_.findWayPointIndicesForDurationAfterStart(time_, before, after, blend);
+  index_ = after;
+}
+
+bool robot_trajectory::TrajectoryCursor::next(robot_state::RobotState &state)
+{
+  if (done_)
+    return false;
+
+  std::size_t count = trajectory_.getWayPointCount();
+  double duration = trajectory_.getDuration();
+  if (time_ >= duration)
+  {
+    time_ = duration;
+    done_ = true;
+  }
+
+  // move forward to the first waypoint reached at or after the current time
+  while (index_ + 1 < count && trajectory_.getWaypointDurationFromStart(index_) < time_)
+    ++index_;
+
+  std::size_t before = index_ > 0 ? index_ - 1 : 0;
+  double segment = trajectory_.getWayPointDurationFromPrevious(index_);
+  double blend = 1.0;
+  if (before != index_ && segment > 0.0)
+    blend = std::min(1.0, (time_ - (trajectory_.getWaypointDurationFromStart(index_) - segment)) / segment);
+  trajectory_.getWayPoint(before).interpolate(trajectory_.getWayPoint(index_), blend, state);
+
+  ++sample_count_;
+  time_ = start_time_ + sample_count_ * period_;
+  return true;
+}
@@ -0,0 +1,366 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_trajectory/compact_robot_trajectory.h>
+#include <urdf_parser/urdf_parser.h>
+#include <gtest/gtest.h>
+#include <boost/math/constants/constants.hpp>
+
+// a planar base carrying a continuous joint, a revolute joint and a joint that mimics it
+static const std::string URDF_MODEL =
+  "<?xml version=\"1.0\" ?>"
+  "<robot name=\"myrobot\">"
+  "  <link name=\"base_link\"/>"
+  "  <link name=\"link_a\"/>"
+  "  <link name=\"link_b\"/>"
+  "  <link name=\"link_c\"/>"
+  "  <joint name=\"joint_a\" type=\"continuous\">"
+  "    <axis xyz=\"0 0 1\"/>"
+  "    <parent link=\"base_link\"/>"
+  "    <child link=\"link_a\"/>"
+  "    <origin rpy=\"0 0 0\" xyz=\"0 0 0.1\"/>"
+  "  </joint>"
+  "  <joint name=\"joint_b\" type=\"revolute\">"
+  "    <axis xyz=\"0 1 0\"/>"
+  "    <parent link=\"link_a\"/>"
+  "    <child link=\"link_b\"/>"
+  "    <origin rpy=\"0 0 0\" xyz=\"0 0 0.5\"/>"
+  "    <limit effort=\"10\" lower=\"-2\" upper=\"2\" velocity=\"1\"/>"
+  "  </joint>"
+  "  <joint name=\"joint_c\" type=\"revolute\">"
+  "    <axis xyz=\"0 1 0\"/>"
+  "    <parent link=\"link_b\"/>"
+  "    <child link=\"link_c\"/>"
+  "    <origin rpy=\"0 0 0\" xyz=\"0 0 0.5\"/>"
+  "    <limit effort=\"10\" lower=\"-5\" upper=\"5\" velocity=\"2\"/>"
+  "    <mimic joint=\"joint_b\" multiplier=\"2\" offset=\"0.1\"/>"
+  "  </joint>"
+  "</robot>";
+
+static const std::string SRDF_MODEL =
+  "<?xml version=\"1.0\" ?>"
+  "<robot name=\"myrobot\">"
+  "  <virtual_joint name=\"base_joint\" child_link=\"base_link\" parent_frame=\"odom_combined\" type=\"planar\"/>"
+  "  <group name=\"arm\">"
+  "    <joint name=\"joint_a\"/>"
+  "    <joint name=\"joint_b\"/>"
+  "    <joint name=\"joint_c\"/>"
+  "  </group>"
+  "  <group name=\"whole_body\">"
+  "    <joint name=\"base_joint\"/>"
+  "    <joint name=\"joint_a\"/>"
+  "    <joint name=\"joint_b\"/>"
+  "    <joint name=\"joint_c\"/>"
+  "  </group>"
+  "</robot>";
+
+class CompactRobotTrajectoryTest : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(URDF_MODEL);
+    boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+    srdf_model->initString(*urdf_model, SRDF_MODEL);
+    robot_model_.reset(new robot_model::RobotModel(urdf_model, srdf_model));
+    group_ = robot_model_->getJointModelGroup("whole_body");
+    ASSERT_TRUE(group_);
+  }
+
+  robot_state::RobotState makeState(double x, double y, double theta, double a, double b) const
+  {
+    robot_state::RobotState state(robot_model_);
+    state.setToDefaultValues();
+    state.setVariablePosition("base_joint/x", x);
+    state.setVariablePosition("base_joint/y", y);
+    state.setVariablePosition("base_joint/theta", theta);
+    state.setVariablePosition("joint_a", a);
+    state.setVariablePosition("joint_b", b);
+    state.update();
+    return state;
+  }
+
+  // set velocities that are consistent with the mimic joint
+  static void setVelocities(robot_state::RobotState &state, double a, double b)
+  {
+    state.setVariableVelocity("base_joint/x", 0.1);
+    state.setVariableVelocity("base_joint/y", -0.2);
+    state.setVariableVelocity("base_joint/theta", 0.3);
+    state.setVariableVelocity("joint_a", a);
+    state.setVariableVelocity("joint_b", b);
+    state.setVariableVelocity("joint_c", 2.0 * b);
+  }
+
+  static void expectSameVariables(const robot_state::RobotState &expected, const robot_state::RobotState &actual)
+  {
+    ASSERT_EQ(expected.getVariableCount(), actual.getVariableCount());
+    for (std::size_t i = 0 ; i < expected.getVariableCount() ; ++i)
+    {
+      EXPECT_NEAR(expected.getVariablePosition(i), actual.getVariablePosition(i), 1e-9) << expected.getVariableNames()[i];
+      if (expected.hasVelocities())
+      {
+        ASSERT_TRUE(actual.hasVelocities());
+        EXPECT_NEAR(expected.getVariableVelocity(i), actual.getVariableVelocity(i), 1e-9) << expected.getVariableNames()[i];
+      }
+      else
+        if (actual.hasVelocities())
+          EXPECT_EQ(0.0, actual.getVariableVelocity(i)) << expected.getVariableNames()[i];
+    }
+  }
+
+  static void expectSameTrajectories(const robot_trajectory::RobotTrajectory &expected, const robot_trajectory::RobotTrajectory &actual)
+  {
+    EXPECT_EQ(expected.getGroupName(), actual.getGroupName());
+    ASSERT_EQ(expected.getWayPointCount(), actual.getWayPointCount());
+    for (std::size_t i = 0 ; i < expected.getWayPointCount() ; ++i)
+    {
+      EXPECT_DOUBLE_EQ(expected.getWayPointDurationFromPrevious(i), actual.getWayPointDurationFromPrevious(i));
+      expectSameVariables(expected.getWayPoint(i), actual.getWayPoint(i));
+    }
+  }
+
+  robot_trajectory::RobotTrajectory makeTrajectory(bool velocities) const
+  {
+    robot_trajectory::RobotTrajectory trajectory(robot_model_, group_);
+    for (std::size_t i = 0 ; i < 5 ; ++i)
+    {
+      robot_state::RobotState state = makeState(0.1 * i, -0.2 * i, 0.3 - 0.1 * i, 0.4 * i, 0.5 - 0.2 * i);
+      if (velocities)
+        setVelocities(state, 0.2 * i, -0.1 * i);
+      trajectory.addSuffixWayPoint(state, i == 0 ? 0.0 : 0.1 * i);
+    }
+    return trajectory;
+  }
+
+  robot_model::RobotModelPtr robot_model_;
+  const robot_model::JointModelGroup *group_;
+};
+
+TEST_F(CompactRobotTrajectoryTest, StoresGroupVariables)
+{
+  robot_trajectory::CompactRobotTrajectory compact(makeTrajectory(false));
+  // the three variables of the planar base, the continuous joint, the revolute joint and its mimic joint
+  EXPECT_EQ(6u, compact.getVariableCount());
+  EXPECT_EQ(5u, compact.getWayPointCount());
+  EXPECT_FALSE(compact.hasVelocities());
+  EXPECT_FALSE(compact.hasAccelerations());
+
+  const std::vector<int> &indices = compact.getVariableIndexList();
+  const double *positions = compact.getWayPointPositions(2);
+  int b = robot_model_->getVariableIndex("joint_b");
+  int c = robot_model_->getVariableIndex("joint_c");
+  for (std::size_t i = 0 ; i < indices.size() ; ++i)
+    if (indices[i] == c)
+      for (std::size_t j = 0 ; j < indices.size() ; ++j)
+        if (indices[j] == b)
+          EXPECT_NEAR(2.0 * positions[j] + 0.1, positions[i], 1e-12);
+}
+
+TEST_F(CompactRobotTrajectoryTest, RobotTrajectoryRoundTrip)
+{
+  for (int velocities = 0 ; velocities < 2 ; ++velocities)
+  {
+    robot_trajectory::RobotTrajectory trajectory = makeTrajectory(velocities);
+    robot_trajectory::CompactRobotTrajectory compact(trajectory);
+    EXPECT_EQ((bool)velocities, compact.hasVelocities());
+
+    robot_trajectory::RobotTrajectory restored(robot_model_, "");
+    compact.getRobotTrajectory(restored);
+    expectSameTrajectories(trajectory, restored);
+
+    // a waypoint state is built from the reference state
+    expectSameVariables(trajectory.getWayPoint(3), *compact.getWayPointState(3));
+  }
+}
+
+TEST_F(CompactRobotTrajectoryTest, MixedVelocities)
+{
+  // waypoints without velocities get zero velocities once one waypoint has them
+  robot_trajectory::RobotTrajectory trajectory(robot_model_, group_);
+  trajectory.addSuffixWayPoint(makeState(0.0, 0.0, 0.0, 0.0, 0.0), 0.0);
+  robot_state::RobotState with_velocities = makeState(0.1, 0.2, 0.3, 0.4, 0.5);
+  setVelocities(with_velocities, 1.0, -1.0);
+  trajectory.addSuffixWayPoint(with_velocities, 0.5);
+  trajectory.addSuffixWayPoint(makeState(0.2, 0.4, 0.6, 0.8, 1.0), 0.5);
+
+  robot_trajectory::CompactRobotTrajectory compact(trajectory);
+  ASSERT_TRUE(compact.hasVelocities());
+  for (std::size_t i = 0 ; i < compact.getVariableCount() ; ++i)
+  {
+    EXPECT_EQ(0.0, compact.getWayPointVelocities(0)[i]);
+    EXPECT_EQ(with_velocities.getVariableVelocity(compact.getVariableIndexList()[i]), compact.getWayPointVelocities(1)[i]);
+    EXPECT_EQ(0.0, compact.getWayPointVelocities(2)[i]);
+  }
+
+  robot_trajectory::RobotTrajectory restored(robot_model_, "");
+  compact.getRobotTrajectory(restored);
+  expectSameTrajectories(trajectory, restored);
+}
+
+TEST_F(CompactRobotTrajectoryTest, MessageRoundTrip)
+{
+  for (int velocities = 0 ; velocities < 2 ; ++velocities)
+  {
+    robot_trajectory::RobotTrajectory trajectory = makeTrajectory(velocities);
+    robot_trajectory::CompactRobotTrajectory compact(trajectory);
+
+    // the message matches the one of the original trajectory
+    moveit_msgs::RobotTrajectory expected, msg;
+    trajectory.getRobotTrajectoryMsg(expected);
+    compact.getRobotTrajectoryMsg(msg);
+
+    // the mimic joint is not active, so it is not in the message
+    EXPECT_EQ(expected.joint_trajectory.joint_names, msg.joint_trajectory.joint_names);
+    ASSERT_EQ(2u, msg.joint_trajectory.joint_names.size());
+    EXPECT_EQ(expected.multi_dof_joint_trajectory.joint_names, msg.multi_dof_joint_trajectory.joint_names);
+    ASSERT_EQ(1u, msg.multi_dof_joint_trajectory.joint_names.size());
+    ASSERT_EQ(expected.joint_trajectory.points.size(), msg.joint_trajectory.points.size());
+    ASSERT_EQ(expected.multi_dof_joint_trajectory.points.size(), msg.multi_dof_joint_trajectory.points.size());
+    for (std::size_t i = 0 ; i < msg.joint_trajectory.points.size() ; ++i)
+    {
+      const trajectory_msgs::JointTrajectoryPoint &e = expected.joint_trajectory.points[i];
+      const trajectory_msgs::JointTrajectoryPoint &p = msg.joint_trajectory.points[i];
+      ASSERT_EQ(e.positions.size(), p.positions.size());
+      for (std::size_t j = 0 ; j < p.positions.size() ; ++j)
+        EXPECT_NEAR(e.positions[j], p.positions[j], 1e-12);
+      ASSERT_EQ(e.velocities.size(), p.velocities.size());
+      for (std::size_t j = 0 ; j < p.velocities.size() ; ++j)
+        EXPECT_NEAR(e.velocities[j], p.velocities[j], 1e-12);
+      EXPECT_NEAR(e.time_from_start.toSec(), p.time_from_start.toSec(), 1e-9);
+
+      const geometry_msgs::Transform &et = expected.multi_dof_joint_trajectory.points[i].transforms[0];
+      const geometry_msgs::Transform &pt = msg.multi_dof_joint_trajectory.points[i].transforms[0];
+      EXPECT_NEAR(et.translation.x, pt.translation.x, 1e-9);
+      EXPECT_NEAR(et.translation.y, pt.translation.y, 1e-9);
+      EXPECT_NEAR(et.rotation.z, pt.rotation.z, 1e-9);
+      EXPECT_NEAR(et.rotation.w, pt.rotation.w, 1e-9);
+    }
+
+    // reading the message back restores the mimic joint and the planar joint from the reference state and the transforms
+    robot_state::RobotState reference = makeState(5.0, 5.0, 1.0, 1.0, 1.0);
+    robot_trajectory::CompactRobotTrajectory restored(robot_model_, group_);
+    restored.setRobotTrajectoryMsg(reference, msg);
+    EXPECT_EQ((bool)velocities, restored.hasVelocities());
+
+    // (messages carry no velocities for multi-DOF joints)
+    robot_trajectory::RobotTrajectory restored_trajectory(robot_model_, "");
+    restored.getRobotTrajectory(restored_trajectory);
+    ASSERT_EQ(trajectory.getWayPointCount(), restored_trajectory.getWayPointCount());
+    const char *onedof[] = { "joint_a", "joint_b", "joint_c" };
+    for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+    {
+      const robot_state::RobotState &e = trajectory.getWayPoint(i);
+      const robot_state::RobotState &p = restored_trajectory.getWayPoint(i);
+      EXPECT_NEAR(trajectory.getWayPointDurationFromPrevious(i), restored_trajectory.getWayPointDurationFromPrevious(i), 1e-9);
+      for (std::size_t j = 0 ; j < e.getVariableCount() ; ++j)
+        EXPECT_NEAR(e.getVariablePosition(j), p.getVariablePosition(j), 1e-9) << e.getVariableNames()[j];
+      if (velocities)
+        for (std::size_t j = 0 ; j < 3 ; ++j)
+          EXPECT_NEAR(e.getVariableVelocity(onedof[j]), p.getVariableVelocity(onedof[j]), 1e-12) << onedof[j];
+    }
+
+    // the same message read by RobotTrajectory gives the same waypoints
+    robot_trajectory::RobotTrajectory from_msg(robot_model_, group_);
+    from_msg.setRobotTrajectoryMsg(reference, msg);
+    for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+      for (std::size_t j = 0 ; j < compact.getVariableCount() ; ++j)
+      {
+        int index = compact.getVariableIndexList()[j];
+        EXPECT_NEAR(from_msg.getWayPoint(i).getVariablePosition(index), restored_trajectory.getWayPoint(i).getVariablePosition(index), 1e-9);
+      }
+  }
+}
+
+TEST_F(CompactRobotTrajectoryTest, Append)
+{
+  robot_trajectory::RobotTrajectory first = makeTrajectory(false);
+  robot_trajectory::RobotTrajectory second = makeTrajectory(true);
+  robot_trajectory::CompactRobotTrajectory compact(first);
+  compact.append(robot_trajectory::CompactRobotTrajectory(second), 0.25);
+
+  first.append(second, 0.25);
+  robot_trajectory::RobotTrajectory restored(robot_model_, "");
+  compact.getRobotTrajectory(restored);
+  expectSameTrajectories(first, restored);
+  EXPECT_DOUBLE_EQ(first.getDuration(), restored.getDuration());
+
+  // a trajectory of another group is not appended
+  robot_trajectory::CompactRobotTrajectory arm(robot_model_, robot_model_->getJointModelGroup("arm"));
+  arm.addSuffixWayPoint(makeState(0.0, 0.0, 0.0, 0.0, 0.0), 0.0);
+  compact.append(arm, 1.0);
+  EXPECT_EQ(first.getWayPointCount(), compact.getWayPointCount());
+}
+
+TEST_F(CompactRobotTrajectoryTest, Unwind)
+{
+  const double pi = boost::math::constants::pi<double>();
+  robot_trajectory::RobotTrajectory trajectory(robot_model_, group_);
+  const double values[] = { 0.0, 3.0, -3.0, -2.9, 3.1, -3.1 };
+  for (std::size_t i = 0 ; i < sizeof(values) / sizeof(values[0]) ; ++i)
+    trajectory.addSuffixWayPoint(makeState(0.0, 0.0, 0.0, values[i], 0.1), 0.1);
+
+  robot_trajectory::CompactRobotTrajectory compact(trajectory);
+  compact.unwind();
+  trajectory.unwind();
+
+  robot_trajectory::RobotTrajectory restored(robot_model_, "");
+  compact.getRobotTrajectory(restored);
+  expectSameTrajectories(trajectory, restored);
+  EXPECT_NEAR(-3.0 + 2.0 * pi, restored.getWayPoint(2).getVariablePosition("joint_a"), 1e-12);
+  EXPECT_NEAR(3.1, restored.getWayPoint(4).getVariablePosition("joint_a"), 1e-12);
+  EXPECT_NEAR(-3.1 + 2.0 * pi, restored.getWayPoint(5).getVariablePosition("joint_a"), 1e-12);
+}
+
+TEST_F(CompactRobotTrajectoryTest, SwapAndClear)
+{
+  robot_trajectory::CompactRobotTrajectory compact(makeTrajectory(true));
+  robot_trajectory::CompactRobotTrajectory arm(robot_model_, robot_model_->getJointModelGroup("arm"));
+  compact.swap(arm);
+  EXPECT_EQ("arm", compact.getGroupName());
+  EXPECT_TRUE(compact.empty());
+  EXPECT_EQ(3u, compact.getVariableCount());
+  EXPECT_EQ("whole_body", arm.getGroupName());
+  EXPECT_EQ(5u, arm.getWayPointCount());
+
+  arm.clear();
+  EXPECT_TRUE(arm.empty());
+  EXPECT_FALSE(arm.hasVelocities());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,294 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <moveit/robot_trajectory/trajectory_cursor.h>
+#include <moveit/exceptions/exceptions.h>
+#include <urdf_parser/urdf_parser.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+
+static const std::string URDF_MODEL =
+  "<?xml version=\"1.0\" ?>"
+  "<robot name=\"myrobot\">"
+  "  <link name=\"base_link\"/>"
+  "  <link name=\"link\"/>"
+  "  <joint name=\"joint\" type=\"revolute\">"
+  "    <axis xyz=\"0 0 1\"/>"
+  "    <parent link=\"base_link\"/>"
+  "    <child link=\"link\"/>"
+  "    <origin rpy=\"0 0 0\" xyz=\"0 0 0.1\"/>"
+  "    <limit effort=\"10\" lower=\"-100\" upper=\"100\" velocity=\"1\"/>"
+  "  </joint>"
+  "</robot>";
+
+static const std::string SRDF_MODEL =
+  "<?xml version=\"1.0\" ?>"
+  "<robot name=\"myrobot\">"
+  "  <virtual_joint name=\"base_joint\" child_link=\"base_link\" parent_frame=\"odom_combined\" type=\"fixed\"/>"
+  "  <group name=\"arm\">"
+  "    <joint name=\"joint\"/>"
+  "  </group>"
+  "</robot>";
+
+// the search that was used before the time index was kept
+static void findWayPointIndicesByLinearScan(const robot_trajectory::RobotTrajectory &trajectory, double duration,
+                                            int &before, int &after, double &blend)
+{
+  if (duration < 0.0)
+  {
+    before = 0;
+    after = 0;
+    blend = 0;
+    return;
+  }
+
+  std::size_t index = 0, num_points = trajectory.getWayPointCount();
+  double running_duration = 0.0;
+  for ( ; index < num_points; ++index)
+  {
+    running_duration += trajectory.getWayPointDurationFromPrevious(index);
+    if (running_duration >= duration)
+      break;
+  }
+  if (index == num_points)
+  {
+    before = after = std::max<int>((int)num_points - 1, 0);
+    blend = 1.0;
+    return;
+  }
+  before = std::max<int>(index - 1, 0);
+  after = index;
+
+  double before_time = running_duration - trajectory.getWayPointDurationFromPrevious(index);
+  if (after == before)
+    blend = 1.0;
+  else
+    blend = (duration - before_time) / trajectory.getWayPointDurationFromPrevious(index);
+}
+
+static double getDurationFromStartByLinearScan(const robot_trajectory::RobotTrajectory &trajectory, std::size_t index)
+{
+  const std::deque<double> &durations = trajectory.getWayPointDurations();
+  if (durations.empty())
+    return 0.0;
+  if (index >= durations.size())
+    index = durations.size() - 1;
+  double time = 0.0;
+  for (std::size_t i = 0 ; i <= index ; ++i)
+    time += durations[i];
+  return time;
+}
+
+class RobotTrajectoryTest : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(URDF_MODEL);
+    boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+    srdf_model->initString(*urdf_model, SRDF_MODEL);
+    robot_model_.reset(new robot_model::RobotModel(urdf_model, srdf_model));
+  }
+
+  robot_state::RobotState makeState(double value) const
+  {
+    robot_state::RobotState state(robot_model_);
+    state.setToDefaultValues();
+    state.setVariablePosition("joint", value);
+    state.update();
+    return state;
+  }
+
+  // a trajectory that moves the joint to \e values, one waypoint per value
+  robot_trajectory::RobotTrajectory makeTrajectory(const double *values, const double *durations, std::size_t count) const
+  {
+    robot_trajectory::RobotTrajectory trajectory(robot_model_, "arm");
+    for (std::size_t i = 0 ; i < count ; ++i)
+      trajectory.addSuffixWayPoint(makeState(values[i]), durations[i]);
+    return trajectory;
+  }
+
+  // compare the time index against a scan of the durations, at the waypoint times, between them and past both ends
+  static void expectSameAsLinearScan(const robot_trajectory::RobotTrajectory &trajectory)
+  {
+    std::size_t count = trajectory.getWayPointCount();
+    for (std::size_t i = 0 ; i < count + 2 ; ++i)
+      EXPECT_DOUBLE_EQ(getDurationFromStartByLinearScan(trajectory, i), trajectory.getWaypointDurationFromStart(i)) << "waypoint " << i;
+    double duration = getDurationFromStartByLinearScan(trajectory, trajectory.getWayPointDurations().size());
+    EXPECT_DOUBLE_EQ(duration, trajectory.getDuration());
+
+    std::vector<double> times(1, -1.0);
+    for (std::size_t i = 0 ; i < count ; ++i)
+    {
+      double time = getDurationFromStartByLinearScan(trajectory, i);
+      times.push_back(time);
+      times.push_back(time - 0.01);
+      times.push_back(time + 0.01);
+    }
+    times.push_back(duration + 1.0);
+
+    for (std::size_t i = 0 ; i < times.size() ; ++i)
+    {
+      int before, after, expected_before, expected_after;
+      double blend, expected_blend;
+      trajectory.findWayPointIndicesForDurationAfterStart(times[i], before, after, blend);
+      findWayPointIndicesByLinearScan(trajectory, times[i], expected_before, expected_after, expected_blend);
+      EXPECT_EQ(expected_before, before) << "time " << times[i];
+      EXPECT_EQ(expected_after, after) << "time " << times[i];
+      EXPECT_NEAR(expected_blend, blend, 1e-12) << "time " << times[i];
+    }
+  }
+
+  robot_model::RobotModelPtr robot_model_;
+};
+
+TEST_F(RobotTrajectoryTest, TimeIndexFollowsMutators)
+{
+  // includes waypoints reached at the same time as the previous one
+  const double values[] = { 0.0, 1.0, 2.0, 3.0, 4.0 };
+  const double durations[] = { 0.0, 0.5, 0.0, 1.0, 0.0 };
+  robot_trajectory::RobotTrajectory trajectory = makeTrajectory(values, durations, 5);
+  expectSameAsLinearScan(trajectory);
+  EXPECT_DOUBLE_EQ(1.5, trajectory.getDuration());
+
+  trajectory.addPrefixWayPoint(makeState(-1.0), 0.25);
+  expectSameAsLinearScan(trajectory);
+
+  trajectory.insertWayPoint(3, makeState(1.5), 0.3);
+  expectSameAsLinearScan(trajectory);
+
+  trajectory.insertWayPoint(trajectory.getWayPointCount(), makeState(5.0), 0.0);
+  expectSameAsLinearScan(trajectory);
+
+  trajectory.setWayPointDurationFromPrevious(2, 0.7);
+  expectSameAsLinearScan(trajectory);
+
+  robot_trajectory::RobotTrajectory other = makeTrajectory(values, durations, 5);
+  trajectory.append(other, 0.4);
+  expectSameAsLinearScan(trajectory);
+
+  trajectory.reverse();
+  expectSameAsLinearScan(trajectory);
+
+  robot_trajectory::RobotTrajectory swapped = makeTrajectory(values + 1, durations + 1, 3);
+  trajectory.swap(swapped);
+  expectSameAsLinearScan(trajectory);
+  expectSameAsLinearScan(swapped);
+  EXPECT_EQ(3u, trajectory.getWayPointCount());
+
+  // durations set past the last waypoint extend the duration, but no waypoint is reached after it
+  trajectory.setWayPointDurationFromPrevious(5, 2.0);
+  expectSameAsLinearScan(trajectory);
+  EXPECT_DOUBLE_EQ(3.5, trajectory.getDuration());
+
+  trajectory.clear();
+  expectSameAsLinearScan(trajectory);
+  EXPECT_EQ(0.0, trajectory.getDuration());
+  trajectory.addSuffixWayPoint(makeState(1.0), 0.5);
+  expectSameAsLinearScan(trajectory);
+}
+
+TEST_F(RobotTrajectoryTest, CursorSamples)
+{
+  const double values[] = { 0.0, 1.0, 2.0, 3.0 };
+  const double durations[] = { 0.0, 0.5, 0.0, 1.0 };
+  robot_trajectory::RobotTrajectory trajectory = makeTrajectory(values, durations, 4);
+
+  robot_state::RobotState state = makeState(0.0);
+  robot_state::RobotStatePtr expected(new robot_state::RobotState(state));
+  robot_trajectory::TrajectoryCursor cursor(trajectory, 0.2);
+  std::size_t samples = 0;
+  while (!cursor.done())
+  {
+    double time = std::min(cursor.getTime(), trajectory.getDuration());
+    ASSERT_TRUE(cursor.next(state));
+    ASSERT_TRUE(trajectory.getStateAtDurationFromStart(time, expected));
+    EXPECT_NEAR(expected->getVariablePosition("joint"), state.getVariablePosition("joint"), 1e-12) << "time " << time;
+    ++samples;
+  }
+  // samples at 0, 0.2, ..., 1.4 and the last waypoint at 1.5
+  EXPECT_EQ(9u, samples);
+  EXPECT_EQ(3.0, state.getVariablePosition("joint"));
+  EXPECT_FALSE(cursor.next(state));
+  EXPECT_EQ(3.0, state.getVariablePosition("joint"));
+
+  // when the duration is a multiple of the period, the last waypoint is sampled once
+  robot_trajectory::TrajectoryCursor exact(trajectory, 0.5);
+  const double expected_values[] = { 0.0, 1.0, 2.5, 3.0 };
+  for (std::size_t i = 0 ; i < 4 ; ++i)
+  {
+    ASSERT_TRUE(exact.next(state));
+    EXPECT_NEAR(expected_values[i], state.getVariablePosition("joint"), 1e-12);
+  }
+  EXPECT_TRUE(exact.done());
+  EXPECT_EQ(3.0, state.getVariablePosition("joint"));
+
+  // seeking restarts the samples from the given time
+  exact.seek(0.75);
+  EXPECT_FALSE(exact.done());
+  ASSERT_TRUE(exact.next(state));
+  EXPECT_NEAR(2.25, state.getVariablePosition("joint"), 1e-12);
+  ASSERT_TRUE(exact.next(state));
+  EXPECT_NEAR(2.75, state.getVariablePosition("joint"), 1e-12);
+  ASSERT_TRUE(exact.next(state));
+  EXPECT_EQ(3.0, state.getVariablePosition("joint"));
+  EXPECT_TRUE(exact.done());
+}
+
+TEST_F(RobotTrajectoryTest, CursorEdgeCases)
+{
+  robot_trajectory::RobotTrajectory trajectory(robot_model_, "arm");
+  EXPECT_THROW(robot_trajectory::TrajectoryCursor(trajectory, 0.0), moveit::ConstructException);
+
+  robot_state::RobotState state = makeState(7.0);
+  robot_trajectory::TrajectoryCursor empty(trajectory, 0.1);
+  EXPECT_TRUE(empty.done());
+  EXPECT_FALSE(empty.next(state));
+  EXPECT_EQ(7.0, state.getVariablePosition("joint"));
+
+  // a single waypoint is sampled once
+  trajectory.addSuffixWayPoint(makeState(1.0), 0.0);
+  robot_trajectory::TrajectoryCursor single(trajectory, 0.1);
+  ASSERT_TRUE(single.next(state));
+  EXPECT_EQ(1.0, state.getVariablePosition("joint"));
+  EXPECT_TRUE(single.done());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
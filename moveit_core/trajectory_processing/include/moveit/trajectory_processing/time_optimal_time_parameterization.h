@@ -0,0 +1,74 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_TRAJECTORY_PROCESSING_TIME_OPTIMAL_TIME_PARAMETERIZATION_
+#define MOVEIT_TRAJECTORY_PROCESSING_TIME_OPTIMAL_TIME_PARAMETERIZATION_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <moveit/robot_trajectory/compact_robot_trajectory.h>
+
+namespace trajectory_processing
+{
+
+/// \brief This class computes the timestamps of a trajectory that traverse its path in
+/// (nearly) minimal time while respecting the velocity and acceleration limits of each joint.
+///
+/// The waypoints are taken as samples of a smooth path parameterized by its length in
+/// joint space. The squared path velocity is integrated in the phase plane over a grid
+/// along the path: a backward pass computes the largest velocities from which the end of
+/// the path can still be reached at rest, and a forward pass accelerates as much as the
+/// limits allow without exceeding them. Limits are enforced at the grid points, and the
+/// cost is linear in the number of waypoints and in the length of the path.
+class TimeOptimalTimeParameterization
+{
+public:
+  /// @param path_resolution The maximum distance in joint space between points of the grid
+  TimeOptimalTimeParameterization(double path_resolution = 0.01);
+  ~TimeOptimalTimeParameterization();
+
+  bool computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory,
+                         const double max_velocity_scaling_factor = 1.0) const;
+
+  /// Same as above; the positions, velocities and accelerations of \e trajectory are used in place.
+  bool computeTimeStamps(robot_trajectory::CompactRobotTrajectory& trajectory,
+                         const double max_velocity_scaling_factor = 1.0) const;
+
+private:
+
+  double path_resolution_;              /// @brief maximum distance between grid points along the path
+};
+
+}
+
+#endif
@@ -0,0 +1,497 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/trajectory_processing/time_optimal_time_parameterization.h>
+#include <console_bridge/console.h>
+#include <Eigen/Core>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace trajectory_processing
+{
+
+static const double DEFAULT_VEL_MAX = 1.0;
+static const double DEFAULT_ACCEL_MAX = 1.0;
+static const double EPSILON = 1e-9;
+
+TimeOptimalTimeParameterization::TimeOptimalTimeParameterization(double path_resolution)
+  : path_resolution_(path_resolution)
+{}
+
+TimeOptimalTimeParameterization::~TimeOptimalTimeParameterization()
+{}
+
+namespace
+{
+
+// The state of the path at a grid point is the squared path velocity x = ds/dt^2,
+// and the control is the path acceleration u = d2s/dt2. Joint velocities are
+// q' * sqrt(x) and joint accelerations q' * u + q'' * x, so all limits are
+// linear constraints on (x, u).
+struct GridConstraints
+{
+  // a line u = alpha + beta * x
+  struct Bound
+  {
+    Bound(double alpha, double beta) : alpha_(alpha), beta_(beta) {}
+    double alpha_;
+    double beta_;
+  };
+
+  void clear()
+  {
+    lower_.clear();
+    upper_.clear();
+    x_min_ = 0.0;
+    x_max_ = std::numeric_limits<double>::infinity();
+  }
+
+  // add the constraint c_u * u + c_x * x <= r
+  void add(double c_u, double c_x, double r)
+  {
+    if (c_u > EPSILON)
+      upper_.push_back(Bound(r / c_u, -c_x / c_u));
+    else
+      if (c_u < -EPSILON)
+        lower_.push_back(Bound(r / c_u, -c_x / c_u));
+      else
+        if (c_x > EPSILON)
+          x_max_ = std::min(x_max_, r / c_x);
+        else
+          if (c_x < -EPSILON)
+            x_min_ = std::max(x_min_, r / c_x);
+  }
+
+  // the interval of x for which some u satisfies all constraints; u is eliminated by
+  // requiring every lower bound to be below every upper bound
+  void getFeasibleInterval(double &x_min, double &x_max) const
+  {
+    x_min = x_min_;
+    x_max = x_max_;
+    for (std::size_t i = 0 ; i < lower_.size() ; ++i)
+      for (std::size_t j = 0 ; j < upper_.size() ; ++j)
+      {
+        double c = lower_[i].beta_ - upper_[j].beta_;
+        double r = upper_[j].alpha_ - lower_[i].alpha_;
+        if (c > EPSILON)
+          x_max = std::min(x_max, r / c);
+        else
+          if (c < -EPSILON)
+            x_min = std::max(x_min, r / c);
+          else
+            if (r < 0.0)
+              x_max = -std::numeric_limits<double>::infinity();
+      }
+  }
+
+  double getMinAcceleration(double x) const
+  {
+    double u = -std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0 ; i < lower_.size() ; ++i)
+      u = std::max(u, lower_[i].alpha_ + lower_[i].beta_ * x);
+    return u;
+  }
+
+  double getMaxAcceleration(double x) const
+  {
+    double u = std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0 ; i < upper_.size() ; ++i)
+      u = std::min(u, upper_[i].alpha_ + upper_[i].beta_ * x);
+    return u;
+  }
+
+  std::vector<Bound> lower_;
+  std::vector<Bound> upper_;
+  double x_min_;
+  double x_max_;
+};
+
+// The path between two distinct waypoints, split into steps of equal length. The path
+// derivatives q' and q'' are interpolated linearly between the values at the waypoints.
+struct PathSegment
+{
+  std::size_t waypoint_;                /// index of the waypoint the segment starts at
+  std::size_t first_grid_point_;
+  std::size_t steps_;
+  double step_;
+};
+
+class PathParameterizer
+{
+public:
+
+  PathParameterizer(const Eigen::VectorXd &v_max, const Eigen::VectorXd &a_max)
+    : v_max_(v_max)
+    , a_max_(a_max)
+    , qd_(v_max.size())
+    , qdd_(v_max.size())
+  {
+  }
+
+  // compute the path derivatives at the waypoints and the grid; returns false if all waypoints are the same
+  // the positions of the waypoints are given one waypoint after the other
+  bool setPath(const double *positions, std::size_t count, double path_resolution)
+  {
+    int dimension = v_max_.size();
+    EigenSTLVectorXd directions(count - 1);
+    std::vector<double> lengths(count - 1);
+    for (std::size_t i = 0 ; i + 1 < count ; ++i)
+    {
+      directions[i] = Eigen::Map<const Eigen::VectorXd>(positions + (i + 1) * dimension, dimension) -
+        Eigen::Map<const Eigen::VectorXd>(positions + i * dimension, dimension);
+      lengths[i] = directions[i].norm();
+      if (lengths[i] > 0.0)
+        directions[i] /= lengths[i];
+    }
+
+    segments_.clear();
+    std::size_t grid_points = 0;
+    for (std::size_t i = 0 ; i + 1 < count ; ++i)
+      if (lengths[i] > EPSILON)
+      {
+        PathSegment segment;
+        segment.waypoint_ = i;
+        segment.first_grid_point_ = grid_points;
+        // at least two steps, so that the path can be accelerated and decelerated
+        segment.steps_ = std::max<std::size_t>(2, (std::size_t)ceil(lengths[i] / path_resolution));
+        segment.step_ = lengths[i] / segment.steps_;
+        segments_.push_back(segment);
+        grid_points += segment.steps_;
+      }
+    if (segments_.empty())
+      return false;
+
+    // q' is the mean direction of the adjacent segments and q'' the change of direction over their
+    // mean length, as for a smooth curve through the waypoints
+    std::size_t n = segments_.size();
+    derivatives_.resize(n + 1);
+    second_derivatives_.resize(n + 1);
+    derivatives_[0] = directions[segments_[0].waypoint_];
+    second_derivatives_[0].setZero(v_max_.size());
+    for (std::size_t k = 1 ; k < n ; ++k)
+    {
+      std::size_t i = segments_[k - 1].waypoint_;
+      std::size_t j = segments_[k].waypoint_;
+      double length = lengths[i] + lengths[j];
+      derivatives_[k] = (lengths[i] * directions[i] + lengths[j] * directions[j]) / length;
+      second_derivatives_[k] = 2.0 * (directions[j] - directions[i]) / length;
+    }
+    derivatives_[n] = directions[segments_[n - 1].waypoint_];
+    second_derivatives_[n].setZero(v_max_.size());
+
+    x_.resize(grid_points + 1);
+    u_.resize(grid_points + 1);
+    x_min_.resize(grid_points + 1);
+    x_max_.resize(grid_points + 1);
+    return true;
+  }
+
+  // compute the squared path velocity at each grid point; returns false if the limits cannot be met
+  bool integrate()
+  {
+    // backward pass: the interval of x at each grid point from which the end can be reached at rest
+    std::size_t last = x_.size() - 1;
+    x_min_[last] = x_max_[last] = 0.0;
+    for (std::size_t k = segments_.size() ; k-- > 0 ; )
+    {
+      const PathSegment &segment = segments_[k];
+      for (std::size_t s = segment.steps_ ; s-- > 0 ; )
+      {
+        std::size_t g = segment.first_grid_point_ + s;
+        setConstraints(k, s, g);
+        double x_min, x_max;
+        constraints_.getFeasibleInterval(x_min, x_max);
+        if (x_max < x_min)
+        {
+          if (x_min - x_max > EPSILON * (1.0 + fabs(x_max)))
+          {
+            logError("The path cannot be followed within the joint limits near grid point %u", (unsigned int)g);
+            return false;
+          }
+          x_min = x_max;
+        }
+        x_min_[g] = x_min;
+        x_max_[g] = x_max;
+      }
+    }
+    if (x_min_[0] > EPSILON)
+    {
+      logError("The path cannot be followed from rest within the joint limits");
+      return false;
+    }
+
+    // forward pass: the largest acceleration that keeps the next grid point in its interval
+    x_[0] = 0.0;
+    for (std::size_t k = 0 ; k < segments_.size() ; ++k)
+    {
+      const PathSegment &segment = segments_[k];
+      for (std::size_t s = 0 ; s < segment.steps_ ; ++s)
+      {
+        std::size_t g = segment.first_grid_point_ + s;
+        setConstraints(k, s, g);
+        double u = std::max(constraints_.getMaxAcceleration(x_[g]), constraints_.getMinAcceleration(x_[g]));
+        double x = x_[g] + 2.0 * segment.step_ * u;
+        x_[g + 1] = std::max(x_min_[g + 1], std::min(x, x_max_[g + 1]));
+        u_[g] = (x_[g + 1] - x_[g]) / (2.0 * segment.step_);
+      }
+    }
+    u_[last] = last > 0 ? u_[last - 1] : 0.0;
+    return true;
+  }
+
+  // the time spent on a segment
+  double getDuration(std::size_t k) const
+  {
+    const PathSegment &segment = segments_[k];
+    double duration = 0.0;
+    for (std::size_t s = 0 ; s < segment.steps_ ; ++s)
+    {
+      std::size_t g = segment.first_grid_point_ + s;
+      duration += 2.0 * segment.step_ / (sqrt(x_[g]) + sqrt(x_[g + 1]));
+    }
+    return duration;
+  }
+
+  const std::vector<PathSegment>& getSegments() const
+  {
+    return segments_;
+  }
+
+  // the joint velocities and accelerations at the start of segment k (or at the end of the path for k = segment count)
+  void getWaypointDerivatives(std::size_t k, Eigen::VectorXd &velocity, Eigen::VectorXd &acceleration) const
+  {
+    std::size_t g = k < segments_.size() ? segments_[k].first_grid_point_ : x_.size() - 1;
+    velocity = derivatives_[k] * sqrt(x_[g]);
+    acceleration = derivatives_[k] * u_[g] + second_derivatives_[k] * x_[g];
+  }
+
+private:
+
+  typedef std::vector<Eigen::VectorXd> EigenSTLVectorXd;
+
+  // set the constraints of grid point g, which is at step s of segment k
+  void setConstraints(std::size_t k, std::size_t s, std::size_t g)
+  {
+    const PathSegment &segment = segments_[k];
+    double t = (double)s / segment.steps_;
+    qd_ = (1.0 - t) * derivatives_[k] + t * derivatives_[k + 1];
+    qdd_ = (1.0 - t) * second_derivatives_[k] + t * second_derivatives_[k + 1];
+
+    constraints_.clear();
+    for (int j = 0 ; j < qd_.size() ; ++j)
+    {
+      if (fabs(qd_[j]) > EPSILON)
+        constraints_.x_max_ = std::min(constraints_.x_max_, (v_max_[j] * v_max_[j]) / (qd_[j] * qd_[j]));
+      constraints_.add(qd_[j], qdd_[j], a_max_[j]);
+      constraints_.add(-qd_[j], -qdd_[j], a_max_[j]);
+    }
+
+    // the next grid point must be in its interval, which the backward pass has already computed
+    double h2 = 2.0 * segment.step_;
+    constraints_.add(h2, 1.0, x_max_[g + 1]);
+    constraints_.add(-h2, -1.0, -x_min_[g + 1]);
+  }
+
+  Eigen::VectorXd v_max_;
+  Eigen::VectorXd a_max_;
+
+  std::vector<PathSegment> segments_;
+  EigenSTLVectorXd derivatives_;
+  EigenSTLVectorXd second_derivatives_;
+
+  // per grid point
+  std::vector<double> x_;
+  std::vector<double> u_;
+  std::vector<double> x_min_;
+  std::vector<double> x_max_;
+
+  // scratch space
+  Eigen::VectorXd qd_;
+  Eigen::VectorXd qdd_;
+  GridConstraints constraints_;
+};
+
+// the limits of the variables with the given indices
+bool getLimits(const robot_model::RobotModel &rmodel, const std::vector<int> &idx, const double max_velocity_scaling_factor,
+               Eigen::VectorXd &v_max, Eigen::VectorXd &a_max)
+{
+  double velocity_scaling_factor = 1.0;
+  if (max_velocity_scaling_factor > 0.0 && max_velocity_scaling_factor <= 1.0)
+    velocity_scaling_factor = max_velocity_scaling_factor;
+  else
+    if (max_velocity_scaling_factor == 0.0)
+      logDebug("A max_velocity_scaling_factor of 0.0 was specified, defaulting to %f instead.", velocity_scaling_factor);
+    else
+      logWarn("Invalid max_velocity_scaling_factor %f specified, defaulting to %f instead.", max_velocity_scaling_factor, velocity_scaling_factor);
+
+  const std::vector<std::string> &vars = rmodel.getVariableNames();
+  v_max.resize(idx.size());
+  a_max.resize(idx.size());
+  for (std::size_t j = 0 ; j < idx.size() ; ++j)
+  {
+    const robot_model::VariableBounds &b = rmodel.getVariableBounds(vars[idx[j]]);
+    v_max[j] = DEFAULT_VEL_MAX;
+    if (b.velocity_bounded_)
+      v_max[j] = std::min(fabs(b.max_velocity_), fabs(b.min_velocity_));
+    v_max[j] *= velocity_scaling_factor;
+    a_max[j] = DEFAULT_ACCEL_MAX;
+    if (b.acceleration_bounded_)
+      a_max[j] = std::min(fabs(b.max_acceleration_), fabs(b.min_acceleration_));
+    if (v_max[j] <= 0.0 || a_max[j] <= 0.0)
+    {
+      logError("The velocity and acceleration limits of variable '%s' need to be positive", vars[idx[j]].c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+// compute the durations of count waypoints from their positions, and their velocities and accelerations;
+// all values are given one waypoint after the other
+bool parameterizePath(const double *positions, std::size_t count, const Eigen::VectorXd &v_max, const Eigen::VectorXd &a_max,
+                      double path_resolution, double *durations, double *velocities, double *accelerations)
+{
+  std::size_t n = v_max.size();
+  PathParameterizer parameterizer(v_max, a_max);
+  if (count < 2 || !parameterizer.setPath(positions, count, path_resolution))
+  {
+    // the robot does not move
+    std::fill(durations, durations + count, 0.0);
+    std::fill(velocities, velocities + count * n, 0.0);
+    std::fill(accelerations, accelerations + count * n, 0.0);
+    return true;
+  }
+
+  if (!parameterizer.integrate())
+    return false;
+
+  // waypoints that repeat the previous one get a duration of zero and the same derivatives
+  const std::vector<PathSegment> &segments = parameterizer.getSegments();
+  Eigen::VectorXd velocity;
+  Eigen::VectorXd acceleration;
+  std::size_t k = 0;
+  for (std::size_t i = 0 ; i < count ; ++i)
+  {
+    durations[i] = 0.0;
+    if (k < segments.size() && segments[k].waypoint_ < i)
+    {
+      durations[i] = parameterizer.getDuration(k);
+      ++k;
+    }
+
+    if (i == 0 || durations[i] > 0.0)
+      parameterizer.getWaypointDerivatives(k, velocity, acceleration);
+    Eigen::Map<Eigen::VectorXd>(velocities + i * n, n) = velocity;
+    Eigen::Map<Eigen::VectorXd>(accelerations + i * n, n) = acceleration;
+  }
+  return true;
+}
+
+}
+
+bool TimeOptimalTimeParameterization::computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory,
+                                                        const double max_velocity_scaling_factor) const
+{
+  if (trajectory.empty())
+    return true;
+
+  const robot_model::JointModelGroup *group = trajectory.getGroup();
+  if (!group)
+  {
+    logError("It looks like the planner did not set the group the plan was computed for");
+    return false;
+  }
+
+  const std::vector<int> &idx = group->getVariableIndexList();
+  Eigen::VectorXd v_max, a_max;
+  if (!getLimits(group->getParentModel(), idx, max_velocity_scaling_factor, v_max, a_max))
+    return false;
+
+  // the path is interpolated linearly between waypoints, so wrapped angles need to be unwound
+  trajectory.unwind();
+
+  const std::size_t num_points = trajectory.getWayPointCount();
+  const std::size_t num_joints = idx.size();
+  std::vector<double> positions(num_points * num_joints);
+  for (std::size_t i = 0 ; i < num_points ; ++i)
+  {
+    const robot_state::RobotState &waypoint = trajectory.getWayPoint(i);
+    for (std::size_t j = 0 ; j < num_joints ; ++j)
+      positions[i * num_joints + j] = waypoint.getVariablePosition(idx[j]);
+  }
+
+  std::vector<double> durations(num_points);
+  std::vector<double> velocities(num_points * num_joints);
+  std::vector<double> accelerations(num_points * num_joints);
+  if (!parameterizePath(&positions[0], num_points, v_max, a_max, path_resolution_,
+                        &durations[0], &velocities[0], &accelerations[0]))
+    return false;
+
+  for (std::size_t i = 0 ; i < num_points ; ++i)
+  {
+    trajectory.setWayPointDurationFromPrevious(i, durations[i]);
+    robot_state::RobotState &waypoint = *trajectory.getWayPointPtr(i);
+    for (std::size_t j = 0 ; j < num_joints ; ++j)
+    {
+      waypoint.setVariableVelocity(idx[j], velocities[i * num_joints + j]);
+      waypoint.setVariableAcceleration(idx[j], accelerations[i * num_joints + j]);
+    }
+  }
+  return true;
+}
+
+bool TimeOptimalTimeParameterization::computeTimeStamps(robot_trajectory::CompactRobotTrajectory& trajectory,
+                                                        const double max_velocity_scaling_factor) const
+{
+  if (trajectory.empty())
+    return true;
+
+  Eigen::VectorXd v_max, a_max;
+  if (!getLimits(*trajectory.getRobotModel(), trajectory.getVariableIndexList(), max_velocity_scaling_factor, v_max, a_max))
+    return false;
+
+  trajectory.unwind();
+
+  // the stored arrays are used in place
+  std::vector<double> durations(trajectory.getWayPointCount());
+  if (!parameterizePath(trajectory.getWayPointPositions(0), trajectory.getWayPointCount(), v_max, a_max, path_resolution_,
+                        &durations[0], trajectory.getWayPointVelocities(0), trajectory.getWayPointAccelerations(0)))
+    return false;
+  for (std::size_t i = 0 ; i < durations.size() ; ++i)
+    trajectory.setWayPointDurationFromPrevious(i, durations[i]);
+  return true;
+}
+
+}
@@ -0,0 +1,207 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/trajectory_processing/time_optimal_time_parameterization.h>
+#include <moveit/trajectory_processing/iterative_time_parameterization.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <urdf_parser/urdf_parser.h>
+#include <ros/package.h>
+#include <boost/filesystem/path.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <cmath>
+
+// the parameterizers fall back to these limits for variables without bounds
+static const double DEFAULT_VEL_MAX = 1.0;
+static const double DEFAULT_ACCEL_MAX = 1.0;
+
+// limits are compared with a small relative slack, to absorb the rounding of the path grid
+static const double LIMIT_TOLERANCE = 1e-3;
+
+class LoadPlanningModelsPr2 : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    std::string resource_dir = ros::package::getPath("moveit_resources");
+    if (resource_dir == "")
+    {
+      FAIL() << "Failed to find package moveit_resources.";
+      return;
+    }
+    boost::filesystem::path res_path(resource_dir);
+
+    srdf_model_.reset(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file((res_path / "test/urdf/robot.xml").string().c_str(), std::fstream::in);
+    if (xml_file.is_open())
+    {
+      while (xml_file.good())
+      {
+        std::string line;
+        std::getline(xml_file, line);
+        xml_string += (line + "\n");
+      }
+      xml_file.close();
+      urdf_model_ = urdf::parseURDF(xml_string);
+    }
+    ASSERT_TRUE(urdf_model_);
+    srdf_model_->initFile(*urdf_model_, (res_path / "test/srdf/robot.xml").string());
+    kmodel_.reset(new robot_model::RobotModel(urdf_model_, srdf_model_));
+  };
+
+  virtual void TearDown()
+  {
+  }
+
+  // a path for the right arm that runs straight through a few key configurations, with sharp corners between them
+  void makeArmPath(robot_trajectory::RobotTrajectory &trajectory) const
+  {
+    static const double KEY[4][7] = { {  0.0,  0.0,  0.0, -0.5,  0.0, -0.5, 0.0 },
+                                      { -0.6,  0.3, -0.4, -1.2,  0.5, -0.8, 0.7 },
+                                      {  0.2,  0.5,  0.3, -0.9, -0.4, -1.2, 1.5 },
+                                      {  0.5, -0.2,  0.6, -0.3,  0.2, -0.4, 0.3 } };
+    static const int STEPS = 10;
+
+    const std::vector<int> &idx = trajectory.getGroup()->getVariableIndexList();
+    ASSERT_EQ(idx.size(), 7u);
+
+    robot_state::RobotState state(kmodel_);
+    state.setToDefaultValues();
+    for (int k = 0 ; k < 3 ; ++k)
+      for (int i = k == 0 ? 0 : 1 ; i <= STEPS ; ++i)
+      {
+        for (std::size_t j = 0 ; j < idx.size() ; ++j)
+          state.setVariablePosition(idx[j], KEY[k][j] + (KEY[k + 1][j] - KEY[k][j]) * i / STEPS);
+        state.update();
+        trajectory.addSuffixWayPoint(state, 0.0);
+      }
+  }
+
+  // the same limits the parameterizers use for each variable of the group
+  void getLimits(const robot_model::JointModelGroup *group, std::vector<double> &v_max, std::vector<double> &a_max) const
+  {
+    const std::vector<int> &idx = group->getVariableIndexList();
+    const std::vector<std::string> &vars = kmodel_->getVariableNames();
+    v_max.resize(idx.size(), DEFAULT_VEL_MAX);
+    a_max.resize(idx.size(), DEFAULT_ACCEL_MAX);
+    for (std::size_t j = 0 ; j < idx.size() ; ++j)
+    {
+      const robot_model::VariableBounds &b = kmodel_->getVariableBounds(vars[idx[j]]);
+      if (b.velocity_bounded_)
+        v_max[j] = std::min(fabs(b.max_velocity_), fabs(b.min_velocity_));
+      if (b.acceleration_bounded_)
+        a_max[j] = std::min(fabs(b.max_acceleration_), fabs(b.min_acceleration_));
+    }
+  }
+
+protected:
+
+  boost::shared_ptr<urdf::ModelInterface> urdf_model_;
+  boost::shared_ptr<srdf::Model>          srdf_model_;
+  robot_model::RobotModelPtr              kmodel_;
+};
+
+TEST_F(LoadPlanningModelsPr2, RespectsJointLimits)
+{
+  robot_trajectory::RobotTrajectory trajectory(kmodel_, "right_arm");
+  makeArmPath(trajectory);
+  ASSERT_EQ(trajectory.getWayPointCount(), 31u);
+
+  trajectory_processing::TimeOptimalTimeParameterization topp;
+  ASSERT_TRUE(topp.computeTimeStamps(trajectory));
+
+  std::vector<double> v_max, a_max;
+  getLimits(trajectory.getGroup(), v_max, a_max);
+  const std::vector<int> &idx = trajectory.getGroup()->getVariableIndexList();
+
+  EXPECT_EQ(trajectory.getWayPointDurationFromPrevious(0), 0.0);
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    const robot_state::RobotState &waypoint = trajectory.getWayPoint(i);
+    ASSERT_TRUE(waypoint.hasVelocities());
+    ASSERT_TRUE(waypoint.hasAccelerations());
+    double dt = trajectory.getWayPointDurationFromPrevious(i);
+    if (i > 0)
+      EXPECT_GT(dt, 0.0) << "waypoint " << i;
+    for (std::size_t j = 0 ; j < idx.size() ; ++j)
+    {
+      EXPECT_LE(fabs(waypoint.getVariableVelocity(idx[j])), v_max[j] * (1.0 + LIMIT_TOLERANCE))
+        << "waypoint " << i << ", variable " << kmodel_->getVariableNames()[idx[j]];
+      EXPECT_LE(fabs(waypoint.getVariableAcceleration(idx[j])), a_max[j] * (1.0 + LIMIT_TOLERANCE))
+        << "waypoint " << i << ", variable " << kmodel_->getVariableNames()[idx[j]];
+
+      // the average velocity over a segment cannot exceed the limit either
+      if (i > 0 && dt > 0.0)
+      {
+        double dq = waypoint.getVariablePosition(idx[j]) - trajectory.getWayPoint(i - 1).getVariablePosition(idx[j]);
+        EXPECT_LE(fabs(dq) / dt, v_max[j] * (1.0 + LIMIT_TOLERANCE))
+          << "segment " << i << ", variable " << kmodel_->getVariableNames()[idx[j]];
+      }
+    }
+  }
+
+  // the path starts and ends at rest
+  for (std::size_t j = 0 ; j < idx.size() ; ++j)
+  {
+    EXPECT_NEAR(trajectory.getFirstWayPoint().getVariableVelocity(idx[j]), 0.0, 1e-6);
+    EXPECT_NEAR(trajectory.getLastWayPoint().getVariableVelocity(idx[j]), 0.0, 1e-6);
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, NotSlowerThanIterativeParabolic)
+{
+  robot_trajectory::RobotTrajectory topp_trajectory(kmodel_, "right_arm");
+  makeArmPath(topp_trajectory);
+  robot_trajectory::RobotTrajectory iptp_trajectory(kmodel_, "right_arm");
+  makeArmPath(iptp_trajectory);
+
+  trajectory_processing::TimeOptimalTimeParameterization topp;
+  ASSERT_TRUE(topp.computeTimeStamps(topp_trajectory));
+  trajectory_processing::IterativeParabolicTimeParameterization iptp;
+  ASSERT_TRUE(iptp.computeTimeStamps(iptp_trajectory));
+
+  ASSERT_EQ(topp_trajectory.getWayPointCount(), iptp_trajectory.getWayPointCount());
+  EXPECT_GT(topp_trajectory.getDuration(), 0.0);
+  EXPECT_LE(topp_trajectory.getDuration(), iptp_trajectory.getDuration());
+  logInform("Time-optimal duration %lf, iterative parabolic duration %lf",
+            topp_trajectory.getDuration(), iptp_trajectory.getDuration());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -49,6 +49,7 @@
 #include <moveit/kinematics_base/kinematics_base.h>
 #include <urdf/model.h>
 #include <tf_conversions/tf_kdl.h>
+#include <algorithm>
 
 // Need a floating point tolerance when checking joint limits, in case the joint starts at limit
 const double LIMIT_TOLERANCE = .0000001;
@@ -245,6 +246,21 @@ public:
                         moveit_msgs::MoveItErrorCodes &error_code,
                         const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
 
+  /**
+   * @brief Solve a batch of independent IK queries. Without free parameters the IKFast solver is evaluated
+   * directly for each pose, reusing the solution buffers across the batch: the solutions within joint limits
+   * are passed to the callback in order of increasing distance to the seed of the query, and the first one
+   * it accepts is returned. Every seed must have one value per joint. With a free joint each query is a
+   * search over it, and searchPositionIK() is called once per query.
+   */
+  bool searchPositionIKBatch(const std::vector<geometry_msgs::Pose> &ik_poses,
+                             const std::vector<std::vector<double> > &ik_seed_states,
+                             double timeout,
+                             std::vector<std::vector<double> > &solutions,
+                             const IKCallbackFn &solution_callback,
+                             std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+                             const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
+
   /**
    * @brief Given a set of joint angles and a set of links, compute their pose
    *
@@ -982,6 +998,94 @@ bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose
   return false;
 }
 
+bool IKFastKinematicsPlugin::searchPositionIKBatch(const std::vector<geometry_msgs::Pose> &ik_poses,
+                                                   const std::vector<std::vector<double> > &ik_seed_states,
+                                                   double timeout,
+                                                   std::vector<std::vector<double> > &solutions,
+                                                   const IKCallbackFn &solution_callback,
+                                                   std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+                                                   const kinematics::KinematicsQueryOptions &options) const
+{
+  if(free_params_.size() != 0)
+    return kinematics::KinematicsBase::searchPositionIKBatch(ik_poses, ik_seed_states, timeout, solutions,
+                                                             solution_callback, error_codes, options);
+
+  solutions.clear();
+  solutions.resize(ik_poses.size());
+  error_codes.resize(ik_poses.size());
+  bool valid_seeds = ik_seed_states.size() == 1 || ik_seed_states.size() == ik_poses.size();
+  for(std::size_t i = 0; valid_seeds && i < ik_seed_states.size(); ++i)
+    valid_seeds = ik_seed_states[i].size() == num_joints_;
+  if(!active_ || !valid_seeds)
+  {
+    if(!active_)
+      ROS_ERROR_NAMED("ikfast","Kinematics not active");
+    else
+      ROS_ERROR_NAMED("ikfast","Expected 1 or %u seed states of size %u", (unsigned int)ik_poses.size(), (unsigned int)num_joints_);
+    for(std::size_t i = 0; i < error_codes.size(); ++i)
+      error_codes[i].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  KDL::Frame frame;
+  const std::vector<double> vfree;
+  IkSolutionList<IkReal> ik_solutions;
+  std::vector<double> sol(num_joints_);
+  std::vector<std::pair<double, int> > candidates; // distance to the seed and index of solutions within limits
+  bool all_solved = true;
+
+  for(std::size_t p = 0; p < ik_poses.size(); ++p)
+  {
+    error_codes[p].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    const std::vector<double> &seed = ik_seed_states.size() == 1 ? ik_seed_states[0] : ik_seed_states[p];
+    tf::poseMsgToKDL(ik_poses[p],frame);
+    int numsol = solve(frame,vfree,ik_solutions);
+
+    candidates.clear();
+    for(int s = 0; s < numsol; ++s)
+    {
+      // without free parameters there are no free values to fill in
+      ik_solutions.GetSolution(s).GetSolution(&sol[0],NULL);
+
+      bool obeys_limits = true;
+      double distance = 0.0;
+      for(unsigned int i = 0; i < sol.size(); i++)
+      {
+        if(joint_has_limits_vector_[i] && ( (sol[i] < (joint_min_vector_[i]-LIMIT_TOLERANCE)) ||
+                                            (sol[i] > (joint_max_vector_[i]+LIMIT_TOLERANCE)) ) )
+        {
+          obeys_limits = false;
+          break;
+        }
+        distance += fabs(sol[i] - seed[i]);
+      }
+      if(obeys_limits)
+        candidates.push_back(std::make_pair(distance, s));
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for(std::size_t c = 0; c < candidates.size(); ++c)
+    {
+      ik_solutions.GetSolution(candidates[c].second).GetSolution(&sol[0],NULL);
+      if(!solution_callback.empty())
+        solution_callback(ik_poses[p], sol, error_codes[p]);
+      else
+        error_codes[p].val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+
+      if(error_codes[p].val == moveit_msgs::MoveItErrorCodes::SUCCESS)
+      {
+        solutions[p] = sol;
+        break;
+      }
+    }
+
+    if(error_codes[p].val != moveit_msgs::MoveItErrorCodes::SUCCESS)
+      all_solved = false;
+  }
+
+  return all_solved;
+}
+
 // Used when there are no redundant joints - aka no free params
 bool IKFastKinematicsPlugin::getPositionIK(const geometry_msgs::Pose &ik_pose,
                                            const std::vector<double> &ik_seed_state,
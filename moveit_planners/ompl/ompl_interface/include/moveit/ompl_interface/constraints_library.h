@@ -42,6 +42,7 @@
 #include <ompl/base/StateStorage.h>
 #include <boost/function.hpp>
 #include <boost/serialization/map.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace ompl_interface
 {
@@ -49,6 +50,38 @@ namespace ompl_interface
 typedef std::pair<std::vector<std::size_t>, std::map<std::size_t, std::pair<std::size_t, std::size_t> > > ConstrainedStateMetadata;
 typedef ompl::base::StateStorageWithMetadata<ConstrainedStateMetadata> ConstraintApproximationStateStorage;
 
+/** \brief Read-only view of the states and connections of a constraint approximation. States with index less than the
+    milestone count are graph nodes; the remaining states are the explicit motions stored between pairs of nodes. */
+class ConstraintApproximationDatabase
+{
+public:
+
+  virtual ~ConstraintApproximationDatabase()
+  {
+  }
+
+  virtual const ompl::base::StateSpacePtr& getStateSpace() const = 0;
+
+  /** \brief The total number of stored states (milestones and explicit motion states) */
+  virtual std::size_t size() const = 0;
+
+  /** \brief Copy the state at \e index to \e state */
+  virtual void copyState(std::size_t index, ompl::base::State *state) const = 0;
+
+  /** \brief The number of milestones connected to \e milestone */
+  virtual std::size_t getConnectionCount(std::size_t milestone) const = 0;
+
+  /** \brief The index of the \e k-th milestone connected to \e milestone */
+  virtual std::size_t getConnection(std::size_t milestone, std::size_t k) const = 0;
+
+  /** \brief Get the range [\e first, \e last) of states describing the motion from milestone \e from to milestone \e to.
+      Return false if no explicit motion is stored for this pair. */
+  virtual bool getMotion(std::size_t from, std::size_t to, std::size_t &first, std::size_t &last) const = 0;
+};
+
+typedef boost::shared_ptr<ConstraintApproximationDatabase> ConstraintApproximationDatabasePtr;
+typedef boost::shared_ptr<const ConstraintApproximationDatabase> ConstraintApproximationDatabaseConstPtr;
+
 class ConstraintApproximation;
 typedef boost::shared_ptr<ConstraintApproximation> ConstraintApproximationPtr;
 typedef boost::shared_ptr<const ConstraintApproximation> ConstraintApproximationConstPtr;
@@ -61,6 +94,12 @@ public:
                           const moveit_msgs::Constraints &msg, const std::string &filename, const ompl::base::StateStoragePtr &storage,
                           std::size_t milestones = 0);
 
+  /** \brief Construct an approximation whose states are in the file \e path. The file is only opened
+      (and memory-mapped, if it is in the binary format) the first time the approximation is used. */
+  ConstraintApproximation(const std::string &group, const std::string &state_space_parameterization, bool explicit_motions,
+                          const moveit_msgs::Constraints &msg, const std::string &filename, const std::string &path,
+                          const ompl::base::StateSpacePtr &space, std::size_t milestones);
+
   virtual ~ConstraintApproximation()
   {
   }
@@ -104,11 +143,15 @@ public:
     return constraint_msg_;
   }
 
+  /** \brief The OMPL state storage this approximation was constructed from. Empty for approximations loaded from a file. */
   const ompl::base::StateStoragePtr& getStateStorage() const
   {
     return state_storage_ptr_;
   }
 
+  /** \brief Get the stored states, loading them if this has not been done yet. Returns an empty pointer if loading fails. */
+  ConstraintApproximationDatabaseConstPtr getDatabase() const;
+
   const std::string& getFilename() const
   {
     return ompldb_filename_;
@@ -125,9 +168,14 @@ protected:
   std::vector<int> space_signature_;
 
   std::string ompldb_filename_;
+  std::string ompldb_path_;
+  ompl::base::StateSpacePtr state_space_;
   ompl::base::StateStoragePtr state_storage_ptr_;
-  ConstraintApproximationStateStorage *state_storage_;
   std::size_t milestones_;
+
+  mutable ConstraintApproximationDatabaseConstPtr database_;
+  mutable bool database_loaded_;
+  mutable boost::mutex database_lock_;
 };
 
 struct ConstraintApproximationConstructionOptions
@@ -138,7 +186,8 @@ struct ConstraintApproximationConstructionOptions
     max_edge_length(std::numeric_limits<double>::infinity()),
     explicit_motions(false),
     explicit_points_resolution(0.0),
-    max_explicit_points(0)
+    max_explicit_points(0),
+    threads(1)
   {
   }
 
@@ -149,15 +198,40 @@ struct ConstraintApproximationConstructionOptions
   bool explicit_motions;
   double explicit_points_resolution;
   unsigned int max_explicit_points;
+
+  /** \brief The number of threads used for sampling and connecting milestones (0 means one per core). Milestones are
+      sampled by one thread if the kinematics solvers of the group do not support concurrent queries */
+  unsigned int threads;
 };
 
 struct ConstraintApproximationConstructionResults
 {
+  ConstraintApproximationConstructionResults() :
+    milestones(0),
+    state_sampling_time(0.0),
+    state_connection_time(0.0),
+    sampling_success_rate(0.0),
+    existing_milestones(0),
+    sampling_attempts(0),
+    candidate_connections(0),
+    connections(0)
+  {
+  }
+
   ConstraintApproximationPtr approx;
   std::size_t                milestones;
   double                     state_sampling_time;
   double                     state_connection_time;
   double                     sampling_success_rate;
+
+  /** \brief The number of milestones taken from the approximation that was extended */
+  std::size_t                existing_milestones;
+  /** \brief The number of states sampled to find the new milestones */
+  std::size_t                sampling_attempts;
+  /** \brief The number of nearby milestone pairs whose connecting motion was checked */
+  std::size_t                candidate_connections;
+  /** \brief The number of connections added (not counting those of the approximation that was extended) */
+  std::size_t                connections;
 };
 
 class ConstraintsLibrary
@@ -182,6 +256,19 @@ public:
                              const std::string &group, const planning_scene::PlanningSceneConstPtr &scene,
                              const ConstraintApproximationConstructionOptions &options);
 
+  /** \brief Sample more milestones for the approximation with the name of \e constr_hard until it has \e options.samples
+      of them, and connect the new milestones. Existing milestones and connections are kept. If there is no such
+      approximation, a new one is constructed. */
+  ConstraintApproximationConstructionResults
+  extendConstraintApproximation(const moveit_msgs::Constraints &constr_sampling, const moveit_msgs::Constraints &constr_hard,
+                                const std::string &group, const planning_scene::PlanningSceneConstPtr &scene,
+                                const ConstraintApproximationConstructionOptions &options);
+
+  ConstraintApproximationConstructionResults
+  extendConstraintApproximation(const moveit_msgs::Constraints &constr,
+                                const std::string &group, const planning_scene::PlanningSceneConstPtr &scene,
+                                const ConstraintApproximationConstructionOptions &options);
+
   void printConstraintApproximations(std::ostream &out = std::cout) const;
   void clearConstraintApproximations();
 
@@ -194,9 +281,16 @@ public:
 
 private:
 
+  ConstraintApproximationConstructionResults
+  buildConstraintApproximation(const moveit_msgs::Constraints &constr_sampling, const moveit_msgs::Constraints &constr_hard,
+                               const std::string &group, const planning_scene::PlanningSceneConstPtr &scene,
+                               const ConstraintApproximationConstructionOptions &options,
+                               const ConstraintApproximationConstPtr &existing);
+
   ompl::base::StateStoragePtr constructConstraintApproximation(const ModelBasedPlanningContextPtr &pcontext,
                                                                const moveit_msgs::Constraints &constr_sampling, const moveit_msgs::Constraints &constr_hard,
                                                                const ConstraintApproximationConstructionOptions &options,
+                                                               const ConstraintApproximationConstPtr &existing,
                                                                ConstraintApproximationConstructionResults &result);
 
   const PlanningContextManager &context_manager_;
@@ -38,19 +38,76 @@
 #define MOVEIT_OMPL_INTERFACE_DETAIL_CONSTRAINED_GOAL_SAMPLER_
 
 #include <ompl/base/goals/GoalLazySamples.h>
+#include <ompl/util/Time.h>
 #include <moveit/kinematic_constraints/kinematic_constraint.h>
 #include <moveit/constraint_samplers/constraint_sampler.h>
 
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/robot_model/joint_model_group.h>
 
+#include <boost/lockfree/queue.hpp>
+#include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
+
 namespace ompl_interface
 {
 
 class ModelBasedPlanningContext;
 
+/** @brief Goal sampling statistics of one planning attempt */
+struct GoalSamplingStatistics
+{
+  GoalSamplingStatistics()
+    : samples_(0)
+    , sampler_failures_(0)
+    , constraint_failures_(0)
+    , invalid_states_(0)
+    , goals_(0)
+    , duration_(0.0)
+  {
+  }
+
+  /** @brief Number of states requested from the constraint sampler */
+  unsigned int samples_;
+
+  /** @brief Number of requests the constraint sampler could not fulfill (usually IK failures) */
+  unsigned int sampler_failures_;
+
+  /** @brief Number of sampled states that did not satisfy the goal constraints */
+  unsigned int constraint_failures_;
+
+  /** @brief Number of sampled states that were not valid */
+  unsigned int invalid_states_;
+
+  /** @brief Number of valid goal states produced */
+  unsigned int goals_;
+
+  /** @brief Time (seconds) spent sampling */
+  double duration_;
+
+  double samplesPerSecond() const
+  {
+    return duration_ > 0.0 ? samples_ / duration_ : 0.0;
+  }
+
+  double goalsPerSecond() const
+  {
+    return duration_ > 0.0 ? goals_ / duration_ : 0.0;
+  }
+
+  /** @brief The fraction of samples the constraint sampler failed to produce */
+  double samplerFailureRate() const
+  {
+    return samples_ > 0 ? (double)sampler_failures_ / (double)samples_ : 0.0;
+  }
+};
+
 /** @class ConstrainedGoalSampler
- *  An interface to the OMPL goal lazy sampler*/
+ *  An interface to the OMPL goal lazy sampler.
+ *
+ *  With more than one constraint sampler, one worker thread is run per sampler. The workers pass validated
+ *  goal states through a bounded lock-free queue to the sampling thread of GoalLazySamples, which only
+ *  collects them. Workers pause while the queue is full. */
 class ConstrainedGoalSampler : public ompl::base::GoalLazySamples
 {
 public:
@@ -58,9 +115,49 @@ public:
   ConstrainedGoalSampler(const ModelBasedPlanningContext *pc, const kinematic_constraints::KinematicConstraintSetPtr &ks,
                          const constraint_samplers::ConstraintSamplerPtr &cs = constraint_samplers::ConstraintSamplerPtr());
 
+  /** @brief Sample goals in parallel, using one worker thread for each of the constraint samplers \e cs */
+  ConstrainedGoalSampler(const ModelBasedPlanningContext *pc, const kinematic_constraints::KinematicConstraintSetPtr &ks,
+                         const std::vector<constraint_samplers::ConstraintSamplerPtr> &cs);
+
+  virtual ~ConstrainedGoalSampler();
+
+  /** @brief Get the statistics of the current or most recent planning attempt */
+  GoalSamplingStatistics getSamplingStatistics() const;
+
+  /** @brief Start sampling for a new planning attempt. The statistics are reset and the workers restarted
+      when the next goal is sampled, even if the sampling thread is still running. */
+  void startSamplingSession();
+
 private:
 
+  struct Worker
+  {
+    constraint_samplers::ConstraintSamplerPtr sampler_;
+    robot_state::RobotState                   work_state_;
+    ompl::base::State                        *scratch_;
+
+    Worker(const constraint_samplers::ConstraintSamplerPtr &sampler, const robot_state::RobotState &state)
+      : sampler_(sampler)
+      , work_state_(state)
+      , scratch_(NULL)
+    {
+    }
+  };
+
+  typedef boost::lockfree::queue<ompl::base::State*, boost::lockfree::fixed_sized<true> > StateQueue;
+
+  void initialize();
   bool sampleUsingConstraintSampler(const ompl::base::GoalLazySamples *gls, ompl::base::State *new_goal);
+  bool collectFromWorkers(const ompl::base::GoalLazySamples *gls, ompl::base::State *new_goal);
+  bool sampleGoal(constraint_samplers::ConstraintSampler *sampler, robot_state::RobotState &work_state,
+                  ompl::base::State *new_goal, bool verbose);
+  bool shouldStop(const ompl::base::GoalLazySamples *gls) const;
+  bool claimAttempt(bool &verbose);
+  void recordSample(unsigned int sampler_failures, unsigned int constraint_failures, unsigned int invalid_states, unsigned int goals);
+  void resetStatistics();
+  void startWorkers();
+  void stopWorkers();
+  void workerThread(Worker *worker);
   bool stateValidityCallback(ompl::base::State* new_goal, robot_state::RobotState const* state,
                               const robot_model::JointModelGroup*, const double*, bool verbose=false) const;
   bool checkStateValidity(ompl::base::State* new_goal, const robot_state::RobotState& state, bool verbose=false) const;
@@ -72,7 +169,26 @@ private:
   robot_state::RobotState                          work_state_;
   unsigned int                                     invalid_sampled_constraints_;
   bool                                             warned_invalid_samples_;
-  unsigned int                                     verbose_display_;
+  unsigned int                                     verbose_display_;  // guarded by stats_lock_
+
+  /* parallel sampling; used only when there is more than one constraint sampler */
+  std::vector<Worker*>                             workers_;
+  boost::scoped_ptr<boost::thread_group>           worker_threads_;
+  unsigned int                                     session_;          // incremented for every planning attempt; guarded by stats_lock_
+  unsigned int                                     sampled_session_;  // the session the sampling thread last worked on
+  bool                                             stop_workers_;
+  unsigned int                                     running_workers_;
+  unsigned int                                     worker_attempts_;
+  std::vector<ompl::base::State*>                  pool_;
+  boost::scoped_ptr<StateQueue>                    ready_goals_;
+  boost::scoped_ptr<StateQueue>                    free_states_;
+  boost::mutex                                     wait_lock_;
+  boost::condition_variable                        goal_ready_;
+  boost::condition_variable                        state_freed_;
+
+  mutable boost::mutex                             stats_lock_;
+  GoalSamplingStatistics                           stats_;
+  ompl::time::point                                stats_start_;
 };
 }
 
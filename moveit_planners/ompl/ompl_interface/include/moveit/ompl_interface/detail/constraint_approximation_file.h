@@ -0,0 +1,60 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_OMPL_INTERFACE_DETAIL_CONSTRAINT_APPROXIMATION_FILE_
+#define MOVEIT_OMPL_INTERFACE_DETAIL_CONSTRAINT_APPROXIMATION_FILE_
+
+#include <moveit/ompl_interface/constraints_library.h>
+
+namespace ompl_interface
+{
+
+/** \brief Check whether \e filename starts with the header of the binary constraint approximation format.
+    Files written by ompl::base::StateStorage do not. */
+bool isConstraintApproximationFile(const std::string &filename);
+
+/** \brief Map \e filename into memory read-only. States are deserialized directly from the mapped pages when
+    they are requested, so the file is never parsed as a whole and its pages are shared by all processes that
+    use it. Returns an empty pointer if the file cannot be mapped, was not written for \e space, or has sections
+    or graph indices that point outside of the file. */
+ConstraintApproximationDatabasePtr mapConstraintApproximationFile(const std::string &filename, const ompl::base::StateSpacePtr &space);
+
+/** \brief Write the first \e milestones states of \e database as graph nodes, followed by the remaining states,
+    in the binary format. The file is written under a temporary name and renamed into place, so processes that
+    have the previous version of \e filename mapped are not affected. */
+bool saveConstraintApproximationFile(const std::string &filename, const ConstraintApproximationDatabase &database, std::size_t milestones);
+
+}
+
+#endif
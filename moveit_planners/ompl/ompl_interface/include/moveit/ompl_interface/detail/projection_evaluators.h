@@ -57,6 +57,9 @@ public:
   virtual void defaultCellSizes();
   virtual void project(const ompl::base::State *state, ompl::base::EuclideanProjection &projection) const;
 
+  /** \brief Use \e state for the variables outside of the planning group */
+  void setStartState(const robot_state::RobotState &state);
+
 private:
 
   const ModelBasedPlanningContext *planning_context_;
@@ -73,6 +73,10 @@ public:
 
   void setVerbose(bool flag);
 
+  /** \brief Use \e state for the variables outside of the planning group, instead of the initial state
+      of the planning context at construction time */
+  void setStartState(const robot_state::RobotState &state);
+
 protected:
 
   bool isValidWithoutCache(const ompl::base::State *state, bool verbose) const;
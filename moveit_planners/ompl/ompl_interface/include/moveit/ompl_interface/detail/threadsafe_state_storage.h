@@ -38,11 +38,18 @@
 #define MOVEIT_OMPL_INTERFACE_DEATIL_THREADSAFE_STATE_STORAGE_
 
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/background_processing/thread_local_cache.h>
 #include <boost/thread.hpp>
+#include <boost/atomic.hpp>
 
 namespace ompl_interface
 {
 
+/** \brief Keeps a separate copy of a robot state for each thread that asks for one.
+    The copies are kept in thread local storage; retrieving an up to date copy does not lock,
+    only copying the start state into it does. They are released when their thread exits or, after this storage is destroyed,
+    the next time their thread needs a new copy. After setStartState(), each thread
+    copies the new start state into its state the next time it asks for it. */
 class TSStateStorage
 {
 public:
@@ -53,11 +60,37 @@ public:
 
   robot_state::RobotState* getStateStorage() const;
 
+  /** \brief Replace the state the per-thread copies start from. Threads that use the storage meanwhile
+      pick up the new state the next time they ask for their copy. */
+  void setStartState(const robot_state::RobotState &start_state);
+
 private:
 
+  TSStateStorage(const TSStateStorage&);
+  TSStateStorage& operator=(const TSStateStorage&);
+
+  /// the copy kept by one thread
+  struct ThreadState
+  {
+    ThreadState(const robot_state::RobotState &state, std::size_t start_state_version)
+      : state_(state)
+      , start_state_version_(start_state_version)
+    {
+    }
+
+    robot_state::RobotState state_;
+    std::size_t             start_state_version_;
+  };
+
   robot_state::RobotState                                       start_state_;
-  mutable std::map<boost::thread::id, robot_state::RobotState*> thread_states_;
-  mutable boost::mutex                                                  lock_;
+
+  /// incremented by setStartState(), so threads know their copy is out of date
+  boost::atomic<std::size_t>                                    start_state_version_;
+
+  /// protects start_state_ and the changes of start_state_version_
+  mutable boost::mutex                                          start_state_lock_;
+
+  moveit::tools::ThreadLocalCache<ThreadState>                  thread_states_;
 };
 
 }
@@ -91,6 +91,16 @@ public:
   virtual void clear();
   virtual bool terminate();
 
+  /** \brief Clear the start state, goals and path constraints, but keep the planner, the state validity checker and
+      the state space settings, so that configure() does not set them up again if the next problem allows it */
+  void clearProblem();
+
+  /** \brief Return true if the planner and state validity checker are set up and can be kept for the next problem */
+  bool isConfigured() const
+  {
+    return configured_;
+  }
+
   const ModelBasedPlanningContextSpecification& getSpecification() const
   {
     return spec_;
@@ -187,6 +197,24 @@ public:
     max_goal_samples_ = max_goal_samples;
   }
 
+  /* \brief Get the number of threads used to sample goal states */
+  unsigned int getMaximumGoalSamplingThreads() const
+  {
+    return max_goal_sampling_threads_;
+  }
+
+  /* \brief Set the number of threads used to sample goal states. Each thread uses its own constraint sampler;
+     since the samplers share the kinematics solvers of the group, one thread is used unless the solvers support
+     concurrent queries */
+  void setMaximumGoalSamplingThreads(unsigned int max_goal_sampling_threads)
+  {
+    max_goal_sampling_threads_ = max_goal_sampling_threads;
+  }
+
+  /* \brief Check whether the kinematics solvers of the group, which the constraint samplers of all threads share,
+     can be queried from several threads */
+  bool supportsConcurrentIK() const;
+
   /* \brief Get the maximum number of planning threads allowed */
   unsigned int getMaximumPlanningThreads() const
   {
@@ -323,6 +351,9 @@ protected:
   virtual void useConfig();
   virtual ob::GoalPtr constructGoal();
 
+  /// pass the initial state to the state validity checker and projections of a configured context
+  void setStartStateOutsideGroup();
+
   void registerTerminationCondition(const ob::PlannerTerminationCondition &ptc);
   void unregisterTerminationCondition();
 
@@ -363,6 +394,9 @@ protected:
   /// maximum number of attempts to be made at sampling a goal states
   unsigned int                                            max_goal_sampling_attempts_;
 
+  /// number of threads sampling goal states concurrently
+  unsigned int                                            max_goal_sampling_threads_;
+
   /// when planning in parallel, this is the maximum number of threads to use at one time
   unsigned int                                            max_planning_threads_;
 
@@ -375,6 +409,12 @@ protected:
   bool                                                    use_state_validity_cache_;
 
   bool                                                    simplify_solutions_;
+
+  /// true if configure() set up the planner and state validity checker for the current attached bodies and planning volume
+  bool                                                    configured_;
+
+  /// the planning volume last set with setPlanningVolume()
+  moveit_msgs::WorkspaceParameters                        planning_volume_;
 };
 
 }
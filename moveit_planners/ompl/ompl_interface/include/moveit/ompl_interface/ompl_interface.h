@@ -159,9 +159,12 @@ protected:
   /** @brief Configure the planners*/
   void loadPlannerConfigurations();
 
-  /** @brief Load the additional plugins for sampling constraints */
+  /** @brief Load the additional plugins for sampling constraints and the number of goal sampling threads */
   void loadConstraintSamplers();
 
+  /** @brief Load the size and eviction policy of the planning context cache, and whether cached contexts keep their configuration */
+  void loadContextCacheSettings();
+
   void configureContext(const ModelBasedPlanningContextPtr &context) const;
 
   /** \brief Configure the OMPL planning context for a new planning request */
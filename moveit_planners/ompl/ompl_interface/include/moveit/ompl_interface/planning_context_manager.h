@@ -53,6 +53,16 @@ class PlanningContextManager
 {
 public:
 
+  /** \brief How a cached planning context is chosen for removal when the cache is full */
+  enum ContextEvictionPolicy
+    {
+      /** \brief Remove the context that was not used for the longest time */
+      EVICT_LEAST_RECENTLY_USED,
+
+      /** \brief Remove the context that was used the least number of times */
+      EVICT_LEAST_FREQUENTLY_USED
+    };
+
   PlanningContextManager(const robot_model::RobotModelConstPtr &kmodel, const constraint_samplers::ConstraintSamplerManagerPtr &csm);
   ~PlanningContextManager();
 
@@ -102,6 +112,18 @@ public:
     max_goal_samples_ = max_goal_samples;
   }
 
+  /* \brief Get the number of threads used to sample goal states */
+  unsigned int getMaximumGoalSamplingThreads() const
+  {
+    return max_goal_sampling_threads_;
+  }
+
+  /* \brief Set the number of threads used to sample goal states */
+  void setMaximumGoalSamplingThreads(unsigned int max_goal_sampling_threads)
+  {
+    max_goal_sampling_threads_ = max_goal_sampling_threads;
+  }
+
   /* \brief Get the maximum number of planning threads allowed */
   unsigned int getMaximumPlanningThreads() const
   {
@@ -137,6 +159,42 @@ public:
     minimum_waypoint_count_ = mwc;
   }
 
+  /** \brief Get the maximum number of planning contexts kept for reuse; 0 means there is no limit */
+  unsigned int getMaximumCachedContexts() const
+  {
+    return max_cached_contexts_;
+  }
+
+  /** \brief Set the maximum number of planning contexts kept for reuse; 0 means there is no limit */
+  void setMaximumCachedContexts(unsigned int max_cached_contexts)
+  {
+    max_cached_contexts_ = max_cached_contexts;
+  }
+
+  ContextEvictionPolicy getContextEvictionPolicy() const
+  {
+    return context_eviction_policy_;
+  }
+
+  /** \brief Set how a cached planning context is chosen for removal when the cache is full */
+  void setContextEvictionPolicy(ContextEvictionPolicy policy)
+  {
+    context_eviction_policy_ = policy;
+  }
+
+  bool getReuseContextConfiguration() const
+  {
+    return reuse_context_configuration_;
+  }
+
+  /** \brief If true, a reused planning context keeps its configured planner and state validity checker, and only
+      the planning scene, start state and goals are set for a new request (as long as the attached bodies and the
+      planning volume stay the same). Otherwise the context is configured from scratch for every request. */
+  void setReuseContextConfiguration(bool flag)
+  {
+    reuse_context_configuration_ = flag;
+  }
+
   const robot_model::RobotModelConstPtr& getRobotModel() const
   {
     return kmodel_;
@@ -211,6 +269,9 @@ protected:
   /// maximum number of attempts to be made at sampling goals
   unsigned int                                          max_goal_sampling_attempts_;
 
+  /// number of threads sampling goal states concurrently
+  unsigned int                                          max_goal_sampling_threads_;
+
   /// when planning in parallel, this is the maximum number of threads to use at one time
   unsigned int                                          max_planning_threads_;
 
@@ -220,6 +281,15 @@ protected:
   /// the minimum number of points to include on the solution path (interpolation is used to reach this number, if needed)
   unsigned int                                          minimum_waypoint_count_;
 
+  /// the maximum number of planning contexts to keep for reuse (0 for no limit)
+  unsigned int                                          max_cached_contexts_;
+
+  /// how a context is chosen for removal when max_cached_contexts_ is reached
+  ContextEvictionPolicy                                 context_eviction_policy_;
+
+  /// keep the configuration of reused contexts (planner, state validity checker) when possible
+  bool                                                  reuse_context_configuration_;
+
 private:
 
   class LastPlanningContext;
@@ -36,10 +36,13 @@
 
 #include <moveit/ompl_interface/constraints_library.h>
 #include <moveit/ompl_interface/detail/constrained_sampler.h>
+#include <moveit/ompl_interface/detail/constraint_approximation_file.h>
 #include <moveit/profiler/profiler.h>
 #include <ompl/tools/config/SelfConfig.h>
+#include <ompl/datastructures/NearestNeighborsGNAT.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
 #include <fstream>
 
 namespace ompl_interface
@@ -80,20 +83,78 @@ void hexToMsg(const std::string &hex, T& msg)
 }
 }
 
+/** \brief Database view of the ompl::base::StateStorage used while constructing approximations and for files in the OMPL format */
+class StoredConstraintApproximationDatabase : public ConstraintApproximationDatabase
+{
+public:
+
+  StoredConstraintApproximationDatabase(const ob::StateStoragePtr &storage) :
+    storage_ptr_(storage), storage_(static_cast<const ConstraintApproximationStateStorage*>(storage.get()))
+  {
+  }
+
+  virtual const ob::StateSpacePtr& getStateSpace() const
+  {
+    return storage_->getStateSpace();
+  }
+
+  virtual std::size_t size() const
+  {
+    return storage_->size();
+  }
+
+  virtual void copyState(std::size_t index, ob::State *state) const
+  {
+    storage_->getStateSpace()->copyState(state, storage_->getState(index));
+  }
+
+  virtual std::size_t getConnectionCount(std::size_t milestone) const
+  {
+    return storage_->getMetadata(milestone).first.size();
+  }
+
+  virtual std::size_t getConnection(std::size_t milestone, std::size_t k) const
+  {
+    return storage_->getMetadata(milestone).first[k];
+  }
+
+  virtual bool getMotion(std::size_t from, std::size_t to, std::size_t &first, std::size_t &last) const
+  {
+    const ConstrainedStateMetadata &md = storage_->getMetadata(from);
+    std::map<std::size_t, std::pair<std::size_t, std::size_t> >::const_iterator it = md.second.find(to);
+    if (it == md.second.end())
+      return false;
+    first = it->second.first;
+    last = it->second.second;
+    return true;
+  }
+
+private:
+
+  ob::StateStoragePtr storage_ptr_;
+  const ConstraintApproximationStateStorage *storage_;
+};
+
 class ConstraintApproximationStateSampler : public ob::StateSampler
 {
 public:
 
-  ConstraintApproximationStateSampler(const ob::StateSpace *space, const ConstraintApproximationStateStorage *state_storage, std::size_t milestones) :
-    ob::StateSampler(space), state_storage_(state_storage)
+  ConstraintApproximationStateSampler(const ob::StateSpace *space, const ConstraintApproximationDatabaseConstPtr &database, std::size_t milestones) :
+    ob::StateSampler(space), database_(database)
   {
     max_index_ = milestones - 1;
     inv_dim_ = space->getDimension() > 0 ? 1.0 / (double)space->getDimension() : 1.0;
+    stored_state_ = space_->allocState();
+  }
+
+  virtual ~ConstraintApproximationStateSampler()
+  {
+    space_->freeState(stored_state_);
   }
 
   virtual void sampleUniform(ob::State *state)
   {
-    space_->copyState(state, state_storage_->getState(rng_.uniformInt(0, max_index_)));
+    database_->copyState(rng_.uniformInt(0, max_index_), state);
   }
 
   virtual void sampleUniformNear(ob::State *state, const ob::State *near, const double distance)
@@ -103,14 +164,14 @@ public:
 
     if (tag >= 0)
     {
-      const ConstrainedStateMetadata &md = state_storage_->getMetadata(tag);
-      if (!md.first.empty())
+      std::size_t nc = database_->getConnectionCount(tag);
+      if (nc > 0)
       {
-        std::size_t matt = md.first.size() / 3;
+        std::size_t matt = nc / 3;
         std::size_t att = 0;
         do
         {
-          index = md.first[rng_.uniformInt(0, md.first.size() - 1)];
+          index = database_->getConnection(tag, rng_.uniformInt(0, nc - 1));
         } while (dirty_.find(index) != dirty_.end() && ++att < matt);
         if (att >= matt)
           index = -1;
@@ -121,15 +182,16 @@ public:
     if (index < 0)
       index = rng_.uniformInt(0, max_index_);
 
-    double dist = space_->distance(near, state_storage_->getState(index));
+    database_->copyState(index, stored_state_);
+    double dist = space_->distance(near, stored_state_);
 
     if (dist > distance)
     {
       double d = pow(rng_.uniform01(), inv_dim_) * distance;
-      space_->interpolate(near, state_storage_->getState(index), d / dist, state);
+      space_->interpolate(near, stored_state_, d / dist, state);
     }
     else
-      space_->copyState(state, state_storage_->getState(index));
+      space_->copyState(state, stored_state_);
   }
 
   virtual void sampleGaussian(ob::State *state, const ob::State *mean, const double stdDev)
@@ -140,13 +202,15 @@ public:
 protected:
 
   /** \brief The states to sample from */
-  const ConstraintApproximationStateStorage *state_storage_;
+  ConstraintApproximationDatabaseConstPtr database_;
+  /** \brief Scratch state the stored state selected by sampleUniformNear() is copied to */
+  ob::State *stored_state_;
   std::set<std::size_t> dirty_;
   unsigned int max_index_;
   double inv_dim_;
 };
 
-bool interpolateUsingStoredStates(const ConstraintApproximationStateStorage *state_storage, const ob::State *from, const ob::State *to, const double t, ob::State *state)
+bool interpolateUsingStoredStates(const ConstraintApproximationDatabaseConstPtr &database, const ob::State *from, const ob::State *to, const double t, ob::State *state)
 {
   int tag_from = from->as<ModelBasedStateSpace::StateType>()->tag;
   int tag_to = to->as<ModelBasedStateSpace::StateType>()->tag;
@@ -155,47 +219,37 @@ bool interpolateUsingStoredStates(const ConstraintApproximationStateStorage *sta
     return false;
 
   if (tag_from == tag_to)
-    state_storage->getStateSpace()->copyState(state, to);
+    database->getStateSpace()->copyState(state, to);
   else
   {
-    const ConstrainedStateMetadata &md = state_storage->getMetadata(tag_from);
-
-    std::map<std::size_t, std::pair<std::size_t, std::size_t> >::const_iterator it = md.second.find(tag_to);
-    if (it == md.second.end())
+    std::size_t first, last;
+    if (!database->getMotion(tag_from, tag_to, first, last))
       return false;
-    const std::pair<std::size_t, std::size_t> &istates = it->second;
-    std::size_t index = (std::size_t)((istates.second - istates.first + 2) * t + 0.5);
+    std::size_t index = (std::size_t)((last - first + 2) * t + 0.5);
 
     if (index == 0)
-      state_storage->getStateSpace()->copyState(state, from);
+      database->getStateSpace()->copyState(state, from);
     else
     {
       --index;
-      if (index >= istates.second - istates.first)
-        state_storage->getStateSpace()->copyState(state, to);
+      if (index >= last - first)
+        database->getStateSpace()->copyState(state, to);
       else
-        state_storage->getStateSpace()->copyState(state, state_storage->getState(istates.first + index));
+        database->copyState(first + index, state);
     }
   }
   return true;
 }
 
-ompl_interface::InterpolationFunction ompl_interface::ConstraintApproximation::getInterpolationFunction() const
-{
-  if (explicit_motions_ && milestones_ > 0 && milestones_ < state_storage_->size())
-    return boost::bind(&interpolateUsingStoredStates, state_storage_, _1, _2, _3, _4);
-  return InterpolationFunction();
-}
-
 ompl::base::StateSamplerPtr allocConstraintApproximationStateSampler(const ob::StateSpace *space, const std::vector<int> &expected_signature,
-                                                                     const ConstraintApproximationStateStorage *state_storage, std::size_t milestones)
+                                                                     const ConstraintApproximationDatabaseConstPtr &database, std::size_t milestones)
 {
   std::vector<int> sig;
   space->computeSignature(sig);
   if (sig != expected_signature)
     return ompl::base::StateSamplerPtr();
   else
-    return ompl::base::StateSamplerPtr(new ConstraintApproximationStateSampler(space, state_storage, milestones));
+    return ompl::base::StateSamplerPtr(new ConstraintApproximationStateSampler(space, database, milestones));
 }
 
 }
@@ -204,19 +258,67 @@ ompl_interface::ConstraintApproximation::ConstraintApproximation(const std::stri
                                                                  bool explicit_motions, const moveit_msgs::Constraints &msg, const std::string &filename,
                                                                  const ompl::base::StateStoragePtr &storage, std::size_t milestones) :
   group_(group), state_space_parameterization_(state_space_parameterization), explicit_motions_(explicit_motions), constraint_msg_(msg),
-  ompldb_filename_(filename), state_storage_ptr_(storage), milestones_(milestones)
+  ompldb_filename_(filename), state_space_(storage->getStateSpace()), state_storage_ptr_(storage), milestones_(milestones),
+  database_(new StoredConstraintApproximationDatabase(storage)), database_loaded_(true)
 {
-  state_storage_ = static_cast<ConstraintApproximationStateStorage*>(state_storage_ptr_.get());
-  state_storage_->getStateSpace()->computeSignature(space_signature_);
+  state_space_->computeSignature(space_signature_);
   if (milestones_ == 0)
-    milestones_ = state_storage_->size();
+    milestones_ = storage->size();
+}
+
+ompl_interface::ConstraintApproximation::ConstraintApproximation(const std::string &group, const std::string &state_space_parameterization,
+                                                                 bool explicit_motions, const moveit_msgs::Constraints &msg, const std::string &filename,
+                                                                 const std::string &path, const ompl::base::StateSpacePtr &space, std::size_t milestones) :
+  group_(group), state_space_parameterization_(state_space_parameterization), explicit_motions_(explicit_motions), constraint_msg_(msg),
+  ompldb_filename_(filename), ompldb_path_(path), state_space_(space), milestones_(milestones), database_loaded_(false)
+{
+  state_space_->computeSignature(space_signature_);
+}
+
+ompl_interface::ConstraintApproximationDatabaseConstPtr ompl_interface::ConstraintApproximation::getDatabase() const
+{
+  boost::mutex::scoped_lock slock(database_lock_);
+  if (database_loaded_)
+    return database_;
+  database_loaded_ = true;
+
+  if (isConstraintApproximationFile(ompldb_path_))
+    database_ = mapConstraintApproximationFile(ompldb_path_, state_space_);
+  else
+  {
+    // files written before the binary format was introduced are parsed into an OMPL state storage
+    ConstraintApproximationStateStorage *cass = new ConstraintApproximationStateStorage(state_space_);
+    ompl::base::StateStoragePtr storage(cass);
+    cass->load(ompldb_path_.c_str());
+    if (cass->size() > 0)
+      database_.reset(new StoredConstraintApproximationDatabase(storage));
+  }
+
+  if (database_)
+    logInform("Loaded %lu states (%lu milestones) for constraint named '%s' from '%s'",
+              database_->size(), milestones_, constraint_msg_.name.c_str(), ompldb_path_.c_str());
+  else
+    logError("Unable to load constraint approximation '%s' from '%s'", constraint_msg_.name.c_str(), ompldb_path_.c_str());
+  return database_;
+}
+
+ompl_interface::InterpolationFunction ompl_interface::ConstraintApproximation::getInterpolationFunction() const
+{
+  if (!explicit_motions_ || milestones_ == 0)
+    return InterpolationFunction();
+  ConstraintApproximationDatabaseConstPtr database = getDatabase();
+  if (database && milestones_ < database->size())
+    return boost::bind(&interpolateUsingStoredStates, database, _1, _2, _3, _4);
+  return InterpolationFunction();
 }
 
 ompl::base::StateSamplerAllocator ompl_interface::ConstraintApproximation::getStateSamplerAllocator(const moveit_msgs::Constraints &msg) const
 {
-  if (state_storage_->size() == 0)
+  ConstraintApproximationDatabaseConstPtr database = getDatabase();
+  if (!database || database->size() == 0)
     return ompl::base::StateSamplerAllocator();
-  return boost::bind(&allocConstraintApproximationStateSampler, _1, space_signature_, state_storage_, milestones_);
+  std::size_t milestones = milestones_ > 0 ? std::min(milestones_, database->size()) : database->size();
+  return boost::bind(&allocConstraintApproximationStateSampler, _1, space_signature_, database, milestones);
 }
 /*
 void ompl_interface::ConstraintApproximation::visualizeDistribution(const std::string &link_name, unsigned int count, visualization_msgs::MarkerArray &arr) const
@@ -296,18 +398,12 @@ void ompl_interface::ConstraintsLibrary::loadConstraintApproximations(const std:
     {
       moveit_msgs::Constraints msg;
       hexToMsg(serialization, msg);
-      ConstraintApproximationStateStorage *cass = new ConstraintApproximationStateStorage(pc->getOMPLSimpleSetup()->getStateSpace());
-      cass->load((path + "/" + filename).c_str());
-      ConstraintApproximationPtr cap(new ConstraintApproximation(group, state_space_parameterization, explicit_motions, msg, filename,
-                                                                 ompl::base::StateStoragePtr(cass), milestones));
+      // the states themselves are only read when the approximation is first used
+      ConstraintApproximationPtr cap(new ConstraintApproximation(group, state_space_parameterization, explicit_motions, msg, filename, path + "/" + filename,
+                                                                 pc->getOMPLSimpleSetup()->getStateSpace(), milestones));
       if (constraint_approximations_.find(cap->getName()) != constraint_approximations_.end())
         logWarn("Overwriting constraint approximation named '%s'", cap->getName().c_str());
       constraint_approximations_[cap->getName()] = cap;
-      std::size_t sum = 0;
-      for (std::size_t i = 0 ; i < cass->size() ; ++i)
-        sum += cass->getMetadata(i).first.size();
-      logInform("Loaded %lu states (%lu milestones) and %lu connections (%0.1lf per state) for constraint named '%s'%s",
-                cass->size(), cap->getMilestoneCount(), sum, (double)sum / (double)cap->getMilestoneCount(), msg.name.c_str(), explicit_motions ? ". Explicit motions included." : "");
     }
   }
   logInform("Done loading constrained space approximations.");
@@ -336,8 +432,9 @@ void ompl_interface::ConstraintsLibrary::saveConstraintApproximations(const std:
       msgToHex(it->second->getConstraintsMsg(), serialization);
       fout << serialization << std::endl;
       fout << it->second->getFilename() << std::endl;
-      if (it->second->getStateStorage())
-        it->second->getStateStorage()->store((path + "/" + it->second->getFilename()).c_str());
+      ConstraintApproximationDatabaseConstPtr database = it->second->getDatabase();
+      if (database)
+        saveConstraintApproximationFile(path + "/" + it->second->getFilename(), *database, it->second->getMilestoneCount());
     }
   else
     logError("Unable to save constraint approximation to '%s'", path.c_str());
@@ -380,10 +477,268 @@ ompl_interface::ConstraintsLibrary::addConstraintApproximation(const moveit_msgs
   return addConstraintApproximation(constr, constr, group, scene, options);
 }
 
+namespace ompl_interface
+{
+namespace
+{
+
+// number of candidate connections a thread claims at a time
+const std::size_t CONNECTION_BLOCK_SIZE = 16;
+
+unsigned int constructionThreadCount(const ConstraintApproximationConstructionOptions &options)
+{
+  return options.threads > 0 ? options.threads : std::max(1u, boost::thread::hardware_concurrency());
+}
+
+/** \brief Milestone sampling progress shared by the sampling threads */
+struct MilestoneSampling
+{
+  MilestoneSampling(ConstraintApproximationStateStorage *storage, std::size_t target) :
+    storage_(storage), initial_(storage->size()), target_(target), attempts_(0), progress_(-1), slow_warn_(false), stop_(false)
+  {
+  }
+
+  ConstraintApproximationStateStorage *storage_;
+  std::size_t initial_;
+  std::size_t target_;
+  std::size_t attempts_;
+  int progress_;
+  bool slow_warn_;
+  bool stop_;
+  boost::mutex lock_;
+};
+
+/** \brief The constraints, sampler and robot state a single thread uses to sample milestones and check connections */
+class ConstructionWorker
+{
+public:
+
+  ConstructionWorker(const ModelBasedPlanningContextPtr &pcontext, const moveit_msgs::Constraints &constr_sampling, const moveit_msgs::Constraints &constr_hard) :
+    pcontext_(pcontext), kset_(pcontext->getRobotModel()), kstate_(pcontext->getCompleteInitialRobotState()),
+    csmp_(NULL), temp_(pcontext->getOMPLStateSpace()), attempts_(0)
+  {
+    robot_state::Transforms no_transforms(pcontext->getRobotModel()->getModelFrame());
+    kset_.add(constr_hard, no_transforms);
+
+    const constraint_samplers::ConstraintSamplerManagerPtr &csmng = pcontext->getConstraintSamplerManager();
+    if (csmng)
+    {
+      constraint_samplers::ConstraintSamplerPtr cs = csmng->selectSampler(pcontext->getPlanningScene(), pcontext->getJointModelGroup()->getName(), constr_sampling);
+      if (cs)
+        csmp_ = new ConstrainedSampler(pcontext.get(), cs);
+    }
+    sampler_ = csmp_ ? ob::StateSamplerPtr(csmp_) : pcontext->getOMPLStateSpace()->allocDefaultStateSampler();
+  }
+
+  double getConstrainedSamplingRate() const
+  {
+    return csmp_ ? csmp_->getConstrainedSamplingRate() : 0.0;
+  }
+
+  std::size_t getAttempts() const
+  {
+    return attempts_;
+  }
+
+  void sampleMilestones(MilestoneSampling *sampling)
+  {
+    while (true)
+    {
+      sampler_->sampleUniform(temp_.get());
+      ++attempts_;
+      pcontext_->getOMPLStateSpace()->copyToRobotState(kstate_, temp_.get());
+      bool satisfied = kset_.decide(kstate_).satisfied;
+
+      boost::mutex::scoped_lock slock(sampling->lock_);
+      ++sampling->attempts_;
+      if (sampling->stop_)
+        break;
+      ConstraintApproximationStateStorage *storage = sampling->storage_;
+      if (satisfied)
+      {
+        temp_->as<ModelBasedStateSpace::StateType>()->tag = storage->size();
+        storage->addState(temp_.get());
+      }
+
+      std::size_t kept = storage->size() - sampling->initial_;
+      std::size_t wanted = sampling->target_ - sampling->initial_;
+      if (kept >= wanted)
+      {
+        sampling->stop_ = true;
+        break;
+      }
+
+      int progress = 100 * kept / wanted;
+      if (progress != sampling->progress_)
+      {
+        sampling->progress_ = progress;
+        logInform("%d%% complete (kept %0.1lf%% sampled states)", progress, 100.0 * (double)kept / (double)sampling->attempts_);
+      }
+
+      if (!sampling->slow_warn_ && sampling->attempts_ > 10 && sampling->attempts_ > kept * 100)
+      {
+        sampling->slow_warn_ = true;
+        logWarn("Computation of valid state database is very slow...");
+      }
+
+      if (sampling->attempts_ > wanted && kept == 0)
+      {
+        logError("Unable to generate any samples");
+        sampling->stop_ = true;
+        break;
+      }
+    }
+  }
+
+  /** \brief Check the states at \e steps - 1 evenly spaced points strictly between \e from and \e to */
+  bool checkMotion(const ob::State *from, const ob::State *to, unsigned int steps)
+  {
+    const ModelBasedStateSpacePtr &space = pcontext_->getOMPLStateSpace();
+    for (unsigned int k = 1 ; k < steps ; ++k)
+    {
+      space->interpolate(from, to, (double)k / (double)steps, temp_.get());
+      space->copyToRobotState(kstate_, temp_.get());
+      if (!kset_.decide(kstate_).satisfied)
+        return false;
+    }
+    return true;
+  }
+
+private:
+
+  ModelBasedPlanningContextPtr pcontext_;
+  kinematic_constraints::KinematicConstraintSet kset_;
+  robot_state::RobotState kstate_;
+  ConstrainedSampler *csmp_;
+  ob::StateSamplerPtr sampler_;
+  ompl::base::ScopedState<> temp_;
+  std::size_t attempts_;
+};
+
+typedef boost::shared_ptr<ConstructionWorker> ConstructionWorkerPtr;
+
+/** \brief A pair of milestones close enough to be connected; \e first_ is the larger index */
+struct CandidateConnection
+{
+  std::size_t first_;
+  std::size_t second_;
+  double distance_;
+  unsigned int steps_;
+  bool valid_;
+};
+
+bool candidateIndexLess(const CandidateConnection &a, const CandidateConnection &b)
+{
+  return a.first_ < b.first_ || (a.first_ == b.first_ && a.second_ < b.second_);
+}
+
+bool candidateIndexEqual(const CandidateConnection &a, const CandidateConnection &b)
+{
+  return a.first_ == b.first_ && a.second_ == b.second_;
+}
+
+bool candidateDistanceLess(const CandidateConnection &a, const CandidateConnection &b)
+{
+  return a.distance_ < b.distance_;
+}
+
+/** \brief Connection checking progress shared by the threads validating candidate connections */
+struct ConnectionChecking
+{
+  ConnectionChecking(const ConstraintApproximationStateStorage *storage, std::vector<CandidateConnection> *candidates) :
+    storage_(storage), candidates_(candidates), next_(0), progress_(-1)
+  {
+  }
+
+  const ConstraintApproximationStateStorage *storage_;
+  std::vector<CandidateConnection> *candidates_;
+  std::size_t next_;
+  int progress_;
+  boost::mutex lock_;
+};
+
+void checkConnections(ConstructionWorker *worker, ConnectionChecking *checking)
+{
+  std::vector<CandidateConnection> &candidates = *checking->candidates_;
+  while (true)
+  {
+    std::size_t begin, end;
+    {
+      boost::mutex::scoped_lock slock(checking->lock_);
+      begin = checking->next_;
+      end = std::min(begin + CONNECTION_BLOCK_SIZE, candidates.size());
+      checking->next_ = end;
+      int progress = candidates.empty() ? 100 : 100 * begin / candidates.size();
+      if (progress != checking->progress_)
+      {
+        checking->progress_ = progress;
+        logInform("%d%% complete", progress);
+      }
+    }
+    if (begin >= end)
+      break;
+    for (std::size_t i = begin ; i < end ; ++i)
+      candidates[i].valid_ = worker->checkMotion(checking->storage_->getState(candidates[i].first_),
+                                                 checking->storage_->getState(candidates[i].second_), candidates[i].steps_);
+  }
+}
+
+double milestoneDistance(const ob::StateSpace *space, const ConstraintApproximationStateStorage *storage, std::size_t a, std::size_t b)
+{
+  return space->distance(storage->getState(a), storage->getState(b));
+}
+
+void addConnection(ConstraintApproximationStateStorage *storage, std::size_t a, std::size_t b)
+{
+  storage->getMetadata(a).first.push_back(b);
+  storage->getMetadata(b).first.push_back(a);
+}
+
+void setMotion(ConstraintApproximationStateStorage *storage, std::size_t a, std::size_t b, std::size_t first, std::size_t last)
+{
+  storage->getMetadata(a).second[b] = std::make_pair(first, last);
+  storage->getMetadata(b).second[a] = std::make_pair(first, last);
+}
+
+}
+}
+
 ompl_interface::ConstraintApproximationConstructionResults
 ompl_interface::ConstraintsLibrary::addConstraintApproximation(const moveit_msgs::Constraints &constr_sampling, const moveit_msgs::Constraints &constr_hard,
                                                                const std::string &group, const planning_scene::PlanningSceneConstPtr &scene,
                                                                const ConstraintApproximationConstructionOptions &options)
+{
+  return buildConstraintApproximation(constr_sampling, constr_hard, group, scene, options, ConstraintApproximationConstPtr());
+}
+
+ompl_interface::ConstraintApproximationConstructionResults
+ompl_interface::ConstraintsLibrary::extendConstraintApproximation(const moveit_msgs::Constraints &constr, const std::string &group,
+                                                                  const planning_scene::PlanningSceneConstPtr &scene,
+                                                                  const ConstraintApproximationConstructionOptions &options)
+{
+  return extendConstraintApproximation(constr, constr, group, scene, options);
+}
+
+ompl_interface::ConstraintApproximationConstructionResults
+ompl_interface::ConstraintsLibrary::extendConstraintApproximation(const moveit_msgs::Constraints &constr_sampling, const moveit_msgs::Constraints &constr_hard,
+                                                                  const std::string &group, const planning_scene::PlanningSceneConstPtr &scene,
+                                                                  const ConstraintApproximationConstructionOptions &options)
+{
+  ConstraintApproximationConstPtr existing = getConstraintApproximation(constr_hard);
+  if (existing && (existing->getGroup() != group || existing->getStateSpaceParameterization() != options.state_space_parameterization))
+  {
+    logWarn("Constraint approximation named '%s' was computed for group '%s' with parameterization '%s'. Constructing a new one.",
+            existing->getName().c_str(), existing->getGroup().c_str(), existing->getStateSpaceParameterization().c_str());
+    existing.reset();
+  }
+  return buildConstraintApproximation(constr_sampling, constr_hard, group, scene, options, existing);
+}
+
+ompl_interface::ConstraintApproximationConstructionResults
+ompl_interface::ConstraintsLibrary::buildConstraintApproximation(const moveit_msgs::Constraints &constr_sampling, const moveit_msgs::Constraints &constr_hard,
+                                                                 const std::string &group, const planning_scene::PlanningSceneConstPtr &scene,
+                                                                 const ConstraintApproximationConstructionOptions &options,
+                                                                 const ConstraintApproximationConstPtr &existing)
 {
   ConstraintApproximationConstructionResults res;
   ModelBasedPlanningContextPtr pc = context_manager_.getPlanningContext(group, options.state_space_parameterization);
@@ -394,7 +749,7 @@ ompl_interface::ConstraintsLibrary::addConstraintApproximation(const moveit_msgs
     pc->setCompleteInitialState(scene->getCurrentState());
 
     ros::WallTime start = ros::WallTime::now();
-    ompl::base::StateStoragePtr ss = constructConstraintApproximation(pc, constr_sampling, constr_hard, options, res);
+    ompl::base::StateStoragePtr ss = constructConstraintApproximation(pc, constr_sampling, constr_hard, options, existing, res);
     logInform("Spent %lf seconds constructing the database", (ros::WallTime::now() - start).toSec());
     if (ss)
     {
@@ -415,82 +770,83 @@ ompl_interface::ConstraintsLibrary::addConstraintApproximation(const moveit_msgs
 ompl::base::StateStoragePtr ompl_interface::ConstraintsLibrary::constructConstraintApproximation(const ModelBasedPlanningContextPtr &pcontext,
                                                                                                  const moveit_msgs::Constraints &constr_sampling, const moveit_msgs::Constraints &constr_hard,
                                                                                                  const ConstraintApproximationConstructionOptions &options,
+                                                                                                 const ConstraintApproximationConstPtr &existing,
                                                                                                  ConstraintApproximationConstructionResults &result)
 {
   // state storage structure
   ConstraintApproximationStateStorage *cass = new ConstraintApproximationStateStorage(pcontext->getOMPLStateSpace());
   ob::StateStoragePtr sstor(cass);
 
-  // construct a sampler for the sampling constraints
-  kinematic_constraints::KinematicConstraintSet kset(pcontext->getRobotModel());
-  robot_state::Transforms no_transforms(pcontext->getRobotModel()->getModelFrame());
-  kset.add(constr_hard, no_transforms);
-
-  const robot_state::RobotState &default_state = pcontext->getCompleteInitialRobotState();
-
-  unsigned int attempts = 0;
-
   double bounds_val = std::numeric_limits<double>::max() / 2.0 - 1.0;
   pcontext->getOMPLStateSpace()->setPlanningVolume(-bounds_val, bounds_val, -bounds_val, bounds_val, -bounds_val, bounds_val);
   pcontext->getOMPLStateSpace()->setup();
 
-  // construct the constrained states
+  const ob::StateSpacePtr &space = pcontext->getOMPLSimpleSetup()->getStateSpace();
+  ompl::base::ScopedState<> temp(pcontext->getOMPLStateSpace());
 
-  robot_state::RobotState kstate(default_state);
-  const constraint_samplers::ConstraintSamplerManagerPtr &csmng = pcontext->getConstraintSamplerManager();
-  ConstrainedSampler *csmp = NULL;
-  if (csmng)
+  // start from the milestones of the approximation being extended
+  ConstraintApproximationDatabaseConstPtr existing_db;
+  if (existing)
   {
-    constraint_samplers::ConstraintSamplerPtr cs = csmng->selectSampler(pcontext->getPlanningScene(), pcontext->getJointModelGroup()->getName(), constr_sampling);
-    if (cs)
-      csmp = new ConstrainedSampler(pcontext.get(), cs);
+    std::vector<int> sig;
+    space->computeSignature(sig);
+    if (sig != existing->getSpaceSignature())
+      logWarn("Constraint approximation named '%s' was computed for a different state space. Not extending it.", existing->getName().c_str());
+    else
+      existing_db = existing->getDatabase();
   }
-
-  ob::StateSamplerPtr ss(csmp ? ob::StateSamplerPtr(csmp) : pcontext->getOMPLStateSpace()->allocDefaultStateSampler());
-
-  ompl::base::ScopedState<> temp(pcontext->getOMPLStateSpace());
-  int done = -1;
-  bool slow_warn = false;
-  ompl::time::point start = ompl::time::now();
-  while (sstor->size() < options.samples)
+  if (existing_db)
   {
-    ++attempts;
-    int done_now = 100 * sstor->size() / options.samples;
-    if (done != done_now)
+    std::size_t existing_milestones = std::min(existing->getMilestoneCount(), existing_db->size());
+    for (std::size_t i = 0 ; i < existing_milestones ; ++i)
     {
-      done = done_now;
-      logInform("%d%% complete (kept %0.1lf%% sampled states)", done, 100.0 * (double)sstor->size() / (double)attempts);
+      existing_db->copyState(i, temp.get());
+      temp->as<ModelBasedStateSpace::StateType>()->tag = i;
+      sstor->addState(temp.get());
     }
+    result.existing_milestones = existing_milestones;
+    logInform("Extending constraint approximation named '%s' with %u milestones", existing->getName().c_str(), (unsigned int)existing_milestones);
+  }
 
-    if (!slow_warn && attempts > 10 && attempts > sstor->size() * 100)
-    {
-      slow_warn = true;
-      logWarn("Computation of valid state database is very slow...");
-    }
+  unsigned int threads = constructionThreadCount(options);
+  std::vector<ConstructionWorkerPtr> workers(threads);
+  for (unsigned int t = 0 ; t < threads ; ++t)
+    workers[t].reset(new ConstructionWorker(pcontext, constr_sampling, constr_hard));
 
-    if (attempts > options.samples && sstor->size() == 0)
-    {
-      logError("Unable to generate any samples");
-      break;
-    }
+  // the constraint samplers of all workers use the same kinematics solvers
+  unsigned int sampling_thread_count = threads;
+  if (sampling_thread_count > 1 && !pcontext->supportsConcurrentIK())
+  {
+    logDebug("The kinematics solvers of group '%s' do not support concurrent queries; milestones are sampled by one thread",
+             pcontext->getGroupName().c_str());
+    sampling_thread_count = 1;
+  }
 
-    ss->sampleUniform(temp.get());
-    pcontext->getOMPLStateSpace()->copyToRobotState(kstate, temp.get());
-    if (kset.decide(kstate).satisfied)
-    {
-      if (sstor->size() < options.samples)
-      {
-        temp->as<ModelBasedStateSpace::StateType>()->tag = sstor->size();
-        sstor->addState(temp.get());
-      }
-    }
+  // construct the constrained states
+  ompl::time::point start = ompl::time::now();
+  if (sstor->size() < options.samples)
+  {
+    MilestoneSampling sampling(cass, options.samples);
+    boost::thread_group sampling_threads;
+    for (unsigned int t = 1 ; t < sampling_thread_count ; ++t)
+      sampling_threads.create_thread(boost::bind(&ConstructionWorker::sampleMilestones, workers[t].get(), &sampling));
+    workers[0]->sampleMilestones(&sampling);
+    sampling_threads.join_all();
   }
 
+  std::size_t attempts = 0;
+  double success_rate = 0.0;
+  for (unsigned int t = 0 ; t < threads ; ++t)
+  {
+    attempts += workers[t]->getAttempts();
+    success_rate += workers[t]->getConstrainedSamplingRate() * workers[t]->getAttempts();
+  }
+  result.sampling_attempts = attempts;
   result.state_sampling_time = ompl::time::seconds(ompl::time::now() - start);
-  logInform("Generated %u states in %lf seconds", (unsigned int)sstor->size(), result.state_sampling_time);
-  if (csmp)
+  logInform("Generated %u states in %lf seconds using %u threads", (unsigned int)(sstor->size() - result.existing_milestones), result.state_sampling_time, sampling_thread_count);
+  if (attempts > 0 && success_rate > 0.0)
   {
-    result.sampling_success_rate = csmp->getConstrainedSamplingRate();
+    result.sampling_success_rate = success_rate / (double)attempts;
     logInform("Constrained sampling rate: %lf", result.sampling_success_rate);
   }
 
@@ -498,82 +854,107 @@ ompl::base::StateStoragePtr ompl_interface::ConstraintsLibrary::constructConstra
   if (options.edges_per_sample > 0)
   {
     logInform("Computing graph connections (max %u edges per sample) ...", options.edges_per_sample);
+    start = ompl::time::now();
+    std::size_t milestones = sstor->size();
 
-    // construct connexions
-    const ob::StateSpacePtr &space = pcontext->getOMPLSimpleSetup()->getStateSpace();
-    unsigned int milestones = sstor->size();
-    std::vector<ob::State*> int_states(options.max_explicit_points, NULL);
-    pcontext->getOMPLSimpleSetup()->getSpaceInformation()->allocStates(int_states);
-
-    ompl::time::point start = ompl::time::now();
-    int good = 0;
-    int done = -1;
-
-    for (std::size_t j = 0 ; j < milestones ; ++j)
+    // keep the connections of the approximation being extended; their explicit motions are copied after the milestones
+    if (existing_db)
     {
-      int done_now = 100 * j / milestones;
-      if (done != done_now)
+      for (std::size_t i = 0 ; i < result.existing_milestones ; ++i)
       {
-        done = done_now;
-        logInform("%d%% complete", done);
+        std::size_t nc = existing_db->getConnectionCount(i);
+        for (std::size_t k = 0 ; k < nc ; ++k)
+        {
+          std::size_t j = existing_db->getConnection(i, k);
+          if (j >= i || cass->getMetadata(i).first.size() >= options.edges_per_sample || cass->getMetadata(j).first.size() >= options.edges_per_sample)
+            continue;
+          std::size_t first, last;
+          if (options.explicit_motions && existing_db->getMotion(i, j, first, last))
+          {
+            std::size_t begin = sstor->size();
+            for (std::size_t s = first ; s < last ; ++s)
+            {
+              existing_db->copyState(s, temp.get());
+              temp->as<ModelBasedStateSpace::StateType>()->tag = -1;
+              sstor->addState(temp.get());
+            }
+            setMotion(cass, i, j, begin, sstor->size());
+          }
+          addConnection(cass, i, j);
+        }
       }
-      if (cass->getMetadata(j).first.size() >= options.edges_per_sample)
-        continue;
+    }
 
-      const ob::State *sj = sstor->getState(j);
+    // find pairs of nearby milestones, at least one of which is new
+    ompl::NearestNeighborsGNAT<std::size_t> nn;
+    nn.setDistanceFunction(boost::bind(&milestoneDistance, space.get(), cass, _1, _2));
+    std::vector<std::size_t> ids(milestones);
+    for (std::size_t i = 0 ; i < milestones ; ++i)
+      ids[i] = i;
+    nn.add(ids);
 
-      for (std::size_t i = j + 1 ; i < milestones ; ++i)
+    std::vector<CandidateConnection> candidates;
+    std::vector<std::size_t> nbh;
+    for (std::size_t j = 0 ; j < milestones ; ++j)
+    {
+      nn.nearestK(j, options.edges_per_sample + 1, nbh);
+      for (std::size_t k = 0 ; k < nbh.size() ; ++k)
       {
-        if (cass->getMetadata(i).first.size() >= options.edges_per_sample)
+        std::size_t i = nbh[k];
+        if (i == j || (i < result.existing_milestones && j < result.existing_milestones))
           continue;
-        double d = space->distance(sstor->getState(i), sj);
-        if (d >= options.max_edge_length)
+        CandidateConnection c;
+        c.distance_ = milestoneDistance(space.get(), cass, i, j);
+        if (c.distance_ >= options.max_edge_length)
           continue;
-        unsigned int isteps = std::min<unsigned int>(options.max_explicit_points, d / options.explicit_points_resolution);
-        double step = 1.0 / (double)isteps;
-        double remain = 1.0;
-        bool ok = true;
-        space->interpolate(sstor->getState(i), sj, step, int_states[0]);
-        for (unsigned int k = 1 ; k < isteps ; ++k)
-        {
-          double this_step = step / (1.0 - (k - 1) * step);
-          space->interpolate(int_states[k-1], sj, this_step, int_states[k]);
-          pcontext->getOMPLStateSpace()->copyToRobotState(kstate, int_states[k]);
-          if (!kset.decide(kstate).satisfied)
-          {
-            ok = false;
-            break;
-          }
-        }
+        c.first_ = std::max(i, j);
+        c.second_ = std::min(i, j);
+        c.steps_ = options.explicit_points_resolution > 0.0 ?
+          std::min<double>(options.max_explicit_points, c.distance_ / options.explicit_points_resolution) : options.max_explicit_points;
+        c.valid_ = false;
+        candidates.push_back(c);
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(), &candidateIndexLess);
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), &candidateIndexEqual), candidates.end());
+    result.candidate_connections = candidates.size();
+
+    // check the motions along candidate connections in parallel
+    ConnectionChecking checking(cass, &candidates);
+    boost::thread_group checking_threads;
+    for (unsigned int t = 1 ; t < threads ; ++t)
+      checking_threads.create_thread(boost::bind(&checkConnections, workers[t].get(), &checking));
+    checkConnections(workers[0].get(), &checking);
+    checking_threads.join_all();
+
+    // connect the closest pairs first, respecting the limit on edges per milestone
+    std::stable_sort(candidates.begin(), candidates.end(), &candidateDistanceLess);
+    for (std::size_t c = 0 ; c < candidates.size() ; ++c)
+    {
+      const CandidateConnection &cc = candidates[c];
+      if (!cc.valid_ || cass->getMetadata(cc.first_).first.size() >= options.edges_per_sample ||
+          cass->getMetadata(cc.second_).first.size() >= options.edges_per_sample)
+        continue;
+      addConnection(cass, cc.first_, cc.second_);
+      ++result.connections;
 
-        if (ok)
+      if (options.explicit_motions && cc.steps_ > 0)
+      {
+        std::size_t begin = sstor->size();
+        for (unsigned int k = 1 ; k <= cc.steps_ ; ++k)
         {
-          cass->getMetadata(i).first.push_back(j);
-          cass->getMetadata(j).first.push_back(i);
-
-          if (options.explicit_motions)
-          {
-            cass->getMetadata(i).second[j].first = sstor->size();
-            for (unsigned int k = 0 ; k < isteps ; ++k)
-            {
-              int_states[k]->as<ModelBasedStateSpace::StateType>()->tag = -1;
-              sstor->addState(int_states[k]);
-            }
-            cass->getMetadata(i).second[j].second = sstor->size();
-            cass->getMetadata(j).second[i] = cass->getMetadata(i).second[j];
-          }
-
-          good++;
-          if (cass->getMetadata(j).first.size() >= options.edges_per_sample)
-            break;
+          space->interpolate(sstor->getState(cc.first_), sstor->getState(cc.second_), (double)k / (double)cc.steps_, temp.get());
+          temp->as<ModelBasedStateSpace::StateType>()->tag = -1;
+          sstor->addState(temp.get());
         }
+        setMotion(cass, cc.first_, cc.second_, begin, sstor->size());
       }
     }
 
     result.state_connection_time = ompl::time::seconds(ompl::time::now() - start);
-    logInform("Computed possible connexions in %lf seconds. Added %d connexions", result.state_connection_time, good);
-    pcontext->getOMPLSimpleSetup()->getSpaceInformation()->freeStates(int_states);
-
-    return sstor;
+    logInform("Computed possible connexions in %lf seconds. Checked %u candidates and added %u connexions",
+              result.state_connection_time, (unsigned int)result.candidate_connections, (unsigned int)result.connections);
   }
+
+  return sstor;
 }
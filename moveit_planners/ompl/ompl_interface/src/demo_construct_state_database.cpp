@@ -75,6 +75,7 @@ void computeDB(const robot_model::RobotModelPtr &robot_model,
   opt.max_edge_length = 0.2;
   opt.explicit_points_resolution = 0.05;
   opt.max_explicit_points = 10;
+  opt.threads = 0;
 
   ompl_interface.getConstraintsLibrary().addConstraintApproximation(c, "right_arm", ps, opt);
   ompl_interface.getConstraintsLibrary().saveConstraintApproximations("~/constraints_approximation_database");
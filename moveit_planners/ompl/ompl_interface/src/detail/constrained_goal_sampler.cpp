@@ -38,6 +38,13 @@
 #include <moveit/ompl_interface/model_based_planning_context.h>
 #include <moveit/ompl_interface/detail/state_validity_checker.h>
 #include <moveit/profiler/profiler.h>
+#include <boost/bind.hpp>
+
+namespace
+{
+// how long waiting threads sleep before checking again whether sampling was stopped
+const boost::posix_time::milliseconds WAIT_PERIOD(10);
+}
 
 ompl_interface::ConstrainedGoalSampler::ConstrainedGoalSampler(const ModelBasedPlanningContext *pc,
                                                                const kinematic_constraints::KinematicConstraintSetPtr &ks,
@@ -51,13 +58,121 @@ ompl_interface::ConstrainedGoalSampler::ConstrainedGoalSampler(const ModelBasedP
   , invalid_sampled_constraints_(0)
   , warned_invalid_samples_(false)
   , verbose_display_(0)
+  , session_(0)
+  , sampled_session_(0)
+  , stop_workers_(false)
+  , running_workers_(0)
+  , worker_attempts_(0)
+{
+  initialize();
+}
+
+ompl_interface::ConstrainedGoalSampler::ConstrainedGoalSampler(const ModelBasedPlanningContext *pc,
+                                                               const kinematic_constraints::KinematicConstraintSetPtr &ks,
+                                                               const std::vector<constraint_samplers::ConstraintSamplerPtr> &cs)
+  : ob::GoalLazySamples(pc->getOMPLSimpleSetup()->getSpaceInformation(),
+                        boost::bind(&ConstrainedGoalSampler::sampleUsingConstraintSampler, this, _1, _2), false)
+  , planning_context_(pc)
+  , kinematic_constraint_set_(ks)
+  , constraint_sampler_(cs.empty() ? constraint_samplers::ConstraintSamplerPtr() : cs[0])
+  , work_state_(pc->getCompleteInitialRobotState())
+  , invalid_sampled_constraints_(0)
+  , warned_invalid_samples_(false)
+  , verbose_display_(0)
+  , session_(0)
+  , sampled_session_(0)
+  , stop_workers_(false)
+  , running_workers_(0)
+  , worker_attempts_(0)
+{
+  if (cs.size() > 1)
+  {
+    for (std::size_t i = 0 ; i < cs.size() ; ++i)
+    {
+      Worker *w = new Worker(cs[i], pc->getCompleteInitialRobotState());
+      w->scratch_ = si_->allocState();
+      workers_.push_back(w);
+    }
+
+    // up to two goals per worker wait to be collected; all the states are allocated here so sampling does not allocate
+    std::size_t capacity = 2 * workers_.size();
+    // the queues keep one node for internal use
+    ready_goals_.reset(new StateQueue(capacity + 1));
+    free_states_.reset(new StateQueue(capacity + 1));
+    for (std::size_t i = 0 ; i < capacity ; ++i)
+    {
+      pool_.push_back(si_->allocState());
+      free_states_->push(pool_.back());
+    }
+  }
+  initialize();
+}
+
+ompl_interface::ConstrainedGoalSampler::~ConstrainedGoalSampler()
+{
+  // the sampling thread calls into this instance, so it needs to end before the members are destroyed
+  stopSampling();
+  stopWorkers();
+  for (std::size_t i = 0 ; i < workers_.size() ; ++i)
+  {
+    si_->freeState(workers_[i]->scratch_);
+    delete workers_[i];
+  }
+  for (std::size_t i = 0 ; i < pool_.size() ; ++i)
+    si_->freeState(pool_[i]);
+}
+
+void ompl_interface::ConstrainedGoalSampler::initialize()
 {
   if (!constraint_sampler_)
     default_sampler_ = si_->allocStateSampler();
-  logDebug("Constructed a ConstrainedGoalSampler instance at address %p", this);
+  logDebug("Constructed a ConstrainedGoalSampler instance at address %p using %u sampling threads", this,
+           workers_.empty() ? 1u : (unsigned int)workers_.size());
+  startSamplingSession();
+}
+
+void ompl_interface::ConstrainedGoalSampler::startSamplingSession()
+{
+  {
+    boost::mutex::scoped_lock slock(stats_lock_);
+    session_++;
+  }
   startSampling();
 }
 
+ompl_interface::GoalSamplingStatistics ompl_interface::ConstrainedGoalSampler::getSamplingStatistics() const
+{
+  boost::mutex::scoped_lock slock(stats_lock_);
+  return stats_;
+}
+
+void ompl_interface::ConstrainedGoalSampler::resetStatistics()
+{
+  boost::mutex::scoped_lock slock(stats_lock_);
+  stats_ = GoalSamplingStatistics();
+  stats_start_ = ompl::time::now();
+  invalid_sampled_constraints_ = 0;
+}
+
+void ompl_interface::ConstrainedGoalSampler::recordSample(unsigned int sampler_failures, unsigned int constraint_failures,
+                                                          unsigned int invalid_states, unsigned int goals)
+{
+  boost::mutex::scoped_lock slock(stats_lock_);
+  stats_.samples_++;
+  stats_.sampler_failures_ += sampler_failures;
+  stats_.constraint_failures_ += constraint_failures;
+  stats_.invalid_states_ += invalid_states;
+  stats_.goals_ += goals;
+  stats_.duration_ = ompl::time::seconds(ompl::time::now() - stats_start_);
+
+  invalid_sampled_constraints_ += constraint_failures;
+  if (constraint_failures && !warned_invalid_samples_ && invalid_sampled_constraints_ >= (stats_.samples_ * 8) / 10)
+  {
+    warned_invalid_samples_ = true;
+    logWarn("More than 80%% of the sampled goal states fail to satisfy the constraints imposed on the goal sampler. Is the constrained sampler working correctly?");
+  }
+}
+
 bool ompl_interface::ConstrainedGoalSampler::checkStateValidity(ob::State* new_goal,
                                                                 const robot_state::RobotState& state,
                                                                 bool verbose) const
@@ -79,10 +194,90 @@ bool ompl_interface::ConstrainedGoalSampler::stateValidityCallback(ob::State* ne
   return checkStateValidity(new_goal, solution_state, verbose);
 }
 
+bool ompl_interface::ConstrainedGoalSampler::shouldStop(const ob::GoalLazySamples *gls) const
+{
+  // terminate after a maximum number of samples
+  if (gls->getStateCount() >= planning_context_->getMaximumGoalSamples())
+    return true;
+
+  // terminate the sampling thread when a solution has been found
+  return planning_context_->getOMPLSimpleSetup()->getProblemDefinition()->hasSolution();
+}
+
+bool ompl_interface::ConstrainedGoalSampler::sampleGoal(constraint_samplers::ConstraintSampler *sampler,
+                                                        robot_state::RobotState &work_state,
+                                                        ob::State *new_goal, bool verbose)
+{
+  if (sampler)
+  {
+    // makes the constraint sampler also perform a validity callback
+    robot_state::GroupStateValidityCallbackFn gsvcf = boost::bind(&ompl_interface::ConstrainedGoalSampler::stateValidityCallback,
+                                                                  this,
+                                                                  new_goal,
+                                                                  _1,  // pointer to state
+                                                                  _2,  // const* joint model group
+                                                                  _3,  // double* of joint positions
+                                                                  verbose);
+    sampler->setGroupStateValidityCallback( gsvcf );
+
+    if (!sampler->project(work_state, planning_context_->getMaximumStateSamplingAttempts()))
+    {
+      recordSample(1, 0, 0, 0);
+      return false;
+    }
+    work_state.update();
+    if (!kinematic_constraint_set_->decide(work_state, verbose).satisfied)
+    {
+      recordSample(0, 1, 0, 0);
+      return false;
+    }
+    if (!checkStateValidity(new_goal, work_state, verbose))
+    {
+      recordSample(0, 0, 1, 0);
+      return false;
+    }
+  }
+  else
+  {
+    default_sampler_->sampleUniform(new_goal);
+    if (!static_cast<const StateValidityChecker*>(si_->getStateValidityChecker().get())->isValid(new_goal, verbose))
+    {
+      recordSample(0, 0, 1, 0);
+      return false;
+    }
+    planning_context_->getOMPLStateSpace()->copyToRobotState(work_state, new_goal);
+    if (!kinematic_constraint_set_->decide(work_state, verbose).satisfied)
+    {
+      recordSample(0, 1, 0, 0);
+      return false;
+    }
+  }
+  recordSample(0, 0, 0, 1);
+  return true;
+}
+
 bool ompl_interface::ConstrainedGoalSampler::sampleUsingConstraintSampler(const ob::GoalLazySamples *gls, ob::State *new_goal)
 {
   //  moveit::Profiler::ScopedBlock sblock("ConstrainedGoalSampler::sampleUsingConstraintSampler");
 
+  // thread ids are reused, so planning attempts are told apart by an explicit counter
+  unsigned int session;
+  {
+    boost::mutex::scoped_lock slock(stats_lock_);
+    session = session_;
+  }
+  if (session != sampled_session_)
+  {
+    sampled_session_ = session;
+    stopWorkers();
+    resetStatistics();
+    if (!workers_.empty())
+      startWorkers();
+  }
+
+  if (!workers_.empty())
+    return collectFromWorkers(gls, new_goal);
+
   unsigned int max_attempts = planning_context_->getMaximumGoalSamplingAttempts();
   unsigned int attempts_so_far = gls->samplingAttemptsCount();
 
@@ -90,12 +285,7 @@ bool ompl_interface::ConstrainedGoalSampler::sampleUsingConstraintSampler(const
   if (attempts_so_far >= max_attempts)
     return false;
 
-  // terminate after a maximum number of samples
-  if (gls->getStateCount() >= planning_context_->getMaximumGoalSamples())
-    return false;
-
-  // terminate the sampling thread when a solution has been found
-  if (planning_context_->getOMPLSimpleSetup()->getProblemDefinition()->hasSolution())
+  if (shouldStop(gls))
     return false;
 
   unsigned int max_attempts_div2 = max_attempts/2;
@@ -103,53 +293,130 @@ bool ompl_interface::ConstrainedGoalSampler::sampleUsingConstraintSampler(const
   {
     bool verbose = false;
     if (gls->getStateCount() == 0 && a >= max_attempts_div2)
+    {
+      boost::mutex::scoped_lock slock(stats_lock_);
       if (verbose_display_ < 1)
       {
         verbose = true;
         verbose_display_++;
       }
+    }
+
+    if (sampleGoal(constraint_sampler_.get(), work_state_, new_goal, verbose))
+      return true;
+  }
+  return false;
+}
 
-    if (constraint_sampler_)
+bool ompl_interface::ConstrainedGoalSampler::collectFromWorkers(const ob::GoalLazySamples *gls, ob::State *new_goal)
+{
+  while (true)
+  {
+    // check before looking at the queue, so goals pushed by workers that just finished are not missed
+    bool workers_done;
     {
-      // makes the constraint sampler also perform a validity callback
-      robot_state::GroupStateValidityCallbackFn gsvcf = boost::bind(&ompl_interface::ConstrainedGoalSampler::stateValidityCallback,
-                                                                    this,
-                                                                    new_goal,
-                                                                    _1,  // pointer to state
-                                                                    _2,  // const* joint model group
-                                                                    _3,  // double* of joint positions
-                                                                    verbose);
-      constraint_sampler_->setGroupStateValidityCallback( gsvcf );
-
-      if (constraint_sampler_->project(work_state_, planning_context_->getMaximumStateSamplingAttempts()))
-      {
-        work_state_.update();
-        if (kinematic_constraint_set_->decide(work_state_, verbose).satisfied)
-        {
-          if (checkStateValidity(new_goal, work_state_, verbose))
-            return true;
-        }
-        else
-        {
-          invalid_sampled_constraints_++;
-          if (!warned_invalid_samples_ && invalid_sampled_constraints_ >= (attempts_so_far * 8) / 10)
-          {
-            warned_invalid_samples_ = true;
-            logWarn("More than 80%% of the sampled goal states fail to satisfy the constraints imposed on the goal sampler. Is the constrained sampler working correctly?");
-          }
-        }
-      }
+      boost::mutex::scoped_lock slock(stats_lock_);
+      workers_done = running_workers_ == 0;
+    }
+
+    ob::State *st = NULL;
+    if (ready_goals_->pop(st))
+    {
+      si_->copyState(new_goal, st);
+      free_states_->push(st);
+      state_freed_.notify_one();
+      return true;
+    }
+
+    if (workers_done || !gls->isSampling() || shouldStop(gls))
+    {
+      stopWorkers();
+      return false;
     }
-    else
+
+    boost::mutex::scoped_lock wlock(wait_lock_);
+    goal_ready_.timed_wait(wlock, WAIT_PERIOD);
+  }
+}
+
+void ompl_interface::ConstrainedGoalSampler::startWorkers()
+{
+  // goals left over from a previous planning attempt are discarded
+  ob::State *st = NULL;
+  while (ready_goals_->pop(st))
+    free_states_->push(st);
+
+  {
+    boost::mutex::scoped_lock slock(stats_lock_);
+    stop_workers_ = false;
+    running_workers_ = workers_.size();
+    worker_attempts_ = 0;
+  }
+  worker_threads_.reset(new boost::thread_group());
+  for (std::size_t i = 0 ; i < workers_.size() ; ++i)
+    worker_threads_->create_thread(boost::bind(&ConstrainedGoalSampler::workerThread, this, workers_[i]));
+}
+
+void ompl_interface::ConstrainedGoalSampler::stopWorkers()
+{
+  if (!worker_threads_)
+    return;
+  {
+    boost::mutex::scoped_lock slock(stats_lock_);
+    stop_workers_ = true;
+  }
+  state_freed_.notify_all();
+  worker_threads_->join_all();
+  worker_threads_.reset();
+}
+
+bool ompl_interface::ConstrainedGoalSampler::claimAttempt(bool &verbose)
+{
+  boost::mutex::scoped_lock slock(stats_lock_);
+  if (stop_workers_ || worker_attempts_ >= planning_context_->getMaximumGoalSamplingAttempts())
+    return false;
+  verbose = false;
+  if (getStateCount() == 0 && worker_attempts_ >= planning_context_->getMaximumGoalSamplingAttempts() / 2 && verbose_display_ < 1)
+  {
+    verbose = true;
+    verbose_display_++;
+  }
+  worker_attempts_++;
+  return true;
+}
+
+void ompl_interface::ConstrainedGoalSampler::workerThread(Worker *worker)
+{
+  bool verbose = false;
+  while (isSampling() && !planning_context_->getOMPLSimpleSetup()->getProblemDefinition()->hasSolution() && claimAttempt(verbose))
+  {
+    if (!sampleGoal(worker->sampler_.get(), worker->work_state_, worker->scratch_, verbose))
+      continue;
+
+    // wait for room in the queue
+    ob::State *st = NULL;
+    while (!free_states_->pop(st))
     {
-      default_sampler_->sampleUniform(new_goal);
-      if (static_cast<const StateValidityChecker*>(si_->getStateValidityChecker().get())->isValid(new_goal, verbose))
       {
-        planning_context_->getOMPLStateSpace()->copyToRobotState(work_state_, new_goal);
-        if (kinematic_constraint_set_->decide(work_state_, verbose).satisfied)
-          return true;
+        boost::mutex::scoped_lock slock(stats_lock_);
+        if (stop_workers_)
+          break;
       }
+      if (!isSampling())
+        break;
+      boost::mutex::scoped_lock wlock(wait_lock_);
+      state_freed_.timed_wait(wlock, WAIT_PERIOD);
     }
+    if (!st)
+      break;
+    si_->copyState(st, worker->scratch_);
+    ready_goals_->push(st);
+    goal_ready_.notify_one();
   }
-  return false;
+
+  {
+    boost::mutex::scoped_lock slock(stats_lock_);
+    running_workers_--;
+  }
+  goal_ready_.notify_one();
 }
@@ -0,0 +1,413 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/ompl_interface/detail/constraint_approximation_file.h>
+#include <moveit/ompl_interface/parameterization/model_based_state_space.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <cstring>
+
+namespace ompl_interface
+{
+
+namespace
+{
+
+// All sections are 8-byte aligned and stored in native byte order; the byte order mark rejects files written on
+// a machine with a different one. The layout is:
+//   FileHeader
+//   int32_t signature[signature_count_]                  at signature_offset_
+//   state records of state_stride_ bytes each           at states_offset_
+//   uint64_t adjacency[milestone_count_ + 1]             at adjacency_offset_
+//   EdgeRecord edges[edge_count_]                        at edges_offset_
+// The edges of milestone i are edges[adjacency[i] .. adjacency[i + 1]), sorted by target.
+const char FILE_MAGIC[8] = { 'M', 'O', 'V', 'E', 'I', 'T', 'C', 'A' };
+const boost::uint32_t FILE_VERSION = 1;
+const boost::uint32_t FILE_BYTE_ORDER_MARK = 0x01020304;
+const boost::uint64_t NO_MOTION = std::numeric_limits<boost::uint64_t>::max();
+
+struct FileHeader
+{
+  char            magic_[8];
+  boost::uint32_t version_;
+  boost::uint32_t byte_order_;
+  boost::uint64_t state_size_;
+  boost::uint64_t state_stride_;
+  boost::uint64_t state_count_;
+  boost::uint64_t milestone_count_;
+  boost::uint64_t edge_count_;
+  boost::uint64_t signature_offset_;
+  boost::uint64_t signature_count_;
+  boost::uint64_t states_offset_;
+  boost::uint64_t adjacency_offset_;
+  boost::uint64_t edges_offset_;
+};
+
+struct EdgeRecord
+{
+  boost::uint64_t target_;
+  boost::uint64_t first_;  // NO_MOTION if there is no explicit motion for this edge
+  boost::uint64_t last_;
+};
+
+bool edgeTargetLess(const EdgeRecord &a, const EdgeRecord &b)
+{
+  return a.target_ < b.target_;
+}
+
+bool edgeTargetLessThan(const EdgeRecord &e, boost::uint64_t target)
+{
+  return e.target_ < target;
+}
+
+boost::uint64_t align8(boost::uint64_t value)
+{
+  return (value + 7) & ~(boost::uint64_t)7;
+}
+
+void computeFileSignature(const ompl::base::StateSpacePtr &space, std::vector<boost::int32_t> &signature)
+{
+  std::vector<int> sig;
+  space->computeSignature(sig);
+  signature.assign(sig.begin(), sig.end());
+}
+
+// true if count elements of element_size bytes starting at offset fit in a file of file_size bytes
+bool sectionFits(boost::uint64_t offset, boost::uint64_t count, boost::uint64_t element_size, boost::uint64_t file_size)
+{
+  if (offset % 8 != 0 || offset > file_size)
+    return false;
+  return element_size == 0 || count <= (file_size - offset) / element_size;
+}
+
+// true if the adjacency index and the edges only refer to data inside the file; the sections must fit in the file.
+// Lookups index the mapped memory without further checks, so this is done once, when the file is mapped.
+bool checkFileGraph(const char *data, const FileHeader &header, const std::string &filename)
+{
+  const boost::uint64_t *adjacency = reinterpret_cast<const boost::uint64_t*>(data + header.adjacency_offset_);
+  if (adjacency[0] != 0 || adjacency[header.milestone_count_] != header.edge_count_)
+  {
+    logError("Constraint approximation file '%s' has an inconsistent adjacency index", filename.c_str());
+    return false;
+  }
+  for (boost::uint64_t i = 0 ; i < header.milestone_count_ ; ++i)
+    if (adjacency[i] > adjacency[i + 1])
+    {
+      logError("Constraint approximation file '%s' has a decreasing adjacency index at milestone %llu", filename.c_str(), (unsigned long long)i);
+      return false;
+    }
+
+  const EdgeRecord *edges = reinterpret_cast<const EdgeRecord*>(data + header.edges_offset_);
+  for (boost::uint64_t i = 0 ; i < header.milestone_count_ ; ++i)
+    for (boost::uint64_t k = adjacency[i] ; k < adjacency[i + 1] ; ++k)
+    {
+      const EdgeRecord &e = edges[k];
+      bool valid = e.target_ < header.milestone_count_ && (k == adjacency[i] || edges[k - 1].target_ <= e.target_);
+      if (e.first_ == NO_MOTION)
+        valid = valid && e.last_ == NO_MOTION;
+      else
+        valid = valid && e.first_ <= e.last_ && e.last_ <= header.state_count_;
+      if (!valid)
+      {
+        logError("Constraint approximation file '%s' has an invalid edge from milestone %llu", filename.c_str(), (unsigned long long)i);
+        return false;
+      }
+    }
+  return true;
+}
+
+bool checkFileHeader(const char *data, std::size_t size, const ompl::base::StateSpacePtr &space, const std::string &filename)
+{
+  if (size < sizeof(FileHeader))
+    return false;
+  const FileHeader *header = reinterpret_cast<const FileHeader*>(data);
+  if (memcmp(header->magic_, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+    return false;
+  if (header->version_ != FILE_VERSION || header->byte_order_ != FILE_BYTE_ORDER_MARK)
+  {
+    logError("Constraint approximation file '%s' has version %u and byte order mark %x. Expected version %u and byte order mark %x",
+             filename.c_str(), header->version_, header->byte_order_, FILE_VERSION, FILE_BYTE_ORDER_MARK);
+    return false;
+  }
+  if (header->state_size_ != space->getSerializationLength() || header->state_stride_ < header->state_size_ ||
+      header->state_stride_ % 8 != 0 || header->milestone_count_ > header->state_count_)
+  {
+    logError("Constraint approximation file '%s' does not describe states of space '%s'", filename.c_str(), space->getName().c_str());
+    return false;
+  }
+  if (!sectionFits(header->signature_offset_, header->signature_count_, sizeof(boost::int32_t), size) ||
+      !sectionFits(header->states_offset_, header->state_count_, header->state_stride_, size) ||
+      !sectionFits(header->adjacency_offset_, header->milestone_count_ + 1, sizeof(boost::uint64_t), size) ||
+      !sectionFits(header->edges_offset_, header->edge_count_, sizeof(EdgeRecord), size))
+  {
+    logError("Constraint approximation file '%s' is truncated", filename.c_str());
+    return false;
+  }
+
+  std::vector<boost::int32_t> signature;
+  computeFileSignature(space, signature);
+  const boost::int32_t *file_signature = reinterpret_cast<const boost::int32_t*>(data + header->signature_offset_);
+  if (signature.size() != header->signature_count_ || !std::equal(signature.begin(), signature.end(), file_signature))
+  {
+    logError("Constraint approximation file '%s' was computed for a different state space than '%s'", filename.c_str(), space->getName().c_str());
+    return false;
+  }
+
+  return checkFileGraph(data, *header, filename);
+}
+
+class MappedConstraintApproximationDatabase : public ConstraintApproximationDatabase
+{
+public:
+
+  MappedConstraintApproximationDatabase(const ompl::base::StateSpacePtr &space, const std::string &filename) :
+    space_(space),
+    file_(filename.c_str(), boost::interprocess::read_only),
+    region_(file_, boost::interprocess::read_only),
+    data_(static_cast<const char*>(region_.get_address())),
+    states_(NULL), adjacency_(NULL), edges_(NULL),
+    state_stride_(0), state_count_(0), milestone_count_(0),
+    model_based_(dynamic_cast<const ModelBasedStateSpace*>(space.get()) != NULL)
+  {
+  }
+
+  /** \brief Check the header of the mapped file and locate its sections */
+  bool initialize(const std::string &filename)
+  {
+    if (!checkFileHeader(data_, region_.get_size(), space_, filename))
+      return false;
+    const FileHeader *header = reinterpret_cast<const FileHeader*>(data_);
+    state_stride_ = header->state_stride_;
+    state_count_ = header->state_count_;
+    milestone_count_ = header->milestone_count_;
+    states_ = data_ + header->states_offset_;
+    adjacency_ = reinterpret_cast<const boost::uint64_t*>(data_ + header->adjacency_offset_);
+    edges_ = reinterpret_cast<const EdgeRecord*>(data_ + header->edges_offset_);
+    return true;
+  }
+
+  virtual const ompl::base::StateSpacePtr& getStateSpace() const
+  {
+    return space_;
+  }
+
+  virtual std::size_t size() const
+  {
+    return state_count_;
+  }
+
+  virtual void copyState(std::size_t index, ompl::base::State *state) const
+  {
+    space_->deserialize(state, states_ + index * state_stride_);
+    if (model_based_)
+      state->as<ModelBasedStateSpace::StateType>()->clearKnownInformation();
+  }
+
+  virtual std::size_t getConnectionCount(std::size_t milestone) const
+  {
+    return adjacency_[milestone + 1] - adjacency_[milestone];
+  }
+
+  virtual std::size_t getConnection(std::size_t milestone, std::size_t k) const
+  {
+    return edges_[adjacency_[milestone] + k].target_;
+  }
+
+  virtual bool getMotion(std::size_t from, std::size_t to, std::size_t &first, std::size_t &last) const
+  {
+    if (from >= milestone_count_)
+      return false;
+    const EdgeRecord *begin = edges_ + adjacency_[from];
+    const EdgeRecord *end = edges_ + adjacency_[from + 1];
+    const EdgeRecord *e = std::lower_bound(begin, end, (boost::uint64_t)to, &edgeTargetLessThan);
+    if (e == end || e->target_ != to || e->first_ == NO_MOTION)
+      return false;
+    first = e->first_;
+    last = e->last_;
+    return true;
+  }
+
+private:
+
+  ompl::base::StateSpacePtr             space_;
+  boost::interprocess::file_mapping     file_;
+  boost::interprocess::mapped_region    region_;
+  const char                           *data_;
+  const char                           *states_;
+  const boost::uint64_t                *adjacency_;
+  const EdgeRecord                     *edges_;
+  std::size_t                           state_stride_;
+  std::size_t                           state_count_;
+  std::size_t                           milestone_count_;
+
+  /** \brief Whether the states are ModelBasedStateSpace states, whose cached information must be cleared */
+  bool                                  model_based_;
+};
+
+void writePadding(std::ofstream &out, std::size_t count)
+{
+  static const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  out.write(zeros, count);
+}
+
+}
+
+bool isConstraintApproximationFile(const std::string &filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(FILE_MAGIC)];
+  if (!in.read(magic, sizeof(magic)))
+    return false;
+  return memcmp(magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0;
+}
+
+ConstraintApproximationDatabasePtr mapConstraintApproximationFile(const std::string &filename, const ompl::base::StateSpacePtr &space)
+{
+  try
+  {
+    boost::shared_ptr<MappedConstraintApproximationDatabase> database(new MappedConstraintApproximationDatabase(space, filename));
+    if (database->initialize(filename))
+      return database;
+  }
+  catch(boost::interprocess::interprocess_exception &ex)
+  {
+    logError("Unable to map constraint approximation file '%s': %s", filename.c_str(), ex.what());
+  }
+  return ConstraintApproximationDatabasePtr();
+}
+
+bool saveConstraintApproximationFile(const std::string &filename, const ConstraintApproximationDatabase &database, std::size_t milestones)
+{
+  const ompl::base::StateSpacePtr &space = database.getStateSpace();
+  const std::size_t count = database.size();
+  if (milestones == 0 || milestones > count)
+    milestones = count;
+
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic_, FILE_MAGIC, sizeof(FILE_MAGIC));
+  header.version_ = FILE_VERSION;
+  header.byte_order_ = FILE_BYTE_ORDER_MARK;
+
+  std::vector<boost::int32_t> signature;
+  computeFileSignature(space, signature);
+
+  // gather the edges of each milestone, sorted by target so lookups can use binary search
+  std::vector<boost::uint64_t> adjacency(milestones + 1, 0);
+  std::vector<EdgeRecord> edges;
+  for (std::size_t i = 0 ; i < milestones ; ++i)
+  {
+    std::size_t first_edge = edges.size();
+    std::size_t nc = database.getConnectionCount(i);
+    for (std::size_t k = 0 ; k < nc ; ++k)
+    {
+      EdgeRecord e;
+      e.target_ = database.getConnection(i, k);
+      if (e.target_ >= milestones)
+        continue;
+      std::size_t first, last;
+      if (database.getMotion(i, e.target_, first, last) && first <= last && last <= count)
+      {
+        e.first_ = first;
+        e.last_ = last;
+      }
+      else
+        e.first_ = e.last_ = NO_MOTION;
+      edges.push_back(e);
+    }
+    std::sort(edges.begin() + first_edge, edges.end(), &edgeTargetLess);
+    adjacency[i + 1] = edges.size();
+  }
+
+  header.state_size_ = space->getSerializationLength();
+  header.state_stride_ = align8(header.state_size_);
+  header.state_count_ = count;
+  header.milestone_count_ = milestones;
+  header.edge_count_ = edges.size();
+  header.signature_offset_ = align8(sizeof(FileHeader));
+  header.signature_count_ = signature.size();
+  header.states_offset_ = align8(header.signature_offset_ + signature.size() * sizeof(boost::int32_t));
+  header.adjacency_offset_ = header.states_offset_ + count * header.state_stride_;
+  header.edges_offset_ = header.adjacency_offset_ + adjacency.size() * sizeof(boost::uint64_t);
+
+  // write to a temporary file and rename it, so the file is replaced atomically for processes that have it mapped
+  std::string temp_filename = filename + ".tmp";
+  std::ofstream out(temp_filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  writePadding(out, header.signature_offset_ - sizeof(header));
+  if (!signature.empty())
+    out.write(reinterpret_cast<const char*>(&signature[0]), signature.size() * sizeof(boost::int32_t));
+  writePadding(out, header.states_offset_ - header.signature_offset_ - signature.size() * sizeof(boost::int32_t));
+
+  std::vector<char> record(header.state_stride_, 0);
+  ompl::base::State *state = space->allocState();
+  for (std::size_t i = 0 ; i < count && out.good() ; ++i)
+  {
+    database.copyState(i, state);
+    space->serialize(&record[0], state);
+    out.write(&record[0], record.size());
+  }
+  space->freeState(state);
+
+  out.write(reinterpret_cast<const char*>(&adjacency[0]), adjacency.size() * sizeof(boost::uint64_t));
+  if (!edges.empty())
+    out.write(reinterpret_cast<const char*>(&edges[0]), edges.size() * sizeof(EdgeRecord));
+  out.close();
+
+  if (!out.good())
+  {
+    logError("Unable to write constraint approximation file '%s'", temp_filename.c_str());
+    boost::system::error_code ec;
+    boost::filesystem::remove(temp_filename, ec);
+    return false;
+  }
+
+  try
+  {
+    boost::filesystem::rename(temp_filename, filename);
+  }
+  catch(boost::filesystem::filesystem_error &ex)
+  {
+    logError("Unable to rename '%s' to '%s': %s", temp_filename.c_str(), filename.c_str(), ex.what());
+    return false;
+  }
+  return true;
+}
+
+}
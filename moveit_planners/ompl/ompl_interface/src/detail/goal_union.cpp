@@ -35,6 +35,7 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/ompl_interface/detail/goal_union.h>
+#include <moveit/ompl_interface/detail/constrained_goal_sampler.h>
 #include <ompl/base/goals/GoalLazySamples.h>
 
 namespace
@@ -61,7 +62,9 @@ ompl_interface::GoalSampleableRegionMux::GoalSampleableRegionMux(const std::vect
 void ompl_interface::GoalSampleableRegionMux::startSampling()
 {
   for (std::size_t i = 0 ; i < goals_.size() ; ++i)
-    if (goals_[i]->hasType(ompl::base::GOAL_LAZY_SAMPLES))
+    if (ConstrainedGoalSampler *cgs = dynamic_cast<ConstrainedGoalSampler*>(goals_[i].get()))
+      cgs->startSamplingSession();
+    else if (goals_[i]->hasType(ompl::base::GOAL_LAZY_SAMPLES))
       static_cast<ompl::base::GoalLazySamples*>(goals_[i].get())->startSampling();
 }
 
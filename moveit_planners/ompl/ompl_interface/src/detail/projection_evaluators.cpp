@@ -70,6 +70,11 @@ void ompl_interface::ProjectionEvaluatorLinkPose::project(const ompl::base::Stat
   projection(2) = o.z();
 }
 
+void ompl_interface::ProjectionEvaluatorLinkPose::setStartState(const robot_state::RobotState &state)
+{
+  tss_.setStartState(state);
+}
+
 ompl_interface::ProjectionEvaluatorJointValue::ProjectionEvaluatorJointValue(const ModelBasedPlanningContext *pc,
                                                                              const std::vector<unsigned int> &variables)
   : ompl::base::ProjectionEvaluator(pc->getOMPLStateSpace())
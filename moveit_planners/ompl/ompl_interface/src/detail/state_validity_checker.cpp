@@ -68,6 +68,11 @@ void ompl_interface::StateValidityChecker::setVerbose(bool flag)
   verbose_ = flag;
 }
 
+void ompl_interface::StateValidityChecker::setStartState(const robot_state::RobotState &state)
+{
+  tss_.setStartState(state);
+}
+
 bool ompl_interface::StateValidityChecker::isValid(const ompl::base::State *state, bool verbose) const
 {
   //  moveit::Profiler::ScopedBlock sblock("isValid");
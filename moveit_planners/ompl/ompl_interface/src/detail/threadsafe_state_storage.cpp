@@ -36,32 +36,47 @@
 
 #include <moveit/ompl_interface/detail/threadsafe_state_storage.h>
 
-ompl_interface::TSStateStorage::TSStateStorage(const robot_model::RobotModelPtr &kmodel) : start_state_(kmodel)
+ompl_interface::TSStateStorage::TSStateStorage(const robot_model::RobotModelPtr &kmodel)
+  : start_state_(kmodel)
+  , start_state_version_(0)
 {
   start_state_.setToDefaultValues();
 }
 
-ompl_interface::TSStateStorage::TSStateStorage(const robot_state::RobotState &start_state) : start_state_(start_state)
+ompl_interface::TSStateStorage::TSStateStorage(const robot_state::RobotState &start_state)
+  : start_state_(start_state)
+  , start_state_version_(0)
 {
 }
 
 ompl_interface::TSStateStorage::~TSStateStorage()
 {
-  for (std::map<boost::thread::id, robot_state::RobotState*>::iterator it = thread_states_.begin() ; it != thread_states_.end() ; ++it)
-    delete it->second;
 }
 
 robot_state::RobotState* ompl_interface::TSStateStorage::getStateStorage() const
 {
-  robot_state::RobotState *st = NULL;
-  boost::mutex::scoped_lock slock(lock_);/// \todo use Thread Local Storage?
-  std::map<boost::thread::id, robot_state::RobotState*>::const_iterator it = thread_states_.find(boost::this_thread::get_id());
-  if (it == thread_states_.end())
+  ThreadState *ts = thread_states_.get();
+
+  // the lock is only needed to copy the start state, the first time or after it changed
+  if (!ts || ts->start_state_version_ != start_state_version_.load(boost::memory_order_acquire))
   {
-    st = new robot_state::RobotState(start_state_);
-    thread_states_[boost::this_thread::get_id()] = st;
+    boost::mutex::scoped_lock slock(start_state_lock_);
+    std::size_t version = start_state_version_.load(boost::memory_order_relaxed);
+    if (!ts)
+      ts = thread_states_.set(new ThreadState(start_state_, version));
+    else
+      if (ts->start_state_version_ != version)
+      {
+        ts->state_ = start_state_;
+        ts->start_state_version_ = version;
+      }
   }
-  else
-    st = it->second;
-  return st;
+  return &ts->state_;
+}
+
+void ompl_interface::TSStateStorage::setStartState(const robot_state::RobotState &start_state)
+{
+  boost::mutex::scoped_lock slock(start_state_lock_);
+  start_state_ = start_state;
+  start_state_version_.fetch_add(1, boost::memory_order_release);
 }
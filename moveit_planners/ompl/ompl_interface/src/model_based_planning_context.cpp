@@ -64,11 +64,13 @@ ompl_interface::ModelBasedPlanningContext::ModelBasedPlanningContext(const std::
   max_goal_samples_(0),
   max_state_sampling_attempts_(0),
   max_goal_sampling_attempts_(0),
+  max_goal_sampling_threads_(1),
   max_planning_threads_(0),
   max_solution_segment_length_(0.0),
   minimum_waypoint_count_(0),
   use_state_validity_cache_(true),
-  simplify_solutions_(true)
+  simplify_solutions_(true),
+  configured_(false)
 {
   ompl_simple_setup_->getStateSpace()->computeSignature(space_signature_);
   ompl_simple_setup_->getStateSpace()->setStateSamplerAllocator(boost::bind(&ModelBasedPlanningContext::allocPathConstrainedSampler, this, _1));
@@ -182,7 +184,16 @@ void ompl_interface::ModelBasedPlanningContext::configure()
   ompl::base::ScopedState<> ompl_start_state(spec_.state_space_);
   spec_.state_space_->copyToOMPLState(ompl_start_state.get(), getCompleteInitialRobotState());
   ompl_simple_setup_->setStartState(ompl_start_state);
-  ompl_simple_setup_->setStateValidityChecker(ob::StateValidityCheckerPtr(new StateValidityChecker(this)));
+
+  // the planner and state validity checker are kept from the previous problem if it had the same attached bodies
+  // and the same planning volume; only the values of the variables outside of the group are passed on to them
+  if (!configured_)
+  {
+    ompl_simple_setup_->setStateValidityChecker(ob::StateValidityCheckerPtr(new StateValidityChecker(this)));
+    useConfig();
+  }
+  else
+    setStartStateOutsideGroup();
 
   if (path_constraints_ && spec_.constraints_library_)
   {
@@ -194,9 +205,24 @@ void ompl_interface::ModelBasedPlanningContext::configure()
     }
   }
 
-  useConfig();
   if (ompl_simple_setup_->getGoal())
     ompl_simple_setup_->setup();
+  configured_ = true;
+}
+
+void ompl_interface::ModelBasedPlanningContext::setStartStateOutsideGroup()
+{
+  StateValidityChecker *svc = dynamic_cast<StateValidityChecker*>(ompl_simple_setup_->getStateValidityChecker().get());
+  if (svc)
+    svc->setStartState(getCompleteInitialRobotState());
+
+  const std::map<std::string, ob::ProjectionEvaluatorPtr> &projections = spec_.state_space_->getRegisteredProjections();
+  for (std::map<std::string, ob::ProjectionEvaluatorPtr>::const_iterator it = projections.begin() ; it != projections.end() ; ++it)
+  {
+    ProjectionEvaluatorLinkPose *pe = dynamic_cast<ProjectionEvaluatorLinkPose*>(it->second.get());
+    if (pe)
+      pe->setStartState(getCompleteInitialRobotState());
+  }
 }
 
 void ompl_interface::ModelBasedPlanningContext::useConfig()
@@ -254,6 +280,13 @@ void ompl_interface::ModelBasedPlanningContext::setPlanningVolume(const moveit_m
   spec_.state_space_->setPlanningVolume(wparams.min_corner.x, wparams.max_corner.x,
                                         wparams.min_corner.y, wparams.max_corner.y,
                                         wparams.min_corner.z, wparams.max_corner.z);
+
+  // the space information needs to be set up again for new bounds
+  if (wparams.min_corner.x != planning_volume_.min_corner.x || wparams.max_corner.x != planning_volume_.max_corner.x ||
+      wparams.min_corner.y != planning_volume_.min_corner.y || wparams.max_corner.y != planning_volume_.max_corner.y ||
+      wparams.min_corner.z != planning_volume_.min_corner.z || wparams.max_corner.z != planning_volume_.max_corner.z)
+    configured_ = false;
+  planning_volume_ = wparams;
 }
 
 void ompl_interface::ModelBasedPlanningContext::simplifySolution(double timeout)
@@ -296,10 +329,29 @@ void ompl_interface::ModelBasedPlanningContext::setVerboseStateValidityChecks(bo
     static_cast<StateValidityChecker*>(ompl_simple_setup_->getStateValidityChecker().get())->setVerbose(flag);
 }
 
+bool ompl_interface::ModelBasedPlanningContext::supportsConcurrentIK() const
+{
+  const std::pair<robot_model::JointModelGroup::KinematicsSolver, robot_model::JointModelGroup::KinematicsSolverMap> &solvers = getJointModelGroup()->getGroupKinematics();
+  if (solvers.first.solver_instance_ && !solvers.first.solver_instance_->supportsConcurrentQueries())
+    return false;
+  for (robot_model::JointModelGroup::KinematicsSolverMap::const_iterator it = solvers.second.begin() ; it != solvers.second.end() ; ++it)
+    if (it->second.solver_instance_ && !it->second.solver_instance_->supportsConcurrentQueries())
+      return false;
+  return true;
+}
+
 ompl::base::GoalPtr ompl_interface::ModelBasedPlanningContext::constructGoal()
 {
   // ******************* set up the goal representation, based on goal constraints
 
+  // the constraint samplers of all threads use the same kinematics solvers
+  unsigned int goal_sampling_threads = max_goal_sampling_threads_;
+  if (goal_sampling_threads > 1 && !supportsConcurrentIK())
+  {
+    logDebug("The kinematics solvers of group '%s' do not support concurrent queries; goals are sampled by one thread", getGroupName().c_str());
+    goal_sampling_threads = 1;
+  }
+
   std::vector<ob::GoalPtr> goals;
   for (std::size_t i = 0 ; i < goal_constraints_.size() ; ++i)
   {
@@ -308,7 +360,22 @@ ompl::base::GoalPtr ompl_interface::ModelBasedPlanningContext::constructGoal()
       cs = spec_.constraint_sampler_manager_->selectSampler(getPlanningScene(), getGroupName(), goal_constraints_[i]->getAllConstraints());
     if (cs)
     {
-      ob::GoalPtr g = ob::GoalPtr(new ConstrainedGoalSampler(this, goal_constraints_[i], cs));
+      ob::GoalPtr g;
+      if (goal_sampling_threads > 1)
+      {
+        // each sampling thread needs its own constraint sampler
+        std::vector<constraint_samplers::ConstraintSamplerPtr> samplers(1, cs);
+        for (unsigned int t = 1 ; t < goal_sampling_threads ; ++t)
+        {
+          constraint_samplers::ConstraintSamplerPtr extra =
+            spec_.constraint_sampler_manager_->selectSampler(getPlanningScene(), getGroupName(), goal_constraints_[i]->getAllConstraints());
+          if (extra)
+            samplers.push_back(extra);
+        }
+        g.reset(new ConstrainedGoalSampler(this, goal_constraints_[i], samplers));
+      }
+      else
+        g.reset(new ConstrainedGoalSampler(this, goal_constraints_[i], cs));
       goals.push_back(g);
     }
   }
@@ -321,17 +388,51 @@ ompl::base::GoalPtr ompl_interface::ModelBasedPlanningContext::constructGoal()
   return ob::GoalPtr();
 }
 
+namespace
+{
+// true if the two states have the same bodies attached at the same places
+bool haveSameAttachedBodies(const robot_state::RobotState &a, const robot_state::RobotState &b)
+{
+  std::vector<const robot_state::AttachedBody*> attached_a, attached_b;
+  a.getAttachedBodies(attached_a);
+  b.getAttachedBodies(attached_b);
+  if (attached_a.size() != attached_b.size())
+    return false;
+  for (std::size_t i = 0 ; i < attached_a.size() ; ++i)
+  {
+    const robot_state::AttachedBody *other = b.getAttachedBody(attached_a[i]->getName());
+    if (!other || other->getAttachedLink() != attached_a[i]->getAttachedLink() ||
+        other->getShapes() != attached_a[i]->getShapes() ||
+        other->getFixedTransforms().size() != attached_a[i]->getFixedTransforms().size())
+      return false;
+    for (std::size_t j = 0 ; j < other->getFixedTransforms().size() ; ++j)
+      if (!other->getFixedTransforms()[j].isApprox(attached_a[i]->getFixedTransforms()[j]))
+        return false;
+  }
+  return true;
+}
+}
+
 void ompl_interface::ModelBasedPlanningContext::setCompleteInitialState(const robot_state::RobotState &complete_initial_robot_state)
 {
+  // joint values are passed on to a configured context by configure(), attached bodies are not
+  if (configured_ && !haveSameAttachedBodies(complete_initial_robot_state_, complete_initial_robot_state))
+    configured_ = false;
   complete_initial_robot_state_ = complete_initial_robot_state;
 }
 
 void ompl_interface::ModelBasedPlanningContext::clear()
+{
+  clearProblem();
+  ompl_simple_setup_->setStateValidityChecker(ob::StateValidityCheckerPtr());
+  configured_ = false;
+}
+
+void ompl_interface::ModelBasedPlanningContext::clearProblem()
 {
   ompl_simple_setup_->clear();
   ompl_simple_setup_->clearStartStates();
   ompl_simple_setup_->setGoal(ob::GoalPtr());
-  ompl_simple_setup_->setStateValidityChecker(ob::StateValidityCheckerPtr());
   path_constraints_.reset();
   goal_constraints_.clear();
   getOMPLStateSpace()->setInterpolationFunction(InterpolationFunction());
@@ -399,7 +500,9 @@ bool ompl_interface::ModelBasedPlanningContext::benchmark(double timeout, unsign
 void ompl_interface::ModelBasedPlanningContext::startSampling()
 {
   bool gls = ompl_simple_setup_->getGoal()->hasType(ob::GOAL_LAZY_SAMPLES);
-  if (gls)
+  if (ConstrainedGoalSampler *cgs = dynamic_cast<ConstrainedGoalSampler*>(ompl_simple_setup_->getGoal().get()))
+    cgs->startSamplingSession();
+  else if (gls)
     static_cast<ob::GoalLazySamples*>(ompl_simple_setup_->getGoal().get())->startSampling();
   else
     // we know this is a GoalSampleableMux by elimination
@@ -434,6 +537,13 @@ void ompl_interface::ModelBasedPlanningContext::postSolve()
   int iv = ompl_simple_setup_->getSpaceInformation()->getMotionValidator()->getInvalidMotionCount();
   logDebug("There were %d valid motions and %d invalid motions.", v, iv);
 
+  if (const ConstrainedGoalSampler *gs = dynamic_cast<const ConstrainedGoalSampler*>(ompl_simple_setup_->getGoal().get()))
+  {
+    GoalSamplingStatistics stats = gs->getSamplingStatistics();
+    logDebug("Goal sampling produced %u goals from %u samples in %lf seconds (%.1lf samples/s, %.1lf%% constraint sampler failures).",
+             stats.goals_, stats.samples_, stats.duration_, stats.samplesPerSecond(), 100.0 * stats.samplerFailureRate());
+  }
+
   if (ompl_simple_setup_->getProblemDefinition()->hasApproximateSolution())
     logWarn("Computed solution is approximate");
 }
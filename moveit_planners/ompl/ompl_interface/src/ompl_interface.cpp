@@ -54,6 +54,7 @@ ompl_interface::OMPLInterface::OMPLInterface(const robot_model::RobotModelConstP
   loadPlannerConfigurations();
   loadConstraintApproximations();
   loadConstraintSamplers();
+  loadContextCacheSettings();
 }
 
 ompl_interface::OMPLInterface::OMPLInterface(const robot_model::RobotModelConstPtr &kmodel, const planning_interface::PlannerConfigurationMap &pconfig, const ros::NodeHandle &nh) :
@@ -69,6 +70,7 @@ ompl_interface::OMPLInterface::OMPLInterface(const robot_model::RobotModelConstP
   setPlannerConfigurations(pconfig);
   loadConstraintApproximations();
   loadConstraintSamplers();
+  loadContextCacheSettings();
 }
 
 ompl_interface::OMPLInterface::~OMPLInterface()
@@ -167,6 +169,32 @@ bool ompl_interface::OMPLInterface::loadConstraintApproximations()
 void ompl_interface::OMPLInterface::loadConstraintSamplers()
 {
   constraint_sampler_manager_loader_.reset(new constraint_sampler_manager_loader::ConstraintSamplerManagerLoader(constraint_sampler_manager_));
+
+  int goal_sampling_threads;
+  nh_.param("goal_sampling_threads", goal_sampling_threads, 1);
+  context_manager_.setMaximumGoalSamplingThreads(goal_sampling_threads > 0 ? goal_sampling_threads : 1);
+}
+
+void ompl_interface::OMPLInterface::loadContextCacheSettings()
+{
+  int max_cached_contexts;
+  nh_.param("max_cached_contexts", max_cached_contexts, 0);
+  context_manager_.setMaximumCachedContexts(max_cached_contexts > 0 ? max_cached_contexts : 0);
+
+  std::string policy;
+  nh_.param("context_eviction_policy", policy, std::string("least_recently_used"));
+  if (policy == "least_frequently_used")
+    context_manager_.setContextEvictionPolicy(PlanningContextManager::EVICT_LEAST_FREQUENTLY_USED);
+  else
+  {
+    if (policy != "least_recently_used")
+      ROS_WARN("Unknown planning context eviction policy '%s'; using 'least_recently_used'", policy.c_str());
+    context_manager_.setContextEvictionPolicy(PlanningContextManager::EVICT_LEAST_RECENTLY_USED);
+  }
+
+  bool reuse_configuration;
+  nh_.param("reuse_context_configuration", reuse_configuration, true);
+  context_manager_.setReuseContextConfiguration(reuse_configuration);
 }
 
 void ompl_interface::OMPLInterface::loadPlannerConfigurations()
@@ -90,8 +90,65 @@ private:
 
 struct PlanningContextManager::CachedContexts
 {
+  struct Entry
+  {
+    ModelBasedPlanningContextPtr context_;
+    unsigned long                last_use_;
+    unsigned long                use_count_;
+  };
+
+  CachedContexts() : size_(0), clock_(0)
+  {
+  }
+
+  void use(Entry &entry)
+  {
+    entry.last_use_ = ++clock_;
+    entry.use_count_++;
+  }
+
+  /// remove the context the policy chooses among the ones not currently in use; return false if all are in use
+  bool evict(ContextEvictionPolicy policy)
+  {
+    std::map<std::pair<std::string, std::string>, std::vector<Entry> >::iterator victim_list = contexts_.end();
+    std::size_t victim = 0;
+    for (std::map<std::pair<std::string, std::string>, std::vector<Entry> >::iterator it = contexts_.begin() ; it != contexts_.end() ; ++it)
+      for (std::size_t i = 0 ; i < it->second.size() ; ++i)
+      {
+        const Entry &e = it->second[i];
+        if (!e.context_.unique())
+          continue;
+        if (victim_list != contexts_.end())
+        {
+          const Entry &v = victim_list->second[victim];
+          if (policy == EVICT_LEAST_FREQUENTLY_USED ?
+              (e.use_count_ > v.use_count_ || (e.use_count_ == v.use_count_ && e.last_use_ >= v.last_use_)) :
+              e.last_use_ >= v.last_use_)
+            continue;
+        }
+        victim_list = it;
+        victim = i;
+      }
+    if (victim_list == contexts_.end())
+      return false;
+    logDebug("Removing cached planning context '%s'", victim_list->second[victim].context_->getName().c_str());
+    victim_list->second.erase(victim_list->second.begin() + victim);
+    if (victim_list->second.empty())
+      contexts_.erase(victim_list);
+    size_--;
+    return true;
+  }
+
+  void clear()
+  {
+    contexts_.clear();
+    size_ = 0;
+  }
+
   std::map<std::pair<std::string, std::string>,
-           std::vector<ModelBasedPlanningContextPtr> > contexts_;
+           std::vector<Entry> >                        contexts_;
+  std::size_t                                          size_;
+  unsigned long                                        clock_;
   boost::mutex                                         lock_;
 };
 
@@ -99,8 +156,9 @@ struct PlanningContextManager::CachedContexts
 
 ompl_interface::PlanningContextManager::PlanningContextManager(const robot_model::RobotModelConstPtr &kmodel, const constraint_samplers::ConstraintSamplerManagerPtr &csm) :
   kmodel_(kmodel), constraint_sampler_manager_(csm),
-  max_goal_samples_(10), max_state_sampling_attempts_(4), max_goal_sampling_attempts_(1000),
-  max_planning_threads_(4), max_solution_segment_length_(0.0), minimum_waypoint_count_(2)
+  max_goal_samples_(10), max_state_sampling_attempts_(4), max_goal_sampling_attempts_(1000), max_goal_sampling_threads_(1),
+  max_planning_threads_(4), max_solution_segment_length_(0.0), minimum_waypoint_count_(2),
+  max_cached_contexts_(0), context_eviction_policy_(EVICT_LEAST_RECENTLY_USED), reuse_context_configuration_(true)
 {
   last_planning_context_.reset(new LastPlanningContext());
   cached_contexts_.reset(new CachedContexts());
@@ -170,6 +228,10 @@ ompl_interface::ConfiguredPlannerSelector ompl_interface::PlanningContextManager
 void ompl_interface::PlanningContextManager::setPlannerConfigurations(const planning_interface::PlannerConfigurationMap &pconfig)
 {
   planner_configs_ = pconfig;
+
+  // cached contexts were configured for the previous settings
+  boost::mutex::scoped_lock slock(cached_contexts_->lock_);
+  cached_contexts_->clear();
 }
 
 ompl_interface::ModelBasedPlanningContextPtr ompl_interface::PlanningContextManager::getPlanningContext(const std::string &config, const std::string& factory_type) const
@@ -199,17 +261,25 @@ ompl_interface::ModelBasedPlanningContextPtr ompl_interface::PlanningContextMana
 
   {
     boost::mutex::scoped_lock slock(cached_contexts_->lock_);
-    std::map<std::pair<std::string, std::string>, std::vector<ModelBasedPlanningContextPtr> >::const_iterator cc =
+    std::map<std::pair<std::string, std::string>, std::vector<CachedContexts::Entry> >::iterator cc =
       cached_contexts_->contexts_.find(std::make_pair(config.name, factory->getType()));
     if (cc != cached_contexts_->contexts_.end())
     {
+      // prefer a context that is already configured, so its setup can be kept
+      std::size_t index = cc->second.size();
       for (std::size_t i = 0 ; i < cc->second.size() ; ++i)
-        if (cc->second[i].unique())
+        if (cc->second[i].context_.unique() && (index == cc->second.size() || cc->second[i].context_->isConfigured()))
         {
-          logDebug("Reusing cached planning context");
-          context = cc->second[i];
-          break;
+          index = i;
+          if (cc->second[i].context_->isConfigured())
+            break;
         }
+      if (index < cc->second.size())
+      {
+        logDebug("Reusing cached planning context");
+        context = cc->second[index].context_;
+        cached_contexts_->use(cc->second[index]);
+      }
     }
   }
 
@@ -250,7 +320,19 @@ ompl_interface::ModelBasedPlanningContextPtr ompl_interface::PlanningContextMana
     context->useStateValidityCache(state_validity_cache);
     {
       boost::mutex::scoped_lock slock(cached_contexts_->lock_);
-      cached_contexts_->contexts_[std::make_pair(config.name, factory->getType())].push_back(context);
+      while (max_cached_contexts_ > 0 && cached_contexts_->size_ >= max_cached_contexts_)
+        if (!cached_contexts_->evict(context_eviction_policy_))
+        {
+          logDebug("All %u cached planning contexts are in use; the cache grows beyond its maximum size", (unsigned int)cached_contexts_->size_);
+          break;
+        }
+      CachedContexts::Entry entry;
+      entry.context_ = context;
+      entry.last_use_ = 0;
+      entry.use_count_ = 0;
+      cached_contexts_->use(entry);
+      cached_contexts_->contexts_[std::make_pair(config.name, factory->getType())].push_back(entry);
+      cached_contexts_->size_++;
     }
   }
 
@@ -258,6 +340,7 @@ ompl_interface::ModelBasedPlanningContextPtr ompl_interface::PlanningContextMana
   context->setMaximumGoalSamples(max_goal_samples_);
   context->setMaximumStateSamplingAttempts(max_state_sampling_attempts_);
   context->setMaximumGoalSamplingAttempts(max_goal_sampling_attempts_);
+  context->setMaximumGoalSamplingThreads(max_goal_sampling_threads_);
   if (max_solution_segment_length_ <= std::numeric_limits<double>::epsilon())
     context->setMaximumSolutionSegmentLength(context->getOMPLSimpleSetup()->getStateSpace()->getMaximumExtent() / 100.0);
   else
@@ -355,7 +438,11 @@ ompl_interface::ModelBasedPlanningContextPtr ompl_interface::PlanningContextMana
   ModelBasedPlanningContextPtr context = getPlanningContext(pc->second, boost::bind(&PlanningContextManager::getStateSpaceFactory2, this, _1, req), req);
   if (context)
   {
-    context->clear();
+    // keep the planner and state validity checker of a configured context, if allowed
+    if (reuse_context_configuration_)
+      context->clearProblem();
+    else
+      context->clear();
 
     robot_state::RobotStatePtr start_state = planning_scene->getCurrentStateUpdated(req.start_state);
 
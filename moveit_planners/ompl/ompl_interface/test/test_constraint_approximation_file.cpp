@@ -0,0 +1,252 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/ompl_interface/detail/constraint_approximation_file.h>
+#include <ompl/base/spaces/RealVectorStateSpace.h>
+#include <boost/filesystem.hpp>
+#include <boost/cstdint.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <cstring>
+
+namespace
+{
+
+// a few states of a plane, connected as a small graph
+class VectorDatabase : public ompl_interface::ConstraintApproximationDatabase
+{
+public:
+
+  VectorDatabase() : space_(new ompl::base::RealVectorStateSpace(2)), connections_(3)
+  {
+    ompl::base::RealVectorBounds bounds(2);
+    bounds.setLow(-1.0);
+    bounds.setHigh(1.0);
+    space_->as<ompl::base::RealVectorStateSpace>()->setBounds(bounds);
+    for (int i = 0 ; i < 4 ; ++i)
+    {
+      states_.push_back(space_->allocState());
+      states_.back()->as<ompl::base::RealVectorStateSpace::StateType>()->values[0] = 0.1 * i;
+      states_.back()->as<ompl::base::RealVectorStateSpace::StateType>()->values[1] = -0.1 * i;
+    }
+    // milestones 0, 1 and 2; state 3 is the explicit motion from 0 to 1
+    connections_[0].push_back(2);
+    connections_[0].push_back(1);
+    connections_[1].push_back(0);
+    connections_[2].push_back(0);
+  }
+
+  virtual ~VectorDatabase()
+  {
+    for (std::size_t i = 0 ; i < states_.size() ; ++i)
+      space_->freeState(states_[i]);
+  }
+
+  virtual const ompl::base::StateSpacePtr& getStateSpace() const
+  {
+    return space_;
+  }
+
+  virtual std::size_t size() const
+  {
+    return states_.size();
+  }
+
+  virtual void copyState(std::size_t index, ompl::base::State *state) const
+  {
+    space_->copyState(state, states_[index]);
+  }
+
+  virtual std::size_t getConnectionCount(std::size_t milestone) const
+  {
+    return connections_[milestone].size();
+  }
+
+  virtual std::size_t getConnection(std::size_t milestone, std::size_t k) const
+  {
+    return connections_[milestone][k];
+  }
+
+  virtual bool getMotion(std::size_t from, std::size_t to, std::size_t &first, std::size_t &last) const
+  {
+    if (from != 0 || to != 1)
+      return false;
+    first = 3;
+    last = 4;
+    return true;
+  }
+
+private:
+
+  ompl::base::StateSpacePtr                   space_;
+  std::vector<ompl::base::State*>             states_;
+  std::vector<std::vector<std::size_t> >      connections_;
+};
+
+// offsets of the header fields of version 1 of the file format
+const std::size_t ADJACENCY_OFFSET_FIELD = 80;
+const std::size_t EDGES_OFFSET_FIELD = 88;
+const std::size_t EDGE_RECORD_SIZE = 3 * sizeof(boost::uint64_t);
+
+boost::uint64_t readWord(const std::string &data, std::size_t offset)
+{
+  boost::uint64_t value;
+  memcpy(&value, data.data() + offset, sizeof(value));
+  return value;
+}
+
+void writeWord(std::string &data, std::size_t offset, boost::uint64_t value)
+{
+  memcpy(&data[offset], &value, sizeof(value));
+}
+
+}
+
+class ConstraintApproximationFile : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    filename_ = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("constraint_approximation_%%%%-%%%%-%%%%")).string();
+    ASSERT_TRUE(ompl_interface::saveConstraintApproximationFile(filename_, database_, 3));
+    std::ifstream in(filename_.c_str(), std::ios::in | std::ios::binary);
+    contents_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  virtual void TearDown()
+  {
+    boost::system::error_code ec;
+    boost::filesystem::remove(filename_, ec);
+  }
+
+  // write contents to the file and map it
+  ompl_interface::ConstraintApproximationDatabasePtr mapContents(const std::string &contents) const
+  {
+    std::ofstream out(filename_.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), contents.size());
+    out.close();
+    return ompl_interface::mapConstraintApproximationFile(filename_, database_.getStateSpace());
+  }
+
+  std::size_t getEdgeOffset(std::size_t k) const
+  {
+    return readWord(contents_, EDGES_OFFSET_FIELD) + k * EDGE_RECORD_SIZE;
+  }
+
+  VectorDatabase database_;
+  std::string    filename_;
+  std::string    contents_;
+};
+
+TEST_F(ConstraintApproximationFile, RoundTrip)
+{
+  EXPECT_TRUE(ompl_interface::isConstraintApproximationFile(filename_));
+  ompl_interface::ConstraintApproximationDatabasePtr mapped = mapContents(contents_);
+  ASSERT_TRUE(mapped);
+  EXPECT_EQ(4u, mapped->size());
+  ASSERT_EQ(2u, mapped->getConnectionCount(0));
+  EXPECT_EQ(1u, mapped->getConnection(0, 0));
+  EXPECT_EQ(2u, mapped->getConnection(0, 1));
+  EXPECT_EQ(1u, mapped->getConnectionCount(1));
+  EXPECT_EQ(1u, mapped->getConnectionCount(2));
+
+  std::size_t first, last;
+  ASSERT_TRUE(mapped->getMotion(0, 1, first, last));
+  EXPECT_EQ(3u, first);
+  EXPECT_EQ(4u, last);
+  EXPECT_FALSE(mapped->getMotion(0, 2, first, last));
+
+  // the states are read back as they were stored
+  const ompl::base::StateSpacePtr &space = database_.getStateSpace();
+  ompl::base::State *expected = space->allocState();
+  ompl::base::State *loaded = space->allocState();
+  for (std::size_t i = 0 ; i < database_.size() ; ++i)
+  {
+    database_.copyState(i, expected);
+    mapped->copyState(i, loaded);
+    EXPECT_TRUE(space->equalStates(expected, loaded));
+    EXPECT_DOUBLE_EQ(0.1 * i, loaded->as<ompl::base::RealVectorStateSpace::StateType>()->values[0]);
+  }
+  space->freeState(expected);
+  space->freeState(loaded);
+}
+
+TEST_F(ConstraintApproximationFile, RejectsTruncatedFile)
+{
+  EXPECT_FALSE(mapContents(contents_.substr(0, contents_.size() - EDGE_RECORD_SIZE)));
+}
+
+TEST_F(ConstraintApproximationFile, RejectsDecreasingAdjacency)
+{
+  // milestone 0 claims more edges than milestone 1 starts at
+  std::string corrupted = contents_;
+  writeWord(corrupted, readWord(contents_, ADJACENCY_OFFSET_FIELD) + sizeof(boost::uint64_t), 4);
+  EXPECT_FALSE(mapContents(corrupted));
+}
+
+TEST_F(ConstraintApproximationFile, RejectsInvalidEdges)
+{
+  // a target that is not a milestone
+  std::string corrupted = contents_;
+  writeWord(corrupted, getEdgeOffset(0), 1000000);
+  EXPECT_FALSE(mapContents(corrupted));
+
+  // a motion that ends beyond the stored states
+  corrupted = contents_;
+  writeWord(corrupted, getEdgeOffset(0) + 2 * sizeof(boost::uint64_t), 5);
+  EXPECT_FALSE(mapContents(corrupted));
+
+  // a motion that ends before it starts
+  corrupted = contents_;
+  writeWord(corrupted, getEdgeOffset(0) + sizeof(boost::uint64_t), 4);
+  writeWord(corrupted, getEdgeOffset(0) + 2 * sizeof(boost::uint64_t), 3);
+  EXPECT_FALSE(mapContents(corrupted));
+
+  // edges of a milestone out of order
+  corrupted = contents_;
+  std::string first_edge = corrupted.substr(getEdgeOffset(0), EDGE_RECORD_SIZE);
+  corrupted.replace(getEdgeOffset(0), EDGE_RECORD_SIZE, corrupted.substr(getEdgeOffset(1), EDGE_RECORD_SIZE));
+  corrupted.replace(getEdgeOffset(1), EDGE_RECORD_SIZE, first_edge);
+  EXPECT_FALSE(mapContents(corrupted));
+
+  // the original is still accepted
+  EXPECT_TRUE(mapContents(contents_));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
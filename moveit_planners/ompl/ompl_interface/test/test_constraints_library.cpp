@@ -0,0 +1,412 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2012, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Ioan Sucan */
+
+#include <moveit/ompl_interface/constraints_library.h>
+#include <moveit/constraint_samplers/constraint_sampler_manager.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/kinematics_base/kinematics_base.h>
+#include <ompl/base/ScopedState.h>
+#include <urdf_parser/urdf_parser.h>
+#include <ros/package.h>
+#include <boost/filesystem/path.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <algorithm>
+
+/* A kinematics solver that does not support concurrent queries. It never finds a solution, so the samplers fall back
+   to uniform sampling, and it records how many of its queries overlapped. */
+class SerialKinematics : public kinematics::KinematicsBase
+{
+public:
+
+  SerialKinematics(const robot_model::JointModelGroup *jmg) :
+    joint_names_(jmg->getActiveJointModelNames()), link_names_(jmg->getLinkModelNames()), calls_(0), active_(0), max_active_(0)
+  {
+    setValues("", jmg->getName(), jmg->getParentModel().getModelFrame(), link_names_.back(), 0.1);
+  }
+
+  virtual bool getPositionIK(const geometry_msgs::Pose &ik_pose, const std::vector<double> &ik_seed_state, std::vector<double> &solution,
+                             moveit_msgs::MoveItErrorCodes &error_code, const kinematics::KinematicsQueryOptions &options) const
+  {
+    return query(error_code);
+  }
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose, const std::vector<double> &ik_seed_state, double timeout,
+                                std::vector<double> &solution, moveit_msgs::MoveItErrorCodes &error_code,
+                                const kinematics::KinematicsQueryOptions &options) const
+  {
+    return query(error_code);
+  }
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose, const std::vector<double> &ik_seed_state, double timeout,
+                                const std::vector<double> &consistency_limits, std::vector<double> &solution,
+                                moveit_msgs::MoveItErrorCodes &error_code, const kinematics::KinematicsQueryOptions &options) const
+  {
+    return query(error_code);
+  }
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose, const std::vector<double> &ik_seed_state, double timeout,
+                                std::vector<double> &solution, const IKCallbackFn &solution_callback,
+                                moveit_msgs::MoveItErrorCodes &error_code, const kinematics::KinematicsQueryOptions &options) const
+  {
+    return query(error_code);
+  }
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose, const std::vector<double> &ik_seed_state, double timeout,
+                                const std::vector<double> &consistency_limits, std::vector<double> &solution,
+                                const IKCallbackFn &solution_callback, moveit_msgs::MoveItErrorCodes &error_code,
+                                const kinematics::KinematicsQueryOptions &options) const
+  {
+    return query(error_code);
+  }
+
+  virtual bool getPositionFK(const std::vector<std::string> &link_names, const std::vector<double> &joint_angles,
+                             std::vector<geometry_msgs::Pose> &poses) const
+  {
+    return false;
+  }
+
+  virtual bool initialize(const std::string &robot_description, const std::string &group_name, const std::string &base_frame,
+                          const std::string &tip_frame, double search_discretization)
+  {
+    return true;
+  }
+
+  virtual const std::vector<std::string>& getJointNames() const
+  {
+    return joint_names_;
+  }
+
+  virtual const std::vector<std::string>& getLinkNames() const
+  {
+    return link_names_;
+  }
+
+  std::size_t getCalls() const
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    return calls_;
+  }
+
+  std::size_t getMaxConcurrentCalls() const
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    return max_active_;
+  }
+
+private:
+
+  bool query(moveit_msgs::MoveItErrorCodes &error_code) const
+  {
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      ++calls_;
+      max_active_ = std::max(max_active_, ++active_);
+    }
+    // leave other threads time to overlap with this query
+    boost::this_thread::sleep(boost::posix_time::microseconds(200));
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      --active_;
+    }
+    error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  std::vector<std::string> joint_names_;
+  std::vector<std::string> link_names_;
+  mutable boost::mutex lock_;
+  mutable std::size_t calls_;
+  mutable std::size_t active_;
+  mutable std::size_t max_active_;
+};
+
+kinematics::KinematicsBasePtr allocateSolver(const kinematics::KinematicsBasePtr &solver, const robot_model::JointModelGroup *jmg)
+{
+  return solver;
+}
+
+class ConstraintsLibraryPr2 : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    std::string resource_dir = ros::package::getPath("moveit_resources");
+    if (resource_dir == "")
+    {
+      FAIL() << "Failed to find package moveit_resources.";
+      return;
+    }
+    boost::filesystem::path res_path(resource_dir);
+
+    srdf_model_.reset(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file((res_path / "test/urdf/robot.xml").string().c_str(), std::fstream::in);
+    if (xml_file.is_open())
+    {
+      while (xml_file.good())
+      {
+        std::string line;
+        std::getline(xml_file, line);
+        xml_string += (line + "\n");
+      }
+      xml_file.close();
+      urdf_model_ = urdf::parseURDF(xml_string);
+    }
+    ASSERT_TRUE(urdf_model_);
+    srdf_model_->initFile(*urdf_model_, (res_path / "test/srdf/robot.xml").string());
+    kmodel_.reset(new robot_model::RobotModel(urdf_model_, srdf_model_));
+    scene_.reset(new planning_scene::PlanningScene(kmodel_));
+
+    planning_interface::PlannerConfigurationSettings settings;
+    settings.group = "right_arm";
+    settings.name = "right_arm";
+    settings.config["type"] = "geometric::RRTConnect";
+    planning_interface::PlannerConfigurationMap pconfig;
+    pconfig[settings.name] = settings;
+
+    manager_.reset(new ompl_interface::PlanningContextManager(kmodel_, constraint_samplers::ConstraintSamplerManagerPtr(new constraint_samplers::ConstraintSamplerManager())));
+    manager_->setPlannerConfigurations(pconfig);
+
+    // the shoulder of the right arm stays within 0.3 rad of 0
+    constraints_.name = "pan";
+    constraints_.joint_constraints.resize(1);
+    constraints_.joint_constraints[0].joint_name = "r_shoulder_pan_joint";
+    constraints_.joint_constraints[0].position = 0.0;
+    constraints_.joint_constraints[0].tolerance_above = 0.3;
+    constraints_.joint_constraints[0].tolerance_below = 0.3;
+    constraints_.joint_constraints[0].weight = 1.0;
+
+    options_.state_space_parameterization = "JointModel";
+    options_.samples = 40;
+    options_.edges_per_sample = 4;
+    options_.explicit_motions = true;
+    options_.explicit_points_resolution = 0.1;
+    options_.max_explicit_points = 5;
+  };
+
+  virtual void TearDown()
+  {
+  }
+
+  /* Check that the milestones and the states of the explicit motions of \e approx satisfy the constraints, and that
+     its connections are symmetric and respect the options. Return the number of connections. */
+  std::size_t checkApproximation(const ompl_interface::ConstraintApproximationConstPtr &approx, std::size_t milestones) const
+  {
+    EXPECT_EQ(milestones, approx->getMilestoneCount());
+    ompl_interface::ConstraintApproximationDatabaseConstPtr db = approx->getDatabase();
+    EXPECT_TRUE(db);
+    if (!db)
+      return 0;
+
+    ompl_interface::ModelBasedPlanningContextPtr pc = manager_->getPlanningContext("right_arm", options_.state_space_parameterization);
+    kinematic_constraints::KinematicConstraintSet kset(kmodel_);
+    kset.add(constraints_, scene_->getTransforms());
+    robot_state::RobotState state(kmodel_);
+    state.setToDefaultValues();
+    ompl::base::ScopedState<> temp(pc->getOMPLStateSpace());
+
+    std::size_t connections = 0;
+    std::size_t motion_states = 0;
+    for (std::size_t i = 0 ; i < milestones ; ++i)
+    {
+      db->copyState(i, temp.get());
+      pc->getOMPLStateSpace()->copyToRobotState(state, temp.get());
+      EXPECT_TRUE(kset.decide(state).satisfied);
+
+      std::size_t count = db->getConnectionCount(i);
+      EXPECT_LE(count, options_.edges_per_sample);
+      for (std::size_t k = 0 ; k < count ; ++k)
+      {
+        std::size_t j = db->getConnection(i, k);
+        EXPECT_LT(j, milestones);
+        EXPECT_NE(i, j);
+        bool symmetric = false;
+        for (std::size_t l = 0 ; l < db->getConnectionCount(j) && !symmetric ; ++l)
+          symmetric = db->getConnection(j, l) == i;
+        EXPECT_TRUE(symmetric);
+        if (j < i)
+          continue;
+        ++connections;
+
+        std::size_t first, last;
+        if (db->getMotion(i, j, first, last))
+        {
+          EXPECT_LE(milestones, first);
+          EXPECT_LE(first, last);
+          EXPECT_LE(last, db->size());
+          motion_states += last - first;
+          for (std::size_t s = first ; s < last ; ++s)
+          {
+            db->copyState(s, temp.get());
+            pc->getOMPLStateSpace()->copyToRobotState(state, temp.get());
+            EXPECT_TRUE(kset.decide(state).satisfied);
+          }
+        }
+      }
+    }
+
+    // besides the milestones, only the states of the explicit motions are stored
+    EXPECT_EQ(db->size(), milestones + motion_states);
+    return connections;
+  }
+
+protected:
+
+  boost::shared_ptr<urdf::ModelInterface>                   urdf_model_;
+  boost::shared_ptr<srdf::Model>                            srdf_model_;
+  robot_model::RobotModelPtr                                kmodel_;
+  planning_scene::PlanningScenePtr                          scene_;
+  boost::shared_ptr<ompl_interface::PlanningContextManager> manager_;
+  moveit_msgs::Constraints                                  constraints_;
+  ompl_interface::ConstraintApproximationConstructionOptions options_;
+};
+
+TEST_F(ConstraintsLibraryPr2, SerialAndParallelConstruction)
+{
+  ompl_interface::ConstraintsLibrary serial_library(*manager_);
+  options_.threads = 1;
+  ompl_interface::ConstraintApproximationConstructionResults serial = serial_library.addConstraintApproximation(constraints_, "right_arm", scene_, options_);
+  ASSERT_TRUE(serial.approx);
+
+  ompl_interface::ConstraintsLibrary parallel_library(*manager_);
+  options_.threads = 4;
+  ompl_interface::ConstraintApproximationConstructionResults parallel = parallel_library.addConstraintApproximation(constraints_, "right_arm", scene_, options_);
+  ASSERT_TRUE(parallel.approx);
+
+  // the milestones are random, but both have as many of them, with valid connections
+  EXPECT_EQ(options_.samples, serial.milestones);
+  EXPECT_EQ(serial.milestones, parallel.milestones);
+  EXPECT_EQ(serial.connections, checkApproximation(serial.approx, serial.milestones));
+  EXPECT_EQ(parallel.connections, checkApproximation(parallel.approx, parallel.milestones));
+  EXPECT_GT(serial.connections, 0u);
+  EXPECT_GT(parallel.connections, 0u);
+  EXPECT_LE(serial.connections, serial.candidate_connections);
+  EXPECT_LE(parallel.connections, parallel.candidate_connections);
+}
+
+TEST_F(ConstraintsLibraryPr2, ExtendKeepsExistingMilestones)
+{
+  ompl_interface::ConstraintsLibrary library(*manager_);
+  options_.threads = 2;
+  options_.samples = 20;
+  ompl_interface::ConstraintApproximationConstructionResults initial = library.addConstraintApproximation(constraints_, "right_arm", scene_, options_);
+  ASSERT_TRUE(initial.approx);
+  std::size_t initial_connections = checkApproximation(initial.approx, 20);
+  ompl_interface::ConstraintApproximationDatabaseConstPtr initial_db = initial.approx->getDatabase();
+  ASSERT_TRUE(initial_db);
+
+  options_.threads = 4;
+  options_.samples = 40;
+  ompl_interface::ConstraintApproximationConstructionResults extended = library.extendConstraintApproximation(constraints_, "right_arm", scene_, options_);
+  ASSERT_TRUE(extended.approx);
+  EXPECT_EQ(20u, extended.existing_milestones);
+  EXPECT_EQ(40u, extended.milestones);
+  checkApproximation(extended.approx, 40);
+
+  // the existing milestones come first, unchanged, and keep their connections
+  ompl_interface::ConstraintApproximationDatabaseConstPtr extended_db = extended.approx->getDatabase();
+  ASSERT_TRUE(extended_db);
+  const ompl::base::StateSpacePtr &space = initial_db->getStateSpace();
+  ompl::base::ScopedState<> a(space), b(space);
+  std::size_t kept_connections = 0;
+  for (std::size_t i = 0 ; i < 20 ; ++i)
+  {
+    initial_db->copyState(i, a.get());
+    extended_db->copyState(i, b.get());
+    EXPECT_TRUE(space->equalStates(a.get(), b.get()));
+    for (std::size_t k = 0 ; k < initial_db->getConnectionCount(i) ; ++k)
+    {
+      std::size_t j = initial_db->getConnection(i, k);
+      bool kept = false;
+      for (std::size_t l = 0 ; l < extended_db->getConnectionCount(i) && !kept ; ++l)
+        kept = extended_db->getConnection(i, l) == j;
+      EXPECT_TRUE(kept);
+      if (j > i)
+        ++kept_connections;
+    }
+  }
+  EXPECT_EQ(initial_connections, kept_connections);
+
+  // an approximation that already has enough milestones is not extended
+  ompl_interface::ConstraintApproximationConstructionResults same = library.extendConstraintApproximation(constraints_, "right_arm", scene_, options_);
+  ASSERT_TRUE(same.approx);
+  EXPECT_EQ(40u, same.existing_milestones);
+  EXPECT_EQ(40u, same.milestones);
+  EXPECT_EQ(0u, same.connections);
+  checkApproximation(same.approx, 40);
+}
+
+TEST_F(ConstraintsLibraryPr2, SerialSamplingWithoutConcurrentIK)
+{
+  robot_model::JointModelGroup *jmg = kmodel_->getJointModelGroup("right_arm");
+  boost::shared_ptr<SerialKinematics> solver(new SerialKinematics(jmg));
+  jmg->setSolverAllocators(boost::bind(&allocateSolver, kinematics::KinematicsBasePtr(solver), _1));
+  ASSERT_TRUE(jmg->getSolverInstance());
+  EXPECT_FALSE(manager_->getPlanningContext("right_arm", options_.state_space_parameterization)->supportsConcurrentIK());
+
+  // an orientation constraint that every state satisfies, sampled by IK
+  moveit_msgs::Constraints constraints;
+  constraints.name = "wrist";
+  constraints.orientation_constraints.resize(1);
+  constraints.orientation_constraints[0].header.frame_id = kmodel_->getModelFrame();
+  constraints.orientation_constraints[0].link_name = solver->getTipFrame();
+  constraints.orientation_constraints[0].orientation.w = 1.0;
+  constraints.orientation_constraints[0].absolute_x_axis_tolerance = 4.0;
+  constraints.orientation_constraints[0].absolute_y_axis_tolerance = 4.0;
+  constraints.orientation_constraints[0].absolute_z_axis_tolerance = 4.0;
+  constraints.orientation_constraints[0].weight = 1.0;
+
+  ompl_interface::ConstraintsLibrary library(*manager_);
+  options_.threads = 4;
+  options_.samples = 20;
+  ompl_interface::ConstraintApproximationConstructionResults result = library.addConstraintApproximation(constraints, "right_arm", scene_, options_);
+  ASSERT_TRUE(result.approx);
+  EXPECT_EQ(20u, result.milestones);
+
+  // the solver was used, but never by two threads at once
+  EXPECT_GT(solver->getCalls(), 0u);
+  EXPECT_EQ(1u, solver->getMaxConcurrentCalls());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
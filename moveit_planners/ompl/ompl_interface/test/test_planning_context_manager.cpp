@@ -0,0 +1,204 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2012, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/ompl_interface/planning_context_manager.h>
+#include <moveit/ompl_interface/model_based_planning_context.h>
+#include <moveit/ompl_interface/detail/constrained_goal_sampler.h>
+#include <moveit/constraint_samplers/constraint_sampler_manager.h>
+#include <moveit/kinematic_constraints/utils.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <geometric_shapes/shapes.h>
+#include <urdf_parser/urdf_parser.h>
+#include <ros/package.h>
+#include <boost/filesystem/path.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+
+class LoadPlanningModelsPr2 : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    std::string resource_dir = ros::package::getPath("moveit_resources");
+    if (resource_dir == "")
+    {
+      FAIL() << "Failed to find package moveit_resources.";
+      return;
+    }
+    boost::filesystem::path res_path(resource_dir);
+
+    srdf_model_.reset(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file((res_path / "test/urdf/robot.xml").string().c_str(), std::fstream::in);
+    if (xml_file.is_open())
+    {
+      while (xml_file.good())
+      {
+        std::string line;
+        std::getline(xml_file, line);
+        xml_string += (line + "\n");
+      }
+      xml_file.close();
+      urdf_model_ = urdf::parseURDF(xml_string);
+    }
+    ASSERT_TRUE(urdf_model_);
+    srdf_model_->initFile(*urdf_model_, (res_path / "test/srdf/robot.xml").string());
+    kmodel_.reset(new robot_model::RobotModel(urdf_model_, srdf_model_));
+    scene_.reset(new planning_scene::PlanningScene(kmodel_));
+
+    planning_interface::PlannerConfigurationSettings settings;
+    settings.group = "right_arm";
+    settings.name = "right_arm";
+    settings.config["type"] = "geometric::RRTConnect";
+    planning_interface::PlannerConfigurationMap pconfig;
+    pconfig[settings.name] = settings;
+
+    manager_.reset(new ompl_interface::PlanningContextManager(kmodel_, constraint_samplers::ConstraintSamplerManagerPtr(new constraint_samplers::ConstraintSamplerManager())));
+    manager_->setPlannerConfigurations(pconfig);
+  };
+
+  virtual void TearDown()
+  {
+  }
+
+  // a request to move the right arm to a joint goal, starting from the current state of the scene
+  moveit_msgs::MotionPlanRequest makeRequest() const
+  {
+    moveit_msgs::MotionPlanRequest req;
+    req.group_name = "right_arm";
+    req.start_state.is_diff = true;
+    req.workspace_parameters.min_corner.x = req.workspace_parameters.min_corner.y = req.workspace_parameters.min_corner.z = -1.0;
+    req.workspace_parameters.max_corner.x = req.workspace_parameters.max_corner.y = req.workspace_parameters.max_corner.z = 1.0;
+
+    robot_state::RobotState goal(kmodel_);
+    goal.setToDefaultValues();
+    goal.setVariablePosition("r_shoulder_pan_joint", -0.5);
+    goal.setVariablePosition("r_elbow_flex_joint", -0.8);
+    req.goal_constraints.push_back(kinematic_constraints::constructGoalConstraints(goal, kmodel_->getJointModelGroup("right_arm")));
+    return req;
+  }
+
+protected:
+
+  boost::shared_ptr<urdf::ModelInterface>                   urdf_model_;
+  boost::shared_ptr<srdf::Model>                            srdf_model_;
+  robot_model::RobotModelPtr                                kmodel_;
+  planning_scene::PlanningScenePtr                          scene_;
+  boost::shared_ptr<ompl_interface::PlanningContextManager> manager_;
+};
+
+TEST_F(LoadPlanningModelsPr2, KeepsConfiguredPlanner)
+{
+  moveit_msgs::MoveItErrorCodes error_code;
+  ompl_interface::ModelBasedPlanningContextPtr context = manager_->getPlanningContext(scene_, makeRequest(), error_code);
+  ASSERT_TRUE(context);
+  EXPECT_EQ(moveit_msgs::MoveItErrorCodes::SUCCESS, error_code.val);
+  EXPECT_TRUE(context->isConfigured());
+  const ompl_interface::ModelBasedPlanningContext *first_context = context.get();
+  const ompl::base::Planner *first_planner = context->getOMPLSimpleSetup()->getPlanner().get();
+  const ompl::base::StateValidityChecker *first_checker = context->getOMPLSimpleSetup()->getStateValidityChecker().get();
+  ASSERT_TRUE(first_planner);
+  context.reset();
+
+  // joints outside of the group move a little, as they do with encoder noise on a real robot
+  scene_->getCurrentStateNonConst().setVariablePosition("l_shoulder_pan_joint", 1e-4);
+  scene_->getCurrentStateNonConst().setVariablePosition("torso_lift_joint", 0.01);
+  context = manager_->getPlanningContext(scene_, makeRequest(), error_code);
+  ASSERT_TRUE(context);
+  EXPECT_EQ(first_context, context.get());
+  EXPECT_EQ(first_planner, context->getOMPLSimpleSetup()->getPlanner().get());
+  EXPECT_EQ(first_checker, context->getOMPLSimpleSetup()->getStateValidityChecker().get());
+  EXPECT_EQ(0.01, context->getCompleteInitialRobotState().getVariablePosition("torso_lift_joint"));
+  context.reset();
+
+  // a new planning volume needs a new setup
+  moveit_msgs::MotionPlanRequest req = makeRequest();
+  req.workspace_parameters.max_corner.z = 2.0;
+  context = manager_->getPlanningContext(scene_, req, error_code);
+  ASSERT_TRUE(context);
+  EXPECT_EQ(first_context, context.get());
+  EXPECT_NE(first_checker, context->getOMPLSimpleSetup()->getStateValidityChecker().get());
+  const ompl::base::StateValidityChecker *second_checker = context->getOMPLSimpleSetup()->getStateValidityChecker().get();
+  context.reset();
+
+  // and so does a new attached body
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(0.05, 0.05, 0.05)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  scene_->getCurrentStateNonConst().attachBody("box", shapes, poses, std::vector<std::string>(), "r_gripper_palm_link");
+  context = manager_->getPlanningContext(scene_, req, error_code);
+  ASSERT_TRUE(context);
+  EXPECT_NE(second_checker, context->getOMPLSimpleSetup()->getStateValidityChecker().get());
+}
+
+TEST_F(LoadPlanningModelsPr2, SamplesGoalsOnSeveralThreads)
+{
+  manager_->setMaximumGoalSamplingThreads(3);
+  moveit_msgs::MotionPlanRequest req = makeRequest();
+  moveit_msgs::MoveItErrorCodes error_code;
+  ompl_interface::ModelBasedPlanningContextPtr context = manager_->getPlanningContext(scene_, req, error_code);
+  ASSERT_TRUE(context);
+  EXPECT_EQ(3u, context->getMaximumGoalSamplingThreads());
+
+  ompl_interface::ConstrainedGoalSampler *goal = dynamic_cast<ompl_interface::ConstrainedGoalSampler*>(context->getOMPLSimpleSetup()->getGoal().get());
+  ASSERT_TRUE(goal);
+
+  // sampling stops by itself once enough goals are found
+  for (int i = 0 ; i < 3000 && goal->isSampling() ; ++i)
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  goal->stopSampling();
+
+  ompl_interface::GoalSamplingStatistics stats = goal->getSamplingStatistics();
+  EXPECT_EQ(stats.samples_, stats.sampler_failures_ + stats.constraint_failures_ + stats.invalid_states_ + stats.goals_);
+  ASSERT_GT(goal->getStateCount(), 0u);
+  EXPECT_GE(stats.goals_, goal->getStateCount());
+
+  // every goal the workers handed over satisfies the goal constraints
+  kinematic_constraints::KinematicConstraintSet constraints(kmodel_);
+  constraints.add(req.goal_constraints[0], scene_->getTransforms());
+  robot_state::RobotState state(kmodel_);
+  state.setToDefaultValues();
+  for (unsigned int i = 0 ; i < goal->getStateCount() ; ++i)
+  {
+    context->getOMPLStateSpace()->copyToRobotState(state, goal->getState(i));
+    EXPECT_TRUE(constraints.decide(state).satisfied);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
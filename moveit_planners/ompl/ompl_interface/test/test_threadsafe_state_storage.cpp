@@ -0,0 +1,222 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2012, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/ompl_interface/detail/threadsafe_state_storage.h>
+#include <urdf_parser/urdf_parser.h>
+#include <boost/scoped_ptr.hpp>
+#include <boost/bind.hpp>
+#include <gtest/gtest.h>
+
+static const std::string URDF_MODEL =
+  "<?xml version=\"1.0\" ?>"
+  "<robot name=\"myrobot\">"
+  "  <link name=\"base_link\"/>"
+  "  <link name=\"link\"/>"
+  "  <joint name=\"joint\" type=\"revolute\">"
+  "    <axis xyz=\"0 0 1\"/>"
+  "    <parent link=\"base_link\"/>"
+  "    <child link=\"link\"/>"
+  "    <origin rpy=\"0 0 0\" xyz=\"0 0 0.1\"/>"
+  "    <limit effort=\"10\" lower=\"-100\" upper=\"100\" velocity=\"1\"/>"
+  "  </joint>"
+  "</robot>";
+
+static const std::string SRDF_MODEL =
+  "<?xml version=\"1.0\" ?>"
+  "<robot name=\"myrobot\">"
+  "  <virtual_joint name=\"base_joint\" child_link=\"base_link\" parent_frame=\"odom_combined\" type=\"fixed\"/>"
+  "  <group name=\"arm\">"
+  "    <joint name=\"joint\"/>"
+  "  </group>"
+  "</robot>";
+
+static const std::size_t THREAD_COUNT = 4;
+
+class ThreadSafeStateStorageTest : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(URDF_MODEL);
+    boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+    srdf_model->initString(*urdf_model, SRDF_MODEL);
+    robot_model_.reset(new robot_model::RobotModel(urdf_model, srdf_model));
+  }
+
+  robot_state::RobotState makeState(double value) const
+  {
+    robot_state::RobotState state(robot_model_);
+    state.setToDefaultValues();
+    state.setVariablePosition("joint", value);
+    return state;
+  }
+
+  robot_model::RobotModelPtr robot_model_;
+};
+
+// what one thread saw of a storage
+struct ThreadResult
+{
+  ThreadResult() : state_(NULL), start_value_(0.0), kept_state_(false), kept_value_(false)
+  {
+  }
+
+  robot_state::RobotState *state_;
+  double                   start_value_;
+  bool                     kept_state_;
+  bool                     kept_value_;
+};
+
+// writes a value of its own into the state of the calling thread, and waits until all threads did so
+// before checking that the thread still sees the same state and value
+static void useStorage(const ompl_interface::TSStateStorage *storage, double value, boost::barrier *all_written,
+                       ThreadResult *result)
+{
+  robot_state::RobotState *state = storage->getStateStorage();
+  result->state_ = state;
+  result->start_value_ = state->getVariablePosition("joint");
+  state->setVariablePosition("joint", value);
+
+  all_written->wait();
+
+  result->kept_state_ = storage->getStateStorage() == state;
+  result->kept_value_ = state->getVariablePosition("joint") == value;
+}
+
+TEST_F(ThreadSafeStateStorageTest, ThreadsGetSeparateStates)
+{
+  ompl_interface::TSStateStorage storage(makeState(0.5));
+  robot_state::RobotState *main_state = storage.getStateStorage();
+  main_state->setVariablePosition("joint", -1.0);
+
+  boost::barrier all_written(THREAD_COUNT);
+  std::vector<ThreadResult> results(THREAD_COUNT);
+  boost::thread_group threads;
+  for (std::size_t i = 0 ; i < THREAD_COUNT ; ++i)
+    threads.create_thread(boost::bind(&useStorage, &storage, (double)i, &all_written, &results[i]));
+  threads.join_all();
+
+  for (std::size_t i = 0 ; i < THREAD_COUNT ; ++i)
+  {
+    EXPECT_EQ(0.5, results[i].start_value_);
+    EXPECT_TRUE(results[i].kept_state_);
+    EXPECT_TRUE(results[i].kept_value_);
+    EXPECT_NE(main_state, results[i].state_);
+    for (std::size_t j = 0 ; j < i ; ++j)
+      EXPECT_NE(results[j].state_, results[i].state_);
+  }
+  EXPECT_EQ(main_state, storage.getStateStorage());
+  EXPECT_EQ(-1.0, main_state->getVariablePosition("joint"));
+}
+
+TEST_F(ThreadSafeStateStorageTest, StartStateReachesAllThreads)
+{
+  ompl_interface::TSStateStorage storage(robot_model_);
+  robot_state::RobotState *main_state = storage.getStateStorage();
+  main_state->setVariablePosition("joint", -1.0);
+
+  storage.setStartState(makeState(2.0));
+  EXPECT_EQ(main_state, storage.getStateStorage());
+  EXPECT_EQ(2.0, main_state->getVariablePosition("joint"));
+
+  boost::barrier all_written(THREAD_COUNT);
+  std::vector<ThreadResult> results(THREAD_COUNT);
+  boost::thread_group threads;
+  for (std::size_t i = 0 ; i < THREAD_COUNT ; ++i)
+    threads.create_thread(boost::bind(&useStorage, &storage, (double)i, &all_written, &results[i]));
+  threads.join_all();
+
+  for (std::size_t i = 0 ; i < THREAD_COUNT ; ++i)
+    EXPECT_EQ(2.0, results[i].start_value_);
+}
+
+// keeps the state of a storage while the main thread destroys the storage, then uses the state
+// and asks a second storage for a state
+class StateHolder
+{
+public:
+
+  StateHolder() : got_state_(2), storage_destroyed_(2), kept_value_(false), second_value_(0.0)
+  {
+  }
+
+  void run(const ompl_interface::TSStateStorage *first, const ompl_interface::TSStateStorage *second)
+  {
+    robot_state::RobotState *state = first->getStateStorage();
+    state->setVariablePosition("joint", 3.0);
+    got_state_.wait();
+
+    storage_destroyed_.wait();
+    // the storage is gone, but the state of this thread stays valid until it needs a new one
+    state->setVariablePosition("joint", state->getVariablePosition("joint") + 1.0);
+    kept_value_ = state->getVariablePosition("joint") == 4.0;
+
+    second_value_ = second->getStateStorage()->getVariablePosition("joint");
+  }
+
+  boost::barrier got_state_;
+  boost::barrier storage_destroyed_;
+  bool           kept_value_;
+  double         second_value_;
+};
+
+TEST_F(ThreadSafeStateStorageTest, StorageDestroyedWhileThreadHoldsState)
+{
+  boost::scoped_ptr<ompl_interface::TSStateStorage> first(new ompl_interface::TSStateStorage(makeState(0.5)));
+  ompl_interface::TSStateStorage second(makeState(-0.5));
+
+  // the main thread holds a state of the storage as well
+  first->getStateStorage()->setVariablePosition("joint", 1.0);
+
+  StateHolder holder;
+  boost::thread thread(boost::bind(&StateHolder::run, &holder, first.get(), &second));
+  holder.got_state_.wait();
+  first.reset();
+  holder.storage_destroyed_.wait();
+  thread.join();
+
+  EXPECT_TRUE(holder.kept_value_);
+  EXPECT_EQ(-0.5, holder.second_value_);
+
+  // a storage built after the first one was destroyed starts from its own state
+  ompl_interface::TSStateStorage third(makeState(1.5));
+  EXPECT_EQ(1.5, third.getStateStorage()->getVariablePosition("joint"));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -46,6 +46,9 @@
 #include <map>
 
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/scoped_ptr.hpp>
 
 namespace point_containment_filter
 {
@@ -79,6 +82,13 @@ public:
 
   void setTransformCallback (const TransformCallback& transform_callback);
 
+  /** \brief Set the maximum number of threads maskContainment() uses, including the calling thread.
+      The default is 1. A value of 0 means one thread per hardware core. */
+  void setMaxThreads(unsigned int max_threads);
+
+  /** \brief Get the maximum number of threads maskContainment() uses, including the calling thread */
+  unsigned int getMaxThreads() const;
+
   /** \brief Compute the containment mask (INSIDE or OUTSIDE) for a given pointcloud. If a mask element is INSIDE, the point
       is inside the robot. The point is outside if the mask element is OUTSIDE.
   */
@@ -106,6 +116,11 @@ private:
     bodies::Body *body;
     ShapeHandle handle;
     double volume;
+
+    /* the scaled and padded dimensions of spheres, boxes and cylinders; they do not depend on the pose */
+    int type;
+    Eigen::Vector3d half_extents; // box half sizes; half length of a cylinder in z
+    double radius2; // squared radius of a sphere or cylinder
   };
 
   struct SortBodies
@@ -120,9 +135,36 @@ private:
     }
   };
 
+  /** \brief The parameters of a posed body, laid out so blocks of points can be tested against it at once.
+      Spheres, boxes and cylinders are tested directly; other bodies call bodies::Body::containsPoint().
+      The dimensions are copied from the SeeShape; only the pose is extracted for every cloud */
+  struct ContainmentTest
+  {
+    const bodies::Body *body;
+    int type;
+    bodies::BoundingSphere bsphere;
+    Eigen::Vector3d center;
+    Eigen::Matrix3d axes; // rows are the axes of the body
+    Eigen::Vector3d half_extents; // box half sizes; half length of a cylinder in z
+    double radius2; // squared radius of a sphere or cylinder
+  };
+
+  /** \brief Extract the pose independent parameters of the body of \e ss */
+  static void setShapeDimensions(SeeShape &ss);
+
   /** \brief Free memory. */
   void freeMemory();
 
+  /** \brief Compute the mask of the points in [begin, end) of the current job */
+  void computeMaskRange(std::size_t begin, std::size_t end);
+
+  /** \brief Process chunks of the current job until none are left */
+  void processChunks();
+
+  void workerThread();
+  void startWorkers(unsigned int count);
+  void stopWorkers();
+
   TransformCallback transform_callback_;
   ShapeHandle next_handle_;
   ShapeHandle min_handle_;
@@ -131,6 +173,28 @@ private:
   std::set<SeeShape, SortBodies> bodies_;
   std::map<ShapeHandle, std::set<SeeShape, SortBodies>::iterator> used_handles_;
   std::vector<bodies::BoundingSphere> bspheres_;
+
+  unsigned int max_threads_;
+
+  /* the mask computation in progress; set by maskContainment() while holding shapes_lock_ */
+  const sensor_msgs::PointCloud2 *job_cloud_;
+  int *job_mask_;
+  double job_min_dist2_;
+  double job_max_dist2_;
+  bodies::BoundingSphere job_bound_;
+  std::vector<ContainmentTest> job_tests_;
+  std::size_t job_point_count_;
+
+  /* workers that help maskContainment(); they take chunks of the current job */
+  boost::scoped_ptr<boost::thread_group> workers_;
+  boost::mutex pool_lock_;
+  boost::condition_variable work_available_;
+  boost::condition_variable work_done_;
+  unsigned int job_generation_;
+  std::size_t chunk_count_;
+  std::size_t next_chunk_;
+  std::size_t done_chunks_;
+  bool stop_workers_;
 };
 
 }
@@ -38,16 +38,40 @@
 #include <geometric_shapes/body_operations.h>
 #include <ros/console.h>
 #include <sensor_msgs/point_cloud2_iterator.h>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// points are tested in blocks of this size, one body at a time
+static const std::size_t BLOCK_SIZE = 128;
+
+// the blocks are handed out to threads in chunks of this many points
+static const std::size_t CHUNK_SIZE = BLOCK_SIZE * 16;
+}
 
 point_containment_filter::ShapeMask::ShapeMask(const TransformCallback& transform_callback) :
   transform_callback_(transform_callback),
   next_handle_ (1),
-  min_handle_ (1)
+  min_handle_ (1),
+  max_threads_(1),
+  job_cloud_(NULL),
+  job_mask_(NULL),
+  job_min_dist2_(0.0),
+  job_max_dist2_(0.0),
+  job_point_count_(0),
+  job_generation_(0),
+  chunk_count_(0),
+  next_chunk_(0),
+  done_chunks_(0),
+  stop_workers_(false)
 {
 }
 
 point_containment_filter::ShapeMask::~ShapeMask()
 {
+  stopWorkers();
   freeMemory();
 }
 
@@ -64,6 +88,112 @@ void point_containment_filter::ShapeMask::setTransformCallback(const TransformCa
   transform_callback_ = transform_callback;
 }
 
+void point_containment_filter::ShapeMask::setMaxThreads(unsigned int max_threads)
+{
+  boost::mutex::scoped_lock _(shapes_lock_);
+  if (max_threads == 0)
+    max_threads = std::max(1u, boost::thread::hardware_concurrency());
+  if (max_threads == max_threads_)
+    return;
+  stopWorkers();
+  max_threads_ = max_threads;
+  startWorkers(max_threads_ - 1);
+}
+
+unsigned int point_containment_filter::ShapeMask::getMaxThreads() const
+{
+  boost::mutex::scoped_lock _(shapes_lock_);
+  return max_threads_;
+}
+
+void point_containment_filter::ShapeMask::startWorkers(unsigned int count)
+{
+  stop_workers_ = false;
+  if (count == 0)
+    return;
+  workers_.reset(new boost::thread_group());
+  for (unsigned int i = 0 ; i < count ; ++i)
+    workers_->create_thread(boost::bind(&ShapeMask::workerThread, this));
+}
+
+void point_containment_filter::ShapeMask::stopWorkers()
+{
+  {
+    boost::mutex::scoped_lock slock(pool_lock_);
+    stop_workers_ = true;
+  }
+  work_available_.notify_all();
+  if (workers_)
+  {
+    workers_->join_all();
+    workers_.reset();
+  }
+}
+
+void point_containment_filter::ShapeMask::workerThread()
+{
+  unsigned int generation = 0;
+  while (true)
+  {
+    {
+      boost::mutex::scoped_lock slock(pool_lock_);
+      while (!stop_workers_ && generation == job_generation_)
+        work_available_.wait(slock);
+      if (stop_workers_)
+        return;
+      generation = job_generation_;
+    }
+    processChunks();
+  }
+}
+
+void point_containment_filter::ShapeMask::processChunks()
+{
+  while (true)
+  {
+    std::size_t chunk;
+    {
+      boost::mutex::scoped_lock slock(pool_lock_);
+      if (next_chunk_ >= chunk_count_)
+        return;
+      chunk = next_chunk_++;
+    }
+    computeMaskRange(chunk * CHUNK_SIZE, std::min((chunk + 1) * CHUNK_SIZE, job_point_count_));
+    {
+      boost::mutex::scoped_lock slock(pool_lock_);
+      if (++done_chunks_ == chunk_count_)
+        work_done_.notify_all();
+    }
+  }
+}
+
+void point_containment_filter::ShapeMask::setShapeDimensions(SeeShape &ss)
+{
+  const bodies::Body *body = ss.body;
+  const std::vector<double> dims = body->getDimensions();
+  ss.type = body->getType();
+  ss.half_extents = Eigen::Vector3d::Zero();
+  ss.radius2 = 0.0;
+  switch (ss.type)
+  {
+    case shapes::SPHERE:
+      ss.radius2 = dims[0] * body->getScale() + body->getPadding();
+      ss.radius2 *= ss.radius2;
+      break;
+    case shapes::BOX:
+      for (int d = 0 ; d < 3 ; ++d)
+        ss.half_extents[d] = dims[d] * body->getScale() / 2.0 + body->getPadding();
+      break;
+    case shapes::CYLINDER:
+      ss.radius2 = dims[0] * body->getScale() + body->getPadding();
+      ss.radius2 *= ss.radius2;
+      ss.half_extents[2] = dims[1] * body->getScale() / 2.0 + body->getPadding();
+      break;
+    default:
+      break;
+  }
+}
+
 point_containment_filter::ShapeHandle point_containment_filter::ShapeMask::addShape(const shapes::ShapeConstPtr &shape, double scale, double padding)
 {
   boost::mutex::scoped_lock _(shapes_lock_);
@@ -75,6 +205,7 @@ point_containment_filter::ShapeHandle point_containment_filter::ShapeMask::addSh
     ss.body->setPadding(padding);
     ss.volume = ss.body->computeVolume();
     ss.handle = next_handle_;
+    setShapeDimensions(ss);
     std::pair<std::set<SeeShape, SortBodies>::iterator, bool> insert_op = bodies_.insert(ss);
     if (!insert_op.second)
       ROS_ERROR("Internal error in management of bodies in ShapeMask. This is a serious error.");
@@ -126,44 +257,160 @@ void point_containment_filter::ShapeMask::maskContainment(const sensor_msgs::Poi
   {
     Eigen::Affine3d tmp;
     bspheres_.resize(bodies_.size());
+    job_tests_.resize(bodies_.size());
     std::size_t j = 0;
-    for (std::set<SeeShape>::const_iterator it = bodies_.begin() ; it != bodies_.end() ; ++it)
+    std::size_t k = 0;
+    for (std::set<SeeShape>::const_iterator it = bodies_.begin() ; it != bodies_.end() ; ++it, ++k)
     {
       if (transform_callback_(it->handle, tmp))
       {
         it->body->setPose(tmp);
         it->body->computeBoundingSphere(bspheres_[j++]);
       }
-    }
 
+      // only the pose of the body changes between clouds
+      ContainmentTest &t = job_tests_[k];
+      const bodies::Body *body = it->body;
+      const Eigen::Affine3d &pose = body->getPose();
+      t.body = body;
+      t.type = it->type;
+      body->computeBoundingSphere(t.bsphere);
+      t.center = pose.translation();
+      t.axes = pose.rotation().transpose();
+      t.half_extents = it->half_extents;
+      t.radius2 = it->radius2;
+    }
 
     // compute a sphere that bounds the entire robot
-    bodies::BoundingSphere bound;
-    bodies::mergeBoundingSpheres(bspheres_, bound);
-    const double radiusSquared = bound.radius * bound.radius;
-
-    // we now decide which points we keep
-    sensor_msgs::PointCloud2ConstIterator<float> iter_x(data_in, "x");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_y(data_in, "y");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_z(data_in, "z");
-
-    // Cloud iterators are not incremented in the for loop, because of the pragma
-// Comment out below parallelization as it can result in very high CPU consumption    
-//#pragma omp parallel for schedule(dynamic)
-    for (int i = 0 ; i < (int)np ; ++i)
+    bodies::mergeBoundingSpheres(bspheres_, job_bound_);
+
+    job_cloud_ = &data_in;
+    job_mask_ = mask.empty() ? NULL : &mask[0];
+    job_min_dist2_ = min_sensor_dist * min_sensor_dist;
+    job_max_dist2_ = max_sensor_dist * max_sensor_dist;
+    job_point_count_ = np;
+
+    // small clouds are not worth waking up the workers for
+    if (max_threads_ <= 1 || np <= CHUNK_SIZE)
+      computeMaskRange(0, np);
+    else
+    {
+      {
+        boost::mutex::scoped_lock slock(pool_lock_);
+        chunk_count_ = (np + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        next_chunk_ = 0;
+        done_chunks_ = 0;
+        ++job_generation_;
+      }
+      work_available_.notify_all();
+      processChunks();
+      boost::mutex::scoped_lock slock(pool_lock_);
+      while (done_chunks_ < chunk_count_)
+        work_done_.wait(slock);
+    }
+    job_cloud_ = NULL;
+    job_mask_ = NULL;
+  }
+}
+
+void point_containment_filter::ShapeMask::computeMaskRange(std::size_t begin, std::size_t end)
+{
+  sensor_msgs::PointCloud2ConstIterator<float> iter_x = sensor_msgs::PointCloud2ConstIterator<float>(*job_cloud_, "x") + begin;
+  sensor_msgs::PointCloud2ConstIterator<float> iter_y = sensor_msgs::PointCloud2ConstIterator<float>(*job_cloud_, "y") + begin;
+  sensor_msgs::PointCloud2ConstIterator<float> iter_z = sensor_msgs::PointCloud2ConstIterator<float>(*job_cloud_, "z") + begin;
+
+  const double bound_radius2 = job_bound_.radius * job_bound_.radius;
+  const Eigen::Vector3d &bc = job_bound_.center;
+
+  double x[BLOCK_SIZE], y[BLOCK_SIZE], z[BLOCK_SIZE];
+  int out[BLOCK_SIZE];
+  unsigned char candidate[BLOCK_SIZE]; // the point may still be inside a body
+
+  for (std::size_t b = begin ; b < end ; b += BLOCK_SIZE)
+  {
+    const std::size_t n = std::min(BLOCK_SIZE, end - b);
+    for (std::size_t i = 0 ; i < n ; ++i, ++iter_x, ++iter_y, ++iter_z)
+    {
+      x[i] = *iter_x;
+      y[i] = *iter_y;
+      z[i] = *iter_z;
+    }
+
+    // the loops below have no branches that depend on the points, so the compiler can vectorize them
+    unsigned char any = 0;
+    for (std::size_t i = 0 ; i < n ; ++i)
     {
-      Eigen::Vector3d pt = Eigen::Vector3d(*(iter_x+i), *(iter_y+i), *(iter_z+i));
-      double d = pt.norm();
-      int out = OUTSIDE;
-      if (d < min_sensor_dist || d > max_sensor_dist)
-        out = CLIP;
-      else
-        if ((bound.center - pt).squaredNorm() < radiusSquared)
-          for (std::set<SeeShape>::const_iterator it = bodies_.begin() ; it != bodies_.end() && out == OUTSIDE ; ++it)
-            if (it->body->containsPoint(pt))
-              out = INSIDE;
-      mask[i] = out;
+      const double d2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+      const unsigned char clip = (d2 < job_min_dist2_) | (d2 > job_max_dist2_);
+      const double bx = bc.x() - x[i], by = bc.y() - y[i], bz = bc.z() - z[i];
+      out[i] = clip ? (int)CLIP : (int)OUTSIDE;
+      candidate[i] = !clip & (bx * bx + by * by + bz * bz < bound_radius2);
+      any |= candidate[i];
     }
+
+    for (std::size_t k = 0 ; any && k < job_tests_.size() ; ++k)
+    {
+      const ContainmentTest &t = job_tests_[k];
+      const double cx = t.center.x(), cy = t.center.y(), cz = t.center.z();
+      switch (t.type)
+      {
+        case shapes::SPHERE:
+          for (std::size_t i = 0 ; i < n ; ++i)
+          {
+            const double dx = x[i] - cx, dy = y[i] - cy, dz = z[i] - cz;
+            const unsigned char hit = candidate[i] & (dx * dx + dy * dy + dz * dz < t.radius2);
+            out[i] = hit ? (int)INSIDE : out[i];
+            candidate[i] &= !hit;
+          }
+          break;
+        case shapes::BOX:
+          for (std::size_t i = 0 ; i < n ; ++i)
+          {
+            const double dx = x[i] - cx, dy = y[i] - cy, dz = z[i] - cz;
+            const double l = t.axes(0, 0) * dx + t.axes(0, 1) * dy + t.axes(0, 2) * dz;
+            const double w = t.axes(1, 0) * dx + t.axes(1, 1) * dy + t.axes(1, 2) * dz;
+            const double h = t.axes(2, 0) * dx + t.axes(2, 1) * dy + t.axes(2, 2) * dz;
+            const unsigned char hit = candidate[i] & (std::abs(l) <= t.half_extents[0]) & (std::abs(w) <= t.half_extents[1]) &
+              (std::abs(h) <= t.half_extents[2]);
+            out[i] = hit ? (int)INSIDE : out[i];
+            candidate[i] &= !hit;
+          }
+          break;
+        case shapes::CYLINDER:
+          for (std::size_t i = 0 ; i < n ; ++i)
+          {
+            const double dx = x[i] - cx, dy = y[i] - cy, dz = z[i] - cz;
+            const double b1 = t.axes(0, 0) * dx + t.axes(0, 1) * dy + t.axes(0, 2) * dz;
+            const double b2 = t.axes(1, 0) * dx + t.axes(1, 1) * dy + t.axes(1, 2) * dz;
+            const double h = t.axes(2, 0) * dx + t.axes(2, 1) * dy + t.axes(2, 2) * dz;
+            const unsigned char hit = candidate[i] & (std::abs(h) <= t.half_extents[2]) & (b1 * b1 + b2 * b2 < t.radius2);
+            out[i] = hit ? (int)INSIDE : out[i];
+            candidate[i] &= !hit;
+          }
+          break;
+        default:
+          {
+            const double r2 = t.bsphere.radius * t.bsphere.radius;
+            for (std::size_t i = 0 ; i < n ; ++i)
+              if (candidate[i])
+              {
+                const Eigen::Vector3d pt(x[i], y[i], z[i]);
+                if ((t.bsphere.center - pt).squaredNorm() <= r2 && t.body->containsPoint(pt))
+                {
+                  out[i] = INSIDE;
+                  candidate[i] = 0;
+                }
+              }
+          }
+          break;
+      }
+
+      any = 0;
+      for (std::size_t i = 0 ; i < n ; ++i)
+        any |= candidate[i];
+    }
+
+    std::copy(out, out + n, job_mask_ + b);
   }
 }
 
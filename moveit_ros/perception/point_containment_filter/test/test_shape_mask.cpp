@@ -0,0 +1,170 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/point_containment_filter/shape_mask.h>
+#include <geometric_shapes/shapes.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
+#include <Eigen/StdVector>
+#include <boost/bind.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <cmath>
+
+using namespace point_containment_filter;
+
+typedef std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d> > PoseVector;
+
+namespace
+{
+
+bool getShapeTransform(const PoseVector *poses, ShapeHandle handle, Eigen::Affine3d &transform)
+{
+  if (handle >= poses->size())
+    return false;
+  transform = (*poses)[handle];
+  return true;
+}
+
+}
+
+class ShapeMaskTest : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    rng_.seed(3);
+    mask_.reset(new ShapeMask(boost::bind(&getShapeTransform, &poses_, _1, _2)));
+    poses_.resize(4, Eigen::Affine3d::Identity());
+
+    // scaled and padded bodies, at poses rotated about different axes
+    ShapeHandle sphere = mask_->addShape(shapes::ShapeConstPtr(new shapes::Sphere(0.2)), 1.5, 0.05);
+    ShapeHandle box = mask_->addShape(shapes::ShapeConstPtr(new shapes::Box(0.4, 0.2, 0.6)), 1.2, 0.03);
+    ShapeHandle cylinder = mask_->addShape(shapes::ShapeConstPtr(new shapes::Cylinder(0.15, 0.5)), 0.8, 0.1);
+    poses_[sphere] = Eigen::Translation3d(0.5, -0.3, 0.2) * Eigen::AngleAxisd(0.7, Eigen::Vector3d::UnitZ());
+    poses_[box] = Eigen::Translation3d(-0.4, 0.5, 0.1) * Eigen::AngleAxisd(0.9, Eigen::Vector3d(1.0, 1.0, 0.0).normalized());
+    poses_[cylinder] = Eigen::Translation3d(0.1, 0.2, -0.6) * Eigen::AngleAxisd(-1.2, Eigen::Vector3d(0.3, -1.0, 0.5).normalized());
+
+    // uniform points around the bodies
+    std::vector<Eigen::Vector3d> points;
+    for (int i = 0 ; i < 10000 ; ++i)
+      points.push_back(Eigen::Vector3d(uniform(-1.5, 1.5), uniform(-1.5, 1.5), uniform(-1.5, 1.5)));
+
+    // points just inside and just outside of the surface of each body, in its frame
+    const double eps = 1e-4;
+    for (int i = 0 ; i < 2000 ; ++i)
+    {
+      const double offset = i % 2 ? eps : -eps;
+      Eigen::Vector3d dir(uniform(-1.0, 1.0), uniform(-1.0, 1.0), uniform(-1.0, 1.0));
+      dir.normalize();
+      points.push_back(poses_[sphere] * (dir * (0.2 * 1.5 + 0.05 + offset)));
+
+      Eigen::Vector3d half(0.2 * 1.2 + 0.03, 0.1 * 1.2 + 0.03, 0.3 * 1.2 + 0.03);
+      Eigen::Vector3d local(uniform(-half.x(), half.x()), uniform(-half.y(), half.y()), uniform(-half.z(), half.z()));
+      int face = i % 3;
+      local[face] = (i % 4 < 2 ? 1.0 : -1.0) * (half[face] + offset);
+      points.push_back(poses_[box] * local);
+
+      const double radius = 0.15 * 0.8 + 0.1, half_length = 0.25 * 0.8 + 0.1;
+      const double angle = uniform(-M_PI, M_PI);
+      if (i % 3)
+        local = Eigen::Vector3d(cos(angle) * (radius + offset), sin(angle) * (radius + offset), uniform(-half_length, half_length));
+      else
+        local = Eigen::Vector3d(cos(angle) * radius * 0.9, sin(angle) * radius * 0.9, (i % 4 < 2 ? 1.0 : -1.0) * (half_length + offset));
+      points.push_back(poses_[cylinder] * local);
+    }
+
+    sensor_msgs::PointCloud2Modifier modifier(cloud_);
+    modifier.setPointCloud2FieldsByString(1, "xyz");
+    modifier.resize(points.size());
+    sensor_msgs::PointCloud2Iterator<float> iter_x(cloud_, "x"), iter_y(cloud_, "y"), iter_z(cloud_, "z");
+    for (std::size_t i = 0 ; i < points.size() ; ++i, ++iter_x, ++iter_y, ++iter_z)
+    {
+      *iter_x = points[i].x();
+      *iter_y = points[i].y();
+      *iter_z = points[i].z();
+    }
+  }
+
+  double uniform(double low, double high)
+  {
+    return boost::random::uniform_real_distribution<double>(low, high)(rng_);
+  }
+
+  // compare the mask of the cloud to the containment of each of its points, as computed by the bodies
+  void checkMask()
+  {
+    std::vector<int> mask;
+    mask_->maskContainment(cloud_, Eigen::Vector3d::Zero(), 0.0, 100.0, mask);
+    ASSERT_EQ(cloud_.width * cloud_.height, mask.size());
+
+    std::size_t inside = 0;
+    sensor_msgs::PointCloud2ConstIterator<float> iter_x(cloud_, "x"), iter_y(cloud_, "y"), iter_z(cloud_, "z");
+    for (std::size_t i = 0 ; i < mask.size() ; ++i, ++iter_x, ++iter_y, ++iter_z)
+    {
+      EXPECT_EQ(mask_->getMaskContainment(*iter_x, *iter_y, *iter_z), mask[i]) << "point " << i;
+      if (mask[i] == ShapeMask::INSIDE)
+        ++inside;
+    }
+    EXPECT_LT(0u, inside);
+    EXPECT_GT(mask.size(), inside);
+  }
+
+  boost::random::mt19937      rng_;
+  boost::scoped_ptr<ShapeMask> mask_;
+  PoseVector                  poses_;
+  sensor_msgs::PointCloud2    cloud_;
+};
+
+TEST_F(ShapeMaskTest, SingleThreadMatchesContainsPoint)
+{
+  checkMask();
+}
+
+TEST_F(ShapeMaskTest, ThreadsMatchContainsPoint)
+{
+  mask_->setMaxThreads(4);
+  ASSERT_EQ(4u, mask_->getMaxThreads());
+  checkMask();
+
+  // the workers are reused for the next cloud
+  checkMask();
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,103 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PERCEPTION_POINTCLOUD_OCTOMAP_UPDATER_FREE_CELL_TRACER_
+#define MOVEIT_PERCEPTION_POINTCLOUD_OCTOMAP_UPDATER_FREE_CELL_TRACER_
+
+#include <octomap/octomap.h>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace occupancy_map_monitor
+{
+
+/** \brief Pack an octree key into an integer, so that sets of keys can be kept as sorted vectors */
+inline boost::uint64_t packKey(const octomap::OcTreeKey &key)
+{
+  return (static_cast<boost::uint64_t>(key[0]) << 32) | (static_cast<boost::uint64_t>(key[1]) << 16) | static_cast<boost::uint64_t>(key[2]);
+}
+
+/** \brief The octree key packed by packKey() */
+inline octomap::OcTreeKey unpackKey(boost::uint64_t packed)
+{
+  return octomap::OcTreeKey(static_cast<octomap::key_type>(packed >> 32),
+                            static_cast<octomap::key_type>((packed >> 16) & 0xFFFF),
+                            static_cast<octomap::key_type>(packed & 0xFFFF));
+}
+
+/** \brief Computes the cells of an octree crossed by rays from a sensor origin.
+
+    Each thread traces a contiguous part of the rays into a SortedKeyBuffer of its own, and the sorted buffers are
+    merged, so the result does not depend on the number of threads. The key rays and buffers are kept between calls,
+    as they preallocate a lot of memory. */
+class FreeCellTracer
+{
+public:
+
+  /** \brief Trace rays on up to \e max_threads threads, including the calling thread (0 means one per core) */
+  explicit FreeCellTracer(unsigned int max_threads = 1);
+
+  /** \brief Set the maximum number of threads that trace rays, including the calling thread (0 means one per core) */
+  void setMaxThreads(unsigned int max_threads);
+
+  unsigned int getMaxThreads() const
+  {
+    return max_threads_;
+  }
+
+  /** \brief Compute the sorted packed keys of the cells along the rays from \e sensor_origin to the cells whose
+      (sorted, packed) keys are in \e ray_ends. Return false if a ray could not be traced */
+  bool computeFreeCells(const octomap::OcTree &tree, const octomap::point3d &sensor_origin,
+                        const std::vector<boost::uint64_t> &ray_ends, std::vector<boost::uint64_t> &free_cells);
+
+  /** \brief A thread is not given fewer rays than this */
+  static const std::size_t MIN_RAYS_PER_THREAD = 512;
+
+private:
+
+  static void traceRays(const octomap::OcTree *tree, const octomap::point3d &sensor_origin, const boost::uint64_t *begin,
+                        const boost::uint64_t *end, octomap::KeyRay *key_ray, std::vector<boost::uint64_t> *free_cells, bool *ok);
+
+  unsigned int max_threads_;
+
+  /* the key ray of the calling thread, and those of the additional threads along with the buffers of free cells they find */
+  octomap::KeyRay key_ray_;
+  std::vector<boost::shared_ptr<octomap::KeyRay> > thread_key_rays_;
+  std::vector<std::vector<boost::uint64_t> > thread_free_cells_;
+};
+
+}
+
+#endif
@@ -44,6 +44,8 @@
 #include <sensor_msgs/PointCloud2.h>
 #include <moveit/occupancy_map_monitor/occupancy_map_updater.h>
 #include <moveit/point_containment_filter/shape_mask.h>
+#include <moveit/pointcloud_octomap_updater/free_cell_tracer.h>
+#include <boost/cstdint.hpp>
 
 namespace occupancy_map_monitor
 {
@@ -83,15 +85,16 @@ private:
   double padding_;
   double max_range_;
   unsigned int point_subsample_;
+  unsigned int max_filter_threads_;
+  double voxel_downsample_;
   std::string filtered_cloud_topic_;
   ros::Publisher filtered_cloud_publisher_;
 
   message_filters::Subscriber<sensor_msgs::PointCloud2> *point_cloud_subscriber_;
   tf::MessageFilter<sensor_msgs::PointCloud2> *point_cloud_filter_;
 
-  /* used to store all cells in the map which a given ray passes through during raycasting.
-     we cache this here because it dynamically pre-allocates a lot of memory in its contsructor */
-  octomap::KeyRay key_ray_;
+  /* traces the rays of each cloud; it caches the key rays, which dynamically pre-allocate a lot of memory */
+  FreeCellTracer free_cell_tracer_;
 
   boost::scoped_ptr<point_containment_filter::ShapeMask> shape_mask_;
   std::vector<int> mask_;
@@ -0,0 +1,110 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PERCEPTION_POINTCLOUD_OCTOMAP_UPDATER_SORTED_KEY_BUFFER_
+#define MOVEIT_PERCEPTION_POINTCLOUD_OCTOMAP_UPDATER_SORTED_KEY_BUFFER_
+
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace occupancy_map_monitor
+{
+
+/** \brief Sort a vector of packed octree keys and remove the duplicates */
+inline void sortUnique(std::vector<boost::uint64_t> &keys)
+{
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+/** \brief Collects packed octree keys into a vector that ends up sorted and free of duplicates.
+
+    Rays traced from the same sensor origin share most of their cells, so the vector is compacted
+    whenever it grows to twice its size after the previous compaction. This bounds the memory
+    used by duplicates while keeping the total sorting cost O(n log n), no matter how many
+    distinct keys there are. */
+class SortedKeyBuffer
+{
+public:
+
+  /** \brief Collect keys into \e keys, which is cleared. No compaction happens below \e min_compaction_size keys */
+  explicit SortedKeyBuffer(std::vector<boost::uint64_t> &keys, std::size_t min_compaction_size = DEFAULT_MIN_COMPACTION_SIZE) :
+    keys_(keys),
+    min_compaction_size_(min_compaction_size),
+    next_compaction_size_(min_compaction_size),
+    compaction_count_(0)
+  {
+    keys_.clear();
+  }
+
+  void push_back(boost::uint64_t key)
+  {
+    keys_.push_back(key);
+  }
+
+  /** \brief Compact the keys if enough of them were added since the last compaction */
+  void compactIfNeeded()
+  {
+    if (keys_.size() > next_compaction_size_)
+      compact();
+  }
+
+  /** \brief Sort the keys and remove the duplicates */
+  void compact()
+  {
+    sortUnique(keys_);
+    next_compaction_size_ = std::max(min_compaction_size_, 2 * keys_.size());
+    compaction_count_++;
+  }
+
+  /** \brief The number of times the keys were compacted */
+  std::size_t getCompactionCount() const
+  {
+    return compaction_count_;
+  }
+
+  static const std::size_t DEFAULT_MIN_COMPACTION_SIZE = 1 << 20;
+
+private:
+
+  std::vector<boost::uint64_t> &keys_;
+  std::size_t min_compaction_size_;
+  std::size_t next_compaction_size_;
+  std::size_t compaction_count_;
+};
+
+}
+
+#endif
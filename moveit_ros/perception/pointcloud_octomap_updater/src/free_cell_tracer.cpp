@@ -0,0 +1,123 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/pointcloud_octomap_updater/free_cell_tracer.h>
+#include <moveit/pointcloud_octomap_updater/sorted_key_buffer.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_array.hpp>
+#include <algorithm>
+#include <iterator>
+
+namespace occupancy_map_monitor
+{
+
+FreeCellTracer::FreeCellTracer(unsigned int max_threads) : max_threads_(1)
+{
+  setMaxThreads(max_threads);
+}
+
+void FreeCellTracer::setMaxThreads(unsigned int max_threads)
+{
+  max_threads_ = max_threads > 0 ? max_threads : std::max(1u, boost::thread::hardware_concurrency());
+}
+
+void FreeCellTracer::traceRays(const octomap::OcTree *tree, const octomap::point3d &sensor_origin, const boost::uint64_t *begin,
+                               const boost::uint64_t *end, octomap::KeyRay *key_ray, std::vector<boost::uint64_t> *free_cells, bool *ok)
+{
+  try
+  {
+    SortedKeyBuffer buffer(*free_cells);
+    for (const boost::uint64_t *it = begin ; it != end ; ++it)
+    {
+      if (tree->computeRayKeys(sensor_origin, tree->keyToCoord(unpackKey(*it)), *key_ray))
+        for (octomap::KeyRay::iterator jt = key_ray->begin(), jend = key_ray->end() ; jt != jend ; ++jt)
+          buffer.push_back(packKey(*jt));
+      buffer.compactIfNeeded();
+    }
+    buffer.compact();
+    *ok = true;
+  }
+  catch (...)
+  {
+    *ok = false;
+  }
+}
+
+bool FreeCellTracer::computeFreeCells(const octomap::OcTree &tree, const octomap::point3d &sensor_origin,
+                                      const std::vector<boost::uint64_t> &ray_ends, std::vector<boost::uint64_t> &free_cells)
+{
+  std::size_t thread_count = std::min<std::size_t>(max_threads_, ray_ends.size() / MIN_RAYS_PER_THREAD);
+  if (thread_count <= 1)
+  {
+    bool ok;
+    traceRays(&tree, sensor_origin, ray_ends.empty() ? NULL : &ray_ends[0], ray_ends.empty() ? NULL : &ray_ends[0] + ray_ends.size(),
+              &key_ray_, &free_cells, &ok);
+    return ok;
+  }
+
+  // every thread traces a contiguous part of the rays into a buffer of its own
+  while (thread_key_rays_.size() < thread_count - 1)
+    thread_key_rays_.push_back(boost::shared_ptr<octomap::KeyRay>(new octomap::KeyRay()));
+  thread_free_cells_.resize(thread_count - 1);
+  boost::scoped_array<bool> ok(new bool[thread_count]);
+
+  const std::size_t chunk = (ray_ends.size() + thread_count - 1) / thread_count;
+  const boost::uint64_t *ends = &ray_ends[0];
+  boost::thread_group workers;
+  for (std::size_t t = 1 ; t < thread_count ; ++t)
+    workers.create_thread(boost::bind(&FreeCellTracer::traceRays, &tree, sensor_origin, ends + std::min(t * chunk, ray_ends.size()),
+                                      ends + std::min((t + 1) * chunk, ray_ends.size()), thread_key_rays_[t - 1].get(),
+                                      &thread_free_cells_[t - 1], &ok[t]));
+  traceRays(&tree, sensor_origin, ends, ends + std::min(chunk, ray_ends.size()), &key_ray_, &free_cells, &ok[0]);
+  workers.join_all();
+
+  for (std::size_t t = 0 ; t < thread_count ; ++t)
+    if (!ok[t])
+      return false;
+
+  // merge the sorted buffers
+  std::vector<boost::uint64_t> merged;
+  for (std::size_t t = 0 ; t < thread_count - 1 ; ++t)
+  {
+    merged.clear();
+    merged.reserve(free_cells.size() + thread_free_cells_[t].size());
+    std::set_union(free_cells.begin(), free_cells.end(), thread_free_cells_[t].begin(), thread_free_cells_[t].end(),
+                   std::back_inserter(merged));
+    free_cells.swap(merged);
+  }
+  return true;
+}
+
+}
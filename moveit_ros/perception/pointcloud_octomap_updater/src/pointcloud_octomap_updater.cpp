@@ -36,20 +36,50 @@
 
 #include <cmath>
 #include <moveit/pointcloud_octomap_updater/pointcloud_octomap_updater.h>
+#include <moveit/pointcloud_octomap_updater/sorted_key_buffer.h>
+#include <moveit/pointcloud_octomap_updater/free_cell_tracer.h>
 #include <moveit/occupancy_map_monitor/occupancy_map_monitor.h>
 #include <message_filters/subscriber.h>
 #include <sensor_msgs/point_cloud2_iterator.h>
 #include <XmlRpcException.h>
+#include <boost/bind.hpp>
+#include <algorithm>
 
 namespace occupancy_map_monitor
 {
 
+namespace
+{
+// index of the downsampling voxel a point falls in; 21 bits per axis
+inline boost::uint64_t packVoxel(double x, double y, double z, double inv_size)
+{
+  static const boost::int64_t OFFSET = 1 << 20;
+  static const boost::int64_t MASK = (1 << 21) - 1;
+  return (static_cast<boost::uint64_t>((static_cast<boost::int64_t>(std::floor(x * inv_size)) + OFFSET) & MASK) << 42) |
+    (static_cast<boost::uint64_t>((static_cast<boost::int64_t>(std::floor(y * inv_size)) + OFFSET) & MASK) << 21) |
+    static_cast<boost::uint64_t>((static_cast<boost::int64_t>(std::floor(z * inv_size)) + OFFSET) & MASK);
+}
+
+// keep one endpoint per downsampling voxel; the keys come paired with the voxel they are in
+void keepOnePerVoxel(std::vector<std::pair<boost::uint64_t, boost::uint64_t> > &voxel_keys, std::vector<boost::uint64_t> &keys)
+{
+  std::sort(voxel_keys.begin(), voxel_keys.end());
+  keys.clear();
+  for (std::size_t i = 0 ; i < voxel_keys.size() ; ++i)
+    if (i == 0 || voxel_keys[i].first != voxel_keys[i - 1].first)
+      keys.push_back(voxel_keys[i].second);
+  sortUnique(keys);
+}
+}
+
 PointCloudOctomapUpdater::PointCloudOctomapUpdater() : OccupancyMapUpdater("PointCloudUpdater"),
                                                        private_nh_("~"),
                                                        scale_(1.0),
                                                        padding_(0.0),
                                                        max_range_(std::numeric_limits<double>::infinity()),
                                                        point_subsample_(1),
+                                                       max_filter_threads_(1),
+                                                       voxel_downsample_(0.0),
                                                        point_cloud_subscriber_(NULL),
                                                        point_cloud_filter_(NULL)
 {
@@ -72,6 +102,11 @@ bool PointCloudOctomapUpdater::setParams(XmlRpc::XmlRpcValue &params)
     readXmlParam(params, "padding_offset", &padding_);
     readXmlParam(params, "padding_scale", &scale_);
     readXmlParam(params, "point_subsample", &point_subsample_);
+    readXmlParam(params, "max_filter_threads", &max_filter_threads_);
+    readXmlParam(params, "voxel_downsample", &voxel_downsample_);
+    unsigned int ray_threads = free_cell_tracer_.getMaxThreads();
+    readXmlParam(params, "ray_threads", &ray_threads);
+    free_cell_tracer_.setMaxThreads(ray_threads);
     if (params.hasMember("filtered_cloud_topic"))
       filtered_cloud_topic_ = static_cast<const std::string&>(params["filtered_cloud_topic"]);
   }
@@ -89,6 +124,7 @@ bool PointCloudOctomapUpdater::initialize()
   tf_ = monitor_->getTFClient();
   shape_mask_.reset(new point_containment_filter::ShapeMask());
   shape_mask_->setTransformCallback(boost::bind(&PointCloudOctomapUpdater::getShapeTransform, this, _1, _2));
+  shape_mask_->setMaxThreads(max_filter_threads_);
   if (!filtered_cloud_topic_.empty())
     filtered_cloud_publisher_ = private_nh_.advertise<sensor_msgs::PointCloud2>(filtered_cloud_topic_, 10, false);
   return true;
@@ -203,7 +239,14 @@ void PointCloudOctomapUpdater::cloudMsgCallback(const sensor_msgs::PointCloud2::
   shape_mask_->maskContainment(*cloud_msg, sensor_origin_eigen, 0.0, max_range_, mask_);
   updateMask(*cloud_msg, sensor_origin_eigen, mask_);
 
-  octomap::KeySet free_cells, occupied_cells, model_cells, clip_cells;
+  /* sets of cells are kept as sorted vectors of packed keys */
+  std::vector<boost::uint64_t> free_cells, occupied_cells, model_cells, clip_cells;
+
+  /* when downsampling, endpoints are first collected along with the voxel they fall in */
+  const bool downsample = voxel_downsample_ > 0.0;
+  const double inv_voxel_size = downsample ? 1.0 / voxel_downsample_ : 0.0;
+  std::vector<std::pair<boost::uint64_t, boost::uint64_t> > occupied_voxels, model_voxels, clip_voxels;
+
   boost::scoped_ptr<sensor_msgs::PointCloud2> filtered_cloud;
 
   //We only use these iterators if we are creating a filtered_cloud for
@@ -253,15 +296,31 @@ void PointCloudOctomapUpdater::cloudMsgCallback(const sensor_msgs::PointCloud2::
           tf::Vector3 point_tf = map_H_sensor * tf::Vector3(pt_iter[0], pt_iter[1],
             pt_iter[2]);
 
+          const boost::uint64_t key = packKey(tree_->coordToKey(point_tf.getX(), point_tf.getY(), point_tf.getZ()));
+          const boost::uint64_t voxel = downsample ? packVoxel(point_tf.getX(), point_tf.getY(), point_tf.getZ(), inv_voxel_size) : 0;
+
           /* occupied cell at ray endpoint if ray is shorter than max range and this point
              isn't on a part of the robot*/
           if (mask_[row_c + col] == point_containment_filter::ShapeMask::INSIDE)
-            model_cells.insert(tree_->coordToKey(point_tf.getX(), point_tf.getY(), point_tf.getZ()));
+          {
+            if (downsample)
+              model_voxels.push_back(std::make_pair(voxel, key));
+            else
+              model_cells.push_back(key);
+          }
           else if (mask_[row_c + col] == point_containment_filter::ShapeMask::CLIP)
-            clip_cells.insert(tree_->coordToKey(point_tf.getX(), point_tf.getY(), point_tf.getZ()));
+          {
+            if (downsample)
+              clip_voxels.push_back(std::make_pair(voxel, key));
+            else
+              clip_cells.push_back(key);
+          }
           else
           {
-            occupied_cells.insert(tree_->coordToKey(point_tf.getX(), point_tf.getY(), point_tf.getZ()));
+            if (downsample)
+              occupied_voxels.push_back(std::make_pair(voxel, key));
+            else
+              occupied_cells.push_back(key);
             //build list of valid points if we want to publish them
             if (filtered_cloud)
             {
@@ -278,20 +337,34 @@ void PointCloudOctomapUpdater::cloudMsgCallback(const sensor_msgs::PointCloud2::
       }
     }
 
-    /* compute the free cells along each ray that ends at an occupied cell */
-    for (octomap::KeySet::iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
-      if (tree_->computeRayKeys(sensor_origin, tree_->keyToCoord(*it), key_ray_))
-        free_cells.insert(key_ray_.begin(), key_ray_.end());
+    /* drop duplicate endpoints before tracing any rays */
+    if (downsample)
+    {
+      keepOnePerVoxel(occupied_voxels, occupied_cells);
+      keepOnePerVoxel(model_voxels, model_cells);
+      keepOnePerVoxel(clip_voxels, clip_cells);
+    }
+    else
+    {
+      sortUnique(occupied_cells);
+      sortUnique(model_cells);
+      sortUnique(clip_cells);
+    }
 
-    /* compute the free cells along each ray that ends at a model cell */
-    for (octomap::KeySet::iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
-      if (tree_->computeRayKeys(sensor_origin, tree_->keyToCoord(*it), key_ray_))
-        free_cells.insert(key_ray_.begin(), key_ray_.end());
+    /* compute the free cells along each ray that ends at an occupied, model or clipped cell */
+    std::vector<boost::uint64_t> ray_ends;
+    ray_ends.reserve(occupied_cells.size() + model_cells.size() + clip_cells.size());
+    std::set_union(occupied_cells.begin(), occupied_cells.end(), model_cells.begin(), model_cells.end(), std::back_inserter(ray_ends));
+    const std::size_t union_size = ray_ends.size();
+    ray_ends.insert(ray_ends.end(), clip_cells.begin(), clip_cells.end());
+    std::inplace_merge(ray_ends.begin(), ray_ends.begin() + union_size, ray_ends.end());
+    ray_ends.erase(std::unique(ray_ends.begin(), ray_ends.end()), ray_ends.end());
 
-    /* compute the free cells along each ray that ends at a clipped cell */
-    for (octomap::KeySet::iterator it = clip_cells.begin(), end = clip_cells.end(); it != end; ++it)
-      if (tree_->computeRayKeys(sensor_origin, tree_->keyToCoord(*it), key_ray_))
-        free_cells.insert(key_ray_.begin(), key_ray_.end());
+    if (!free_cell_tracer_.computeFreeCells(*tree_, sensor_origin, ray_ends, free_cells))
+    {
+      tree_->unlockRead();
+      return;
+    }
   }
   catch (...)
   {
@@ -302,29 +375,31 @@ void PointCloudOctomapUpdater::cloudMsgCallback(const sensor_msgs::PointCloud2::
   tree_->unlockRead();
 
   /* cells that overlap with the model are not occupied */
-  for (octomap::KeySet::iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
-    occupied_cells.erase(*it);
+  std::vector<boost::uint64_t> remaining;
+  std::set_difference(occupied_cells.begin(), occupied_cells.end(), model_cells.begin(), model_cells.end(), std::back_inserter(remaining));
+  occupied_cells.swap(remaining);
 
   /* occupied cells are not free */
-  for (octomap::KeySet::iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
-    free_cells.erase(*it);
+  remaining.clear();
+  std::set_difference(free_cells.begin(), free_cells.end(), occupied_cells.begin(), occupied_cells.end(), std::back_inserter(remaining));
+  free_cells.swap(remaining);
 
   tree_->lockWrite();
 
   try
   {
     /* mark free cells only if not seen occupied in this cloud */
-    for (octomap::KeySet::iterator it = free_cells.begin(), end = free_cells.end(); it != end; ++it)
-      tree_->updateNode(*it, false);
+    for (std::vector<boost::uint64_t>::const_iterator it = free_cells.begin(), end = free_cells.end(); it != end; ++it)
+      tree_->updateNode(unpackKey(*it), false);
 
     /* now mark all occupied cells */
-    for (octomap::KeySet::iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
-      tree_->updateNode(*it, true);
+    for (std::vector<boost::uint64_t>::const_iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
+      tree_->updateNode(unpackKey(*it), true);
 
     // set the logodds to the minimum for the cells that are part of the model
     const float lg = tree_->getClampingThresMinLog() - tree_->getClampingThresMaxLog();
-    for (octomap::KeySet::iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
-      tree_->updateNode(*it, lg);
+    for (std::vector<boost::uint64_t>::const_iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
+      tree_->updateNode(unpackKey(*it), lg);
   }
   catch (...)
   {
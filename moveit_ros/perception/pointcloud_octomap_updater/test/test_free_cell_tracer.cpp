@@ -0,0 +1,142 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/pointcloud_octomap_updater/free_cell_tracer.h>
+#include <moveit/pointcloud_octomap_updater/sorted_key_buffer.h>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <set>
+
+using namespace occupancy_map_monitor;
+
+namespace
+{
+
+const double RESOLUTION = 0.02;
+
+// the packed keys of the cells of a fixed cloud: a wall in front of the sensor and a ball closer to it
+void getRayEnds(const octomap::OcTree &tree, int rows, std::vector<boost::uint64_t> &ray_ends)
+{
+  ray_ends.clear();
+  for (int i = 0 ; i < rows ; ++i)
+    for (int j = 0 ; j < rows ; ++j)
+    {
+      ray_ends.push_back(packKey(tree.coordToKey(2.0, -1.2 + 0.03 * i, -1.2 + 0.03 * j)));
+      const double theta = M_PI * i / rows, phi = 2.0 * M_PI * j / rows;
+      ray_ends.push_back(packKey(tree.coordToKey(1.0 + 0.3 * sin(theta) * cos(phi), 0.2 + 0.3 * sin(theta) * sin(phi), 0.3 * cos(theta))));
+    }
+  sortUnique(ray_ends);
+}
+
+// trace each ray on its own into a set
+void getExpectedFreeCells(const octomap::OcTree &tree, const octomap::point3d &origin, const std::vector<boost::uint64_t> &ray_ends,
+                          std::vector<boost::uint64_t> &free_cells)
+{
+  std::set<boost::uint64_t> cells;
+  octomap::KeyRay key_ray;
+  for (std::size_t i = 0 ; i < ray_ends.size() ; ++i)
+    if (tree.computeRayKeys(origin, tree.keyToCoord(unpackKey(ray_ends[i])), key_ray))
+      for (octomap::KeyRay::iterator it = key_ray.begin() ; it != key_ray.end() ; ++it)
+        cells.insert(packKey(*it));
+  free_cells.assign(cells.begin(), cells.end());
+}
+
+// the free cells that are not ray ends, as the updater marks them
+std::vector<boost::uint64_t> getMarkedFree(const std::vector<boost::uint64_t> &free_cells, const std::vector<boost::uint64_t> &ray_ends)
+{
+  std::vector<boost::uint64_t> marked;
+  std::set_difference(free_cells.begin(), free_cells.end(), ray_ends.begin(), ray_ends.end(), std::back_inserter(marked));
+  return marked;
+}
+
+}
+
+TEST(FreeCellTracer, ThreadCountDoesNotChangeCells)
+{
+  octomap::OcTree tree(RESOLUTION);
+  const octomap::point3d origin(0.05, 0.1, -0.05);
+  std::vector<boost::uint64_t> ray_ends;
+  getRayEnds(tree, 80, ray_ends);
+  ASSERT_GT(ray_ends.size(), 4 * FreeCellTracer::MIN_RAYS_PER_THREAD);
+
+  std::vector<boost::uint64_t> expected;
+  getExpectedFreeCells(tree, origin, ray_ends, expected);
+  ASSERT_FALSE(expected.empty());
+
+  static const unsigned int THREADS[] = { 1, 2, 3, 4 };
+  for (std::size_t k = 0 ; k < sizeof(THREADS) / sizeof(THREADS[0]) ; ++k)
+  {
+    FreeCellTracer tracer(THREADS[k]);
+    std::vector<boost::uint64_t> free_cells;
+    ASSERT_TRUE(tracer.computeFreeCells(tree, origin, ray_ends, free_cells));
+    EXPECT_TRUE(expected == free_cells) << THREADS[k] << " threads";
+    EXPECT_TRUE(getMarkedFree(expected, ray_ends) == getMarkedFree(free_cells, ray_ends)) << THREADS[k] << " threads";
+  }
+}
+
+TEST(FreeCellTracer, ReusedBetweenClouds)
+{
+  octomap::OcTree tree(RESOLUTION);
+  const octomap::point3d origin(0.0, 0.0, 0.0);
+  std::vector<boost::uint64_t> large, small;
+  getRayEnds(tree, 80, large);
+  getRayEnds(tree, 10, small);
+
+  std::vector<boost::uint64_t> expected_large, expected_small;
+  getExpectedFreeCells(tree, origin, large, expected_large);
+  getExpectedFreeCells(tree, origin, small, expected_small);
+
+  // the buffers of a previous, larger cloud do not leak into the next one
+  FreeCellTracer tracer(4);
+  std::vector<boost::uint64_t> free_cells;
+  ASSERT_TRUE(tracer.computeFreeCells(tree, origin, large, free_cells));
+  EXPECT_TRUE(expected_large == free_cells);
+  ASSERT_TRUE(tracer.computeFreeCells(tree, origin, small, free_cells));
+  EXPECT_TRUE(expected_small == free_cells);
+  tracer.setMaxThreads(2);
+  ASSERT_TRUE(tracer.computeFreeCells(tree, origin, large, free_cells));
+  EXPECT_TRUE(expected_large == free_cells);
+
+  std::vector<boost::uint64_t> no_rays;
+  ASSERT_TRUE(tracer.computeFreeCells(tree, origin, no_rays, free_cells));
+  EXPECT_TRUE(free_cells.empty());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,97 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/pointcloud_octomap_updater/sorted_key_buffer.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+using namespace occupancy_map_monitor;
+
+TEST(SortedKeyBuffer, SortsAndRemovesDuplicates)
+{
+  std::vector<boost::uint64_t> keys(3, 42);
+  SortedKeyBuffer buffer(keys, 4);
+  EXPECT_TRUE(keys.empty());
+  static const boost::uint64_t VALUES[] = { 5, 3, 5, 9, 1, 3, 3, 7 };
+  for (std::size_t i = 0 ; i < sizeof(VALUES) / sizeof(VALUES[0]) ; ++i)
+  {
+    buffer.push_back(VALUES[i]);
+    buffer.compactIfNeeded();
+  }
+  buffer.compact();
+
+  static const boost::uint64_t EXPECTED[] = { 1, 3, 5, 7, 9 };
+  ASSERT_EQ(keys.size(), sizeof(EXPECTED) / sizeof(EXPECTED[0]));
+  for (std::size_t i = 0 ; i < keys.size() ; ++i)
+    EXPECT_EQ(keys[i], EXPECTED[i]);
+}
+
+// the number of compactions has to stay logarithmic once there are more distinct keys than the minimum compaction size
+TEST(SortedKeyBuffer, ManyDistinctKeys)
+{
+  static const std::size_t DISTINCT_KEYS = 3 * SortedKeyBuffer::DEFAULT_MIN_COMPACTION_SIZE + 1000;
+  static const std::size_t KEYS_PER_RAY = 16;
+
+  // visit every key twice, in a scrambled order, the way rays from one origin revisit cells
+  std::vector<boost::uint64_t> order(DISTINCT_KEYS);
+  for (std::size_t i = 0 ; i < DISTINCT_KEYS ; ++i)
+    order[i] = i * 7919;
+  boost::random::mt19937 rng(1);
+  for (std::size_t i = DISTINCT_KEYS - 1 ; i > 0 ; --i)
+    std::swap(order[i], order[boost::random::uniform_int_distribution<std::size_t>(0, i)(rng)]);
+
+  std::vector<boost::uint64_t> keys;
+  SortedKeyBuffer buffer(keys);
+  for (std::size_t i = 0 ; i < DISTINCT_KEYS ; ++i)
+  {
+    buffer.push_back(order[i]);
+    buffer.push_back(order[i / 2]);
+    if (i % KEYS_PER_RAY == KEYS_PER_RAY - 1)
+      buffer.compactIfNeeded();
+  }
+  buffer.compact();
+
+  ASSERT_EQ(keys.size(), DISTINCT_KEYS);
+  for (std::size_t i = 0 ; i < keys.size() ; ++i)
+    EXPECT_EQ(keys[i], i * 7919);
+  // a fixed threshold would compact after almost every one of the ~2^18 rays once the distinct keys exceed it
+  EXPECT_LE(buffer.getCompactionCount(), 8u);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
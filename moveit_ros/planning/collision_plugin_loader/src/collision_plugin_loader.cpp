@@ -73,21 +73,15 @@ public:
   bool activate(
     const std::string& name,
     const planning_scene::PlanningScenePtr& scene,
-    bool exclusive)
+    bool exclusive,
+    const std::map<std::string, double>& parameters)
   {
     std::map<std::string, CollisionPluginPtr>::iterator it = plugins_.find(name);
-    if (it == plugins_.end())
+    CollisionPluginPtr plugin = it == plugins_.end() ? load(name) : it->second;
+    if (plugin)
     {
-      CollisionPluginPtr plugin = load(name);
-      if (plugin)
-      {
-        return plugin->initialize(scene, exclusive);
-      }
-      return false;
-    }
-    if (it->second)
-    {
-      return it->second->initialize(scene, exclusive);
+      plugin->setParameters(parameters);
+      return plugin->initialize(scene, exclusive);
     }
     return false;
   }
@@ -111,7 +105,7 @@ bool CollisionPluginLoader::activate(
   const planning_scene::PlanningScenePtr& scene,
   bool exclusive)
 {
-  return loader_->activate(name, scene, exclusive);
+  return loader_->activate(name, scene, exclusive, std::map<std::string, double>());
 }
 
 void CollisionPluginLoader::setupScene(
@@ -145,7 +139,20 @@ void CollisionPluginLoader::setupScene(
     return;
   }
 
-  activate(collision_detector_name, scene, true);
+  // optional settings of the detector, e.g. the volume of the distance field of the HYBRID detector; that field is
+  // dense, at about 44 bytes per voxel, and every planning scene with a world of its own keeps a copy
+  std::map<std::string, double> parameters;
+  if (nh.searchParam("collision_detector_parameters", param_name))
+  {
+    if (!nh.getParam(param_name, parameters))
+      ROS_WARN_STREAM("Parameter '" << param_name << "' should map names to numbers; ignoring it");
+  }
+  else if (nh.hasParam("/move_group/collision_detector_parameters"))
+  {
+    nh.getParam("/move_group/collision_detector_parameters", parameters);
+  }
+
+  loader_->activate(collision_detector_name, scene, true, parameters);
   ROS_INFO_STREAM("Using collision detector:" << scene->getActiveCollisionDetectorName().c_str());
 }
 
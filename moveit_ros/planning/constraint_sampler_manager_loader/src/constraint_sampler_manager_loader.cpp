@@ -77,6 +77,24 @@ public:
         }
       }
     }
+
+    std::string reachability_maps;
+    if (nh_.getParam("reachability_maps", reachability_maps))
+    {
+      boost::char_separator<char> sep(" ");
+      boost::tokenizer<boost::char_separator<char> > tok(reachability_maps, sep);
+      for (boost::tokenizer<boost::char_separator<char> >::iterator beg = tok.begin() ; beg != tok.end(); ++beg)
+      {
+        constraint_samplers::ReachabilityMapPtr map(new constraint_samplers::ReachabilityMap());
+        if (map->load(*beg))
+        {
+          csm->registerReachabilityMap(map);
+          ROS_INFO("Loaded reachability map for group '%s' from '%s'", map->getGroupName().c_str(), std::string(*beg).c_str());
+        }
+        else
+          ROS_ERROR("Unable to load reachability map from '%s'", std::string(*beg).c_str());
+      }
+    }
   }
 
 private:
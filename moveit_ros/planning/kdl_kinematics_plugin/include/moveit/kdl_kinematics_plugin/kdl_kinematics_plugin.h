@@ -64,9 +64,20 @@
 #include <moveit/kinematics_base/kinematics_base.h>
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/background_processing/thread_local_cache.h>
 
 namespace kdl_kinematics_plugin
 {
+/**
+ * @brief Solvers and scratch space used by one thread for IK and FK queries (defined in the source file)
+ */
+struct SolverWorkspace;
+
+/**
+ * @brief The state of a batch of IK queries shared by the threads solving it (defined in the source file)
+ */
+struct BatchQuery;
+
 /**
  * @brief Specific implementation of kinematics using KDL. This version can be used with any robot.
  */
@@ -117,6 +128,24 @@ namespace kdl_kinematics_plugin
                                   moveit_msgs::MoveItErrorCodes &error_code,
                                   const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
 
+    /**
+     * @brief Solve a batch of independent IK queries. Each thread reuses its solvers for all the queries it takes.
+     * The number of threads is read from the batch_threads parameter (default 1, 0 for one per core).
+     */
+    virtual bool searchPositionIKBatch(const std::vector<geometry_msgs::Pose> &ik_poses,
+                                       const std::vector<std::vector<double> > &ik_seed_states,
+                                       double timeout,
+                                       std::vector<std::vector<double> > &solutions,
+                                       const IKCallbackFn &solution_callback,
+                                       std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+                                       const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
+
+    /** @brief The solvers and buffers used by a query are kept per thread, so queries can run concurrently */
+    virtual bool supportsConcurrentQueries() const
+    {
+      return true;
+    }
+
     virtual bool getPositionFK(const std::vector<std::string> &link_names,
                                const std::vector<double> &joint_angles,
                                std::vector<geometry_msgs::Pose> &poses) const;
@@ -169,6 +198,21 @@ namespace kdl_kinematics_plugin
 
     bool timedOut(const ros::WallTime &start_time, double duration) const;
 
+    /** @brief Search for an IK solution using the solvers of the given workspace */
+    bool searchPositionIK(SolverWorkspace &ws,
+                          const geometry_msgs::Pose &ik_pose,
+                          const std::vector<double> &ik_seed_state,
+                          double timeout,
+                          std::vector<double> &solution,
+                          const IKCallbackFn &solution_callback,
+                          moveit_msgs::MoveItErrorCodes &error_code,
+                          const std::vector<double> &consistency_limits,
+                          const kinematics::KinematicsQueryOptions &options) const;
+
+    /** @brief Solve queries of the batch until none are left; run by each thread of searchPositionIKBatch() */
+    void solveBatchQueries(BatchQuery &query) const;
+
+
 
     /** @brief Check whether the solution lies within the consistency limit of the seed state
      *  @param seed_state Seed state
@@ -185,7 +229,14 @@ namespace kdl_kinematics_plugin
 
     int getKDLSegmentIndex(const std::string &name) const;
 
-    void getRandomConfiguration(KDL::JntArray &jnt_array, bool lock_redundancy) const;
+    /** @brief Get the solvers and buffers of the calling thread, creating them on first use.
+     *  Returns NULL if the solvers could not be configured. */
+    SolverWorkspace* getSolverWorkspace() const;
+
+    /** @brief Make previously created per-thread workspaces stale, e.g. after the chain or the redundant joints change */
+    void resetSolverWorkspaces();
+
+    void getRandomConfiguration(SolverWorkspace &ws, KDL::JntArray &jnt_array, bool lock_redundancy) const;
 
     /** @brief Get a random configuration within joint limits close to the seed state
      *  @param seed_state Seed state
@@ -193,7 +244,8 @@ namespace kdl_kinematics_plugin
      *  @param consistency_limit The returned state will contain a value for the redundant joint in the range [seed_state(redundancy_limit)-consistency_limit,seed_state(redundancy_limit)+consistency_limit]
      *  @param jnt_array Returned random configuration
      */
-    void getRandomConfiguration(const KDL::JntArray& seed_state,
+    void getRandomConfiguration(SolverWorkspace &ws,
+                                const KDL::JntArray& seed_state,
                                 const std::vector<double> &consistency_limits,
                                 KDL::JntArray &jnt_array,
                                 bool lock_redundancy) const;
@@ -228,6 +280,10 @@ namespace kdl_kinematics_plugin
     double epsilon_;
     std::vector<JointMimic> mimic_joints_;
 
+    unsigned int batch_threads_; /** Number of threads used by searchPositionIKBatch() */
+
+    moveit::tools::ThreadLocalCache<SolverWorkspace> solver_workspaces_; /** The per-thread workspaces built for the current configuration */
+
   };
 }
 
@@ -47,25 +47,127 @@
 
 #include <moveit/rdf_loader/rdf_loader.h>
 
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+
 //register KDLKinematics as a KinematicsBase implementation
 CLASS_LOADER_REGISTER_CLASS(kdl_kinematics_plugin::KDLKinematicsPlugin, kinematics::KinematicsBase)
 
 namespace kdl_kinematics_plugin
 {
 
-  KDLKinematicsPlugin::KDLKinematicsPlugin():active_(false) {}
+// The solvers keep their own copy of the chain, so a workspace does not depend on the plugin once built
+struct SolverWorkspace
+{
+  SolverWorkspace(const KDL::Chain &chain, unsigned int dimension, const KDL::JntArray &q_min, const KDL::JntArray &q_max,
+                  int num_mimic_joints, int num_redundant_joints, bool position_ik,
+                  unsigned int max_iterations, double epsilon, const robot_state::RobotState &state)
+    : fk_solver_(chain)
+    , ik_solver_vel_(chain, num_mimic_joints, num_redundant_joints, position_ik)
+    , ik_solver_pos_(chain, q_min, q_max, fk_solver_, ik_solver_vel_, max_iterations, epsilon, position_ik)
+    , seed_(dimension)
+    , pos_in_(dimension)
+    , pos_out_(dimension)
+    , fk_pos_in_(dimension)
+    , state_(state)
+    , values_(dimension, 0.0)
+    , near_(dimension, 0.0)
+  {
+  }
+
+  KDL::ChainFkSolverPos_recursive fk_solver_;
+  KDL::ChainIkSolverVel_pinv_mimic ik_solver_vel_;
+  KDL::ChainIkSolverPos_NR_JL_Mimic ik_solver_pos_;
+
+  KDL::JntArray seed_;
+  KDL::JntArray pos_in_;
+  KDL::JntArray pos_out_;
+  // separate from pos_in_ so FK calls made from an IK solution callback do not disturb the search
+  KDL::JntArray fk_pos_in_;
+
+  // used for sampling random restarts; not shared so the random number generators are not shared either
+  robot_state::RobotState state_;
+
+  std::vector<double> values_;
+  std::vector<double> near_;
+  std::vector<double> consistency_limits_;
+};
+
+struct BatchQuery
+{
+  BatchQuery(const std::vector<geometry_msgs::Pose> &ik_poses,
+             const std::vector<std::vector<double> > &ik_seed_states,
+             double timeout,
+             std::vector<std::vector<double> > &solutions,
+             const kinematics::KinematicsBase::IKCallbackFn &solution_callback,
+             std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+             const kinematics::KinematicsQueryOptions &options)
+    : ik_poses_(ik_poses)
+    , ik_seed_states_(ik_seed_states)
+    , timeout_(timeout)
+    , solutions_(solutions)
+    , solution_callback_(solution_callback)
+    , error_codes_(error_codes)
+    , options_(options)
+    , next_(0)
+  {
+  }
+
+  const std::vector<geometry_msgs::Pose> &ik_poses_;
+  const std::vector<std::vector<double> > &ik_seed_states_;
+  double timeout_;
+  std::vector<std::vector<double> > &solutions_;
+  const kinematics::KinematicsBase::IKCallbackFn &solution_callback_;
+  std::vector<moveit_msgs::MoveItErrorCodes> &error_codes_;
+  const kinematics::KinematicsQueryOptions &options_;
+
+  boost::mutex lock_;
+  std::size_t next_; // index of the next query to solve
+};
+
+KDLKinematicsPlugin::KDLKinematicsPlugin()
+  : active_(false)
+  , batch_threads_(1)
+{
+}
+
+void KDLKinematicsPlugin::resetSolverWorkspaces()
+{
+  solver_workspaces_.clear();
+}
+
+SolverWorkspace* KDLKinematicsPlugin::getSolverWorkspace() const
+{
+  SolverWorkspace *ws = solver_workspaces_.get();
+  if (ws)
+    return ws;
+
+  ws = new SolverWorkspace(kdl_chain_, dimension_, joint_min_, joint_max_,
+                           joint_model_group_->getMimicJointModels().size(),
+                           redundant_joint_indices_.size(), position_ik_,
+                           max_solver_iterations_, epsilon_, *state_);
+  ws->ik_solver_vel_.setMimicJoints(mimic_joints_);
+  ws->ik_solver_pos_.setMimicJoints(mimic_joints_);
+  if ((redundant_joint_indices_.size() > 0) && !ws->ik_solver_vel_.setRedundantJointsMapIndex(redundant_joints_map_index_))
+  {
+    ROS_ERROR_NAMED("kdl","Could not set redundant joints");
+    delete ws;
+    return NULL;
+  }
+  return solver_workspaces_.set(ws);
+}
 
-void KDLKinematicsPlugin::getRandomConfiguration(KDL::JntArray &jnt_array, bool lock_redundancy) const
+void KDLKinematicsPlugin::getRandomConfiguration(SolverWorkspace &ws, KDL::JntArray &jnt_array, bool lock_redundancy) const
 {
-  std::vector<double> jnt_array_vector(dimension_, 0.0);
-  state_->setToRandomPositions(joint_model_group_);
-  state_->copyJointGroupPositions(joint_model_group_, &jnt_array_vector[0]);
+  ws.state_.setToRandomPositions(joint_model_group_);
+  ws.state_.copyJointGroupPositions(joint_model_group_, &ws.values_[0]);
   for (std::size_t i = 0; i < dimension_; ++i)
   {
     if (lock_redundancy)
       if (isRedundantJoint(i))
         continue;
-    jnt_array(i) = jnt_array_vector[i];
+    jnt_array(i) = ws.values_[i];
   }
 }
 
@@ -77,18 +179,20 @@ bool KDLKinematicsPlugin::isRedundantJoint(unsigned int index) const
   return false;
 }
 
-void KDLKinematicsPlugin::getRandomConfiguration(const KDL::JntArray &seed_state,
+void KDLKinematicsPlugin::getRandomConfiguration(SolverWorkspace &ws,
+                                                 const KDL::JntArray &seed_state,
                                                  const std::vector<double> &consistency_limits,
                                                  KDL::JntArray &jnt_array,
                                                  bool lock_redundancy) const
 {
-  std::vector<double> values(dimension_, 0.0);
-  std::vector<double> near(dimension_, 0.0);
+  std::vector<double> &values = ws.values_;
+  std::vector<double> &near = ws.near_;
   for (std::size_t i = 0 ; i < dimension_; ++i)
     near[i] = seed_state(i);
 
   // Need to resize the consistency limits to remove mimic joints
-  std::vector<double> consistency_limits_mimic;
+  std::vector<double> &consistency_limits_mimic = ws.consistency_limits_;
+  consistency_limits_mimic.clear();
   for(std::size_t i = 0; i < dimension_; ++i)
   {
     if(!mimic_joints_[i].active)
@@ -96,7 +200,7 @@ void KDLKinematicsPlugin::getRandomConfiguration(const KDL::JntArray &seed_state
     consistency_limits_mimic.push_back(consistency_limits[i]);
   }
 
-  joint_model_group_->getVariableRandomPositionsNearBy(state_->getRandomNumberGenerator(), values, near, consistency_limits_mimic);
+  joint_model_group_->getVariableRandomPositionsNearBy(ws.state_.getRandomNumberGenerator(), values, near, consistency_limits_mimic);
 
   for (std::size_t i = 0; i < dimension_; ++i)
   {
@@ -208,9 +312,11 @@ bool KDLKinematicsPlugin::initialize(const std::string &robot_description,
   int max_solver_iterations;
   double epsilon;
   bool position_ik;
+  int batch_threads;
 
   private_handle.param("max_solver_iterations", max_solver_iterations, 500);
   private_handle.param("epsilon", epsilon, 1e-5);
+  private_handle.param("batch_threads", batch_threads, 1);
   private_handle.param(group_name+"/position_only_ik", position_ik, false);
   ROS_DEBUG_NAMED("kdl","Looking in private handle: %s for param name: %s",
             private_handle.getNamespace().c_str(),
@@ -280,7 +386,10 @@ bool KDLKinematicsPlugin::initialize(const std::string &robot_description,
   joint_model_group_ = joint_model_group;
   max_solver_iterations_ = max_solver_iterations;
   epsilon_ = epsilon;
+  // 0 uses one thread per core
+  batch_threads_ = batch_threads > 0 ? batch_threads : std::max(1u, boost::thread::hardware_concurrency());
 
+  resetSolverWorkspaces();
   active_ = true;
   ROS_DEBUG_NAMED("kdl","KDL solver initialized");
   return true;
@@ -341,6 +450,7 @@ bool KDLKinematicsPlugin::setRedundantJoints(const std::vector<unsigned int> &re
 
   redundant_joints_map_index_ = redundant_joints_map_index;
   redundant_joint_indices_ = redundant_joints;
+  resetSolverWorkspaces();
   return true;
 }
 
@@ -475,7 +585,6 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
                                            const std::vector<double> &consistency_limits,
                                            const kinematics::KinematicsQueryOptions &options) const
 {
-  ros::WallTime n1 = ros::WallTime::now();
   if(!active_)
   {
     ROS_ERROR_NAMED("kdl","kinematics not active");
@@ -483,6 +592,26 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
     return false;
   }
 
+  SolverWorkspace *ws = getSolverWorkspace();
+  if (!ws)
+  {
+    error_code.val = error_code.NO_IK_SOLUTION;
+    return false;
+  }
+  return searchPositionIK(*ws, ik_pose, ik_seed_state, timeout, solution, solution_callback, error_code, consistency_limits, options);
+}
+
+bool KDLKinematicsPlugin::searchPositionIK(SolverWorkspace &ws,
+                                           const geometry_msgs::Pose &ik_pose,
+                                           const std::vector<double> &ik_seed_state,
+                                           double timeout,
+                                           std::vector<double> &solution,
+                                           const IKCallbackFn &solution_callback,
+                                           moveit_msgs::MoveItErrorCodes &error_code,
+                                           const std::vector<double> &consistency_limits,
+                                           const kinematics::KinematicsQueryOptions &options) const
+{
+  ros::WallTime n1 = ros::WallTime::now();
   if(ik_seed_state.size() != dimension_)
   {
     ROS_ERROR_STREAM_NAMED("kdl","Seed state must have size " << dimension_ << " instead of size " << ik_seed_state.size());
@@ -497,26 +626,19 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
     return false;
   }
 
-  KDL::JntArray jnt_seed_state(dimension_);
-  KDL::JntArray jnt_pos_in(dimension_);
-  KDL::JntArray jnt_pos_out(dimension_);
-
-  KDL::ChainFkSolverPos_recursive fk_solver(kdl_chain_);
-  KDL::ChainIkSolverVel_pinv_mimic ik_solver_vel(kdl_chain_, joint_model_group_->getMimicJointModels().size(), redundant_joint_indices_.size(), position_ik_);
-  KDL::ChainIkSolverPos_NR_JL_Mimic ik_solver_pos(kdl_chain_, joint_min_, joint_max_, fk_solver, ik_solver_vel, max_solver_iterations_, epsilon_, position_ik_);
-  ik_solver_vel.setMimicJoints(mimic_joints_);
-  ik_solver_pos.setMimicJoints(mimic_joints_);
-
-  if ((redundant_joint_indices_.size() > 0) && !ik_solver_vel.setRedundantJointsMapIndex(redundant_joints_map_index_))
-  {
-    ROS_ERROR_NAMED("kdl","Could not set redundant joints");
-    return false;
-  }
+  KDL::JntArray &jnt_seed_state = ws.seed_;
+  KDL::JntArray &jnt_pos_in = ws.pos_in_;
+  KDL::JntArray &jnt_pos_out = ws.pos_out_;
+  KDL::ChainIkSolverVel_pinv_mimic &ik_solver_vel = ws.ik_solver_vel_;
+  KDL::ChainIkSolverPos_NR_JL_Mimic &ik_solver_pos = ws.ik_solver_pos_;
 
+  // the solver is reused, so the locking requested by a previous query must not carry over
   if(options.lock_redundant_joints)
   {
     ik_solver_vel.lockRedundantJoints();
   }
+  else
+    ik_solver_vel.unlockRedundantJoints();
 
   solution.resize(dimension_);
 
@@ -552,7 +674,7 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
     ROS_DEBUG_NAMED("kdl","IK valid: %d", ik_valid);
     if(!consistency_limits.empty())
     {
-      getRandomConfiguration(jnt_seed_state, consistency_limits, jnt_pos_in, options.lock_redundant_joints);
+      getRandomConfiguration(ws, jnt_seed_state, consistency_limits, jnt_pos_in, options.lock_redundant_joints);
       if( (ik_valid < 0 && !options.return_approximate_solution) || !checkConsistency(jnt_seed_state, consistency_limits, jnt_pos_out))
       {
         ROS_DEBUG_NAMED("kdl","Could not find IK solution: does not match consistency limits");
@@ -561,7 +683,7 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
     }
     else
     {
-      getRandomConfiguration(jnt_pos_in, options.lock_redundant_joints);
+      getRandomConfiguration(ws, jnt_pos_in, options.lock_redundant_joints);
       ROS_DEBUG_NAMED("kdl","New random configuration");
       for(unsigned int j=0; j < dimension_; j++)
         ROS_DEBUG_NAMED("kdl","%d %f", j, jnt_pos_in(j));
@@ -593,6 +715,72 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
   return false;
 }
 
+bool KDLKinematicsPlugin::searchPositionIKBatch(const std::vector<geometry_msgs::Pose> &ik_poses,
+                                                const std::vector<std::vector<double> > &ik_seed_states,
+                                                double timeout,
+                                                std::vector<std::vector<double> > &solutions,
+                                                const IKCallbackFn &solution_callback,
+                                                std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+                                                const kinematics::KinematicsQueryOptions &options) const
+{
+  solutions.clear();
+  solutions.resize(ik_poses.size());
+  error_codes.resize(ik_poses.size());
+  if(!active_ || (ik_seed_states.size() != 1 && ik_seed_states.size() != ik_poses.size()))
+  {
+    if(!active_)
+      ROS_ERROR_NAMED("kdl","kinematics not active");
+    else
+      ROS_ERROR_NAMED("kdl","Expected 1 or %u seed states but got %u", (unsigned int)ik_poses.size(), (unsigned int)ik_seed_states.size());
+    for(std::size_t i = 0; i < error_codes.size(); ++i)
+      error_codes[i].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  BatchQuery query(ik_poses, ik_seed_states, timeout, solutions, solution_callback, error_codes, options);
+  std::size_t thread_count = std::min<std::size_t>(batch_threads_, ik_poses.size());
+  boost::thread_group workers;
+  for(std::size_t i = 1; i < thread_count; ++i)
+    workers.create_thread(boost::bind(&KDLKinematicsPlugin::solveBatchQueries, this, boost::ref(query)));
+  solveBatchQueries(query);
+  workers.join_all();
+
+  bool all_solved = true;
+  for(std::size_t i = 0; i < error_codes.size(); ++i)
+    if(error_codes[i].val != moveit_msgs::MoveItErrorCodes::SUCCESS)
+    {
+      solutions[i].clear();
+      all_solved = false;
+    }
+  return all_solved;
+}
+
+void KDLKinematicsPlugin::solveBatchQueries(BatchQuery &query) const
+{
+  // each thread sets up its solvers once and then takes queries until none are left;
+  // queries are taken one at a time because their run times vary widely
+  SolverWorkspace *ws = getSolverWorkspace();
+  const std::vector<double> no_consistency_limits;
+  while(true)
+  {
+    std::size_t i;
+    {
+      boost::mutex::scoped_lock slock(query.lock_);
+      if(query.next_ >= query.ik_poses_.size())
+        return;
+      i = query.next_++;
+    }
+    if(!ws)
+    {
+      query.error_codes_[i].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+      continue;
+    }
+    const std::vector<double> &seed = query.ik_seed_states_.size() == 1 ? query.ik_seed_states_[0] : query.ik_seed_states_[i];
+    searchPositionIK(*ws, query.ik_poses_[i], seed, query.timeout_, query.solutions_[i], query.solution_callback_,
+                     query.error_codes_[i], no_consistency_limits, query.options_);
+  }
+}
+
 bool KDLKinematicsPlugin::getPositionFK(const std::vector<std::string> &link_names,
                                         const std::vector<double> &joint_angles,
                                         std::vector<geometry_msgs::Pose> &poses) const
@@ -614,13 +802,17 @@ bool KDLKinematicsPlugin::getPositionFK(const std::vector<std::string> &link_nam
   geometry_msgs::PoseStamped pose;
   tf::Stamped<tf::Pose> tf_pose;
 
-  KDL::JntArray jnt_pos_in(dimension_);
+  SolverWorkspace *ws = getSolverWorkspace();
+  if (!ws)
+    return false;
+
+  KDL::JntArray &jnt_pos_in = ws->fk_pos_in_;
   for(unsigned int i=0; i < dimension_; i++)
   {
     jnt_pos_in(i) = joint_angles[i];
   }
 
-  KDL::ChainFkSolverPos_recursive fk_solver(kdl_chain_);
+  KDL::ChainFkSolverPos_recursive &fk_solver = ws->fk_solver_;
 
   bool valid = true;
   for(unsigned int i=0; i < poses.size(); i++)
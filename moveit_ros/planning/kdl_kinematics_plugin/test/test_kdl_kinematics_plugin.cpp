@@ -0,0 +1,261 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/kdl_kinematics_plugin/kdl_kinematics_plugin.h>
+#include <moveit/rdf_loader/rdf_loader.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+
+namespace
+{
+const double TIMEOUT = 0.5;
+const double POSE_TOLERANCE = 1e-4;
+
+void expectPoseNear(const geometry_msgs::Pose &expected, const geometry_msgs::Pose &actual)
+{
+  EXPECT_NEAR(expected.position.x, actual.position.x, POSE_TOLERANCE);
+  EXPECT_NEAR(expected.position.y, actual.position.y, POSE_TOLERANCE);
+  EXPECT_NEAR(expected.position.z, actual.position.z, POSE_TOLERANCE);
+  // q and -q are the same rotation
+  double dot = expected.orientation.x * actual.orientation.x + expected.orientation.y * actual.orientation.y +
+    expected.orientation.z * actual.orientation.z + expected.orientation.w * actual.orientation.w;
+  EXPECT_NEAR(1.0, fabs(dot), POSE_TOLERANCE);
+}
+
+void rejectSolution(const geometry_msgs::Pose &ik_pose, const std::vector<double> &solution, moveit_msgs::MoveItErrorCodes &error_code)
+{
+  error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+}
+}
+
+class KDLKinematicsPluginTest : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    rdf_loader::RDFLoader rdf_loader("robot_description");
+    ASSERT_TRUE(rdf_loader.getURDF());
+    ASSERT_TRUE(rdf_loader.getSRDF());
+    robot_model_.reset(new robot_model::RobotModel(rdf_loader.getURDF(), rdf_loader.getSRDF()));
+  }
+
+  // construct a solver for an arm of the PR2 that solves batches on the given number of threads
+  boost::shared_ptr<kdl_kinematics_plugin::KDLKinematicsPlugin> createSolver(const std::string &arm, int batch_threads)
+  {
+    ros::param::set("~batch_threads", batch_threads);
+    boost::shared_ptr<kdl_kinematics_plugin::KDLKinematicsPlugin> solver(new kdl_kinematics_plugin::KDLKinematicsPlugin());
+    const std::string tip = arm == "right_arm" ? "r_wrist_roll_link" : "l_wrist_roll_link";
+    if (!solver->initialize("robot_description", arm, "torso_lift_link", tip, 0.1))
+    {
+      ADD_FAILURE() << "Unable to initialize the KDL solver for " << arm;
+      solver.reset();
+    }
+    return solver;
+  }
+
+  /* Sample reachable poses of the tip of \e solver. The seeds are the states that reach them, slightly moved, so
+     the first Newton-Raphson iterations converge and the solutions are repeatable */
+  void samplePoses(const kdl_kinematics_plugin::KDLKinematicsPlugin &solver, std::size_t count,
+                   std::vector<geometry_msgs::Pose> &poses, std::vector<std::vector<double> > &seeds)
+  {
+    const robot_model::JointModelGroup *jmg = robot_model_->getJointModelGroup(solver.getGroupName());
+    robot_state::RobotState state(robot_model_);
+    state.setToDefaultValues();
+    std::vector<std::string> tip(1, solver.getTipFrame());
+    poses.clear();
+    seeds.clear();
+    while (poses.size() < count)
+    {
+      state.setToRandomPositions(jmg);
+      std::vector<double> values;
+      state.copyJointGroupPositions(jmg, values);
+      std::vector<geometry_msgs::Pose> fk;
+      ASSERT_TRUE(solver.getPositionFK(tip, values, fk));
+      poses.push_back(fk[0]);
+      for (std::size_t j = 0 ; j < values.size() ; ++j)
+        values[j] += j % 2 ? 0.02 : -0.02;
+      seeds.push_back(values);
+    }
+  }
+
+  void checkSolution(const kdl_kinematics_plugin::KDLKinematicsPlugin &solver, const geometry_msgs::Pose &pose,
+                     const std::vector<double> &solution)
+  {
+    std::vector<std::string> tip(1, solver.getTipFrame());
+    std::vector<geometry_msgs::Pose> fk;
+    ASSERT_TRUE(solver.getPositionFK(tip, solution, fk));
+    expectPoseNear(pose, fk[0]);
+  }
+
+  // solve the queries one at a time, as a thread that reuses its workspace would
+  void solveSequentially(const kdl_kinematics_plugin::KDLKinematicsPlugin *solver, const std::vector<geometry_msgs::Pose> *poses,
+                         const std::vector<std::vector<double> > *seeds, std::vector<std::vector<double> > *solutions)
+  {
+    solutions->resize(poses->size());
+    for (std::size_t i = 0 ; i < poses->size() ; ++i)
+    {
+      moveit_msgs::MoveItErrorCodes error_code;
+      solver->searchPositionIK((*poses)[i], (*seeds)[i], TIMEOUT, (*solutions)[i], error_code);
+    }
+  }
+
+  robot_model::RobotModelPtr robot_model_;
+};
+
+TEST_F(KDLKinematicsPluginTest, WorkspaceReuse)
+{
+  boost::shared_ptr<kdl_kinematics_plugin::KDLKinematicsPlugin> right = createSolver("right_arm", 1);
+  boost::shared_ptr<kdl_kinematics_plugin::KDLKinematicsPlugin> left = createSolver("left_arm", 1);
+  ASSERT_TRUE(right && left);
+
+  std::vector<geometry_msgs::Pose> right_poses, left_poses;
+  std::vector<std::vector<double> > right_seeds, left_seeds;
+  samplePoses(*right, 20, right_poses, right_seeds);
+  samplePoses(*left, 20, left_poses, left_seeds);
+
+  // queries of two solvers interleaved on one thread each use the workspace of their own solver
+  std::vector<std::vector<double> > right_solutions, left_solutions;
+  for (std::size_t i = 0 ; i < right_poses.size() ; ++i)
+  {
+    std::vector<double> solution;
+    moveit_msgs::MoveItErrorCodes error_code;
+    ASSERT_TRUE(right->searchPositionIK(right_poses[i], right_seeds[i], TIMEOUT, solution, error_code));
+    checkSolution(*right, right_poses[i], solution);
+    right_solutions.push_back(solution);
+    ASSERT_TRUE(left->searchPositionIK(left_poses[i], left_seeds[i], TIMEOUT, solution, error_code));
+    checkSolution(*left, left_poses[i], solution);
+    left_solutions.push_back(solution);
+  }
+
+  // locking the redundant joints in one query does not carry over to the next one
+  kinematics::KinematicsQueryOptions locked;
+  locked.lock_redundant_joints = true;
+  std::vector<double> solution;
+  moveit_msgs::MoveItErrorCodes error_code;
+  right->searchPositionIK(right_poses[0], right_seeds[0], TIMEOUT, solution, error_code, locked);
+  ASSERT_TRUE(right->searchPositionIK(right_poses[1], right_seeds[1], TIMEOUT, solution, error_code));
+  EXPECT_EQ(right_solutions[1], solution);
+
+  // threads solving the same queries with workspaces of their own find the same solutions
+  std::vector<std::vector<std::vector<double> > > thread_solutions(4);
+  boost::thread_group threads;
+  for (std::size_t t = 0 ; t < thread_solutions.size() ; ++t)
+    threads.create_thread(boost::bind(&KDLKinematicsPluginTest::solveSequentially, this, right.get(), &right_poses, &right_seeds, &thread_solutions[t]));
+  threads.join_all();
+  for (std::size_t t = 0 ; t < thread_solutions.size() ; ++t)
+    EXPECT_EQ(right_solutions, thread_solutions[t]);
+}
+
+TEST_F(KDLKinematicsPluginTest, BatchMatchesSinglePoses)
+{
+  boost::shared_ptr<kdl_kinematics_plugin::KDLKinematicsPlugin> serial = createSolver("right_arm", 1);
+  boost::shared_ptr<kdl_kinematics_plugin::KDLKinematicsPlugin> parallel = createSolver("right_arm", 4);
+  ASSERT_TRUE(serial && parallel);
+
+  std::vector<geometry_msgs::Pose> poses;
+  std::vector<std::vector<double> > seeds;
+  samplePoses(*serial, 50, poses, seeds);
+
+  std::vector<std::vector<double> > expected;
+  solveSequentially(serial.get(), &poses, &seeds, &expected);
+
+  const kinematics::KinematicsBase::IKCallbackFn no_callback;
+  std::vector<std::vector<double> > solutions;
+  std::vector<moveit_msgs::MoveItErrorCodes> error_codes;
+  for (int k = 0 ; k < 2 ; ++k)
+  {
+    const kdl_kinematics_plugin::KDLKinematicsPlugin &solver = k == 0 ? *serial : *parallel;
+    EXPECT_TRUE(solver.searchPositionIKBatch(poses, seeds, TIMEOUT, solutions, no_callback, error_codes));
+    ASSERT_EQ(poses.size(), solutions.size());
+    ASSERT_EQ(poses.size(), error_codes.size());
+    for (std::size_t i = 0 ; i < poses.size() ; ++i)
+    {
+      EXPECT_EQ(moveit_msgs::MoveItErrorCodes::SUCCESS, error_codes[i].val);
+      EXPECT_EQ(expected[i], solutions[i]);
+      checkSolution(solver, poses[i], solutions[i]);
+    }
+
+    // the default implementation gives the same results
+    EXPECT_TRUE(solver.kinematics::KinematicsBase::searchPositionIKBatch(poses, seeds, TIMEOUT, solutions, no_callback, error_codes));
+    for (std::size_t i = 0 ; i < poses.size() ; ++i)
+      EXPECT_EQ(expected[i], solutions[i]);
+  }
+
+  // a single seed is shared by all queries
+  std::vector<geometry_msgs::Pose> near_poses(3, poses[0]);
+  std::vector<std::vector<double> > one_seed(1, seeds[0]);
+  EXPECT_TRUE(parallel->searchPositionIKBatch(near_poses, one_seed, TIMEOUT, solutions, no_callback, error_codes));
+  for (std::size_t i = 0 ; i < near_poses.size() ; ++i)
+    EXPECT_EQ(expected[0], solutions[i]);
+}
+
+TEST_F(KDLKinematicsPluginTest, BatchFailures)
+{
+  boost::shared_ptr<kdl_kinematics_plugin::KDLKinematicsPlugin> parallel = createSolver("right_arm", 4);
+  ASSERT_TRUE(parallel);
+
+  std::vector<geometry_msgs::Pose> poses;
+  std::vector<std::vector<double> > seeds;
+  samplePoses(*parallel, 4, poses, seeds);
+
+  // the number of seeds must match the number of poses, or be one
+  std::vector<std::vector<double> > solutions;
+  std::vector<moveit_msgs::MoveItErrorCodes> error_codes;
+  std::vector<std::vector<double> > two_seeds(seeds.begin(), seeds.begin() + 2);
+  EXPECT_FALSE(parallel->searchPositionIKBatch(poses, two_seeds, TIMEOUT, solutions, kinematics::KinematicsBase::IKCallbackFn(), error_codes));
+  ASSERT_EQ(poses.size(), error_codes.size());
+  for (std::size_t i = 0 ; i < poses.size() ; ++i)
+  {
+    EXPECT_EQ(moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION, error_codes[i].val);
+    EXPECT_TRUE(solutions[i].empty());
+  }
+
+  // solutions rejected by the callback are not returned
+  EXPECT_FALSE(parallel->searchPositionIKBatch(poses, seeds, 0.05, solutions, &rejectSolution, error_codes));
+  for (std::size_t i = 0 ; i < poses.size() ; ++i)
+  {
+    EXPECT_NE(moveit_msgs::MoveItErrorCodes::SUCCESS, error_codes[i].val);
+    EXPECT_TRUE(solutions[i].empty());
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "test_kdl_kinematics_plugin");
+  return RUN_ALL_TESTS();
+}
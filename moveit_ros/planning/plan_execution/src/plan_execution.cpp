@@ -274,33 +274,21 @@ bool plan_execution::PlanExecution::isRemainingPathValid(const ExecutableMotionP
   {
     planning_scene_monitor::LockedPlanningSceneRO lscene(plan.planning_scene_monitor_); // lock the scene so that it does not modify the world representation while isStateValid() is called
     const robot_trajectory::RobotTrajectory &t = *plan.plan_components_[path_segment.first].trajectory_;
-    const collision_detection::AllowedCollisionMatrix *acm = plan.plan_components_[path_segment.first].allowed_collision_matrix_.get();
-    std::size_t wpc = t.getWayPointCount();
-    collision_detection::CollisionRequest req;
+    planning_scene::PathValidityRequest req;
     req.group_name = t.getGroupName();
-    for (std::size_t i = std::max(path_segment.second - 1, 0) ; i < wpc ; ++i)
+    req.acm = plan.plan_components_[path_segment.first].allowed_collision_matrix_.get();
+    req.unpadded = true;
+    // the waypoints about to be executed are checked first and checking stops at the first invalid one
+    req.first_index = std::max(path_segment.second - 1, 0);
+    // check the first invalid waypoint again, in verbose mode, to show what issues have been detected
+    req.verbose = true;
+    std::size_t invalid_index;
+    if (!plan.planning_scene_->isPathValid(t, req, &invalid_index))
     {
-      collision_detection::CollisionResult res;
-      if (acm)
-        plan.planning_scene_->checkCollisionUnpadded(req, res, t.getWayPoint(i), *acm);
-      else
-        plan.planning_scene_->checkCollisionUnpadded(req, res, t.getWayPoint(i));
-
-      if (res.collision || !plan.planning_scene_->isStateFeasible(t.getWayPoint(i), false))
-      {
-        // Dave's debacle
-        ROS_INFO("Trajectory component '%s' is invalid", plan.plan_components_[path_segment.first].description_.c_str());
-
-        // call the same functions again, in verbose mode, to show what issues have been detected
-        plan.planning_scene_->isStateFeasible(t.getWayPoint(i), true);
-        req.verbose = true;
-        res.clear();
-        if (acm)
-          plan.planning_scene_->checkCollisionUnpadded(req, res, t.getWayPoint(i), *acm);
-        else
-          plan.planning_scene_->checkCollisionUnpadded(req, res, t.getWayPoint(i));
-        return false;
-      }
+      // Dave's debacle
+      ROS_INFO("Trajectory component '%s' is invalid at waypoint %u", plan.plan_components_[path_segment.first].description_.c_str(),
+               (unsigned int)invalid_index);
+      return false;
     }
   }
   return true;
@@ -0,0 +1,105 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <moveit/constraint_samplers/reachability_map.h>
+#include <ros/ros.h>
+#include <boost/lexical_cast.hpp>
+
+static const std::string ROBOT_DESCRIPTION = "robot_description";
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "compute_reachability_map");
+
+  ros::AsyncSpinner spinner(1);
+  spinner.start();
+
+  if (argc <= 2)
+    ROS_ERROR("Usage: compute_reachability_map <group> <output file> [samples] [resolution]");
+  else
+  {
+    robot_model_loader::RobotModelLoader rml(ROBOT_DESCRIPTION);
+    std::string group = argv[1];
+    std::string filename = argv[2];
+
+    constraint_samplers::ReachabilityMap::Options options;
+    try
+    {
+      if (argc > 3)
+        options.samples = boost::lexical_cast<unsigned int>(argv[3]);
+      if (argc > 4)
+        options.resolution = boost::lexical_cast<double>(argv[4]);
+    }
+    catch(boost::bad_lexical_cast &)
+    {
+      ROS_ERROR("Invalid number of samples or resolution");
+      ros::shutdown();
+      return 1;
+    }
+
+    const robot_model::JointModelGroup *jmg = rml.getModel()->getJointModelGroup(group);
+    if (jmg)
+    {
+      const kinematics::KinematicsBaseConstPtr &solver = jmg->getSolverInstance();
+      if (solver)
+      {
+        // record poses in the frame the IK constraint sampler sends requests in
+        std::string base = solver->getBaseFrame();
+        if (!base.empty() && base[0] == '/')
+          base.erase(base.begin());
+        if (!rml.getModel()->hasLinkModel(base))
+          base = rml.getModel()->getModelFrame();
+
+        robot_state::RobotState state(rml.getModel());
+        state.setToDefaultValues();
+
+        ROS_INFO("Computing reachability map for group '%s' (tip '%s', frame '%s') from %u samples at resolution %lf",
+                 group.c_str(), solver->getTipFrame().c_str(), base.c_str(), options.samples, options.resolution);
+        constraint_samplers::ReachabilityMap map;
+        ros::WallTime start = ros::WallTime::now();
+        if (map.compute(state, jmg, solver->getTipFrame(), base, options) && map.save(filename))
+          ROS_INFO("Saved %u reachable cells to '%s' in %lf seconds", (unsigned int)map.getCellCount(), filename.c_str(),
+                   (ros::WallTime::now() - start).toSec());
+      }
+      else
+        ROS_ERROR_STREAM("No kinematics solver specified for group " << group);
+    }
+    else
+      ROS_ERROR_STREAM("Group " << group << " is not known");
+  }
+
+  ros::shutdown();
+  return 0;
+}
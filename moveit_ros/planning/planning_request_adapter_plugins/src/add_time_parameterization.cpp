@@ -36,8 +36,9 @@
 
 #include <moveit/planning_request_adapter/planning_request_adapter.h>
 #include <moveit/trajectory_processing/iterative_time_parameterization.h>
+#include <moveit/trajectory_processing/time_optimal_time_parameterization.h>
 #include <class_loader/class_loader.h>
-#include <ros/console.h>
+#include <ros/ros.h>
 
 /*
 #include <ReflexxesAPI.h>
@@ -53,8 +54,25 @@ class AddTimeParameterization : public planning_request_adapter::PlanningRequest
 {
 public:
 
-  AddTimeParameterization() : planning_request_adapter::PlanningRequestAdapter()
+  static const std::string ALGORITHM_PARAM_NAME;
+
+  AddTimeParameterization() : planning_request_adapter::PlanningRequestAdapter(), nh_("~"), time_optimal_(false)
   {
+    std::string algorithm;
+    if (!nh_.getParam(ALGORITHM_PARAM_NAME, algorithm))
+    {
+      algorithm = "iterative_parabolic";
+      ROS_INFO_STREAM("Param '" << ALGORITHM_PARAM_NAME << "' was not set. Using default value: " << algorithm);
+    }
+    else
+      ROS_INFO_STREAM("Param '" << ALGORITHM_PARAM_NAME << "' was set to " << algorithm);
+
+    if (algorithm == "time_optimal")
+      time_optimal_ = true;
+    else
+      if (algorithm != "iterative_parabolic")
+        ROS_WARN_STREAM("Unknown time parameterization algorithm '" << algorithm << "'. Using 'iterative_parabolic' instead. "
+                        "Known algorithms are 'iterative_parabolic' and 'time_optimal'.");
   }
   /*
   void reflexxesComputeTime(robot_trajectory::RobotTrajectory &traj) const
@@ -157,7 +175,10 @@ public:
     if (result && res.trajectory_)
     {
       ROS_DEBUG("Running '%s'", getDescription().c_str());
-      if (!time_param_.computeTimeStamps(*res.trajectory_, req.max_velocity_scaling_factor))
+      bool success = time_optimal_ ?
+        time_optimal_param_.computeTimeStamps(*res.trajectory_, req.max_velocity_scaling_factor) :
+        time_param_.computeTimeStamps(*res.trajectory_, req.max_velocity_scaling_factor);
+      if (!success)
         ROS_WARN("Time parametrization for the solution path failed.");
     }
 
@@ -166,9 +187,14 @@ public:
 
 private:
 
+  ros::NodeHandle nh_;
+  bool time_optimal_;
   trajectory_processing::IterativeParabolicTimeParameterization time_param_;
+  trajectory_processing::TimeOptimalTimeParameterization time_optimal_param_;
 };
 
+const std::string AddTimeParameterization::ALGORITHM_PARAM_NAME = "time_parameterization_algorithm";
+
 }
 
 CLASS_LOADER_REGISTER_CLASS(default_planner_request_adapters::AddTimeParameterization,